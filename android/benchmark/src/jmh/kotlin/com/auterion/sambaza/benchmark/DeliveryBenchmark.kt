@@ -0,0 +1,88 @@
+package com.auterion.sambaza.benchmark
+
+import com.auterion.sambaza.PushableProxyImpl
+import com.auterion.sambaza.StreamInfo
+import org.openjdk.jmh.annotations.*
+import java.io.File
+import java.net.SocketTimeoutException
+import java.util.concurrent.TimeUnit
+
+/**
+ * Time from JniApi.pushFrame to the last RTP packet of the frame reaching a local RTSP client,
+ * i.e. the whole per-frame path through the server.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.SampleTime)
+@OutputTimeUnit(TimeUnit.MICROSECONDS)
+@Fork(1)
+@Warmup(iterations = 3)
+@Measurement(iterations = 5)
+open class DeliveryBenchmark {
+    @Param("30", "60")
+    var framesPerSecond: Int = 0
+
+    private lateinit var proxy: PushableProxyImpl
+    private lateinit var client: RtspTestClient
+    private lateinit var frames: List<ByteArray>
+    private lateinit var pacer: Pacer
+    private var next = 0
+
+    @Setup(Level.Trial)
+    fun setUp() {
+        val stream = System.getProperty("sambaza.stream")
+            ?: throw IllegalStateException("Pass an H.265 Annex-B file with -PsambazaStream=<path>")
+        frames = Frames.accessUnits(File(stream))
+
+        proxy = PushableProxyImpl()
+        proxy.addStream(StreamInfo(1, "", "", 0, PATH))
+        proxy.start()
+
+        client = RtspTestClient("127.0.0.1", proxy.getPort(), PATH)
+        client.play()
+        awaitFirstFrame()
+        pacer = Pacer(framesPerSecond)
+    }
+
+    @TearDown(Level.Trial)
+    fun tearDown() {
+        client.close()
+        proxy.stop()
+    }
+
+    @Setup(Level.Invocation)
+    fun pace() {
+        pacer.await()
+    }
+
+    @Benchmark
+    fun pushAndReceive() {
+        pushNext()
+        client.awaitFrame()
+    }
+
+    private fun pushNext() {
+        proxy.pushFrame(Frames.frame(frames[next]))
+        next = (next + 1) % frames.size
+    }
+
+    /**
+     * The parser holds frames back until it saw the parameter sets, so push until the first frame
+     * comes out, then every push yields one frame.
+     */
+    private fun awaitFirstFrame() {
+        repeat(frames.size) {
+            pushNext()
+            try {
+                client.awaitFrame()
+                return
+            } catch (e: SocketTimeoutException) {
+                // Not out yet, push another one
+            }
+        }
+        throw IllegalStateException("No frame reached the client, is the file H.265 Annex-B?")
+    }
+
+    private companion object {
+        const val PATH = "/bench"
+    }
+}
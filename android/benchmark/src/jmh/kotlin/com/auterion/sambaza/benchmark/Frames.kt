@@ -0,0 +1,109 @@
+package com.auterion.sambaza.benchmark
+
+import com.auterion.sambaza.H264Frame
+import java.io.File
+import kotlin.random.Random
+
+const val H265_CAPS = "video/x-h265,stream-format=byte-stream,alignment=au"
+
+object Frames {
+    /**
+     * An Annex-B TRAIL_R slice of [size] bytes with random content: enough for the push path,
+     * which never decodes, but not for a client.
+     */
+    fun synthetic(size: Int): ByteArray {
+        val frame = Random(size).nextBytes(size)
+        frame[0] = 0
+        frame[1] = 0
+        frame[2] = 0
+        frame[3] = 1
+        frame[4] = 0x02
+        frame[5] = 0x01
+        return frame
+    }
+
+    fun frame(buffer: ByteArray): H264Frame {
+        val frame = H264Frame(ULong.MAX_VALUE, H265_CAPS)
+        frame.setBuffer(buffer)
+        return frame
+    }
+
+    /**
+     * Splits an H.265 Annex-B file into access units, the way an encoder would hand them out.
+     */
+    fun accessUnits(file: File): List<ByteArray> {
+        val data = file.readBytes()
+        val units = mutableListOf<ByteArray>()
+        var unitStart = -1
+        var hasVcl = false
+
+        var offset = nextStartCode(data, 0)
+        while (offset >= 0) {
+            val header = offset + startCodeLength(data, offset)
+            if (header + 2 >= data.size) {
+                break
+            }
+
+            val type = (data[header].toInt() shr 1) and 0x3f
+            val isVcl = type < 32
+            val startsPicture = isVcl && (data[header + 2].toInt() and 0x80) != 0
+            val startsUnit = hasVcl && (startsPicture || type in 32..35 || type == 39 ||
+                    type in 41..44 || type in 48..55)
+
+            if (unitStart < 0) {
+                unitStart = offset
+            } else if (startsUnit) {
+                units.add(data.copyOfRange(unitStart, offset))
+                unitStart = offset
+                hasVcl = false
+            }
+            hasVcl = hasVcl || isVcl
+
+            offset = nextStartCode(data, header)
+        }
+
+        if (unitStart >= 0) {
+            units.add(data.copyOfRange(unitStart, data.size))
+        }
+        return units
+    }
+
+    private fun nextStartCode(data: ByteArray, from: Int): Int {
+        var i = from
+        while (i + 2 < data.size) {
+            if (data[i].toInt() == 0 && data[i + 1].toInt() == 0 && data[i + 2].toInt() == 1) {
+                return if (i > from && data[i - 1].toInt() == 0) i - 1 else i
+            }
+            i++
+        }
+        return -1
+    }
+
+    private fun startCodeLength(data: ByteArray, offset: Int): Int {
+        return if (data[offset + 2].toInt() == 1) 3 else 4
+    }
+}
+
+/**
+ * Spaces out invocations to a given rate, 0 for back to back. Meant to be called from a
+ * Level.Invocation setup, so that the waiting is not measured.
+ */
+class Pacer(framesPerSecond: Int) {
+    private val intervalNanos = if (framesPerSecond > 0) 1_000_000_000L / framesPerSecond else 0L
+    private var deadline = System.nanoTime()
+
+    fun await() {
+        if (intervalNanos == 0L) {
+            return
+        }
+
+        deadline += intervalNanos
+        val now = System.nanoTime()
+        if (deadline < now) {
+            // Fell behind, do not burst to catch up
+            deadline = now
+            return
+        }
+        Thread.sleep((deadline - now) / 1_000_000, ((deadline - now) % 1_000_000).toInt())
+    }
+}
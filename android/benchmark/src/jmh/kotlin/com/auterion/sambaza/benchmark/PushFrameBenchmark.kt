@@ -0,0 +1,69 @@
+package com.auterion.sambaza.benchmark
+
+import com.auterion.sambaza.H264Frame
+import com.auterion.sambaza.PushableProxyImpl
+import com.auterion.sambaza.RtspProxyImpl
+import com.auterion.sambaza.StreamInfo
+import org.openjdk.jmh.annotations.*
+import java.util.concurrent.TimeUnit
+
+/**
+ * Cost of handing a frame from Kotlin to the native ingest, without any client: the JNI
+ * transition, the array access and copy, and the proxy fan-out.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.MICROSECONDS)
+@Fork(1)
+@Warmup(iterations = 3)
+@Measurement(iterations = 5)
+open class PushFrameBenchmark {
+    @Param("4096", "65536", "262144", "1048576")
+    var frameSize: Int = 0
+
+    // 0 pushes back to back
+    @Param("0", "30", "120")
+    var framesPerSecond: Int = 0
+
+    private lateinit var proxy: PushableProxyImpl
+    private lateinit var payload: ByteArray
+    private lateinit var reusedFrame: H264Frame
+    private lateinit var pacer: Pacer
+
+    @Setup(Level.Trial)
+    fun setUp() {
+        proxy = PushableProxyImpl()
+        // Keep the ingest running without clients, so that pushes go all the way through
+        proxy.setDefaultLinger(RtspProxyImpl.LINGER_ALWAYS_ON)
+        proxy.addStream(StreamInfo(1, "", "", 0, "/bench"))
+        proxy.start()
+
+        payload = Frames.synthetic(frameSize)
+        reusedFrame = Frames.frame(payload)
+        pacer = Pacer(framesPerSecond)
+    }
+
+    @TearDown(Level.Trial)
+    fun tearDown() {
+        proxy.stop()
+    }
+
+    @Setup(Level.Invocation)
+    fun pace() {
+        pacer.await()
+    }
+
+    @Benchmark
+    fun pushReusedFrame() {
+        proxy.pushFrame(reusedFrame)
+    }
+
+    /**
+     * Allocates the frame and its array for every push, like an encoder callback does. Run with
+     * the gc profiler to see the allocation rate this puts on the collector.
+     */
+    @Benchmark
+    fun pushFreshFrame() {
+        proxy.pushFrame(Frames.frame(payload.copyOf()))
+    }
+}
@@ -0,0 +1,120 @@
+package com.auterion.sambaza.benchmark
+
+import java.io.BufferedInputStream
+import java.io.Closeable
+import java.io.DataInputStream
+import java.net.Socket
+
+/**
+ * Just enough of an RTSP client to play one video stream interleaved over TCP and tell when a
+ * whole frame arrived.
+ */
+class RtspTestClient(host: String, port: Int, path: String) : Closeable {
+    private val url = "rtsp://$host:$port$path"
+    private val socket = Socket(host, port)
+    private val input = DataInputStream(BufferedInputStream(socket.getInputStream()))
+    private val output = socket.getOutputStream()
+    private var cseq = 0
+    private var session: String? = null
+
+    private class Response(val headers: Map<String, String>, val body: String)
+
+    init {
+        socket.tcpNoDelay = true
+    }
+
+    fun play(timeoutMillis: Int = 5000) {
+        socket.soTimeout = timeoutMillis
+
+        val describe = request("DESCRIBE", url, "Accept: application/sdp")
+        val base = describe.headers["content-base"] ?: "$url/"
+        val control = describe.body.lines()
+            .firstOrNull { it.startsWith("a=control:") && !it.endsWith("*") }
+            ?.removePrefix("a=control:")?.trim()
+            ?: throw IllegalStateException("No media in SDP:\n${describe.body}")
+        val controlUrl = if (control.startsWith("rtsp://")) control else base + control
+
+        val setup = request("SETUP", controlUrl, "Transport: RTP/AVP/TCP;unicast;interleaved=0-1")
+        session = setup.headers["session"]?.substringBefore(';')
+            ?: throw IllegalStateException("No session in SETUP response")
+
+        request("PLAY", url)
+    }
+
+    /**
+     * Reads RTP packets until the last packet of a frame (marker bit set) arrived.
+     */
+    fun awaitFrame() {
+        while (true) {
+            val channel = readInterleavedChannel()
+            val length = input.readUnsignedShort()
+            val packet = ByteArray(length)
+            input.readFully(packet)
+
+            if (channel == 0 && length > 1 && (packet[1].toInt() and 0x80) != 0) {
+                return
+            }
+        }
+    }
+
+    override fun close() {
+        socket.close()
+    }
+
+    private fun request(method: String, requestUrl: String, vararg headers: String): Response {
+        val message = StringBuilder("$method $requestUrl RTSP/1.0\r\nCSeq: ${++cseq}\r\n")
+        session?.let { message.append("Session: $it\r\n") }
+        headers.forEach { message.append(it).append("\r\n") }
+        message.append("\r\n")
+        output.write(message.toString().toByteArray())
+        output.flush()
+
+        return readResponse()
+    }
+
+    private fun readResponse(): Response {
+        // Packets may already be flowing, skip them
+        var first = input.readUnsignedByte()
+        while (first == '$'.code) {
+            input.readUnsignedByte()
+            input.skipBytes(input.readUnsignedShort())
+            first = input.readUnsignedByte()
+        }
+
+        val status = first.toChar() + readLine()
+        if (!status.contains(" 200 ")) {
+            throw IllegalStateException("RTSP request failed: $status")
+        }
+
+        val headers = mutableMapOf<String, String>()
+        while (true) {
+            val line = readLine()
+            if (line.isEmpty()) {
+                break
+            }
+            headers[line.substringBefore(':').trim().lowercase()] = line.substringAfter(':').trim()
+        }
+
+        val body = ByteArray(headers["content-length"]?.toInt() ?: 0)
+        input.readFully(body)
+        return Response(headers, String(body))
+    }
+
+    private fun readInterleavedChannel(): Int {
+        while (input.readUnsignedByte() != '$'.code) {
+            // Not interleaved data (e.g. a server request), ignore it
+        }
+        return input.readUnsignedByte()
+    }
+
+    private fun readLine(): String {
+        val line = StringBuilder()
+        while (true) {
+            val c = input.readUnsignedByte()
+            if (c == '\n'.code) {
+                return line.toString().trimEnd('\r')
+            }
+            line.append(c.toChar())
+        }
+    }
+}
@@ -0,0 +1,87 @@
+package com.auterion.sambaza.benchmark
+
+import com.auterion.sambaza.PushableProxyImpl
+import com.auterion.sambaza.StreamInfo
+import org.openjdk.jmh.annotations.*
+import java.io.File
+import java.net.SocketTimeoutException
+import java.util.concurrent.TimeUnit
+import kotlin.concurrent.thread
+
+/**
+ * Time from a cold start of the library (loading it included) to the first frame reaching a
+ * local RTSP client, with an encoder pushing frames from the start, i.e. the black screen after
+ * an app restart. Every sample needs a fresh JVM, hence one fork per sample.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.SingleShotTime)
+@OutputTimeUnit(TimeUnit.MILLISECONDS)
+@Fork(10)
+@Warmup(iterations = 0)
+@Measurement(iterations = 1)
+open class StartupBenchmark {
+    private lateinit var frames: List<ByteArray>
+    private var proxy: PushableProxyImpl? = null
+    private var client: RtspTestClient? = null
+    private var encoder: Thread? = null
+
+    @Volatile
+    private var encoding = true
+
+    @Setup(Level.Trial)
+    fun setUp() {
+        val stream = System.getProperty("sambaza.stream")
+            ?: throw IllegalStateException("Pass an H.265 Annex-B file with -PsambazaStream=<path>")
+        frames = Frames.accessUnits(File(stream))
+    }
+
+    @TearDown(Level.Trial)
+    fun tearDown() {
+        proxy?.let { println("\nNative startup timings: ${it.getStartupTimings()}") }
+        encoding = false
+        encoder?.join()
+        client?.close()
+        proxy?.stop()
+    }
+
+    @Benchmark
+    fun coldStartToFirstFrame() {
+        val proxy = PushableProxyImpl()
+        this.proxy = proxy
+        proxy.addStream(StreamInfo(1, "", "", 0, PATH))
+        proxy.start()
+        encoder = thread { encode(proxy) }
+
+        val client = RtspTestClient("127.0.0.1", proxy.getPort(), PATH)
+        this.client = client
+        client.play()
+        awaitFirstFrame(client)
+    }
+
+    private fun encode(proxy: PushableProxyImpl) {
+        val pacer = Pacer(FRAMES_PER_SECOND)
+        var next = 0
+        while (encoding) {
+            proxy.pushFrame(Frames.frame(frames[next]))
+            next = (next + 1) % frames.size
+            pacer.await()
+        }
+    }
+
+    private fun awaitFirstFrame(client: RtspTestClient) {
+        repeat(frames.size) {
+            try {
+                client.awaitFrame()
+                return
+            } catch (e: SocketTimeoutException) {
+                // The parser waits for parameter sets, i.e. for the next IRAP frame
+            }
+        }
+        throw IllegalStateException("No frame reached the client, is the file H.265 Annex-B?")
+    }
+
+    private companion object {
+        const val PATH = "/bench"
+        const val FRAMES_PER_SECOND = 30
+    }
+}
@@ -0,0 +1,7 @@
+package com.auterion.sambaza
+
+data class BacklogStats(
+    val overflows: Long, // times a TCP client fell behind by more than the backlog limit
+    val resyncs: Long, // times such a client was resumed at an IDR
+    val skippedFrames: Long // frames not sent to such clients meanwhile
+)
@@ -0,0 +1,24 @@
+package com.auterion.sambaza
+
+enum class CongestionLevel {
+    NONE,
+
+    /** The ingest queue is filling up or clients report loss, nothing is dropped yet. */
+    RISING,
+
+    /** Frames were dropped since the last report. */
+    DROPPING
+}
+
+/**
+ * Backpressure of a pushable stream, reported when the level changes and at most once per second
+ * while it stays above [CongestionLevel.NONE], so that the producer can lower its bitrate or
+ * frame rate before frames have to be dropped.
+ */
+data class Congestion(
+    val level: CongestionLevel,
+    val queueDepth: Int,
+    val droppedFrames: Int, // by the ingest, since the stream was added
+    val congestedClients: Int,
+    val clientDroppedFrames: Long // by frame thinning, for all clients so far
+)
@@ -1,6 +1,10 @@
 package com.auterion.sambaza
 
-class H264Frame(val pts: ULong, val caps: String?) {
+/**
+ * [captureTimeUs] is the wall-clock time the frame was captured at, in microseconds since the
+ * Unix epoch, or -1 if unknown (see [RtspProxyImpl.setCaptureTimeExtension]).
+ */
+class H264Frame(val pts: ULong, val caps: String?, val captureTimeUs: Long = -1) {
     private var buffer = ByteArray(0)
 
     fun buffer(): ByteArray {
@@ -20,8 +20,8 @@ internal class JniApi {
 
         private external fun runMainLoopNative(mainLoopHandle: Long)
 
-        internal fun createRtspServer(port: Int = 0): Long {
-            val server = createRtspServerNative(port)
+        internal fun createRtspServer(port: Int = 0, memoryBudgetBytes: Long = 0): Long {
+            val server = createRtspServerNative(port, memoryBudgetBytes)
 
             if (server == 0L) {
                 throw RuntimeException("Failed to create server")
@@ -30,7 +30,7 @@ internal class JniApi {
             return server;
         }
 
-        private external fun createRtspServerNative(port: Int): Long
+        private external fun createRtspServerNative(port: Int, memoryBudgetBytes: Long): Long
 
         internal fun getPort(serverHandle: Long): Int {
             return getPortNative(serverHandle)
@@ -50,14 +50,22 @@ internal class JniApi {
 
         private external fun stopNative(skywayServerHandle: Long, mainLoopHandle: Long)
 
-        internal fun addRtspSrcStream(serverHandle: Long, location: String, path: String) {
-            addRtspSrcStreamNative(serverHandle, location, path)
+        internal fun addRtspSrcStream(
+            serverHandle: Long,
+            location: String,
+            path: String,
+            passthrough: Boolean = false,
+            direct: Boolean = false
+        ) {
+            addRtspSrcStreamNative(serverHandle, location, path, passthrough, direct)
         }
 
         private external fun addRtspSrcStreamNative(
             skywayServerHandle: Long,
             location: String,
-            path: String
+            path: String,
+            passthrough: Boolean,
+            direct: Boolean
         )
 
         internal fun addPushableStream(serverHandle: Long, path: String) {
@@ -66,27 +74,287 @@ internal class JniApi {
 
         private external fun addPushableStreamNative(skywayServerHandle: Long, path: String)
 
+        internal fun addShmStream(
+            serverHandle: Long,
+            path: String,
+            memoryFd: Int,
+            doorbellFd: Int
+        ): Boolean {
+            return addShmStreamNative(serverHandle, path, memoryFd, doorbellFd)
+        }
+
+        private external fun addShmStreamNative(
+            skywayServerHandle: Long,
+            path: String,
+            memoryFd: Int,
+            doorbellFd: Int
+        ): Boolean
+
+        internal fun addDerivedStream(
+            serverHandle: Long,
+            parentPath: String,
+            path: String,
+            idrOnly: Boolean,
+            maxTemporalId: Int,
+            maxFps: Int
+        ): Boolean {
+            return addDerivedStreamNative(
+                serverHandle,
+                parentPath,
+                path,
+                idrOnly,
+                maxTemporalId,
+                maxFps
+            )
+        }
+
+        private external fun addDerivedStreamNative(
+            skywayServerHandle: Long,
+            parentPath: String,
+            path: String,
+            idrOnly: Boolean,
+            maxTemporalId: Int,
+            maxFps: Int
+        ): Boolean
+
+        internal fun addSwitchableStream(
+            serverHandle: Long,
+            path: String,
+            sourcePath: String
+        ): Boolean {
+            return addSwitchableStreamNative(serverHandle, path, sourcePath)
+        }
+
+        private external fun addSwitchableStreamNative(
+            skywayServerHandle: Long,
+            path: String,
+            sourcePath: String
+        ): Boolean
+
+        internal fun switchSource(serverHandle: Long, path: String, sourcePath: String): Boolean {
+            return switchSourceNative(serverHandle, path, sourcePath)
+        }
+
+        private external fun switchSourceNative(
+            skywayServerHandle: Long,
+            path: String,
+            sourcePath: String
+        ): Boolean
+
         internal fun removeStream(serverHandle: Long, path: String) {
             removeStreamNative(serverHandle, path)
         }
 
         private external fun removeStreamNative(skywayServerHandle: Long, path: String)
 
-        internal fun pushFrame(serverHandle: Long, frame: H264Frame) {
-            val pts = if (frame.pts == ULong.MAX_VALUE) -1 else frame.pts.toLong()
-            pushFrameNative(
+        internal fun setDefaultLinger(serverHandle: Long, seconds: Int) {
+            setDefaultLingerNative(serverHandle, seconds)
+        }
+
+        private external fun setDefaultLingerNative(skywayServerHandle: Long, seconds: Int)
+
+        internal fun setStreamLinger(serverHandle: Long, path: String, seconds: Int): Boolean {
+            return setStreamLingerNative(serverHandle, path, seconds)
+        }
+
+        private external fun setStreamLingerNative(
+            skywayServerHandle: Long,
+            path: String,
+            seconds: Int
+        ): Boolean
+
+        internal fun setStreamPriority(
+            serverHandle: Long,
+            path: String,
+            priority: StreamPriority
+        ): Boolean {
+            return setStreamPriorityNative(serverHandle, path, priority.ordinal)
+        }
+
+        private external fun setStreamPriorityNative(
+            skywayServerHandle: Long,
+            path: String,
+            priority: Int
+        ): Boolean
+
+        internal fun setClientLimits(serverHandle: Long, maxClients: Int, maxBitrate: Long) {
+            setClientLimitsNative(serverHandle, maxClients, maxBitrate)
+        }
+
+        private external fun setClientLimitsNative(
+            skywayServerHandle: Long,
+            maxClients: Int,
+            maxBitrate: Long
+        )
+
+        internal fun setBitrateEstimate(serverHandle: Long, bitrate: Long) {
+            setBitrateEstimateNative(serverHandle, bitrate)
+        }
+
+        private external fun setBitrateEstimateNative(skywayServerHandle: Long, bitrate: Long)
+
+        internal fun setStreamClientLimits(
+            serverHandle: Long,
+            path: String,
+            maxClients: Int,
+            maxBitrate: Long
+        ): Boolean {
+            return setStreamClientLimitsNative(serverHandle, path, maxClients, maxBitrate)
+        }
+
+        private external fun setStreamClientLimitsNative(
+            skywayServerHandle: Long,
+            path: String,
+            maxClients: Int,
+            maxBitrate: Long
+        ): Boolean
+
+        internal fun addPriorityAddress(serverHandle: Long, address: String): Boolean {
+            return addPriorityAddressNative(serverHandle, address)
+        }
+
+        private external fun addPriorityAddressNative(
+            skywayServerHandle: Long,
+            address: String
+        ): Boolean
+
+        internal fun getMemoryUsage(serverHandle: Long): MemoryUsage {
+            val values = getMemoryUsageNative(serverHandle)
+            return MemoryUsage(values[0], values[1], values[2], values[3])
+        }
+
+        private external fun getMemoryUsageNative(skywayServerHandle: Long): LongArray
+
+        internal fun getStartupTimings(): StartupTimings {
+            // The first value is the origin of the others
+            val values = getStartupTimingsNative()
+            return StartupTimings(values[1], values[2], values[3], values[4])
+        }
+
+        private external fun getStartupTimingsNative(): LongArray
+
+        internal fun setFrameThinning(serverHandle: Long, enabled: Boolean, allowIdrOnly: Boolean) {
+            setFrameThinningNative(serverHandle, enabled, allowIdrOnly)
+        }
+
+        private external fun setFrameThinningNative(
+            skywayServerHandle: Long,
+            enabled: Boolean,
+            allowIdrOnly: Boolean
+        )
+
+        internal fun setCaptureTimeExtension(serverHandle: Long, enabled: Boolean) {
+            setCaptureTimeExtensionNative(serverHandle, enabled)
+        }
+
+        private external fun setCaptureTimeExtensionNative(
+            skywayServerHandle: Long,
+            enabled: Boolean
+        )
+
+        internal fun setThreadPolicy(serverHandle: Long, policy: ThreadPolicy) {
+            setThreadPolicyNative(
                 serverHandle,
-                pts,
-                frame.buffer(),
-                frame.caps ?: ""
+                policy.cpuMask,
+                policy.nice,
+                policy.realtimePriority,
+                policy.namePrefix
+            )
+        }
+
+        private external fun setThreadPolicyNative(
+            skywayServerHandle: Long,
+            cpuMask: Long,
+            nice: Int,
+            realtimePriority: Int,
+            namePrefix: String?
+        )
+
+        internal fun setTcpBacklogLimit(serverHandle: Long, maxBytes: Int, maxDelayMs: Int) {
+            setTcpBacklogLimitNative(serverHandle, maxBytes, maxDelayMs)
+        }
+
+        private external fun setTcpBacklogLimitNative(
+            skywayServerHandle: Long,
+            maxBytes: Int,
+            maxDelayMs: Int
+        )
+
+        internal fun getBacklogStats(serverHandle: Long): BacklogStats {
+            val values = getBacklogStatsNative(serverHandle)
+            return BacklogStats(values[0], values[1], values[2])
+        }
+
+        private external fun getBacklogStatsNative(skywayServerHandle: Long): LongArray
+
+        internal fun startTracing(capacity: Int) {
+            startTracingNative(capacity)
+        }
+
+        private external fun startTracingNative(capacity: Int)
+
+        internal fun stopTracing() {
+            stopTracingNative()
+        }
+
+        private external fun stopTracingNative()
+
+        internal fun dumpTrace(): String {
+            return dumpTraceNative()
+        }
+
+        private external fun dumpTraceNative(): String
+
+        internal fun pushFrame(serverHandle: Long, frame: H264Frame): PushResult {
+            val pts = if (frame.pts == ULong.MAX_VALUE) -1 else frame.pts.toLong()
+            return PushResult(
+                pushFrameNative(
+                    serverHandle,
+                    pts,
+                    frame.captureTimeUs,
+                    frame.buffer(),
+                    frame.caps ?: ""
+                )
             )
         }
 
         private external fun pushFrameNative(
             skywayServerHandle: Long,
             pts: Long,
+            captureTime: Long,
             buffer: ByteArray,
             caps: String
+        ): Long
+
+        internal fun startRecording(serverHandle: Long, path: String): Boolean {
+            return startRecordingNative(serverHandle, path)
+        }
+
+        private external fun startRecordingNative(skywayServerHandle: Long, path: String): Boolean
+
+        internal fun stopRecording(serverHandle: Long) {
+            stopRecordingNative(serverHandle)
+        }
+
+        private external fun stopRecordingNative(skywayServerHandle: Long)
+
+        internal fun interface CongestionListener {
+            fun onCongestion(
+                level: Int,
+                queueDepth: Int,
+                droppedFrames: Int,
+                congestedClients: Int,
+                clientDroppedFrames: Long
+            )
+        }
+
+        internal fun setCongestionListener(serverHandle: Long, listener: CongestionListener?) {
+            setCongestionListenerNative(serverHandle, listener)
+        }
+
+        private external fun setCongestionListenerNative(
+            skywayServerHandle: Long,
+            listener: CongestionListener?
         )
     }
 }
\ No newline at end of file
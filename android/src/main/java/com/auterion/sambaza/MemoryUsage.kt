@@ -0,0 +1,8 @@
+package com.auterion.sambaza
+
+data class MemoryUsage(
+    val limitBytes: Long, // 0 when unlimited
+    val usedBytes: Long,
+    val peakBytes: Long,
+    val shedFrames: Long // frames dropped so far to stay within the budget
+)
@@ -0,0 +1,26 @@
+package com.auterion.sambaza
+
+/**
+ * What became of a pushed frame, packed into a Long so that pushing does not allocate.
+ */
+@JvmInline
+value class PushResult(private val packed: Long) {
+    /** The GstFlowReturn of the push, [FLOW_OK] if the frame was accepted. */
+    val flow: Int get() = packed.toInt()
+
+    /** Frames waiting in the ingest queue after the push. */
+    val queueDepth: Int get() = ((packed ushr 32) and 0xffff).toInt()
+
+    /** Whether a frame had to be dropped to make room for this one. */
+    val dropped: Boolean get() = (packed ushr 48) and 1L != 0L
+
+    val isOk: Boolean get() = flow == FLOW_OK
+
+    companion object {
+        const val FLOW_OK = 0
+        const val FLOW_FLUSHING = -2
+
+        /** Nothing to push to, i.e. no stream added yet. */
+        val FLUSHING = PushResult(FLOW_FLUSHING.toUInt().toLong())
+    }
+}
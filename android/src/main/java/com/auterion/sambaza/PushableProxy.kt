@@ -1,5 +1,16 @@
 package com.auterion.sambaza
 
+import kotlinx.coroutines.flow.Flow
+
 interface PushableProxy : RtspProxy {
-    fun pushFrame(frame: H264Frame)
-}
\ No newline at end of file
+    /**
+     * Queues [frame] for the clients. A result that is not ok, a growing queue depth or a
+     * dropped frame mean the producer is pushing faster than the stream is drained.
+     */
+    fun pushFrame(frame: H264Frame): PushResult
+
+    /**
+     * The latest backpressure of the stream, to adapt the encoder bitrate or frame rate to.
+     */
+    val congestion: Flow<Congestion>
+}
@@ -1,8 +1,33 @@
 package com.auterion.sambaza
 
-class PushableProxyImpl(port: Int = 0) :
-    RtspProxyImpl(port), PushableProxy {
+import kotlinx.coroutines.channels.BufferOverflow
+import kotlinx.coroutines.flow.Flow
+import kotlinx.coroutines.flow.MutableSharedFlow
+import kotlinx.coroutines.flow.asSharedFlow
+
+class PushableProxyImpl(port: Int = 0, memoryBudgetBytes: Long = 0) :
+    RtspProxyImpl(port, memoryBudgetBytes), PushableProxy {
     private var wasStreamAdded = false
+    private val congestionFlow = MutableSharedFlow<Congestion>(
+        replay = 1,
+        onBufferOverflow = BufferOverflow.DROP_OLDEST
+    )
+    override val congestion: Flow<Congestion> = congestionFlow.asSharedFlow()
+
+    init {
+        JniApi.setCongestionListener(skywayServerHandle) { level, queueDepth, droppedFrames,
+                                                           congestedClients, clientDroppedFrames ->
+            congestionFlow.tryEmit(
+                Congestion(
+                    CongestionLevel.values()[level],
+                    queueDepth,
+                    droppedFrames,
+                    congestedClients,
+                    clientDroppedFrames
+                )
+            )
+        }
+    }
 
     override fun addStream(streamInfo: StreamInfo) {
         if (wasStreamAdded) {
@@ -14,8 +39,22 @@ class PushableProxyImpl(port: Int = 0) :
         wasStreamAdded = true
     }
 
-    override fun pushFrame(frame: H264Frame) {
-        if (!wasStreamAdded) return
-        JniApi.pushFrame(skywayServerHandle, frame)
+    override fun pushFrame(frame: H264Frame): PushResult {
+        if (!wasStreamAdded) return PushResult.FLUSHING
+        return JniApi.pushFrame(skywayServerHandle, frame)
+    }
+
+    /**
+     * Records every frame pushed from now on, with its timing, into the file at [path], so that
+     * the stream can be replayed on a desktop with the push_replay tool (see
+     * src/main/test/push_replay.c). Replaces any recording in progress.
+     */
+    fun startRecording(path: String): Boolean {
+        if (!wasStreamAdded) return false
+        return JniApi.startRecording(skywayServerHandle, path)
+    }
+
+    fun stopRecording() {
+        JniApi.stopRecording(skywayServerHandle)
     }
 }
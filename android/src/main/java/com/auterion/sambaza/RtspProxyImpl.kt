@@ -9,7 +9,8 @@ import kotlinx.coroutines.launch
 import java.util.*
 import kotlin.coroutines.CoroutineContext
 
-abstract class RtspProxyImpl(port: Int = 0) : RtspProxy, CoroutineScope {
+abstract class RtspProxyImpl(port: Int = 0, memoryBudgetBytes: Long = 0) : RtspProxy,
+    CoroutineScope {
     override val coroutineContext: CoroutineContext = Job() + Dispatchers.IO
     private var videoStreamFlowCollectJob: Job? = null
 
@@ -18,7 +19,7 @@ abstract class RtspProxyImpl(port: Int = 0) : RtspProxy, CoroutineScope {
         System.loadLibrary("sambaza")
     }
 
-    protected val skywayServerHandle: Long = JniApi.createRtspServer(port)
+    protected val skywayServerHandle: Long = JniApi.createRtspServer(port, memoryBudgetBytes)
     private val streams: MutableMap<Int, StreamInfo> = Collections.synchronizedMap(HashMap())
 
     init {
@@ -43,7 +44,7 @@ abstract class RtspProxyImpl(port: Int = 0) : RtspProxy, CoroutineScope {
                         // If this stream already exists with the same path, don't do anything.
                         return@collect
                     } else { // If it exists with another path, erase it
-                        JniApi.removeStream(skywayServerHandle, streamInfo.path)
+                        JniApi.removeStream(skywayServerHandle, existingStream.path)
                     }
                 }
 
@@ -65,9 +66,184 @@ abstract class RtspProxyImpl(port: Int = 0) : RtspProxy, CoroutineScope {
         JniApi.stop(skywayServerHandle)
     }
 
+    /**
+     * Keeps the ingest of streams added from now on running for [seconds] after their last
+     * client left, so that clients switching between feeds reconnect instantly.
+     * [LINGER_ALWAYS_ON] never stops them.
+     */
+    fun setDefaultLinger(seconds: Int) {
+        JniApi.setDefaultLinger(skywayServerHandle, seconds)
+    }
+
+    /**
+     * Same as [setDefaultLinger], for the stream mounted at [path] only.
+     */
+    fun setStreamLinger(path: String, seconds: Int): Boolean {
+        return JniApi.setStreamLinger(skywayServerHandle, path, seconds)
+    }
+
+    /**
+     * Serves on [path] the frames an encoder in another process writes into a shared memory ring
+     * (a sealed memfd and an eventfd doorbell, e.g. received as ParcelFileDescriptors; see
+     * shm_ring.h for the layout and the producer library), without copying them. The
+     * descriptors are duplicated, the caller may close its own.
+     */
+    fun addShmStream(path: String, memoryFd: Int, doorbellFd: Int): Boolean {
+        return JniApi.addShmStream(skywayServerHandle, path, memoryFd, doorbellFd)
+    }
+
+    /**
+     * Serves the IDR frames of the stream mounted at [parentPath] on [path] (e.g.
+     * "/stream1/lowfps"), at most [maxFps] per second if positive. Shares the parent's ingest.
+     */
+    fun addIdrOnlyStream(parentPath: String, path: String, maxFps: Int = 0): Boolean {
+        return JniApi.addDerivedStream(skywayServerHandle, parentPath, path, true, 0, maxFps)
+    }
+
+    /**
+     * Serves on [path] (e.g. "/stream1") what the stream mounted at [sourcePath] (e.g. "/cam1")
+     * serves, until [switchSource] is called. Connected clients keep their session across
+     * switches.
+     */
+    fun addSwitchableStream(path: String, sourcePath: String): Boolean {
+        return JniApi.addSwitchableStream(skywayServerHandle, path, sourcePath)
+    }
+
+    /**
+     * Makes the switchable stream at [path] serve the stream mounted at [sourcePath] instead,
+     * from its next IRAP frame on.
+     */
+    fun switchSource(path: String, sourcePath: String): Boolean {
+        return JniApi.switchSource(skywayServerHandle, path, sourcePath)
+    }
+
+    /**
+     * Serves the frames of the stream mounted at [parentPath] whose H.265 TemporalId is at most
+     * [maxTemporalId] on [path]. Shares the parent's ingest.
+     */
+    fun addTemporalLayerStream(parentPath: String, path: String, maxTemporalId: Int): Boolean {
+        return JniApi.addDerivedStream(skywayServerHandle, parentPath, path, false, maxTemporalId, 0)
+    }
+
+    /**
+     * When the memory budget runs short, streams shed frames in order of [priority], lowest first.
+     */
+    fun setStreamPriority(path: String, priority: StreamPriority): Boolean {
+        return JniApi.setStreamPriority(skywayServerHandle, path, priority)
+    }
+
+    /**
+     * New clients are refused (453 Not Enough Bandwidth) when admitting them would exceed
+     * [maxClients] or [maxBitrate] bits per second sent in total, 0 for no limit. Clients
+     * already playing are not affected.
+     */
+    fun setClientLimits(maxClients: Int = 0, maxBitrate: Long = 0) {
+        JniApi.setClientLimits(skywayServerHandle, maxClients, maxBitrate)
+    }
+
+    /**
+     * Same as [setClientLimits], for the clients of the stream mounted at [path] only.
+     */
+    fun setStreamClientLimits(path: String, maxClients: Int = 0, maxBitrate: Long = 0): Boolean {
+        return JniApi.setStreamClientLimits(skywayServerHandle, path, maxClients, maxBitrate)
+    }
+
+    /**
+     * The bits per second a client of a stream is assumed to cost against the bitrate limits
+     * until the stream was measured, i.e. until it first sent something. 4 Mbit/s by default.
+     */
+    fun setBitrateEstimate(bitrate: Long) {
+        JniApi.setBitrateEstimate(skywayServerHandle, bitrate)
+    }
+
+    /**
+     * Clients from [address], or from a subnet like "192.168.42.0/24", are admitted regardless
+     * of the client limits (e.g. the ground station).
+     */
+    fun addPriorityAddress(address: String): Boolean {
+        return JniApi.addPriorityAddress(skywayServerHandle, address)
+    }
+
+    fun getMemoryUsage(): MemoryUsage {
+        return JniApi.getMemoryUsage(skywayServerHandle)
+    }
+
+    /**
+     * How long the library took to load, to start serving and to get its first media ready,
+     * for all servers of the process.
+     */
+    fun getStartupTimings(): StartupTimings {
+        return JniApi.getStartupTimings()
+    }
+
+    /**
+     * Congested clients (as reported by their RTCP receiver reports) get their non-reference
+     * frames dropped, and only IDRs if [allowIdrOnly] is set, until their reports improve. Off
+     * by default. Only clients playing over UDP are thinned, those over TCP lose no packets.
+     */
+    fun setFrameThinning(enabled: Boolean, allowIdrOnly: Boolean = false) {
+        JniApi.setFrameThinning(skywayServerHandle, enabled, allowIdrOnly)
+    }
+
+    /**
+     * Runs the streaming threads of the streams added from now on, the RTSP client and media
+     * threads and the main loop thread under [policy], e.g. on the big cores only.
+     */
+    fun setThreadPolicy(policy: ThreadPolicy) {
+        JniApi.setThreadPolicy(skywayServerHandle, policy)
+    }
+
+    /**
+     * Streams added from now on send the wall-clock time their frames were captured at in the
+     * abs-capture-time RTP header extension, for clients to measure the end-to-end latency.
+     * Pushed frames carry [H264Frame.captureTimeUs], relayed ones the capture time upstream sent
+     * or the NTP time of its RTCP sender reports.
+     */
+    fun setCaptureTimeExtension(enabled: Boolean) {
+        JniApi.setCaptureTimeExtension(skywayServerHandle, enabled)
+    }
+
+    /**
+     * RTSP-over-TCP clients with more than [maxBytes] sent to them but not acknowledged yet, or
+     * data sent more than [maxDelayMs] ago (0 for no limit), have the frames queued for them
+     * flushed and resume once caught up, instead of falling ever further behind. Off by default,
+     * e.g. 2 MiB and 2 seconds suit a 10 Mbit/s stream.
+     */
+    fun setTcpBacklogLimit(maxBytes: Int, maxDelayMs: Int) {
+        JniApi.setTcpBacklogLimit(skywayServerHandle, maxBytes, maxDelayMs)
+    }
+
+    fun getBacklogStats(): BacklogStats {
+        return JniApi.getBacklogStats(skywayServerHandle)
+    }
+
+    /**
+     * Records the time spent in every pad push of every pipeline (i.e. per element and streaming
+     * thread) into a ring of the last [capacity] events. The capacity is fixed by the first call.
+     */
+    fun startTracing(capacity: Int = 1 shl 16) {
+        JniApi.startTracing(capacity)
+    }
+
+    fun stopTracing() {
+        JniApi.stopTracing()
+    }
+
+    /**
+     * The recorded events in the Chrome trace format, to be saved as a .json file and opened
+     * in Perfetto (ui.perfetto.dev) or chrome://tracing.
+     */
+    fun dumpTrace(): String {
+        return JniApi.dumpTrace()
+    }
+
     override fun getPort(): Int {
         return JniApi.getPort(skywayServerHandle)
     }
 
     public abstract fun addStream(streamInfo: StreamInfo)
+
+    companion object {
+        const val LINGER_ALWAYS_ON = -1
+    }
 }
@@ -1,9 +1,24 @@
 package com.auterion.sambaza
 
-class RtspSrcProxyImpl(port: Int = 0) :
-    RtspProxyImpl(port) {
+/**
+ * With [passthrough], the cameras' RTP packets are relayed without being depayloaded and
+ * payloaded again, at the cost of frame thinning for congested clients and of derived and
+ * switchable streams.
+ *
+ * With [direct], each camera is read from within the pipeline serving it, which saves a
+ * re-timestamping and a thread handoff per frame. Its streams are then only pulled while played
+ * and cannot have linger times, priorities, derived or switchable streams.
+ */
+class RtspSrcProxyImpl(
+    port: Int = 0,
+    memoryBudgetBytes: Long = 0,
+    private val passthrough: Boolean = false,
+    private val direct: Boolean = false
+) : RtspProxyImpl(port, memoryBudgetBytes) {
     override fun addStream(streamInfo: StreamInfo) {
         println("Adding rtspsrc stream to ${streamInfo.location} (serving on ${streamInfo.path})")
-        JniApi.addRtspSrcStream(skywayServerHandle, streamInfo.location, streamInfo.path)
+        JniApi.addRtspSrcStream(
+            skywayServerHandle, streamInfo.location, streamInfo.path, passthrough, direct
+        )
     }
-}
\ No newline at end of file
+}
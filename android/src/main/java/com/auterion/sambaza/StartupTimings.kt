@@ -0,0 +1,12 @@
+package com.auterion.sambaza
+
+/**
+ * Microseconds from the library initialization to each milestone of the start, -1 for those not
+ * reached yet.
+ */
+data class StartupTimings(
+    val gstReadyMicros: Long,
+    val pluginsReadyMicros: Long,
+    val serverStartedMicros: Long,
+    val firstMediaPreparedMicros: Long // i.e. when the first client could be answered
+)
@@ -0,0 +1,11 @@
+package com.auterion.sambaza
+
+/**
+ * Order in which streams shed frames when the memory budget runs short, [LOW] first.
+ * Must match SkywayStreamPriority.
+ */
+enum class StreamPriority {
+    LOW,
+    NORMAL,
+    HIGH
+}
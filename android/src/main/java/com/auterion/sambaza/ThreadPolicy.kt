@@ -0,0 +1,12 @@
+package com.auterion.sambaza
+
+data class ThreadPolicy(
+    val cpuMask: Long = 0, // bit n for CPU n, 0 to leave the affinity alone
+    val nice: Int = 0,
+    val realtimePriority: Int = 0, // 1-99 for SCHED_FIFO, which needs CAP_SYS_NICE
+    val namePrefix: String? = null // names threads "<namePrefix>:<role>", null keeps their names
+) {
+    companion object {
+        fun cpus(vararg cpus: Int): Long = cpus.fold(0L) { mask, cpu -> mask or (1L shl cpu) }
+    }
+}
@@ -0,0 +1,369 @@
+#include "admission.h"
+
+#include <string.h>
+
+#define RATE_INTERVAL_MS 1000
+
+// A 1080p H.265 stream, until the mount is measured or another estimate is configured
+#define DEFAULT_BITRATE_ESTIMATE (4 * 1000 * 1000)
+
+struct _SkywayMountLoad {
+    // Bytes produced since the last rate update, updated from the streaming thread
+    gint bytes;
+    // The fields below are guarded by the admission lock
+    gboolean measured;
+    guint64 bitrate;
+    guint clients;
+    guint max_clients;
+    guint64 max_bitrate;
+};
+
+struct _SkywayAdmission {
+    GMutex lock;
+    // Mount path -> SkywayMountLoad
+    GHashTable *mounts;
+    // GstRTSPClient -> GPtrArray of the AdmittedMounts it was admitted to
+    GHashTable *admitted;
+    GPtrArray *priority_addresses;
+    guint max_clients;
+    guint64 max_bitrate;
+    guint64 bitrate_estimate;
+    guint rate_source;
+};
+
+typedef struct _AdmittedMount {
+    gchar *path;
+    SkywayMountLoad *load;
+} AdmittedMount;
+
+static void admitted_mount_free(AdmittedMount *admitted);
+
+static gboolean is_under(const gchar *path, const gchar *mount_path);
+
+static SkywayMountLoad *match_mount(SkywayAdmission *self, const gchar *path,
+                                    const gchar **mount_path);
+
+static guint64 mount_bitrate(SkywayAdmission *self, SkywayMountLoad *load);
+
+static gboolean is_priority_address(SkywayAdmission *self, const gchar *ip);
+
+static gboolean can_admit(SkywayAdmission *self, SkywayMountLoad *load, const gchar *path);
+
+static GstRTSPStatusCode
+pre_setup_request_handler(GstRTSPClient *client, GstRTSPContext *ctx, SkywayAdmission *self);
+
+static void
+teardown_request_handler(GstRTSPClient *client, GstRTSPContext *ctx, SkywayAdmission *self);
+
+static void client_closed_handler(GstRTSPClient *client, SkywayAdmission *self);
+
+static gboolean update_rates(SkywayAdmission *self);
+
+SkywayMountLoad *skyway_mount_load_new(void) {
+    return g_atomic_rc_box_new0(SkywayMountLoad);
+}
+
+SkywayMountLoad *skyway_mount_load_ref(SkywayMountLoad *load) {
+    return g_atomic_rc_box_acquire(load);
+}
+
+void skyway_mount_load_unref(SkywayMountLoad *load) {
+    g_atomic_rc_box_release(load);
+}
+
+void skyway_mount_load_count(SkywayMountLoad *load, GstMiniObject *packets) {
+    gsize size = GST_IS_BUFFER_LIST(packets)
+                 ? gst_buffer_list_calculate_size(GST_BUFFER_LIST(packets))
+                 : gst_buffer_get_size(GST_BUFFER(packets));
+    g_atomic_int_add(&load->bytes, (gint) size);
+}
+
+SkywayAdmission *skyway_admission_new() {
+    SkywayAdmission *self = g_new0(SkywayAdmission, 1);
+    g_mutex_init(&self->lock);
+    self->mounts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify) skyway_mount_load_unref);
+    self->admitted = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                           (GDestroyNotify) g_ptr_array_unref);
+    self->priority_addresses = g_ptr_array_new_with_free_func(g_object_unref);
+    self->bitrate_estimate = DEFAULT_BITRATE_ESTIMATE;
+    self->rate_source = g_timeout_add(RATE_INTERVAL_MS, (GSourceFunc) update_rates, self);
+
+    return self;
+}
+
+void skyway_admission_watch_client(SkywayAdmission *self, GstRTSPClient *client) {
+    g_signal_connect(client, "pre-setup-request", G_CALLBACK(pre_setup_request_handler), self);
+    g_signal_connect(client, "teardown-request", G_CALLBACK(teardown_request_handler), self);
+    g_signal_connect(client, "closed", G_CALLBACK(client_closed_handler), self);
+}
+
+void skyway_admission_add_mount(SkywayAdmission *self, const gchar *path, SkywayMountLoad *load) {
+    g_mutex_lock(&self->lock);
+    g_hash_table_replace(self->mounts, g_strdup(path), skyway_mount_load_ref(load));
+    g_mutex_unlock(&self->lock);
+}
+
+void skyway_admission_remove_mount(SkywayAdmission *self, const gchar *path) {
+    // Clients admitted to it stay counted until they leave, they still receive the stream
+    g_mutex_lock(&self->lock);
+    g_hash_table_remove(self->mounts, path);
+    g_mutex_unlock(&self->lock);
+}
+
+void skyway_admission_set_limits(SkywayAdmission *self, guint max_clients, guint64 max_bitrate) {
+    g_mutex_lock(&self->lock);
+    self->max_clients = max_clients;
+    self->max_bitrate = max_bitrate;
+    g_mutex_unlock(&self->lock);
+}
+
+gboolean skyway_admission_set_mount_limits(SkywayAdmission *self, const gchar *path,
+                                           guint max_clients, guint64 max_bitrate) {
+    g_mutex_lock(&self->lock);
+    SkywayMountLoad *load = g_hash_table_lookup(self->mounts, path);
+    if (load) {
+        load->max_clients = max_clients;
+        load->max_bitrate = max_bitrate;
+    }
+    g_mutex_unlock(&self->lock);
+
+    return load != NULL;
+}
+
+gboolean skyway_admission_add_priority_address(SkywayAdmission *self, const gchar *address) {
+    GInetAddressMask *mask = g_inet_address_mask_new_from_string(address, NULL);
+    if (!mask) {
+        return FALSE;
+    }
+
+    g_mutex_lock(&self->lock);
+    g_ptr_array_add(self->priority_addresses, mask);
+    g_mutex_unlock(&self->lock);
+
+    return TRUE;
+}
+
+void skyway_admission_set_bitrate_estimate(SkywayAdmission *self, guint64 bitrate) {
+    g_mutex_lock(&self->lock);
+    self->bitrate_estimate = bitrate;
+    g_mutex_unlock(&self->lock);
+}
+
+void skyway_admission_stop(SkywayAdmission *self) {
+    if (self->rate_source) {
+        g_source_remove(self->rate_source);
+        self->rate_source = 0;
+    }
+}
+
+void skyway_admission_free(SkywayAdmission *self) {
+    skyway_admission_stop(self);
+    g_hash_table_unref(self->admitted);
+    g_hash_table_unref(self->mounts);
+    g_ptr_array_unref(self->priority_addresses);
+    g_mutex_clear(&self->lock);
+    g_free(self);
+}
+
+static void admitted_mount_free(AdmittedMount *admitted) {
+    admitted->load->clients--;
+    skyway_mount_load_unref(admitted->load);
+    g_free(admitted->path);
+    g_free(admitted);
+}
+
+/*
+ * Whether a request URI is for the mount, which SETUP URIs are followed by the control path of
+ * the stream.
+ */
+static gboolean is_under(const gchar *path, const gchar *mount_path) {
+    gsize length = strlen(mount_path);
+    return g_str_has_prefix(path, mount_path) && (path[length] == '\0' || path[length] == '/');
+}
+
+/*
+ * The mount a request URI is for, i.e. the longest mount path it is under.
+ */
+static SkywayMountLoad *match_mount(SkywayAdmission *self, const gchar *path,
+                                    const gchar **mount_path) {
+    SkywayMountLoad *match = NULL;
+    gsize match_length = 0;
+
+    GHashTableIter iter;
+    gpointer key;
+    gpointer value;
+    g_hash_table_iter_init(&iter, self->mounts);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        gsize length = strlen(key);
+        if (length >= match_length && is_under(path, key)) {
+            match = value;
+            match_length = length;
+            *mount_path = key;
+        }
+    }
+
+    return match;
+}
+
+/*
+ * What one more client of the mount costs, estimated until the mount sent something.
+ */
+static guint64 mount_bitrate(SkywayAdmission *self, SkywayMountLoad *load) {
+    return load->measured ? load->bitrate : self->bitrate_estimate;
+}
+
+static gboolean is_priority_address(SkywayAdmission *self, const gchar *ip) {
+    if (!ip || self->priority_addresses->len == 0) {
+        return FALSE;
+    }
+
+    GInetAddress *address = g_inet_address_new_from_string(ip);
+    if (!address) {
+        return FALSE;
+    }
+
+    gboolean priority = FALSE;
+    for (guint i = 0; i < self->priority_addresses->len && !priority; i++) {
+        priority = g_inet_address_mask_matches(g_ptr_array_index(self->priority_addresses, i),
+                                               address);
+    }
+    g_object_unref(address);
+
+    return priority;
+}
+
+static gboolean can_admit(SkywayAdmission *self, SkywayMountLoad *load, const gchar *path) {
+    guint64 total_bitrate = 0;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, self->mounts);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        SkywayMountLoad *mount = value;
+        total_bitrate += mount_bitrate(self, mount) * mount->clients;
+    }
+    guint64 bitrate = mount_bitrate(self, load);
+
+    // A new client costs one more copy of what the mount sends
+    if (self->max_clients && g_hash_table_size(self->admitted) >= self->max_clients) {
+        g_print("Refusing a client for %s, the server has %u clients\n", path,
+                g_hash_table_size(self->admitted));
+        return FALSE;
+    }
+    if (self->max_bitrate && total_bitrate + bitrate > self->max_bitrate) {
+        g_print("Refusing a client for %s, the server sends %" G_GUINT64_FORMAT " bit/s\n", path,
+                total_bitrate);
+        return FALSE;
+    }
+    if (load->max_clients && load->clients >= load->max_clients) {
+        g_print("Refusing a client for %s, it has %u clients\n", path, load->clients);
+        return FALSE;
+    }
+    if (load->max_bitrate && bitrate * (load->clients + 1) > load->max_bitrate) {
+        g_print("Refusing a client for %s, it sends %" G_GUINT64_FORMAT " bit/s\n", path,
+                bitrate * load->clients);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static GstRTSPStatusCode
+pre_setup_request_handler(GstRTSPClient *client, GstRTSPContext *ctx, SkywayAdmission *self) {
+    if (!ctx->uri || !ctx->uri->abspath) {
+        return GST_RTSP_STS_OK;
+    }
+
+    const gchar *client_ip = gst_rtsp_connection_get_ip(gst_rtsp_client_get_connection(client));
+    GstRTSPStatusCode status = GST_RTSP_STS_OK;
+
+    g_mutex_lock(&self->lock);
+    const gchar *mount_path = NULL;
+    SkywayMountLoad *load = match_mount(self, ctx->uri->abspath, &mount_path);
+    GPtrArray *admitted_to = g_hash_table_lookup(self->admitted, client);
+    gboolean admitted = FALSE;
+    for (guint i = 0; admitted_to && i < admitted_to->len && !admitted; i++) {
+        admitted = ((AdmittedMount *) g_ptr_array_index(admitted_to, i))->load == load;
+    }
+
+    // Unknown mounts are refused by the server itself, and a client already admitted to the
+    // mount is only setting up another of its streams (or the same one again)
+    if (load && !admitted) {
+        if (is_priority_address(self, client_ip) || can_admit(self, load, ctx->uri->abspath)) {
+            if (!admitted_to) {
+                admitted_to = g_ptr_array_new_with_free_func(
+                        (GDestroyNotify) admitted_mount_free);
+                g_hash_table_insert(self->admitted, client, admitted_to);
+            }
+
+            AdmittedMount *admitted_mount = g_new(AdmittedMount, 1);
+            admitted_mount->path = g_strdup(mount_path);
+            admitted_mount->load = skyway_mount_load_ref(load);
+            load->clients++;
+            g_ptr_array_add(admitted_to, admitted_mount);
+        } else {
+            status = GST_RTSP_STS_NOT_ENOUGH_BANDWIDTH;
+        }
+    }
+    g_mutex_unlock(&self->lock);
+
+    return status;
+}
+
+/*
+ * Releases the mount torn down only, the client may still play others.
+ */
+static void
+teardown_request_handler(GstRTSPClient *client, GstRTSPContext *ctx, SkywayAdmission *self) {
+    if (!ctx->uri || !ctx->uri->abspath) {
+        client_closed_handler(client, self);
+        return;
+    }
+
+    g_mutex_lock(&self->lock);
+    GPtrArray *admitted_to = g_hash_table_lookup(self->admitted, client);
+    gint match = -1;
+    gsize match_length = 0;
+    for (guint i = 0; admitted_to && i < admitted_to->len; i++) {
+        const gchar *path = ((AdmittedMount *) g_ptr_array_index(admitted_to, i))->path;
+        if (strlen(path) >= match_length && is_under(ctx->uri->abspath, path)) {
+            match = (gint) i;
+            match_length = strlen(path);
+        }
+    }
+
+    if (match >= 0) {
+        g_ptr_array_remove_index_fast(admitted_to, (guint) match);
+        if (admitted_to->len == 0) {
+            g_hash_table_remove(self->admitted, client);
+        }
+    }
+    g_mutex_unlock(&self->lock);
+}
+
+static void client_closed_handler(GstRTSPClient *client, SkywayAdmission *self) {
+    g_mutex_lock(&self->lock);
+    g_hash_table_remove(self->admitted, client);
+    g_mutex_unlock(&self->lock);
+}
+
+static gboolean update_rates(SkywayAdmission *self) {
+    g_mutex_lock(&self->lock);
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, self->mounts);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        SkywayMountLoad *load = value;
+        guint bytes = (guint) g_atomic_int_exchange(&load->bytes, 0);
+        guint64 bitrate = (guint64) bytes * 8 * 1000 / RATE_INTERVAL_MS;
+
+        // An idle mount keeps its last rate: it is what the next client will cost
+        if (bytes > 0 || (load->measured && load->clients > 0)) {
+            load->bitrate = load->measured ? (3 * load->bitrate + bitrate) / 4 : bitrate;
+            load->measured = TRUE;
+        }
+    }
+    g_mutex_unlock(&self->lock);
+
+    return G_SOURCE_CONTINUE;
+}
@@ -0,0 +1,71 @@
+#ifndef SKYWAY_ADMISSION_H
+#define SKYWAY_ADMISSION_H
+
+#include <gst/gst.h>
+#include <gst/rtsp-server/rtsp-server.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SkywayAdmission SkywayAdmission;
+
+/*
+ * What a mount sends: its clients, and the bitrate of the packets its payloader produces, which
+ * every client receives a copy of.
+ */
+typedef struct _SkywayMountLoad SkywayMountLoad;
+
+SkywayMountLoad *skyway_mount_load_new(void);
+
+SkywayMountLoad *skyway_mount_load_ref(SkywayMountLoad *load);
+
+void skyway_mount_load_unref(SkywayMountLoad *load);
+
+/*
+ * Counts the bytes of packets (or packet lists) produced for the mount.
+ */
+void skyway_mount_load_count(SkywayMountLoad *load, GstMiniObject *packets);
+
+/*
+ * Refuses SETUPs with 453 Not Enough Bandwidth when admitting one more client would exceed the
+ * client count or egress bitrate limits of the server or of the mount, so that the clients
+ * already playing keep their quality. Limits of 0 are unlimited. Clients from priority
+ * addresses are always admitted.
+ */
+SkywayAdmission *skyway_admission_new();
+
+void skyway_admission_watch_client(SkywayAdmission *self, GstRTSPClient *client);
+
+void skyway_admission_add_mount(SkywayAdmission *self, const gchar *path, SkywayMountLoad *load);
+
+void skyway_admission_remove_mount(SkywayAdmission *self, const gchar *path);
+
+void skyway_admission_set_limits(SkywayAdmission *self, guint max_clients, guint64 max_bitrate);
+
+gboolean skyway_admission_set_mount_limits(SkywayAdmission *self, const gchar *path,
+                                           guint max_clients, guint64 max_bitrate);
+
+/*
+ * Takes an address or a subnet in CIDR notation (e.g. "192.168.42.0/24"), returns FALSE if it
+ * is not valid.
+ */
+gboolean skyway_admission_add_priority_address(SkywayAdmission *self, const gchar *address);
+
+/*
+ * What a mount is assumed to send per client until it sent something (4 Mbit/s by default), so
+ * that a mount nobody played yet is not admitted for free.
+ */
+void skyway_admission_set_bitrate_estimate(SkywayAdmission *self, guint64 bitrate);
+
+/*
+ * Stops measuring the bitrate of the mounts, for the server to shut down.
+ */
+void skyway_admission_stop(SkywayAdmission *self);
+
+/*
+ * Stops measuring and frees the admission, once the clients it watched are gone.
+ */
+void skyway_admission_free(SkywayAdmission *self);
+
+G_END_DECLS
+
+#endif // SKYWAY_ADMISSION_H
@@ -1,9 +1,25 @@
 #include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
 
 #include "appsink_proxy.h"
 
+#include "h265_nal.h"
+
 typedef struct _SkywayAppSinkProxyPrivate {
-    GstElement *pipeline;
+    GMutex lock;
+    guint play_count;
+    gboolean running;
+    gint linger_seconds;
+    guint linger_source;
+    SkywayMemoryBudget *budget;
+    gint priority;
+    // Only touched by the thread emitting samples
+    gboolean shedding;
+    guint emit_depth;
+    gboolean emit_dropped;
+    // Backpressure of the last sample and drops so far, read from other threads
+    gint queue_depth;
+    gint dropped_samples;
 } SkywayAppSinkProxyPrivate;
 
 enum {
@@ -23,10 +39,20 @@ G_DEFINE_TYPE_WITH_PRIVATE(SkywayAppSinkProxy, skyway_app_sink_proxy, G_TYPE_OBJ
 
 static void skyway_app_sink_proxy_class_init(SkywayAppSinkProxyClass *klass);
 
-static void skyway_app_sink_proxy_init(__attribute__ ((unused)) SkywayAppSinkProxy *self);
+static void skyway_app_sink_proxy_init(SkywayAppSinkProxy *self);
+
+static void skyway_app_sink_proxy_finalize(GObject *object);
+
+static gboolean linger_timeout(SkywayAppSinkProxy *self);
+
+static void schedule_linger(SkywayAppSinkProxy *self, SkywayAppSinkProxyPrivate *priv);
+
+static void cancel_linger(SkywayAppSinkProxyPrivate *priv);
 
 static gboolean default_play(SkywayAppSinkProxy *self);
 
+static gboolean admit_sample(SkywayAppSinkProxyPrivate *priv, GstSample *sample);
+
 static void default_stop(SkywayAppSinkProxy *self);
 
 static guint skyway_app_sink_proxy_signals[LAST_SIGNAL] = {0};
@@ -34,6 +60,9 @@ static guint skyway_app_sink_proxy_signals[LAST_SIGNAL] = {0};
 static void skyway_app_sink_proxy_class_init(SkywayAppSinkProxyClass *klass) {
     g_print("skyway_app_sink_proxy_class_init()\n");
 
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    object_class->finalize = skyway_app_sink_proxy_finalize;
+
     skyway_app_sink_proxy_signals[SIGNAL_EOS] =
             g_signal_new("eos", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
                          G_STRUCT_OFFSET(SkywayAppSinkProxyClass, eos),
@@ -42,7 +71,8 @@ static void skyway_app_sink_proxy_class_init(SkywayAppSinkProxyClass *klass) {
     skyway_app_sink_proxy_signals[SIGNAL_NEW_SAMPLE] =
             g_signal_new("new-sample", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
                          G_STRUCT_OFFSET(SkywayAppSinkProxyClass, new_sample),
-                         NULL, NULL, NULL, GST_TYPE_FLOW_RETURN, 0, G_TYPE_NONE);
+                         NULL, NULL, NULL, GST_TYPE_FLOW_RETURN, 1,
+                         GST_TYPE_SAMPLE | G_SIGNAL_TYPE_STATIC_SCOPE);
 
     skyway_app_sink_proxy_signals[SIGNAL_START_PLAYING] =
             g_signal_new("start-playing", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
@@ -64,42 +94,301 @@ static void skyway_app_sink_proxy_class_init(SkywayAppSinkProxyClass *klass) {
     klass->stop = default_stop;
 }
 
-static void skyway_app_sink_proxy_init(__attribute__ ((unused)) SkywayAppSinkProxy *self) {
+static void skyway_app_sink_proxy_init(SkywayAppSinkProxy *self) {
     g_print("skyway_app_sink_proxy_init()\n");
+    SkywayAppSinkProxyPrivate *priv = skyway_app_sink_proxy_get_instance_private(self);
+    g_mutex_init(&priv->lock);
+    priv->play_count = 0;
+    priv->running = FALSE;
+    priv->linger_seconds = 0;
+    priv->linger_source = 0;
+    priv->budget = NULL;
+    priv->priority = SKYWAY_PRIORITY_NORMAL;
+    priv->shedding = FALSE;
+    priv->queue_depth = 0;
+    priv->dropped_samples = 0;
+}
+
+static void skyway_app_sink_proxy_finalize(GObject *object) {
+    SkywayAppSinkProxyPrivate *priv = skyway_app_sink_proxy_get_instance_private(
+            SKYWAY_APP_SINK_PROXY(object));
+    g_mutex_clear(&priv->lock);
+    g_clear_pointer(&priv->budget, skyway_memory_budget_unref);
+
+    G_OBJECT_CLASS (skyway_app_sink_proxy_parent_class)->finalize(object);
 }
 
 SkywayAppSinkProxy *skyway_app_sink_proxy_new() {
     return g_object_new(SKYWAY_TYPE_APP_SINK_PROXY, NULL);
 }
 
+/*
+ * A proxy can feed several media (e.g. a mount and the mounts derived from it), so play and stop
+ * are counted and only the first play and the last stop reach the subclass. After the last
+ * stop, the subclass keeps running for the linger time so that returning clients start
+ * instantly.
+ */
 gboolean skyway_app_sink_proxy_play(SkywayAppSinkProxy *self) {
+    SkywayAppSinkProxyPrivate *priv = skyway_app_sink_proxy_get_instance_private(self);
     SkywayAppSinkProxyClass *klass = SKYWAY_APP_SINK_PROXY_GET_CLASS(self);
+
+    g_mutex_lock(&priv->lock);
+    if (priv->running) {
+        priv->play_count++;
+        cancel_linger(priv);
+        g_mutex_unlock(&priv->lock);
+        return TRUE;
+    }
+
     if (!klass->play(self)) {
+        g_mutex_unlock(&priv->lock);
         return FALSE;
     }
+    priv->play_count = 1;
+    priv->running = TRUE;
+    g_mutex_unlock(&priv->lock);
 
     g_signal_emit(self, skyway_app_sink_proxy_signals[SIGNAL_START_PLAYING], 0);
     return TRUE;
 }
 
 void skyway_app_sink_proxy_stop(SkywayAppSinkProxy *self) {
+    SkywayAppSinkProxyPrivate *priv = skyway_app_sink_proxy_get_instance_private(self);
     SkywayAppSinkProxyClass *klass = SKYWAY_APP_SINK_PROXY_GET_CLASS(self);
+
+    g_mutex_lock(&priv->lock);
+    // A stop while nobody plays is an explicit shutdown and does not linger
+    gboolean released = priv->play_count > 0;
+    if ((released && --priv->play_count > 0) || !priv->running) {
+        g_mutex_unlock(&priv->lock);
+        return;
+    }
+
+    if (released && priv->linger_seconds != 0) {
+        schedule_linger(self, priv);
+        g_mutex_unlock(&priv->lock);
+        return;
+    }
+
+    cancel_linger(priv);
     klass->stop(self);
+    priv->running = FALSE;
+    g_mutex_unlock(&priv->lock);
+
     g_signal_emit(self, skyway_app_sink_proxy_signals[SIGNAL_STOP_PLAYING], 0);
 }
 
+void skyway_app_sink_proxy_set_linger(SkywayAppSinkProxy *self, gint seconds) {
+    SkywayAppSinkProxyPrivate *priv = skyway_app_sink_proxy_get_instance_private(self);
+    SkywayAppSinkProxyClass *klass = SKYWAY_APP_SINK_PROXY_GET_CLASS(self);
+    gboolean started = FALSE;
+    gboolean stopped = FALSE;
+
+    g_mutex_lock(&priv->lock);
+    priv->linger_seconds = seconds;
+    cancel_linger(priv);
+
+    if (seconds == SKYWAY_LINGER_ALWAYS_ON && !priv->running) {
+        started = priv->running = klass->play(self);
+        if (!started) {
+            g_printerr("Failed to start always-on stream\n");
+        }
+    } else if (priv->running && priv->play_count == 0) {
+        if (seconds > 0) {
+            schedule_linger(self, priv);
+        } else if (seconds == 0) {
+            klass->stop(self);
+            priv->running = FALSE;
+            stopped = TRUE;
+        }
+    }
+    g_mutex_unlock(&priv->lock);
+
+    if (started) {
+        g_signal_emit(self, skyway_app_sink_proxy_signals[SIGNAL_START_PLAYING], 0);
+    }
+
+    if (stopped) {
+        g_signal_emit(self, skyway_app_sink_proxy_signals[SIGNAL_STOP_PLAYING], 0);
+    }
+}
+
+static void schedule_linger(SkywayAppSinkProxy *self, SkywayAppSinkProxyPrivate *priv) {
+    if (priv->linger_seconds <= 0 || priv->linger_source) {
+        return;
+    }
+
+    priv->linger_source = g_timeout_add_seconds_full(G_PRIORITY_DEFAULT,
+                                                      (guint) priv->linger_seconds,
+                                                      (GSourceFunc) linger_timeout,
+                                                      g_object_ref(self), g_object_unref);
+}
+
+static void cancel_linger(SkywayAppSinkProxyPrivate *priv) {
+    if (priv->linger_source) {
+        g_source_remove(priv->linger_source);
+        priv->linger_source = 0;
+    }
+}
+
+static gboolean linger_timeout(SkywayAppSinkProxy *self) {
+    SkywayAppSinkProxyPrivate *priv = skyway_app_sink_proxy_get_instance_private(self);
+    SkywayAppSinkProxyClass *klass = SKYWAY_APP_SINK_PROXY_GET_CLASS(self);
+
+    g_mutex_lock(&priv->lock);
+    // A client may have come back (and cancelled us) while we were waiting for the lock
+    gboolean expired = priv->linger_source == g_source_get_id(g_main_current_source()) &&
+                       priv->running && priv->play_count == 0;
+    if (expired) {
+        priv->linger_source = 0;
+        klass->stop(self);
+        priv->running = FALSE;
+    }
+    g_mutex_unlock(&priv->lock);
+
+    if (expired) {
+        g_print("Linger time elapsed, stopping idle stream\n");
+        g_signal_emit(self, skyway_app_sink_proxy_signals[SIGNAL_STOP_PLAYING], 0);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
 static gboolean default_play(__attribute__ ((unused)) SkywayAppSinkProxy *self) {
     return TRUE;
 }
 
 static void default_stop(__attribute__ ((unused)) SkywayAppSinkProxy *self) {}
 
+/*
+ * Pulls the pending sample once and hands it to every "new-sample" handler, so that several
+ * consumers can share one proxy without stealing samples from each other.
+ */
 GstFlowReturn skyway_app_sink_proxy_emit_new_sample(SkywayAppSinkProxy *self) {
-    GstFlowReturn ret;
-    g_signal_emit(self, skyway_app_sink_proxy_signals[SIGNAL_NEW_SAMPLE], 0, &ret);
+    GstSample *sample = NULL;
+    g_signal_emit(self, skyway_app_sink_proxy_signals[SIGNAL_PULL_SAMPLE], 0, &sample);
+    if (!sample) {
+        return GST_FLOW_ERROR;
+    }
+
+    GstFlowReturn ret = skyway_app_sink_proxy_emit_sample(self, sample);
+    gst_sample_unref(sample);
     return ret;
 }
 
+void skyway_app_sink_proxy_set_memory_budget(SkywayAppSinkProxy *self, SkywayMemoryBudget *budget) {
+    SkywayAppSinkProxyPrivate *priv = skyway_app_sink_proxy_get_instance_private(self);
+    g_clear_pointer(&priv->budget, skyway_memory_budget_unref);
+    priv->budget = budget ? skyway_memory_budget_ref(budget) : NULL;
+}
+
+void skyway_app_sink_proxy_set_priority(SkywayAppSinkProxy *self, SkywayStreamPriority priority) {
+    SkywayAppSinkProxyPrivate *priv = skyway_app_sink_proxy_get_instance_private(self);
+    g_atomic_int_set(&priv->priority, priority);
+}
+
+gboolean skyway_buffer_is_random_access_point(GstBuffer *buffer) {
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        return FALSE;
+    }
+
+    SkywayH265AccessUnitInfo info;
+    gboolean parsed = skyway_h265_parse_access_unit(map.data, map.size, &info);
+    gst_buffer_unmap(buffer, &map);
+
+    if (!parsed) {
+        return !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    }
+    return info.has_irap;
+}
+
+gboolean skyway_rtp_buffer_is_random_access_point(GstBuffer *buffer) {
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+    if (!gst_rtp_buffer_map(buffer, GST_MAP_READ, &rtp)) {
+        return FALSE;
+    }
+
+    gboolean random_access = skyway_h265_rtp_payload_is_random_access_point(
+            gst_rtp_buffer_get_payload(&rtp), gst_rtp_buffer_get_payload_len(&rtp));
+    gst_rtp_buffer_unmap(&rtp);
+    return random_access;
+}
+
+gboolean skyway_sample_is_random_access_point(GstSample *sample) {
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    if (!buffer) {
+        return FALSE;
+    }
+
+    // Passthrough relays emit single RTP packets rather than access units
+    GstCaps *caps = gst_sample_get_caps(sample);
+    if (caps && !gst_caps_is_empty(caps) &&
+        gst_structure_has_name(gst_caps_get_structure(caps, 0), "application/x-rtp")) {
+        return skyway_rtp_buffer_is_random_access_point(buffer);
+    }
+    return skyway_buffer_is_random_access_point(buffer);
+}
+
+static gboolean admit_sample(SkywayAppSinkProxyPrivate *priv, GstSample *sample) {
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    if (!priv->budget || !buffer) {
+        return TRUE;
+    }
+
+    // Once a frame was shed the following ones reference it, so only resume on a fresh start
+    if (priv->shedding && !skyway_sample_is_random_access_point(sample)) {
+        skyway_memory_budget_count_shed(priv->budget);
+        g_atomic_int_inc(&priv->dropped_samples);
+        return FALSE;
+    }
+
+    if (!skyway_memory_budget_admit(priv->budget, buffer,
+                                    (SkywayStreamPriority) g_atomic_int_get(&priv->priority))) {
+        if (!priv->shedding) {
+            g_print("Memory budget exhausted, shedding frames until the next IRAP\n");
+        }
+        priv->shedding = TRUE;
+        skyway_memory_budget_count_shed(priv->budget);
+        g_atomic_int_inc(&priv->dropped_samples);
+        return FALSE;
+    }
+
+    priv->shedding = FALSE;
+    return TRUE;
+}
+
+GstFlowReturn skyway_app_sink_proxy_emit_sample(SkywayAppSinkProxy *self, GstSample *sample) {
+    SkywayAppSinkProxyPrivate *priv = skyway_app_sink_proxy_get_instance_private(self);
+    if (!admit_sample(priv, sample)) {
+        return GST_FLOW_OK;
+    }
+
+    priv->emit_depth = 0;
+    priv->emit_dropped = FALSE;
+    GstFlowReturn ret = GST_FLOW_OK;
+    g_signal_emit(self, skyway_app_sink_proxy_signals[SIGNAL_NEW_SAMPLE], 0, sample, &ret);
+
+    g_atomic_int_set(&priv->queue_depth, (gint) priv->emit_depth);
+    if (priv->emit_dropped) {
+        g_atomic_int_inc(&priv->dropped_samples);
+    }
+    return ret;
+}
+
+void skyway_app_sink_proxy_report_queue(SkywayAppSinkProxy *self, guint depth, gboolean dropped) {
+    SkywayAppSinkProxyPrivate *priv = skyway_app_sink_proxy_get_instance_private(self);
+    priv->emit_depth = MAX(priv->emit_depth, depth);
+    priv->emit_dropped = priv->emit_dropped || dropped;
+}
+
+void skyway_app_sink_proxy_get_backpressure(SkywayAppSinkProxy *self,
+                                            SkywayBackpressure *backpressure) {
+    SkywayAppSinkProxyPrivate *priv = skyway_app_sink_proxy_get_instance_private(self);
+    backpressure->queue_depth = (guint) g_atomic_int_get(&priv->queue_depth);
+    backpressure->dropped_samples = (guint) g_atomic_int_get(&priv->dropped_samples);
+}
+
 void skyway_app_sink_proxy_emit_eos(SkywayAppSinkProxy *self) {
     g_signal_emit(self, skyway_app_sink_proxy_signals[SIGNAL_EOS], 0);
 }
@@ -5,10 +5,21 @@
 #include <glib-object.h>
 #include <gst/gst.h>
 
+#include "memory_budget.h"
+
 G_BEGIN_DECLS
 
 #define SKYWAY_TYPE_APP_SINK_PROXY (skyway_app_sink_proxy_get_type())
 
+#define SKYWAY_LINGER_ALWAYS_ON (-1)
+
+typedef struct _SkywayBackpressure {
+    // Samples queued by the most backed up consumer, after taking the last one
+    guint queue_depth;
+    // Samples dropped so far, shed for the memory budget or pushed out of a full consumer queue
+    guint dropped_samples;
+} SkywayBackpressure;
+
 G_DECLARE_DERIVABLE_TYPE(SkywayAppSinkProxy, skyway_app_sink_proxy, SKYWAY, APP_SINK_PROXY, GObject)
 
 GType skyway_app_sink_proxy_get_type(void);
@@ -19,7 +30,7 @@ typedef struct _SkywayAppSinkProxyClass {
     // signals
     void (*eos)(SkywayAppSinkProxy *skyway_app_sink_proxy);
 
-    GstFlowReturn (*new_sample)(SkywayAppSinkProxy *skyway_app_sink_proxy);
+    GstFlowReturn (*new_sample)(SkywayAppSinkProxy *skyway_app_sink_proxy, GstSample *sample);
 
     void (*start_playing)(SkywayAppSinkProxy *skyway_app_sink_proxy);
 
@@ -40,10 +51,52 @@ gboolean skyway_app_sink_proxy_play(SkywayAppSinkProxy *self);
 
 void skyway_app_sink_proxy_stop(SkywayAppSinkProxy *self);
 
+/*
+ * Keeps the proxy running for the given number of seconds after its last consumer stopped,
+ * or forever with SKYWAY_LINGER_ALWAYS_ON (which also starts it right away). 0 stops at once.
+ */
+void skyway_app_sink_proxy_set_linger(SkywayAppSinkProxy *self, gint seconds);
+
+/*
+ * Samples emitted from now on are charged against the budget. When the budget is short for the
+ * proxy's priority, samples are dropped until the next IRAP frame fits again.
+ */
+void skyway_app_sink_proxy_set_memory_budget(SkywayAppSinkProxy *self, SkywayMemoryBudget *budget);
+
+void skyway_app_sink_proxy_set_priority(SkywayAppSinkProxy *self, SkywayStreamPriority priority);
+
+/*
+ * Whether decoding can start at this access unit: an IRAP picture when the buffer is Annex-B,
+ * otherwise whatever the buffer flags say.
+ */
+gboolean skyway_buffer_is_random_access_point(GstBuffer *buffer);
+
+/*
+ * Whether decoding can start at this RTP packet of an H.265 stream, as relayed by passthrough
+ * streams: the start of an IRAP picture or the parameter sets ahead of it.
+ */
+gboolean skyway_rtp_buffer_is_random_access_point(GstBuffer *buffer);
+
+/*
+ * Either of the above, depending on whether the sample's caps are RTP.
+ */
+gboolean skyway_sample_is_random_access_point(GstSample *sample);
+
 GstFlowReturn skyway_app_sink_proxy_emit_new_sample(SkywayAppSinkProxy *self);
 
+GstFlowReturn skyway_app_sink_proxy_emit_sample(SkywayAppSinkProxy *self, GstSample *sample);
+
 void skyway_app_sink_proxy_emit_eos(SkywayAppSinkProxy *self);
 
+/*
+ * For "new-sample" handlers: how many samples the consumer holds queued after taking this one,
+ * and whether taking it pushed an older one out.
+ */
+void skyway_app_sink_proxy_report_queue(SkywayAppSinkProxy *self, guint depth, gboolean dropped);
+
+void skyway_app_sink_proxy_get_backpressure(SkywayAppSinkProxy *self,
+                                            SkywayBackpressure *backpressure);
+
 G_END_DECLS
 
 #endif // SKYWAY_APPSINK_PROXY_H
@@ -3,6 +3,9 @@
 #include <gst/rtsp-server/rtsp-server.h>
 
 #include "appsrc_factory.h"
+#include "capture_time.h"
+#include "rtspsrc_to_sink.h"
+#include "startup.h"
 
 G_DEFINE_TYPE(AppRtspMedia, app_rtsp_media, GST_TYPE_RTSP_MEDIA)
 
@@ -12,18 +15,71 @@ static gboolean (*default_prepare)(GstRTSPMedia *, GstRTSPThread *);
 
 static gboolean (*default_unprepare)(GstRTSPMedia *);
 
-static GstFlowReturn new_sample_handler(SkywayAppSinkProxy *sink, AppRtspMedia *media);
+static gboolean (*default_setup_sdp)(GstRTSPMedia *, GstSDPMessage *, GstSDPInfo *);
+
+struct _AppSdpCache {
+    GMutex lock;
+    // Caps of every stream and server address the SDP was made for
+    gchar *key;
+    // Only what setup_sdp added to the message: the session attributes and the media sections
+    GstSDPMessage *sdp;
+};
+
+typedef struct _BudgetProbe {
+    GstPad *pad;
+    gulong id;
+} BudgetProbe;
+
+static GstFlowReturn
+new_sample_handler(SkywayAppSinkProxy *sink, GstSample *sample, AppRtspMedia *media);
 
 static void eos_handler(__attribute__ ((unused)) SkywayAppSinkProxy *src, GstAppSrc *appsrc);
 
+static GstPadProbeReturn
+charge_packets_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info,
+                     SkywayMemoryBudget *budget);
+
+static gboolean charge_packet(GstBuffer **buffer, __attribute__ ((unused)) guint idx,
+                              SkywayMemoryBudget *budget);
+
+static void charge_element(const GValue *value, AppRtspMedia *self);
+
+static gboolean charge_pad(__attribute__ ((unused)) GstElement *element, GstPad *pad,
+                           AppRtspMedia *self);
+
+static void budget_probe_free(BudgetProbe *probe);
+
+static GstPadProbeReturn
+admit_frames_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info,
+                   AppRtspMedia *self);
+
+static GstPadProbeReturn
+count_packets_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info,
+                    SkywayMountLoad *load);
+
 static gboolean custom_media_prepare(GstRTSPMedia *media, GstRTSPThread *thread);
 
 static gboolean custom_media_unprepare(GstRTSPMedia *media);
 
+static void custom_media_prepared(GstRTSPMedia *media);
+
+static gboolean custom_media_setup_sdp(GstRTSPMedia *media, GstSDPMessage *sdp, GstSDPInfo *info);
+
+static gchar *sdp_cache_key(GstRTSPMedia *media, GstSDPInfo *info);
+
+static void append_sdp(GstSDPMessage *to, const GstSDPMessage *from, guint first_attribute,
+                       guint first_media);
+
+static void sdp_cache_clear(AppSdpCache *cache);
+
 static void app_rtsp_media_init(__attribute__ ((unused)) AppRtspMedia *media);
 
 static void app_rtsp_media_class_init(AppRtspMediaClass *klass);
 
+static void app_rtsp_media_finalize(GObject *object);
+
+static void app_src_factory_finalize(GObject *object);
+
 static GstRTSPMedia *app_src_factory_construct(GstRTSPMediaFactory *factory, const GstRTSPUrl *url);
 
 static GstElement *extract_element_by_name(GstRTSPMedia *media, const gchar *name);
@@ -74,10 +130,9 @@ static GstElement *extract_element_by_name(GstRTSPMedia *media, const gchar *nam
     return candidate_src;
 }
 
-static GstFlowReturn new_sample_handler(SkywayAppSinkProxy *sink, AppRtspMedia *media) {
-    GstSample *sample;
-    g_signal_emit_by_name(sink, "pull-sample", &sample);
-
+static GstFlowReturn
+new_sample_handler(__attribute__ ((unused)) SkywayAppSinkProxy *sink, GstSample *sample,
+                   AppRtspMedia *media) {
     if (sample) {
         if (!GST_IS_RTSP_MEDIA(&media->parent)) {
             g_printerr("Media invalid, disconnecting signal\n");
@@ -90,9 +145,23 @@ static GstFlowReturn new_sample_handler(SkywayAppSinkProxy *sink, AppRtspMedia *
             return GST_FLOW_ERROR;
         }
 
-        gst_app_src_push_sample(appsrc, sample);
-        gst_sample_unref(sample);
+        // A full appsrc refuses frames until decoding can start again: any frame dropped
+        // mid-GOP corrupts the ones referencing it up to the next IRAP
+        guint64 max_buffers = gst_app_src_get_max_buffers(appsrc);
+        guint64 level = gst_app_src_get_current_level_buffers(appsrc);
+        if ((max_buffers && level >= max_buffers) ||
+            (media->shedding && !skyway_sample_is_random_access_point(sample))) {
+            media->shedding = TRUE;
+            skyway_app_sink_proxy_report_queue(media->appsink, (guint) level, TRUE);
+            return GST_FLOW_OK;
+        }
+        media->shedding = FALSE;
 
+        // The proxy may feed other media as well, their state must not stop the upstream
+        gst_app_src_push_sample(appsrc, sample);
+        skyway_app_sink_proxy_report_queue(media->appsink,
+                                           (guint) gst_app_src_get_current_level_buffers(appsrc),
+                                           FALSE);
         return GST_FLOW_OK;
     }
 
@@ -103,6 +172,92 @@ static void eos_handler(__attribute__ ((unused)) SkywayAppSinkProxy *src, GstApp
     gst_element_send_event(GST_ELEMENT(appsrc), gst_event_new_eos());
 }
 
+static gboolean charge_packet(GstBuffer **buffer, __attribute__ ((unused)) guint idx,
+                              SkywayMemoryBudget *budget) {
+    skyway_memory_budget_charge(budget, *buffer);
+    return TRUE;
+}
+
+/*
+ * Buffers past admission cannot be refused anymore, but they count: queues and stalled clients'
+ * backlogs hold them, which makes the ingest shed frames instead.
+ */
+static GstPadProbeReturn
+charge_packets_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info,
+                     SkywayMemoryBudget *budget) {
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+        skyway_memory_budget_charge(budget, GST_PAD_PROBE_INFO_BUFFER(info));
+    } else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        gst_buffer_list_foreach(GST_PAD_PROBE_INFO_BUFFER_LIST(info),
+                                (GstBufferListFunc) charge_packet, budget);
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+/*
+ * What the proxy does for the frames it emits, for those a direct relay feeds pay0 with: a
+ * refused frame (or packet of one) sheds the following ones until decoding can start again.
+ */
+static GstPadProbeReturn
+admit_frames_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info,
+                   AppRtspMedia *self) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    if (self->shedding && !(self->passthrough ? skyway_rtp_buffer_is_random_access_point(buffer)
+                                              : skyway_buffer_is_random_access_point(buffer))) {
+        skyway_memory_budget_count_shed(self->budget);
+        return GST_PAD_PROBE_DROP;
+    }
+
+    // Direct relays have no priority of their own
+    if (!skyway_memory_budget_admit(self->budget, buffer, SKYWAY_PRIORITY_NORMAL)) {
+        if (!self->shedding) {
+            g_print("Memory budget exhausted, shedding relayed frames until the next IRAP\n");
+        }
+        self->shedding = TRUE;
+        skyway_memory_budget_count_shed(self->budget);
+        return GST_PAD_PROBE_DROP;
+    }
+
+    self->shedding = FALSE;
+    return GST_PAD_PROBE_OK;
+}
+
+/*
+ * Charges what leaves each element, i.e. what the next one queues: the appsrc's queue and its
+ * copies of pushed frames, the launch queue, the parsed frames and the packets.
+ */
+static void charge_element(const GValue *value, AppRtspMedia *self) {
+    gst_element_foreach_src_pad(g_value_get_object(value), (GstElementForeachPadFunc) charge_pad,
+                                self);
+}
+
+static gboolean charge_pad(__attribute__ ((unused)) GstElement *element, GstPad *pad,
+                           AppRtspMedia *self) {
+    BudgetProbe *probe = g_new(BudgetProbe, 1);
+    probe->pad = gst_object_ref(pad);
+    probe->id = gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                                  (GstPadProbeCallback) charge_packets_probe,
+                                  skyway_memory_budget_ref(self->budget),
+                                  (GDestroyNotify) skyway_memory_budget_unref);
+    self->budget_probes = g_slist_prepend(self->budget_probes, probe);
+    return TRUE;
+}
+
+static void budget_probe_free(BudgetProbe *probe) {
+    gst_pad_remove_probe(probe->pad, probe->id);
+    gst_object_unref(probe->pad);
+    g_free(probe);
+}
+
+static GstPadProbeReturn
+count_packets_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info,
+                    SkywayMountLoad *load) {
+    skyway_mount_load_count(load, GST_PAD_PROBE_INFO_DATA(info));
+    return GST_PAD_PROBE_OK;
+}
+
 static gboolean custom_media_prepare(GstRTSPMedia *media, GstRTSPThread *thread) {
     if (!default_prepare(media, thread)) {
         g_printerr("Default prepare() failed!\n");
@@ -111,39 +266,201 @@ static gboolean custom_media_prepare(GstRTSPMedia *media, GstRTSPThread *thread)
 
     AppRtspMedia *self = APP_RTSP_MEDIA(media);
 
-    if (!skyway_app_sink_proxy_play(self->appsink)) {
-        custom_media_unprepare(media);
-        return FALSE;
-    }
+    // A direct relay streams from its own rtspsrc, prepared with the rest of the pipeline
+    if (self->appsink) {
+        if (!skyway_app_sink_proxy_play(self->appsink)) {
+            custom_media_unprepare(media);
+            return FALSE;
+        }
+
+        self->new_sample_handle = g_signal_connect(self->appsink, "new-sample",
+                                                   G_CALLBACK(new_sample_handler), self);
 
-    self->new_sample_handle = g_signal_connect(self->appsink, "new-sample",
-                                               G_CALLBACK(new_sample_handler), self);
+        GstAppSrc *app_src = GST_APP_SRC(extract_element_by_name(media, "appsrc"));
+        if (!app_src) {
+            g_printerr("No appsrc found in media!\n");
+        }
 
-    GstAppSrc *app_src = GST_APP_SRC(extract_element_by_name(media, "appsrc"));
-    if (!app_src) {
-        g_printerr("No appsrc found in media!\n");
+        // Bounds the frames new_sample_handler queues. Passthrough media cannot count frames
+        // in packets, the proxy's budget bounds them instead.
+        if (!self->passthrough) {
+            g_object_set(app_src, "max-buffers", 5, NULL);
+        }
+
+        self->eos_handle = g_signal_connect(self->appsink, "eos", G_CALLBACK(eos_handler),
+                                            app_src);
     }
 
-    gst_app_src_set_leaky_type(app_src, GST_APP_LEAKY_TYPE_NONE);
-    g_object_set(app_src, "max-buffers", 5, NULL);
+    GstElement *element = gst_rtsp_media_get_element(media);
+    GstElement *payloader = gst_bin_get_by_name(GST_BIN(element), "pay0");
+    if (payloader) {
+        if (self->monitor) {
+            self->monitor_probe = skyway_client_monitor_attach_media(self->monitor, media,
+                                                                     payloader);
+        }
+
+        if (self->budget && !self->appsink) {
+            self->admit_pad = gst_element_get_static_pad(payloader, "sink");
+            self->admit_probe = gst_pad_add_probe(self->admit_pad, GST_PAD_PROBE_TYPE_BUFFER,
+                                                  (GstPadProbeCallback) admit_frames_probe, self,
+                                                  NULL);
+        }
+
+        if (self->budget) {
+            GstIterator *elements = gst_bin_iterate_elements(GST_BIN(element));
+            gst_iterator_foreach(elements, (GstIteratorForeachFunction) charge_element, self);
+            gst_iterator_free(elements);
+        }
+
+        if (self->load) {
+            self->load_pad = gst_element_get_static_pad(payloader, "src");
+            self->load_probe = gst_pad_add_probe(self->load_pad,
+                                                 GST_PAD_PROBE_TYPE_BUFFER |
+                                                 GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                                                 (GstPadProbeCallback) count_packets_probe,
+                                                 skyway_mount_load_ref(self->load),
+                                                 (GDestroyNotify) skyway_mount_load_unref);
+        }
+        gst_object_unref(payloader);
+    }
+    g_object_unref(element);
 
-    self->eos_handle = g_signal_connect(self->appsink, "eos", G_CALLBACK(eos_handler), app_src);
     return TRUE;
 }
 
 static gboolean custom_media_unprepare(GstRTSPMedia *media) {
     AppRtspMedia *self = APP_RTSP_MEDIA(media);
 
-    skyway_app_sink_proxy_stop(self->appsink);
-    g_signal_handler_disconnect(self->appsink, self->new_sample_handle);
-    g_signal_handler_disconnect(self->appsink, self->eos_handle);
+    if (self->appsink) {
+        skyway_app_sink_proxy_stop(self->appsink);
+        g_signal_handler_disconnect(self->appsink, self->new_sample_handle);
+        g_signal_handler_disconnect(self->appsink, self->eos_handle);
+    }
+
+    gboolean ret = default_unprepare(media);
+
+    // The pipeline is stopped now, no streaming thread can be inside the monitor probes
+    if (self->monitor_probe) {
+        skyway_client_monitor_detach_media(self->monitor, self->monitor_probe);
+        self->monitor_probe = NULL;
+    }
 
-    return default_unprepare(media);
+    if (self->admit_pad) {
+        gst_pad_remove_probe(self->admit_pad, self->admit_probe);
+        gst_clear_object(&self->admit_pad);
+        self->admit_probe = 0;
+    }
+
+    g_slist_free_full(self->budget_probes, (GDestroyNotify) budget_probe_free);
+    self->budget_probes = NULL;
+    self->shedding = FALSE;
+
+    if (self->load_pad) {
+        gst_pad_remove_probe(self->load_pad, self->load_probe);
+        gst_clear_object(&self->load_pad);
+        self->load_probe = 0;
+    }
+
+    return ret;
+}
+
+static void custom_media_prepared(__attribute__ ((unused)) GstRTSPMedia *media) {
+    skyway_startup_mark(SKYWAY_STARTUP_FIRST_MEDIA_PREPARED);
+}
+
+static gchar *sdp_cache_key(GstRTSPMedia *media, GstSDPInfo *info) {
+    GString *key = g_string_new(NULL);
+    g_string_append_printf(key, "%s %d", info->server_ip ? info->server_ip : "", info->is_ipv6);
+
+    for (guint i = 0; i < gst_rtsp_media_n_streams(media); i++) {
+        GstCaps *caps = gst_rtsp_stream_get_caps(gst_rtsp_media_get_stream(media, i));
+        if (!caps) {
+            g_string_free(key, TRUE);
+            return NULL;
+        }
+
+        gchar *caps_str = gst_caps_to_string(caps);
+        g_string_append_printf(key, "\n%s", caps_str);
+        g_free(caps_str);
+        gst_caps_unref(caps);
+    }
+
+    return g_string_free(key, FALSE);
+}
+
+static void append_sdp(GstSDPMessage *to, const GstSDPMessage *from, guint first_attribute,
+                       guint first_media) {
+    for (guint i = first_attribute; i < gst_sdp_message_attributes_len(from); i++) {
+        const GstSDPAttribute *attribute = gst_sdp_message_get_attribute(from, i);
+        gst_sdp_message_add_attribute(to, attribute->key, attribute->value);
+    }
+
+    for (guint i = first_media; i < gst_sdp_message_medias_len(from); i++) {
+        GstSDPMedia *copy = NULL;
+        gst_sdp_media_copy(gst_sdp_message_get_media(from, i), &copy);
+        // The message takes over the contents, not the struct
+        gst_sdp_message_add_media(to, copy);
+        g_free(copy);
+    }
+}
+
+/*
+ * Polling clients (NVRs, health checks) DESCRIBE over and over a media whose caps did not
+ * change, so its part of the SDP is only made again when they do.
+ */
+static gboolean custom_media_setup_sdp(GstRTSPMedia *media, GstSDPMessage *sdp, GstSDPInfo *info) {
+    AppSdpCache *cache = APP_RTSP_MEDIA(media)->sdp_cache;
+    gchar *key = sdp_cache_key(media, info);
+    if (!key) {
+        return default_setup_sdp(media, sdp, info);
+    }
+
+    g_mutex_lock(&cache->lock);
+    if (g_strcmp0(cache->key, key) == 0) {
+        append_sdp(sdp, cache->sdp, 0, 0);
+        g_mutex_unlock(&cache->lock);
+        g_free(key);
+        return TRUE;
+    }
+    g_mutex_unlock(&cache->lock);
+
+    guint first_attribute = gst_sdp_message_attributes_len(sdp);
+    guint first_media = gst_sdp_message_medias_len(sdp);
+    if (!default_setup_sdp(media, sdp, info)) {
+        g_free(key);
+        return FALSE;
+    }
+
+    GstSDPMessage *added = NULL;
+    gst_sdp_message_new(&added);
+    append_sdp(added, sdp, first_attribute, first_media);
+
+    g_mutex_lock(&cache->lock);
+    g_free(cache->key);
+    cache->key = key;
+    if (cache->sdp) {
+        gst_sdp_message_free(cache->sdp);
+    }
+    cache->sdp = added;
+    g_mutex_unlock(&cache->lock);
+
+    return TRUE;
+}
+
+static void sdp_cache_clear(AppSdpCache *cache) {
+    g_free(cache->key);
+    if (cache->sdp) {
+        gst_sdp_message_free(cache->sdp);
+    }
+    g_mutex_clear(&cache->lock);
 }
 
 static void app_rtsp_media_init(__attribute__ ((unused)) AppRtspMedia *media) {}
 
 static void app_rtsp_media_class_init(AppRtspMediaClass *klass) {
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    object_class->finalize = app_rtsp_media_finalize;
+
     GstRTSPMediaClass *parent_klass = GST_RTSP_MEDIA_CLASS(klass);
     if (!default_prepare) {
         default_prepare = parent_klass->prepare;
@@ -154,19 +471,78 @@ static void app_rtsp_media_class_init(AppRtspMediaClass *klass) {
         default_unprepare = parent_klass->unprepare;
     }
     parent_klass->unprepare = custom_media_unprepare;
+    parent_klass->prepared = custom_media_prepared;
+
+    if (!default_setup_sdp) {
+        default_setup_sdp = parent_klass->setup_sdp;
+    }
+    parent_klass->setup_sdp = custom_media_setup_sdp;
+}
+
+static void app_rtsp_media_finalize(GObject *object) {
+    g_clear_object(&APP_RTSP_MEDIA(object)->appsink);
+    if (APP_RTSP_MEDIA(object)->sdp_cache) {
+        g_atomic_rc_box_release_full(APP_RTSP_MEDIA(object)->sdp_cache,
+                                     (GDestroyNotify) sdp_cache_clear);
+    }
+    g_clear_pointer(&APP_RTSP_MEDIA(object)->load, skyway_mount_load_unref);
+
+    G_OBJECT_CLASS (app_rtsp_media_parent_class)->finalize(object);
 }
 
 static void app_src_factory_class_init(AppSrcFactoryClass *klass) {
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    object_class->finalize = app_src_factory_finalize;
+
     GstRTSPMediaFactoryClass *mf_class = GST_RTSP_MEDIA_FACTORY_CLASS(klass);
     mf_class->construct = app_src_factory_construct;
 }
 
-static void app_src_factory_init(__attribute__ ((unused)) AppSrcFactory *factory) {}
+static void app_src_factory_init(AppSrcFactory *factory) {
+    factory->sdp_cache = g_atomic_rc_box_new0(AppSdpCache);
+    g_mutex_init(&factory->sdp_cache->lock);
+    factory->load = skyway_mount_load_new();
+}
+
+static void app_src_factory_finalize(GObject *object) {
+    g_clear_object(&APP_SRC_FACTORY(object)->appsink);
+    g_free(APP_SRC_FACTORY(object)->relay_location);
+    gst_clear_object(&APP_SRC_FACTORY(object)->spare_element);
+    g_atomic_rc_box_release_full(APP_SRC_FACTORY(object)->sdp_cache,
+                                 (GDestroyNotify) sdp_cache_clear);
+    skyway_mount_load_unref(APP_SRC_FACTORY(object)->load);
+
+    G_OBJECT_CLASS (app_src_factory_parent_class)->finalize(object);
+}
 
 AppSrcFactory *app_src_factory_new() {
     return g_object_new(app_src_factory_get_type(), NULL);
 }
 
+void app_src_factory_prebuild(AppSrcFactory *factory) {
+    if (g_atomic_pointer_get(&factory->spare_element)) {
+        return;
+    }
+
+    skyway_startup_wait_for_plugins();
+
+    // The launch pipeline does not depend on the URL it is requested with
+    GstRTSPUrl *url = NULL;
+    gst_rtsp_url_parse("rtsp://127.0.0.1/", &url);
+    GstElement *element = gst_rtsp_media_factory_create_element(GST_RTSP_MEDIA_FACTORY(factory),
+                                                                url);
+    gst_rtsp_url_free(url);
+    if (!element) {
+        g_printerr("Could not prebuild element!\n");
+        return;
+    }
+
+    // Left floating, like a freshly parsed one, for the media to sink
+    if (!g_atomic_pointer_compare_and_exchange(&factory->spare_element, NULL, element)) {
+        gst_object_unref(element);
+    }
+}
+
 static GstRTSPMedia *
 app_src_factory_construct(GstRTSPMediaFactory *factory, const GstRTSPUrl *url) {
     GstRTSPMediaFactoryClass *klass = GST_RTSP_MEDIA_FACTORY_GET_CLASS(factory);
@@ -175,14 +551,44 @@ app_src_factory_construct(GstRTSPMediaFactory *factory, const GstRTSPUrl *url) {
         return NULL;
     }
 
-    GstElement *element = gst_rtsp_media_factory_create_element(factory, url);
+    GstElement *element = g_atomic_pointer_exchange(&APP_SRC_FACTORY(factory)->spare_element,
+                                                    NULL);
+    if (!element) {
+        skyway_startup_wait_for_plugins();
+        element = gst_rtsp_media_factory_create_element(factory, url);
+    }
     if (!element) {
         g_printerr("Could not create element!");
         return NULL;
     }
 
+    if (APP_SRC_FACTORY(factory)->relay_location) {
+        GstElement *relay_src = gst_bin_get_by_name(GST_BIN(element), "relaysrc");
+        if (relay_src) {
+            skyway_rtsp_src_configure(relay_src, APP_SRC_FACTORY(factory)->relay_location);
+            gst_object_unref(relay_src);
+        }
+    }
+
+    if (APP_SRC_FACTORY(factory)->capture_time) {
+        GstElement *pay = gst_bin_get_by_name(GST_BIN(element), "pay0");
+        if (pay) {
+            skyway_abs_capture_time_add_to(pay);
+            gst_object_unref(pay);
+        }
+    }
+
     AppRtspMedia *media = g_object_new(app_rtsp_media_get_type(), "element", element, NULL);
-    media->appsink = APP_SRC_FACTORY(factory)->appsink;
+    // The media may outlive its mount (and factory) while clients are still playing it
+    media->appsink = APP_SRC_FACTORY(factory)->appsink
+                     ? g_object_ref(APP_SRC_FACTORY(factory)->appsink) : NULL;
+    // Per-client thinning needs pay0 to payload whole frames
+    media->monitor = APP_SRC_FACTORY(factory)->passthrough ? NULL
+                                                           : APP_SRC_FACTORY(factory)->monitor;
+    media->budget = APP_SRC_FACTORY(factory)->budget;
+    media->passthrough = APP_SRC_FACTORY(factory)->passthrough;
+    media->sdp_cache = g_atomic_rc_box_acquire(APP_SRC_FACTORY(factory)->sdp_cache);
+    media->load = skyway_mount_load_ref(APP_SRC_FACTORY(factory)->load);
 
     gst_rtsp_media_collect_streams(GST_RTSP_MEDIA(media));
 
@@ -193,6 +599,12 @@ app_src_factory_construct(GstRTSPMediaFactory *factory, const GstRTSPUrl *url) {
         return NULL;
     }
 
-    gst_rtsp_media_set_reusable(GST_RTSP_MEDIA(media), FALSE);
+    // Before the media is prepared, i.e. before any of its streaming threads starts
+    if (APP_SRC_FACTORY(factory)->thread_policy) {
+        skyway_thread_policy_watch_pipeline(APP_SRC_FACTORY(factory)->thread_policy, pipeline);
+    }
+
+    // Stays in the factory across session cycles, to be prepared again instead of rebuilt
+    gst_rtsp_media_set_reusable(GST_RTSP_MEDIA(media), TRUE);
     return GST_RTSP_MEDIA(media);
 }
@@ -1,20 +1,59 @@
 #ifndef SKYWAY_APPSRC_FACTORY_H
 #define SKYWAY_APPSRC_FACTORY_H
 
+#include "admission.h"
 #include "appsink_proxy.h"
+#include "client_monitor.h"
+#include "memory_budget.h"
+#include "thread_policy.h"
 
 G_BEGIN_DECLS
 
+// The SDP of a mount, shared by its factory and the media it constructs
+typedef struct _AppSdpCache AppSdpCache;
+
 struct _AppRtspMedia {
     GstRTSPMedia parent;
     SkywayAppSinkProxy *appsink;
     gulong new_sample_handle;
     gulong eos_handle;
+    SkywayClientMonitor *monitor;
+    SkywayMediaProbe *monitor_probe;
+    SkywayMemoryBudget *budget;
+    // Charge probes on the src pads of every element in the pipeline
+    GSList *budget_probes;
+    // Admission of a direct relay's frames, which no proxy admits against the budget
+    GstPad *admit_pad;
+    gulong admit_probe;
+    // Frames are refused until the next random access point, by the admission of a direct
+    // relay or when the appsrc of other media is full
+    gboolean shedding;
+    gboolean passthrough;
+    AppSdpCache *sdp_cache;
+    SkywayMountLoad *load;
+    GstPad *load_pad;
+    gulong load_probe;
 };
 
 struct _AppSrcFactory {
     GstRTSPMediaFactory parent;
     SkywayAppSinkProxy *appsink;
+    SkywayClientMonitor *monitor;
+    SkywayMemoryBudget *budget;
+    AppSdpCache *sdp_cache;
+    // Egress of the mount, counted by the media for admission control
+    SkywayMountLoad *load;
+    SkywayThreadPolicy *thread_policy;
+    // Whether the payloader sends the abs-capture-time header extension
+    gboolean capture_time;
+    // Whether pay0 relays RTP packets as received instead of payloading access units: such
+    // media cannot be thinned per client nor leak, the budget sheds their packets by picture
+    gboolean passthrough;
+    // Upstream of a direct relay, whose rtspsrc (named relaysrc) is part of the launch pipeline
+    // instead of an appsink proxy feeding it
+    gchar *relay_location;
+    // Parsed launch pipeline for the next media, taken atomically by whoever constructs it
+    GstElement *spare_element;
 };
 
 G_DECLARE_FINAL_TYPE(AppRtspMedia, app_rtsp_media, APP_RTSP, MEDIA, GstRTSPMedia)
@@ -23,6 +62,13 @@ G_DECLARE_FINAL_TYPE(AppSrcFactory, app_src_factory, APP_SRC, FACTORY, GstRTSPMe
 
 AppSrcFactory *app_src_factory_new();
 
+/*
+ * Builds the pipeline of the next media from the launch string ahead of time, so that a
+ * DESCRIBE does not wait for it to be parsed. Media being reusable, later ones are rare and
+ * parsed when needed.
+ */
+void app_src_factory_prebuild(AppSrcFactory *factory);
+
 void app_src_push_buffer(AppSrcFactory *app_src_factory, GstBuffer *buffer);
 
 G_END_DECLS
@@ -0,0 +1,177 @@
+#include "capture_time.h"
+
+#include <gst/rtp/gstrtpbasepayload.h>
+
+// From 1900 to 1970
+#define NTP_UNIX_OFFSET (G_GUINT64_CONSTANT(2208988800) * GST_SECOND)
+
+// The capture timestamp alone, without the optional estimated capture clock offset
+#define ABS_CAPTURE_TIME_SIZE 8
+
+static GstStaticCaps ntp_reference = GST_STATIC_CAPS("timestamp/x-ntp");
+
+static GstStaticCaps unix_reference = GST_STATIC_CAPS("timestamp/x-unix");
+
+G_DEFINE_TYPE(SkywayAbsCaptureTime, skyway_abs_capture_time, GST_TYPE_RTP_HEADER_EXTENSION)
+
+static GstRTPHeaderExtensionFlags
+abs_capture_time_get_supported_flags(GstRTPHeaderExtension *ext);
+
+static gsize
+abs_capture_time_get_max_size(GstRTPHeaderExtension *ext, const GstBuffer *input_meta);
+
+static gssize
+abs_capture_time_write(GstRTPHeaderExtension *ext, const GstBuffer *input_meta,
+                       GstRTPHeaderExtensionFlags write_flags, GstBuffer *output, guint8 *data,
+                       gsize size);
+
+static gboolean
+abs_capture_time_read(GstRTPHeaderExtension *ext, GstRTPHeaderExtensionFlags read_flags,
+                      const guint8 *data, gsize size, GstBuffer *buffer);
+
+static guint64 ntp_to_fixed_point(guint64 ntp_time);
+
+static guint64 fixed_point_to_ntp(guint64 fixed_point);
+
+static void skyway_abs_capture_time_class_init(SkywayAbsCaptureTimeClass *klass) {
+    GstRTPHeaderExtensionClass *extension_class = GST_RTP_HEADER_EXTENSION_CLASS(klass);
+    extension_class->get_supported_flags = abs_capture_time_get_supported_flags;
+    extension_class->get_max_size = abs_capture_time_get_max_size;
+    extension_class->write = abs_capture_time_write;
+    extension_class->read = abs_capture_time_read;
+
+    gst_element_class_set_static_metadata(GST_ELEMENT_CLASS(klass), "Absolute capture time",
+                                          GST_RTP_HDREXT_ELEMENT_CLASS,
+                                          "Carries the NTP time frames were captured at",
+                                          "Sambaza");
+    gst_rtp_header_extension_class_set_uri(extension_class, SKYWAY_ABS_CAPTURE_TIME_URI);
+}
+
+static void skyway_abs_capture_time_init(__attribute__ ((unused)) SkywayAbsCaptureTime *self) {
+}
+
+gboolean skyway_abs_capture_time_register(void) {
+    // Ranked for depayloaders to find it by its URI when upstream negotiates it
+    return gst_element_register(NULL, "skywayabscapturetime", GST_RANK_MARGINAL,
+                                SKYWAY_TYPE_ABS_CAPTURE_TIME);
+}
+
+gboolean skyway_abs_capture_time_add_to(GstElement *payloader) {
+    if (!GST_IS_RTP_BASE_PAYLOAD(payloader)) {
+        return FALSE;
+    }
+
+    GstRTPHeaderExtension *extension = gst_object_ref_sink(
+            g_object_new(SKYWAY_TYPE_ABS_CAPTURE_TIME, NULL));
+    gst_rtp_header_extension_set_id(extension, SKYWAY_ABS_CAPTURE_TIME_ID);
+    // The payloader takes a reference of its own
+    g_signal_emit_by_name(payloader, "add-extension", extension);
+    gst_object_unref(extension);
+
+    return TRUE;
+}
+
+void skyway_capture_time_set(GstBuffer *buffer, gint64 unix_time_us) {
+    GstCaps *reference = gst_static_caps_get(&unix_reference);
+    gst_buffer_add_reference_timestamp_meta(buffer, reference,
+                                            (GstClockTime) unix_time_us * GST_USECOND,
+                                            GST_CLOCK_TIME_NONE);
+    gst_caps_unref(reference);
+}
+
+gboolean skyway_capture_time_get(GstBuffer *buffer, gint64 *unix_time_us) {
+    guint64 ntp_time;
+    if (!skyway_capture_time_get_ntp(buffer, &ntp_time) || ntp_time < NTP_UNIX_OFFSET) {
+        return FALSE;
+    }
+
+    *unix_time_us = (gint64) ((ntp_time - NTP_UNIX_OFFSET) / GST_USECOND);
+    return TRUE;
+}
+
+gboolean skyway_capture_time_get_ntp(GstBuffer *buffer, guint64 *ntp_time) {
+    GstCaps *reference = gst_static_caps_get(&ntp_reference);
+    GstReferenceTimestampMeta *meta = gst_buffer_get_reference_timestamp_meta(buffer, reference);
+    gst_caps_unref(reference);
+    if (meta) {
+        *ntp_time = meta->timestamp;
+        return TRUE;
+    }
+
+    reference = gst_static_caps_get(&unix_reference);
+    meta = gst_buffer_get_reference_timestamp_meta(buffer, reference);
+    gst_caps_unref(reference);
+    if (meta) {
+        *ntp_time = meta->timestamp + NTP_UNIX_OFFSET;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static GstRTPHeaderExtensionFlags
+abs_capture_time_get_supported_flags(__attribute__ ((unused)) GstRTPHeaderExtension *ext) {
+    return GST_RTP_HEADER_EXTENSION_ONE_BYTE | GST_RTP_HEADER_EXTENSION_TWO_BYTE;
+}
+
+static gsize
+abs_capture_time_get_max_size(__attribute__ ((unused)) GstRTPHeaderExtension *ext,
+                              __attribute__ ((unused)) const GstBuffer *input_meta) {
+    return ABS_CAPTURE_TIME_SIZE;
+}
+
+static gssize
+abs_capture_time_write(__attribute__ ((unused)) GstRTPHeaderExtension *ext,
+                       const GstBuffer *input_meta,
+                       __attribute__ ((unused)) GstRTPHeaderExtensionFlags write_flags,
+                       __attribute__ ((unused)) GstBuffer *output, guint8 *data, gsize size) {
+    guint64 ntp_time;
+    // Packets of frames captured at an unknown time go without the extension
+    if (!skyway_capture_time_get_ntp((GstBuffer *) input_meta, &ntp_time)) {
+        return 0;
+    }
+
+    if (size < ABS_CAPTURE_TIME_SIZE) {
+        return -1;
+    }
+
+    GST_WRITE_UINT64_BE(data, ntp_to_fixed_point(ntp_time));
+    return ABS_CAPTURE_TIME_SIZE;
+}
+
+static gboolean
+abs_capture_time_read(__attribute__ ((unused)) GstRTPHeaderExtension *ext,
+                      __attribute__ ((unused)) GstRTPHeaderExtensionFlags read_flags,
+                      const guint8 *data, gsize size, GstBuffer *buffer) {
+    // With or without the estimated capture clock offset, which we have no use for
+    if (size != ABS_CAPTURE_TIME_SIZE && size != 2 * ABS_CAPTURE_TIME_SIZE) {
+        return FALSE;
+    }
+
+    // Every packet of a frame carries it, the depayloaded frame needs it once
+    GstCaps *reference = gst_static_caps_get(&ntp_reference);
+    if (!gst_buffer_get_reference_timestamp_meta(buffer, reference)) {
+        gst_buffer_add_reference_timestamp_meta(buffer, reference,
+                                                fixed_point_to_ntp(GST_READ_UINT64_BE(data)),
+                                                GST_CLOCK_TIME_NONE);
+    }
+    gst_caps_unref(reference);
+
+    return TRUE;
+}
+
+/*
+ * To the 32.32 fixed point seconds of NTP timestamps, which wrap around in 2036.
+ */
+static guint64 ntp_to_fixed_point(guint64 ntp_time) {
+    guint64 seconds = ntp_time / GST_SECOND;
+    guint64 fraction = gst_util_uint64_scale(ntp_time % GST_SECOND, G_GUINT64_CONSTANT(1) << 32,
+                                             GST_SECOND);
+    return (seconds << 32) | fraction;
+}
+
+static guint64 fixed_point_to_ntp(guint64 fixed_point) {
+    return (fixed_point >> 32) * GST_SECOND +
+           gst_util_uint64_scale(fixed_point & G_MAXUINT32, GST_SECOND,
+                                 G_GUINT64_CONSTANT(1) << 32);
+}
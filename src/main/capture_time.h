@@ -0,0 +1,58 @@
+#ifndef SKYWAY_CAPTURE_TIME_H
+#define SKYWAY_CAPTURE_TIME_H
+
+#include <gst/gst.h>
+#include <gst/rtp/gstrtphdrext.h>
+
+G_BEGIN_DECLS
+
+#define SKYWAY_ABS_CAPTURE_TIME_URI "http://www.webrtc.org/experiments/rtp-hdrext/abs-capture-time"
+
+// The only extension our payloaders write
+#define SKYWAY_ABS_CAPTURE_TIME_ID 1
+
+#define SKYWAY_TYPE_ABS_CAPTURE_TIME (skyway_abs_capture_time_get_type())
+
+typedef struct _SkywayAbsCaptureTime {
+    GstRTPHeaderExtension parent;
+} SkywayAbsCaptureTime;
+
+G_DECLARE_FINAL_TYPE(SkywayAbsCaptureTime, skyway_abs_capture_time, SKYWAY, ABS_CAPTURE_TIME,
+                     GstRTPHeaderExtension)
+
+GType skyway_abs_capture_time_get_type(void);
+
+/*
+ * The abs-capture-time RTP header extension: the NTP time a frame was captured at, for clients
+ * to measure the latency of the whole chain. Written from the capture time of the payloaded
+ * buffers, read back into it by depayloaders negotiating the extension, e.g. those of a relay
+ * whose upstream sends it.
+ */
+gboolean skyway_abs_capture_time_register(void);
+
+/*
+ * Makes payloader (if it is a GstRTPBasePayload) send the extension, and announce it in its
+ * caps and so the SDP. To be called before the payloader negotiates.
+ */
+gboolean skyway_abs_capture_time_add_to(GstElement *payloader);
+
+/*
+ * Tags buffer as captured at unix_time_us (wall-clock, in microseconds since the Unix epoch).
+ */
+void skyway_capture_time_set(GstBuffer *buffer, gint64 unix_time_us);
+
+/*
+ * The capture time of buffer in microseconds since the Unix epoch, as skyway_capture_time_set()
+ * takes it, from either reference timestamp.
+ */
+gboolean skyway_capture_time_get(GstBuffer *buffer, gint64 *unix_time_us);
+
+/*
+ * The capture time of buffer in nanoseconds since the NTP epoch, from its NTP reference
+ * timestamp (e.g. from the RTCP sender reports of a relayed stream) or its Unix one.
+ */
+gboolean skyway_capture_time_get_ntp(GstBuffer *buffer, guint64 *ntp_time);
+
+G_END_DECLS
+
+#endif // SKYWAY_CAPTURE_TIME_H
@@ -0,0 +1,1396 @@
+#include "client_monitor.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/sockios.h>
+#include <linux/tcp.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/video/video.h>
+
+#include "h265_nal.h"
+
+#define POLL_INTERVAL_MS 1000
+
+#define BACKLOG_POLL_INTERVAL_MS 100
+
+// Drained enough to resume, when only a delay limit is set
+#define DRAINED_BYTES (64 * 1024)
+
+// At one mark per 20ms, the marks span more than 2 seconds of backlog
+#define BACKLOG_MARKS 128
+#define BACKLOG_MARK_INTERVAL_US (20 * G_TIME_SPAN_MILLISECOND)
+
+// Every interleaved packet is preceded by '$', the channel and its length
+#define INTERLEAVED_HEADER_SIZE 4
+
+// Loss is expressed in 1/256th, like rb-fractionlost
+#define CONGESTED_FRACTION_LOST 13
+#define SEVERE_FRACTION_LOST 51
+
+// rb-jitter is expressed in RTP clock units, i.e. 90kHz for video
+#define CONGESTED_JITTER (90 * 50)
+
+#define RECOVERY_REPORTS 3
+
+// The access units payloaded but not sent yet, the queues in between hold far fewer
+#define FRAME_MARKS 64
+
+// From the payloader through the session, tee and queues the server links after it
+#define MAX_SEND_PATH_DEPTH 16
+
+typedef enum {
+    FRAME_IRAP,
+    FRAME_REFERENCE,
+    FRAME_NON_REFERENCE
+} FrameKind;
+
+typedef struct _BacklogMark {
+    guint64 handed_bytes;
+    gint64 time;
+} BacklogMark;
+
+/*
+ * The RTSP connection of a TCP-interleaved client, which the transports of every stream it plays
+ * share. Its backlog is what was handed to those transports but not acknowledged by the client
+ * yet: queued by the server for each transport, by the connection and by the socket.
+ */
+typedef struct _TcpConnection {
+    GSocket *socket;
+    gchar *client_ip;
+    guint transports;
+    // Guards what follows, for the streaming threads of the transports and the backlog poll
+    GMutex lock;
+    // Over the limit: the transports are deactivated, which drops what the server queued for
+    // them, until the socket drained
+    gboolean flushing;
+    // Acknowledged by the client before we started counting, and handed to it since
+    guint64 acked_baseline;
+    guint64 handed_bytes;
+    BacklogMark marks[BACKLOG_MARKS];
+    guint first_mark;
+    guint n_marks;
+} TcpConnection;
+
+typedef struct _FrameMark {
+    guint32 rtp_time;
+    FrameKind kind;
+} FrameMark;
+
+typedef struct _SendProbe {
+    SkywayMediaProbe *probe;
+    GstElement *sink;
+    GstPad *pad;
+    gulong id;
+    // Of the last packet through, only touched by the streaming thread of the sink
+    gboolean have_packet;
+    guint32 rtp_time;
+    gboolean marker;
+} SendProbe;
+
+typedef struct _ReceiverReport {
+    guint fraction_lost;
+    gint packets_lost;
+    guint ext_highest_seq;
+    guint jitter;
+} ReceiverReport;
+
+typedef struct _ClientTransport {
+    GstRTSPClient *client;
+    SkywayMediaProbe *probe;
+    GstRTSPStreamTransport *transport;
+    gchar *client_ip;
+    // Only set for unicast UDP transports, the only ones thinned: a TCP-interleaved client loses
+    // no packets, its congestion shows as backlog instead
+    gchar *destination;
+    gint rtp_port;
+    gint rtcp_port;
+    guint32 ssrc;
+    // Only set for TCP-interleaved transports
+    TcpConnection *connection;
+    // Guards the state below, the fields above never change. Streaming threads work on
+    // snapshots of the transports, and may still hold one the monitor forgot.
+    GMutex lock;
+    gboolean removed;
+    // The multiudpsink sending to the destination, once thinning needed it
+    GstElement *gate_sink;
+    SkywayThinLevel level;
+    guint good_reports;
+    gboolean have_report;
+    ReceiverReport last_report;
+    // Held back from the client: a UDP destination taken out of its multiudpsink, or a TCP
+    // transport deactivated to flush its backlog
+    gboolean gated;
+    gboolean need_irap;
+    guint64 gated_packets;
+    guint64 dropped_frames;
+    guint64 skipped_frames;
+    guint64 resyncs;
+} ClientTransport;
+
+struct _SkywayMediaProbe {
+    SkywayClientMonitor *monitor;
+    GstRTSPMedia *media;
+    GstPad *sink_pad;
+    GstPad *src_pad;
+    gulong sink_probe;
+    gulong src_probe;
+    GList *send_probes;
+    // The transports of the media for its streaming threads, replaced as a whole on changes
+    GMutex entries_lock;
+    GPtrArray *entries;
+    gint gated_transports;
+    gint udp_transports;
+    gint tcp_transports;
+    // Of the access unit being payloaded, only touched by the streaming thread of the payloader
+    FrameKind next_kind;
+    GMutex frames_lock;
+    FrameMark frames[FRAME_MARKS];
+    guint first_frame;
+    guint n_frames;
+};
+
+struct _SkywayClientMonitor {
+    GMutex lock;
+    GPtrArray *transports;
+    GList *probes;
+    gboolean thinning_enabled;
+    gboolean allow_idr_only;
+    guint poll_source;
+    // Of the transports gone, so that the total only grows
+    guint64 forgotten_dropped_frames;
+    // Of TCP-interleaved clients, by socket
+    GHashTable *connections;
+    guint max_backlog_bytes;
+    guint max_backlog_delay_ms;
+    guint backlog_source;
+    // Overflows, and the frames skipped and resyncs of the transports gone
+    SkywayBacklogStats backlog_stats;
+};
+
+static ClientTransport *client_transport_ref(ClientTransport *entry);
+
+static void client_transport_unref(ClientTransport *entry);
+
+static void client_transport_clear(ClientTransport *entry);
+
+static void retire_transport(SkywayClientMonitor *self, ClientTransport *entry);
+
+static void publish_entries(SkywayClientMonitor *self, SkywayMediaProbe *probe);
+
+static GPtrArray *get_entries(SkywayMediaProbe *probe);
+
+static void set_gated(ClientTransport *entry, gboolean gated);
+
+static gboolean sink_has_client(GstElement *sink, const gchar *host, gint port);
+
+static void gate_destination(ClientTransport *entry, gboolean gated);
+
+static TcpConnection *
+acquire_connection(SkywayClientMonitor *self, GSocket *socket, const gchar *client_ip);
+
+static void release_connection(SkywayClientMonitor *self, TcpConnection *connection);
+
+static void tcp_connection_free(TcpConnection *connection);
+
+static void forget_transports(SkywayClientMonitor *self, GstRTSPClient *client,
+                              SkywayMediaProbe *probe);
+
+static SkywayMediaProbe *find_probe(SkywayClientMonitor *self, GstRTSPMedia *media);
+
+static void
+play_request_handler(GstRTSPClient *client, GstRTSPContext *ctx, SkywayClientMonitor *self);
+
+static GstRTSPStatusCode
+pre_pause_request_handler(GstRTSPClient *client, GstRTSPContext *ctx, SkywayClientMonitor *self);
+
+static GstRTSPStatusCode
+pre_teardown_request_handler(GstRTSPClient *client, GstRTSPContext *ctx,
+                             SkywayClientMonitor *self);
+
+static void client_closed_handler(GstRTSPClient *client, SkywayClientMonitor *self);
+
+static FrameKind classify_frame(GstBuffer *buffer);
+
+static gboolean should_forward(ClientTransport *entry, FrameKind kind);
+
+static GstPadProbeReturn
+pay_sink_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info,
+               SkywayMediaProbe *probe);
+
+static GstPadProbeReturn
+pay_src_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info,
+              SkywayMediaProbe *probe);
+
+static void record_frame(SkywayMediaProbe *probe, guint32 rtp_time, FrameKind kind);
+
+static FrameKind find_frame(SkywayMediaProbe *probe, guint32 rtp_time);
+
+static void collect_sink_pads(GstPad *src_pad, GPtrArray *sink_pads, guint depth);
+
+static void attach_send_probes(SkywayMediaProbe *probe);
+
+static void send_probe_free(SendProbe *send);
+
+static gboolean track_packets(SendProbe *send, GstPadProbeInfo *info, guint *packets,
+                              guint32 *rtp_time, gboolean *frame_start);
+
+static GstPadProbeReturn
+udp_send_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info, SendProbe *send);
+
+static GstPadProbeReturn
+tcp_send_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info, SendProbe *send);
+
+static gboolean read_receiver_report(ClientTransport *entry, ReceiverReport *report);
+
+static void
+update_thin_level(SkywayClientMonitor *self, ClientTransport *entry, const ReceiverReport *report);
+
+static gboolean poll_receiver_reports(SkywayClientMonitor *self);
+
+static void record_handed(TcpConnection *connection, gsize bytes, gint64 now);
+
+static gboolean read_acked(GSocket *socket, guint64 *bytes);
+
+static gboolean read_unsent(GSocket *socket, guint *bytes);
+
+static void start_counting(TcpConnection *connection);
+
+static gint64 backlog_age(TcpConnection *connection, guint64 delivered, gint64 now);
+
+static gboolean poll_backlogs(SkywayClientMonitor *self);
+
+static void set_transport_active(ClientTransport *entry, gboolean active);
+
+static ClientTransport *client_transport_ref(ClientTransport *entry) {
+    return g_atomic_rc_box_acquire(entry);
+}
+
+static void client_transport_unref(ClientTransport *entry) {
+    g_atomic_rc_box_release_full(entry, (GDestroyNotify) client_transport_clear);
+}
+
+static void client_transport_clear(ClientTransport *entry) {
+    gst_clear_object(&entry->gate_sink);
+    g_object_unref(entry->transport);
+    g_free(entry->client_ip);
+    g_free(entry->destination);
+    g_mutex_clear(&entry->lock);
+}
+
+/*
+ * Called with the monitor locked, before the transport leaves it. Streaming threads still
+ * holding it leave it alone from now on.
+ */
+static void retire_transport(SkywayClientMonitor *self, ClientTransport *entry) {
+    g_mutex_lock(&entry->lock);
+    entry->removed = TRUE;
+    if (entry->gate_sink) {
+        // Given back to the server, which removes it itself once the transport is gone
+        gate_destination(entry, FALSE);
+    }
+    set_gated(entry, FALSE);
+    self->forgotten_dropped_frames += entry->dropped_frames;
+    self->backlog_stats.skipped_frames += entry->skipped_frames;
+    self->backlog_stats.resyncs += entry->resyncs;
+    g_mutex_unlock(&entry->lock);
+
+    if (entry->destination) {
+        (void) g_atomic_int_dec_and_test(&entry->probe->udp_transports);
+    }
+    if (entry->connection) {
+        (void) g_atomic_int_dec_and_test(&entry->probe->tcp_transports);
+        release_connection(self, entry->connection);
+    }
+}
+
+/*
+ * Called with the monitor locked whenever the transports of the probe's media changed.
+ */
+static void publish_entries(SkywayClientMonitor *self, SkywayMediaProbe *probe) {
+    GPtrArray *entries = g_ptr_array_new_with_free_func((GDestroyNotify) client_transport_unref);
+    for (guint i = 0; i < self->transports->len; i++) {
+        ClientTransport *entry = g_ptr_array_index(self->transports, i);
+        if (entry->probe == probe) {
+            g_ptr_array_add(entries, client_transport_ref(entry));
+        }
+    }
+
+    g_mutex_lock(&probe->entries_lock);
+    GPtrArray *old = probe->entries;
+    probe->entries = entries;
+    g_mutex_unlock(&probe->entries_lock);
+
+    g_ptr_array_unref(old);
+}
+
+/*
+ * The transports of the media as last published, for streaming threads to go through without
+ * holding up the monitor or each other.
+ */
+static GPtrArray *get_entries(SkywayMediaProbe *probe) {
+    g_mutex_lock(&probe->entries_lock);
+    GPtrArray *entries = g_ptr_array_ref(probe->entries);
+    g_mutex_unlock(&probe->entries_lock);
+
+    return entries;
+}
+
+static void set_gated(ClientTransport *entry, gboolean gated) {
+    if (entry->gated == gated) {
+        return;
+    }
+
+    entry->gated = gated;
+    if (gated) {
+        g_atomic_int_inc(&entry->probe->gated_transports);
+    } else {
+        (void) g_atomic_int_dec_and_test(&entry->probe->gated_transports);
+    }
+}
+
+static gboolean sink_has_client(GstElement *sink, const gchar *host, gint port) {
+    gchar *clients = NULL;
+    g_object_get(sink, "clients", &clients, NULL);
+
+    // "host:port,host:port", IPv6 hosts unbracketed
+    gboolean found = FALSE;
+    gchar **entries = g_strsplit(clients ? clients : "", ",", -1);
+    for (guint i = 0; entries[i] && !found; i++) {
+        gchar *separator = strrchr(entries[i], ':');
+        found = separator && g_ascii_strtoll(separator + 1, NULL, 10) == port &&
+                strncmp(entries[i], host, separator - entries[i]) == 0 &&
+                host[separator - entries[i]] == '\0';
+    }
+    g_strfreev(entries);
+    g_free(clients);
+
+    return found;
+}
+
+/*
+ * Stops or resumes sending to the destination of a UDP transport from the multiudpsink the
+ * packets of its stream leave through, behind the back of the server which keeps the transport
+ * active (and its RTCP flowing). Called from the streaming thread of that sink right before it
+ * sends the first packet of a frame, so only whole frames are ever held back.
+ */
+static void gate_destination(ClientTransport *entry, gboolean gated) {
+    if (entry->gated == gated) {
+        return;
+    }
+
+    g_signal_emit_by_name(entry->gate_sink, gated ? "remove" : "add", entry->destination,
+                          entry->rtp_port, NULL);
+    set_gated(entry, gated);
+}
+
+SkywayClientMonitor *skyway_client_monitor_new() {
+    SkywayClientMonitor *self = g_new0(SkywayClientMonitor, 1);
+    g_mutex_init(&self->lock);
+    self->transports = g_ptr_array_new_with_free_func((GDestroyNotify) client_transport_unref);
+    self->connections = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                              (GDestroyNotify) tcp_connection_free);
+    self->thinning_enabled = FALSE;
+    self->allow_idr_only = FALSE;
+    self->poll_source = g_timeout_add(POLL_INTERVAL_MS, (GSourceFunc) poll_receiver_reports, self);
+    // Off until the application sets a limit
+    self->max_backlog_bytes = 0;
+    self->max_backlog_delay_ms = 0;
+    self->backlog_source = g_timeout_add(BACKLOG_POLL_INTERVAL_MS, (GSourceFunc) poll_backlogs,
+                                         self);
+
+    return self;
+}
+
+void skyway_client_monitor_set_tcp_backlog_limit(SkywayClientMonitor *self, guint max_bytes,
+                                                 guint max_delay_ms) {
+    g_mutex_lock(&self->lock);
+    self->max_backlog_bytes = max_bytes;
+    self->max_backlog_delay_ms = max_delay_ms;
+    g_mutex_unlock(&self->lock);
+}
+
+void skyway_client_monitor_get_backlog_stats(SkywayClientMonitor *self,
+                                             SkywayBacklogStats *stats) {
+    g_mutex_lock(&self->lock);
+    *stats = self->backlog_stats;
+    for (guint i = 0; i < self->transports->len; i++) {
+        ClientTransport *entry = g_ptr_array_index(self->transports, i);
+        g_mutex_lock(&entry->lock);
+        stats->skipped_frames += entry->skipped_frames;
+        stats->resyncs += entry->resyncs;
+        g_mutex_unlock(&entry->lock);
+    }
+    g_mutex_unlock(&self->lock);
+}
+
+void skyway_client_monitor_set_thinning(SkywayClientMonitor *self, gboolean enabled,
+                                        gboolean allow_idr_only) {
+    g_mutex_lock(&self->lock);
+    self->thinning_enabled = enabled;
+    self->allow_idr_only = allow_idr_only;
+
+    for (guint i = 0; i < self->transports->len; i++) {
+        ClientTransport *entry = g_ptr_array_index(self->transports, i);
+        g_mutex_lock(&entry->lock);
+        if (!enabled || (!allow_idr_only && entry->level == SKYWAY_THIN_IDR_ONLY)) {
+            entry->level = enabled ? SKYWAY_THIN_NON_REFERENCE : SKYWAY_THIN_NONE;
+            entry->good_reports = 0;
+        }
+        g_mutex_unlock(&entry->lock);
+    }
+    g_mutex_unlock(&self->lock);
+}
+
+void skyway_client_monitor_watch_client(SkywayClientMonitor *self, GstRTSPClient *client) {
+    g_signal_connect(client, "play-request", G_CALLBACK(play_request_handler), self);
+    g_signal_connect(client, "pre-pause-request", G_CALLBACK(pre_pause_request_handler), self);
+    g_signal_connect(client, "pre-teardown-request", G_CALLBACK(pre_teardown_request_handler),
+                     self);
+    g_signal_connect(client, "closed", G_CALLBACK(client_closed_handler), self);
+}
+
+SkywayMediaProbe *
+skyway_client_monitor_attach_media(SkywayClientMonitor *self, GstRTSPMedia *media,
+                                   GstElement *payloader) {
+    SkywayMediaProbe *probe = g_new0(SkywayMediaProbe, 1);
+    probe->monitor = self;
+    probe->media = media;
+    probe->next_kind = FRAME_REFERENCE;
+    g_mutex_init(&probe->frames_lock);
+    g_mutex_init(&probe->entries_lock);
+    probe->entries = g_ptr_array_new();
+    probe->sink_pad = gst_element_get_static_pad(payloader, "sink");
+    probe->src_pad = gst_element_get_static_pad(payloader, "src");
+
+    if (!probe->sink_pad || !probe->src_pad) {
+        g_printerr("Payloader has no static sink/src pad, not monitoring clients\n");
+        g_clear_object(&probe->sink_pad);
+        g_clear_object(&probe->src_pad);
+        g_mutex_clear(&probe->frames_lock);
+        g_mutex_clear(&probe->entries_lock);
+        g_ptr_array_unref(probe->entries);
+        g_free(probe);
+        return NULL;
+    }
+
+    g_mutex_lock(&self->lock);
+    self->probes = g_list_prepend(self->probes, probe);
+    g_mutex_unlock(&self->lock);
+
+    probe->sink_probe = gst_pad_add_probe(probe->sink_pad, GST_PAD_PROBE_TYPE_BUFFER,
+                                          (GstPadProbeCallback) pay_sink_probe, probe, NULL);
+    probe->src_probe = gst_pad_add_probe(probe->src_pad,
+                                         GST_PAD_PROBE_TYPE_BUFFER |
+                                         GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                                         (GstPadProbeCallback) pay_src_probe, probe, NULL);
+    return probe;
+}
+
+void skyway_client_monitor_detach_media(SkywayClientMonitor *self, SkywayMediaProbe *probe) {
+    gst_pad_remove_probe(probe->sink_pad, probe->sink_probe);
+    gst_pad_remove_probe(probe->src_pad, probe->src_probe);
+
+    g_mutex_lock(&self->lock);
+    forget_transports(self, NULL, probe);
+    self->probes = g_list_remove(self->probes, probe);
+    g_mutex_unlock(&self->lock);
+
+    g_list_free_full(probe->send_probes, (GDestroyNotify) send_probe_free);
+    gst_object_unref(probe->sink_pad);
+    gst_object_unref(probe->src_pad);
+    g_mutex_clear(&probe->frames_lock);
+    g_mutex_clear(&probe->entries_lock);
+    g_ptr_array_unref(probe->entries);
+    g_free(probe);
+}
+
+void skyway_client_monitor_get_congestion(SkywayClientMonitor *self, guint *congested_clients,
+                                          guint64 *dropped_frames) {
+    *congested_clients = 0;
+    g_mutex_lock(&self->lock);
+    *dropped_frames = self->forgotten_dropped_frames;
+    for (guint i = 0; i < self->transports->len; i++) {
+        ClientTransport *entry = g_ptr_array_index(self->transports, i);
+        g_mutex_lock(&entry->lock);
+        if (entry->level != SKYWAY_THIN_NONE) {
+            (*congested_clients)++;
+        }
+        *dropped_frames += entry->dropped_frames;
+        g_mutex_unlock(&entry->lock);
+    }
+    g_mutex_unlock(&self->lock);
+}
+
+void skyway_client_monitor_stop(SkywayClientMonitor *self) {
+    if (self->poll_source) {
+        g_source_remove(self->poll_source);
+        self->poll_source = 0;
+    }
+    if (self->backlog_source) {
+        g_source_remove(self->backlog_source);
+        self->backlog_source = 0;
+    }
+}
+
+static TcpConnection *
+acquire_connection(SkywayClientMonitor *self, GSocket *socket, const gchar *client_ip) {
+    TcpConnection *connection = g_hash_table_lookup(self->connections, socket);
+    if (!connection) {
+        connection = g_new0(TcpConnection, 1);
+        connection->socket = g_object_ref(socket);
+        connection->client_ip = g_strdup(client_ip);
+        g_mutex_init(&connection->lock);
+        start_counting(connection);
+        g_hash_table_insert(self->connections, socket, connection);
+    }
+
+    connection->transports++;
+    return connection;
+}
+
+static void release_connection(SkywayClientMonitor *self, TcpConnection *connection) {
+    if (--connection->transports == 0) {
+        g_hash_table_remove(self->connections, connection->socket);
+    }
+}
+
+static void tcp_connection_free(TcpConnection *connection) {
+    g_object_unref(connection->socket);
+    g_free(connection->client_ip);
+    g_mutex_clear(&connection->lock);
+    g_free(connection);
+}
+
+static void forget_transports(SkywayClientMonitor *self, GstRTSPClient *client,
+                              SkywayMediaProbe *probe) {
+    for (guint i = self->transports->len; i > 0; i--) {
+        ClientTransport *entry = g_ptr_array_index(self->transports, i - 1);
+        if ((!client || entry->client == client) && (!probe || entry->probe == probe)) {
+            retire_transport(self, entry);
+            g_ptr_array_remove_index_fast(self->transports, i - 1);
+        }
+    }
+
+    for (GList *l = self->probes; l; l = l->next) {
+        if (!probe || l->data == probe) {
+            publish_entries(self, l->data);
+        }
+    }
+}
+
+static SkywayMediaProbe *find_probe(SkywayClientMonitor *self, GstRTSPMedia *media) {
+    for (GList *l = self->probes; l; l = l->next) {
+        SkywayMediaProbe *probe = l->data;
+        if (probe->media == media) {
+            return probe;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+play_request_handler(GstRTSPClient *client, GstRTSPContext *ctx, SkywayClientMonitor *self) {
+    if (!ctx->sessmedia) {
+        return;
+    }
+
+    // Collect the transports before taking our lock, the media and session locks must never
+    // be waited on while a streaming thread may be blocked on it.
+    GstRTSPMedia *media = gst_rtsp_session_media_get_media(ctx->sessmedia);
+    guint n_streams = gst_rtsp_media_n_streams(media);
+    GPtrArray *transports = g_ptr_array_new();
+    for (guint i = 0; i < n_streams; i++) {
+        GstRTSPStreamTransport *transport = gst_rtsp_session_media_get_transport(ctx->sessmedia,
+                                                                                 i);
+        if (transport) {
+            g_ptr_array_add(transports, transport);
+        }
+    }
+
+    GstRTSPConnection *connection = gst_rtsp_client_get_connection(client);
+    const gchar *client_ip = gst_rtsp_connection_get_ip(connection);
+    GSocket *socket = gst_rtsp_connection_get_write_socket(connection);
+
+    g_mutex_lock(&self->lock);
+    SkywayMediaProbe *probe = find_probe(self, media);
+    for (guint i = 0; probe && i < transports->len; i++) {
+        GstRTSPStreamTransport *transport = g_ptr_array_index(transports, i);
+        gboolean known = FALSE;
+        for (guint j = 0; j < self->transports->len && !known; j++) {
+            ClientTransport *entry = g_ptr_array_index(self->transports, j);
+            known = entry->transport == transport;
+        }
+
+        if (known) {
+            continue;
+        }
+
+        ClientTransport *entry = g_atomic_rc_box_new0(ClientTransport);
+        g_mutex_init(&entry->lock);
+        entry->client = client;
+        entry->probe = probe;
+        entry->transport = g_object_ref(transport);
+        entry->client_ip = g_strdup(client_ip);
+        entry->level = SKYWAY_THIN_NONE;
+
+        const GstRTSPTransport *tr = gst_rtsp_stream_transport_get_transport(transport);
+        if (socket && tr->lower_transport == GST_RTSP_LOWER_TRANS_TCP) {
+            entry->connection = acquire_connection(self, socket, client_ip);
+            g_atomic_int_inc(&probe->tcp_transports);
+        } else if (tr->lower_transport == GST_RTSP_LOWER_TRANS_UDP && tr->destination) {
+            entry->destination = g_strdup(tr->destination);
+            entry->rtp_port = tr->client_port.min;
+            entry->rtcp_port = tr->client_port.max;
+            entry->ssrc = tr->ssrc;
+            g_atomic_int_inc(&probe->udp_transports);
+        }
+        g_ptr_array_add(self->transports, entry);
+    }
+
+    // The server creates the sinks of a stream as the first client asks for their protocol
+    if (probe) {
+        publish_entries(self, probe);
+        attach_send_probes(probe);
+    }
+    g_mutex_unlock(&self->lock);
+
+    g_ptr_array_unref(transports);
+}
+
+static GstRTSPStatusCode
+pre_pause_request_handler(GstRTSPClient *client, GstRTSPContext *ctx, SkywayClientMonitor *self) {
+    // Paused transports are deactivated by the server, the gate must not re-activate them
+    return pre_teardown_request_handler(client, ctx, self);
+}
+
+static GstRTSPStatusCode
+pre_teardown_request_handler(GstRTSPClient *client, GstRTSPContext *ctx,
+                             SkywayClientMonitor *self) {
+    g_mutex_lock(&self->lock);
+    SkywayMediaProbe *probe = NULL;
+    if (ctx->sessmedia) {
+        probe = find_probe(self, gst_rtsp_session_media_get_media(ctx->sessmedia));
+    }
+
+    if (!ctx->sessmedia || probe) {
+        forget_transports(self, client, probe);
+    }
+    g_mutex_unlock(&self->lock);
+
+    return GST_RTSP_STS_OK;
+}
+
+static void client_closed_handler(GstRTSPClient *client, SkywayClientMonitor *self) {
+    g_mutex_lock(&self->lock);
+    forget_transports(self, client, NULL);
+    g_mutex_unlock(&self->lock);
+}
+
+static FrameKind classify_frame(GstBuffer *buffer) {
+    SkywayH265AccessUnitInfo info;
+    gboolean parsed = FALSE;
+    GstMapInfo map;
+    if (gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        parsed = skyway_h265_parse_access_unit(map.data, map.size, &info) && info.has_vcl;
+        gst_buffer_unmap(buffer, &map);
+    }
+
+    // Producers do not all flag their keyframes right, the NAL unit types tell. Anything we
+    // cannot parse is assumed to be referenced, which is always safe to send.
+    if (!parsed) {
+        return GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT) ? FRAME_REFERENCE
+                                                                           : FRAME_IRAP;
+    }
+
+    if (info.has_irap) {
+        return FRAME_IRAP;
+    }
+    return info.has_reference ? FRAME_REFERENCE : FRAME_NON_REFERENCE;
+}
+
+static gboolean should_forward(ClientTransport *entry, FrameKind kind) {
+    if (kind == FRAME_IRAP) {
+        entry->need_irap = FALSE;
+        return TRUE;
+    }
+
+    if (entry->need_irap) {
+        return FALSE;
+    }
+
+    switch (entry->level) {
+        case SKYWAY_THIN_NON_REFERENCE:
+            return kind == FRAME_REFERENCE;
+        case SKYWAY_THIN_IDR_ONLY:
+            // Once a reference frame is skipped, the client can only resync on the next IRAP
+            entry->need_irap = TRUE;
+            return FALSE;
+        case SKYWAY_THIN_NONE:
+        default:
+            return TRUE;
+    }
+}
+
+static GstPadProbeReturn
+pay_sink_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info,
+               SkywayMediaProbe *probe) {
+    // Held back clients resume at IRAP frames
+    gboolean needed = g_atomic_int_get(&probe->gated_transports) > 0;
+
+    GPtrArray *entries = get_entries(probe);
+    for (guint i = 0; i < entries->len && !needed; i++) {
+        ClientTransport *entry = g_ptr_array_index(entries, i);
+        if (entry->destination) {
+            g_mutex_lock(&entry->lock);
+            needed = !entry->removed && (entry->level != SKYWAY_THIN_NONE || entry->need_irap);
+            g_mutex_unlock(&entry->lock);
+        }
+    }
+    g_ptr_array_unref(entries);
+
+    // For the packets of this access unit to tell the send path, where each client gets or
+    // misses the frame as a whole. Frames left unclassified are sent to all.
+    probe->next_kind = needed ? classify_frame(GST_PAD_PROBE_INFO_BUFFER(info)) : FRAME_REFERENCE;
+
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+pay_src_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info,
+              SkywayMediaProbe *probe) {
+    if (g_atomic_int_get(&probe->udp_transports) == 0 &&
+        g_atomic_int_get(&probe->tcp_transports) == 0) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstBuffer *first = NULL;
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        first = gst_buffer_list_length(list) > 0 ? gst_buffer_list_get(list, 0) : NULL;
+    } else {
+        first = GST_PAD_PROBE_INFO_BUFFER(info);
+    }
+
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+    if (first && gst_rtp_buffer_map(first, GST_MAP_READ, &rtp)) {
+        record_frame(probe, gst_rtp_buffer_get_timestamp(&rtp), probe->next_kind);
+        gst_rtp_buffer_unmap(&rtp);
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void record_frame(SkywayMediaProbe *probe, guint32 rtp_time, FrameKind kind) {
+    g_mutex_lock(&probe->frames_lock);
+    FrameMark *last = NULL;
+    if (probe->n_frames > 0) {
+        last = &probe->frames[(probe->first_frame + probe->n_frames - 1) % FRAME_MARKS];
+    }
+
+    // The packets of an access unit share its timestamp
+    if (!last || last->rtp_time != rtp_time) {
+        if (probe->n_frames == FRAME_MARKS) {
+            probe->first_frame = (probe->first_frame + 1) % FRAME_MARKS;
+            probe->n_frames--;
+        }
+
+        FrameMark *mark = &probe->frames[(probe->first_frame + probe->n_frames) % FRAME_MARKS];
+        mark->rtp_time = rtp_time;
+        mark->kind = kind;
+        probe->n_frames++;
+    }
+    g_mutex_unlock(&probe->frames_lock);
+}
+
+static FrameKind find_frame(SkywayMediaProbe *probe, guint32 rtp_time) {
+    FrameKind kind = FRAME_REFERENCE;
+
+    g_mutex_lock(&probe->frames_lock);
+    for (guint i = probe->n_frames; i > 0; i--) {
+        FrameMark *mark = &probe->frames[(probe->first_frame + i - 1) % FRAME_MARKS];
+        if (mark->rtp_time == rtp_time) {
+            kind = mark->kind;
+            break;
+        }
+    }
+    g_mutex_unlock(&probe->frames_lock);
+
+    return kind;
+}
+
+/*
+ * Follows the packets leaving src_pad to the sinks they end in, through the internal links of
+ * the elements (and bins) in between.
+ */
+static void collect_sink_pads(GstPad *src_pad, GPtrArray *sink_pads, guint depth) {
+    GstPad *peer = gst_pad_get_peer(src_pad);
+    if (!peer) {
+        return;
+    }
+
+    gboolean linked = FALSE;
+    GstIterator *links = depth < MAX_SEND_PATH_DEPTH ? gst_pad_iterate_internal_links(peer) : NULL;
+    GValue item = G_VALUE_INIT;
+    gboolean done = links == NULL;
+    while (!done) {
+        switch (gst_iterator_next(links, &item)) {
+            case GST_ITERATOR_OK:
+                linked = TRUE;
+                collect_sink_pads(g_value_get_object(&item), sink_pads, depth + 1);
+                g_value_reset(&item);
+                break;
+            case GST_ITERATOR_RESYNC:
+                gst_iterator_resync(links);
+                break;
+            default:
+                done = TRUE;
+                break;
+        }
+    }
+    g_value_unset(&item);
+    if (links) {
+        gst_iterator_free(links);
+    }
+
+    if (linked) {
+        gst_object_unref(peer);
+    } else {
+        g_ptr_array_add(sink_pads, peer);
+    }
+}
+
+static void attach_send_probes(SkywayMediaProbe *probe) {
+    GPtrArray *sink_pads = g_ptr_array_new_with_free_func(gst_object_unref);
+    collect_sink_pads(probe->src_pad, sink_pads, 0);
+
+    for (guint i = 0; i < sink_pads->len; i++) {
+        GstPad *pad = g_ptr_array_index(sink_pads, i);
+        gboolean known = FALSE;
+        for (GList *l = probe->send_probes; l && !known; l = l->next) {
+            known = ((SendProbe *) l->data)->pad == pad;
+        }
+
+        GstElement *sink = gst_pad_get_parent_element(pad);
+        GstElementFactory *factory = sink ? gst_element_get_factory(sink) : NULL;
+        const gchar *name = factory ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory))
+                                    : NULL;
+        // The server hands packets to its TCP-interleaved transports from an appsink
+        gboolean udp = g_strcmp0(name, "multiudpsink") == 0;
+        gboolean tcp = g_strcmp0(name, "appsink") == 0;
+        if (!known && (udp || tcp)) {
+            SendProbe *send = g_new0(SendProbe, 1);
+            send->probe = probe;
+            send->sink = gst_object_ref(sink);
+            send->pad = gst_object_ref(pad);
+            send->id = gst_pad_add_probe(pad,
+                                         GST_PAD_PROBE_TYPE_BUFFER |
+                                         GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                                         (GstPadProbeCallback) (tcp ? tcp_send_probe
+                                                                    : udp_send_probe),
+                                         send, NULL);
+            probe->send_probes = g_list_prepend(probe->send_probes, send);
+        }
+
+        if (sink) {
+            gst_object_unref(sink);
+        }
+    }
+
+    g_ptr_array_unref(sink_pads);
+}
+
+static void send_probe_free(SendProbe *send) {
+    gst_pad_remove_probe(send->pad, send->id);
+    gst_object_unref(send->pad);
+    gst_object_unref(send->sink);
+    g_free(send);
+}
+
+/*
+ * Follows the packets reaching a sink, to tell whether they start a frame.
+ */
+static gboolean track_packets(SendProbe *send, GstPadProbeInfo *info, guint *packets,
+                              guint32 *rtp_time, gboolean *frame_start) {
+    GstBuffer *first = NULL;
+    GstBuffer *last = NULL;
+    *packets = 1;
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        // The payloader pushes the packets of an access unit in one list, if it pushes lists
+        *packets = gst_buffer_list_length(list);
+        first = *packets > 0 ? gst_buffer_list_get(list, 0) : NULL;
+        last = *packets > 0 ? gst_buffer_list_get(list, *packets - 1) : NULL;
+    } else {
+        first = last = GST_PAD_PROBE_INFO_BUFFER(info);
+    }
+
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+    if (!first || !gst_rtp_buffer_map(first, GST_MAP_READ, &rtp)) {
+        return FALSE;
+    }
+    *rtp_time = gst_rtp_buffer_get_timestamp(&rtp);
+    gst_rtp_buffer_unmap(&rtp);
+
+    // A frame starts after the marker of the last one, or at least with a new timestamp
+    *frame_start = !send->have_packet || send->marker || *rtp_time != send->rtp_time;
+    send->have_packet = TRUE;
+    send->rtp_time = *rtp_time;
+    if (gst_rtp_buffer_map(last, GST_MAP_READ, &rtp)) {
+        send->marker = gst_rtp_buffer_get_marker(&rtp);
+        gst_rtp_buffer_unmap(&rtp);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Right before the multiudpsink sends a packet to every destination it has. Clients thinned for
+ * congestion are taken out of (or put back into) those destinations at the first packet of a
+ * frame, so they never get part of one.
+ */
+static GstPadProbeReturn
+udp_send_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info, SendProbe *send) {
+    guint packets;
+    guint32 rtp_time;
+    gboolean frame_start;
+    if (!track_packets(send, info, &packets, &rtp_time, &frame_start)) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    SkywayMediaProbe *probe = send->probe;
+    if (g_atomic_int_get(&probe->udp_transports) == 0 ||
+        (!frame_start && g_atomic_int_get(&probe->gated_transports) == 0)) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    FrameKind kind = frame_start ? find_frame(probe, rtp_time) : FRAME_REFERENCE;
+    GPtrArray *entries = get_entries(probe);
+    for (guint i = 0; i < entries->len; i++) {
+        ClientTransport *entry = g_ptr_array_index(entries, i);
+        if (!entry->destination) {
+            continue;
+        }
+
+        g_mutex_lock(&entry->lock);
+        if (entry->removed) {
+            g_mutex_unlock(&entry->lock);
+            continue;
+        }
+
+        // Only ever decided on the sink sending to it, not on a multicast one of the stream
+        if (!entry->gate_sink && frame_start && entry->level != SKYWAY_THIN_NONE &&
+            sink_has_client(send->sink, entry->destination, entry->rtp_port)) {
+            entry->gate_sink = gst_object_ref(send->sink);
+        }
+
+        if (entry->gate_sink == send->sink) {
+            if (frame_start &&
+                (entry->level != SKYWAY_THIN_NONE || entry->gated || entry->need_irap)) {
+                gboolean forward = should_forward(entry, kind);
+                gate_destination(entry, !forward);
+
+                if (!forward) {
+                    entry->dropped_frames++;
+                }
+            }
+
+            // Count the packets a gated client misses so they are not reported back to us as
+            // loss
+            if (entry->gated) {
+                entry->gated_packets += packets;
+            }
+        }
+        g_mutex_unlock(&entry->lock);
+    }
+    g_ptr_array_unref(entries);
+
+    return GST_PAD_PROBE_OK;
+}
+
+/*
+ * Right before the server hands packets to its TCP-interleaved transports, from the thread that
+ * does. Counts what is handed to the transports that are active, and the frames the others
+ * skip: the backlog poll switches them, off the data path.
+ */
+static GstPadProbeReturn
+tcp_send_probe(__attribute__ ((unused)) GstPad *pad, GstPadProbeInfo *info, SendProbe *send) {
+    guint packets;
+    guint32 rtp_time;
+    gboolean frame_start;
+    SkywayMediaProbe *probe = send->probe;
+    if (!track_packets(send, info, &packets, &rtp_time, &frame_start) ||
+        g_atomic_int_get(&probe->tcp_transports) == 0) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    gsize bytes = 0;
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        bytes = gst_buffer_list_calculate_size(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+    } else {
+        bytes = gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+    }
+    bytes += packets * INTERLEAVED_HEADER_SIZE;
+    gint64 now = g_get_monotonic_time();
+
+    GPtrArray *entries = get_entries(probe);
+    for (guint i = 0; i < entries->len; i++) {
+        ClientTransport *entry = g_ptr_array_index(entries, i);
+        if (!entry->connection) {
+            continue;
+        }
+
+        // The connection lives as long as the transport is not removed
+        g_mutex_lock(&entry->lock);
+        if (entry->removed) {
+            g_mutex_unlock(&entry->lock);
+            continue;
+        }
+
+        TcpConnection *connection = entry->connection;
+        if (frame_start && entry->gated) {
+            entry->skipped_frames++;
+        }
+
+        if (!entry->gated) {
+            g_mutex_lock(&connection->lock);
+            record_handed(connection, bytes, now);
+            g_mutex_unlock(&connection->lock);
+        }
+        g_mutex_unlock(&entry->lock);
+    }
+    g_ptr_array_unref(entries);
+
+    return GST_PAD_PROBE_OK;
+}
+
+/*
+ * Clients behind the same NAT share an IP, so a source is told apart by the SSRC the client
+ * announced in its transport or else the port its RTCP comes from.
+ */
+static gboolean source_matches_client(const GstStructure *source, ClientTransport *entry) {
+    gboolean internal = FALSE;
+    gboolean have_rb = FALSE;
+    gst_structure_get_boolean(source, "internal", &internal);
+    gst_structure_get_boolean(source, "have-rb", &have_rb);
+    if (internal || !have_rb) {
+        return FALSE;
+    }
+
+    guint ssrc = 0;
+    if (entry->ssrc && gst_structure_get_uint(source, "ssrc", &ssrc)) {
+        return ssrc == entry->ssrc;
+    }
+
+    // rtcp-from is "ip:port", or "[ip]:port" for IPv6
+    const gchar *rtcp_from = gst_structure_get_string(source, "rtcp-from");
+    const gchar *port = rtcp_from ? strrchr(rtcp_from, ':') : NULL;
+    if (!port) {
+        return FALSE;
+    }
+
+    if (rtcp_from[0] == '[') {
+        rtcp_from++;
+    }
+
+    gsize ip_len = strlen(entry->destination);
+    return strncmp(rtcp_from, entry->destination, ip_len) == 0 &&
+           (rtcp_from[ip_len] == ':' || rtcp_from[ip_len] == ']') &&
+           g_ascii_strtoll(port + 1, NULL, 10) == entry->rtcp_port;
+}
+
+static gboolean read_receiver_report(ClientTransport *entry, ReceiverReport *report) {
+    if (!entry->destination) {
+        return FALSE;
+    }
+
+    GstRTSPStream *stream = gst_rtsp_stream_transport_get_stream(entry->transport);
+    GObject *session = gst_rtsp_stream_get_rtpsession(stream);
+    if (!session) {
+        return FALSE;
+    }
+
+    GstStructure *stats = NULL;
+    g_object_get(session, "stats", &stats, NULL);
+    g_object_unref(session);
+
+    const GValue *source_stats = stats ? gst_structure_get_value(stats, "source-stats") : NULL;
+    gboolean found = FALSE;
+
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    GValueArray *sources = source_stats ? g_value_get_boxed(source_stats) : NULL;
+    for (guint i = 0; sources && i < sources->n_values && !found; i++) {
+        const GstStructure *source = gst_value_get_structure(g_value_array_get_nth(sources, i));
+        found = source_matches_client(source, entry) &&
+                gst_structure_get_uint(source, "rb-fractionlost", &report->fraction_lost) &&
+                gst_structure_get_int(source, "rb-packetslost", &report->packets_lost) &&
+                gst_structure_get_uint(source, "rb-exthighestseq", &report->ext_highest_seq) &&
+                gst_structure_get_uint(source, "rb-jitter", &report->jitter);
+    }
+    G_GNUC_END_IGNORE_DEPRECATIONS
+
+    if (stats) {
+        gst_structure_free(stats);
+    }
+
+    return found;
+}
+
+static void
+update_thin_level(SkywayClientMonitor *self, ClientTransport *entry, const ReceiverReport *report) {
+    if (!entry->have_report) {
+        entry->have_report = TRUE;
+        entry->last_report = *report;
+        entry->gated_packets = 0;
+        return;
+    }
+
+    if (report->ext_highest_seq == entry->last_report.ext_highest_seq) {
+        // No new receiver report since the last poll
+        return;
+    }
+
+    // The sequence numbers we skipped on purpose show up as lost in the client's report
+    gint64 expected = (gint64) (report->ext_highest_seq - entry->last_report.ext_highest_seq);
+    gint64 lost = (gint64) report->packets_lost - entry->last_report.packets_lost;
+    gint64 gated = (gint64) MIN(entry->gated_packets, (guint64) expected);
+    expected -= gated;
+    lost -= gated;
+
+    guint fraction_lost = 0;
+    if (expected > 0 && lost > 0) {
+        fraction_lost = (guint) MIN((lost << 8) / expected, 255);
+    }
+
+    entry->last_report = *report;
+    entry->gated_packets = 0;
+
+    SkywayThinLevel level = entry->level;
+    if (fraction_lost >= SEVERE_FRACTION_LOST && self->allow_idr_only) {
+        level = SKYWAY_THIN_IDR_ONLY;
+        entry->good_reports = 0;
+    } else if (fraction_lost >= CONGESTED_FRACTION_LOST || report->jitter >= CONGESTED_JITTER) {
+        level = MAX(level, SKYWAY_THIN_NON_REFERENCE);
+        entry->good_reports = 0;
+    } else if (level != SKYWAY_THIN_NONE && ++entry->good_reports >= RECOVERY_REPORTS) {
+        level--;
+        entry->good_reports = 0;
+    }
+
+    if (level != entry->level) {
+        g_print("Client %s: thinning level %d -> %d (loss %u/256, jitter %u)\n",
+                entry->client_ip, entry->level, level, fraction_lost, report->jitter);
+        entry->level = level;
+    }
+}
+
+static gboolean poll_receiver_reports(SkywayClientMonitor *self) {
+    g_mutex_lock(&self->lock);
+    for (guint i = 0; self->thinning_enabled && i < self->transports->len; i++) {
+        ClientTransport *entry = g_ptr_array_index(self->transports, i);
+        ReceiverReport report;
+        if (read_receiver_report(entry, &report)) {
+            g_mutex_lock(&entry->lock);
+            update_thin_level(self, entry, &report);
+            g_mutex_unlock(&entry->lock);
+        }
+    }
+    g_mutex_unlock(&self->lock);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void record_handed(TcpConnection *connection, gsize bytes, gint64 now) {
+    connection->handed_bytes += bytes;
+
+    BacklogMark *last = NULL;
+    if (connection->n_marks > 0) {
+        last = &connection->marks[(connection->first_mark + connection->n_marks - 1) %
+                                  BACKLOG_MARKS];
+    }
+
+    if (last && now - last->time < BACKLOG_MARK_INTERVAL_US) {
+        last->handed_bytes = connection->handed_bytes;
+        return;
+    }
+
+    if (connection->n_marks == BACKLOG_MARKS) {
+        connection->first_mark = (connection->first_mark + 1) % BACKLOG_MARKS;
+        connection->n_marks--;
+    }
+
+    BacklogMark *mark = &connection->marks[(connection->first_mark + connection->n_marks) %
+                                           BACKLOG_MARKS];
+    mark->handed_bytes = connection->handed_bytes;
+    mark->time = now;
+    connection->n_marks++;
+}
+
+/*
+ * What the client acknowledged over the connection so far, RTSP and RTCP included.
+ */
+static gboolean read_acked(GSocket *socket, guint64 *bytes) {
+    if (g_socket_is_closed(socket)) {
+        return FALSE;
+    }
+
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+    memset(&info, 0, sizeof(info));
+    // Kernels before 4.1 do not count acknowledged bytes
+    if (getsockopt(g_socket_get_fd(socket), IPPROTO_TCP, TCP_INFO, &info, &length) < 0 ||
+        length < offsetof(struct tcp_info, tcpi_bytes_acked) + sizeof(info.tcpi_bytes_acked)) {
+        return FALSE;
+    }
+
+    *bytes = info.tcpi_bytes_acked;
+    return TRUE;
+}
+
+/*
+ * What the socket holds not yet acknowledged, only a part of the backlog: SO_SNDBUF caps it, the
+ * rest queues in the server.
+ */
+static gboolean read_unsent(GSocket *socket, guint *bytes) {
+    int queued = 0;
+    if (g_socket_is_closed(socket) ||
+        ioctl(g_socket_get_fd(socket), SIOCOUTQ, &queued) < 0 || queued < 0) {
+        return FALSE;
+    }
+
+    *bytes = (guint) queued;
+    return TRUE;
+}
+
+/*
+ * Counts from what the connection acknowledged and still holds now, i.e. from what it was
+ * handed so far, for the bytes handed from now on to make the backlog.
+ */
+static void start_counting(TcpConnection *connection) {
+    guint64 acked = 0;
+    guint unsent = 0;
+    read_acked(connection->socket, &acked);
+    read_unsent(connection->socket, &unsent);
+
+    connection->acked_baseline = acked + unsent;
+    connection->handed_bytes = 0;
+    connection->first_mark = 0;
+    connection->n_marks = 0;
+}
+
+static gint64 backlog_age(TcpConnection *connection, guint64 delivered, gint64 now) {
+    // The oldest byte not acknowledged yet was handed by the first mark past it
+    for (guint i = 0; i < connection->n_marks; i++) {
+        BacklogMark *mark = &connection->marks[(connection->first_mark + i) % BACKLOG_MARKS];
+        if (mark->handed_bytes > delivered) {
+            return now - mark->time;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Deactivating a transport drops what the server queued for it. Reactivated, it joins the stream
+ * again where it is, like a new client would. From the main context: this takes the locks of the
+ * stream, which the data path must not wait for.
+ */
+static void set_transport_active(ClientTransport *entry, gboolean active) {
+    g_mutex_lock(&entry->lock);
+    // A removed transport must not be added back to its stream
+    if (!entry->removed && entry->gated == active) {
+        gst_rtsp_stream_transport_set_active(entry->transport, active);
+        set_gated(entry, !active);
+        if (active) {
+            entry->resyncs++;
+        }
+    }
+    g_mutex_unlock(&entry->lock);
+}
+
+static gboolean poll_backlogs(SkywayClientMonitor *self) {
+    gint64 now = g_get_monotonic_time();
+    GPtrArray *resync_pads = g_ptr_array_new_with_free_func(gst_object_unref);
+    GPtrArray *deactivate = g_ptr_array_new_with_free_func(
+            (GDestroyNotify) client_transport_unref);
+    GPtrArray *reactivate = g_ptr_array_new_with_free_func(
+            (GDestroyNotify) client_transport_unref);
+
+    g_mutex_lock(&self->lock);
+    GHashTableIter iter;
+    TcpConnection *connection;
+    g_hash_table_iter_init(&iter, self->connections);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &connection)) {
+        guint64 acked = 0;
+        guint unsent = 0;
+        if (!read_acked(connection->socket, &acked) || !read_unsent(connection->socket, &unsent)) {
+            continue;
+        }
+
+        gboolean overflowed = FALSE;
+        gboolean drained = FALSE;
+        guint drained_bytes = self->max_backlog_bytes ? self->max_backlog_bytes / 4
+                                                      : DRAINED_BYTES;
+        g_mutex_lock(&connection->lock);
+        if (!connection->flushing) {
+            // RTSP responses and RTCP are acknowledged as well without being counted as handed,
+            // which only makes the backlog look smaller than it is
+            guint64 delivered = acked > connection->acked_baseline
+                                ? acked - connection->acked_baseline : 0;
+            guint64 backlog = connection->handed_bytes > delivered
+                              ? connection->handed_bytes - delivered : 0;
+            gint64 age_ms = backlog_age(connection, delivered, now) / G_TIME_SPAN_MILLISECOND;
+            if ((self->max_backlog_bytes && backlog > self->max_backlog_bytes) ||
+                (self->max_backlog_delay_ms && age_ms > self->max_backlog_delay_ms)) {
+                g_print("Client %s: TCP backlog of %" G_GUINT64_FORMAT " bytes (%"
+                        G_GINT64_FORMAT "ms), flushing it\n", connection->client_ip, backlog,
+                        age_ms);
+                connection->flushing = TRUE;
+                overflowed = TRUE;
+                self->backlog_stats.overflows++;
+            }
+        } else if (unsent <= drained_bytes) {
+            // Nothing is handed to the deactivated transports, and the connection writes what it
+            // still queued as soon as the socket has room: so it drained along with the socket
+            connection->flushing = FALSE;
+            start_counting(connection);
+            drained = TRUE;
+        }
+        g_mutex_unlock(&connection->lock);
+
+        for (guint i = 0; (overflowed || drained) && i < self->transports->len; i++) {
+            ClientTransport *entry = g_ptr_array_index(self->transports, i);
+            if (entry->connection != connection) {
+                continue;
+            }
+
+            g_ptr_array_add(overflowed ? deactivate : reactivate, client_transport_ref(entry));
+            if (drained) {
+                g_ptr_array_add(resync_pads, gst_object_ref(entry->probe->sink_pad));
+            }
+        }
+    }
+    g_mutex_unlock(&self->lock);
+
+    for (guint i = 0; i < deactivate->len; i++) {
+        set_transport_active(g_ptr_array_index(deactivate, i), FALSE);
+    }
+    for (guint i = 0; i < reactivate->len; i++) {
+        set_transport_active(g_ptr_array_index(reactivate, i), TRUE);
+    }
+    g_ptr_array_unref(deactivate);
+    g_ptr_array_unref(reactivate);
+
+    // Ask an encoder upstream, if any honours it, for an IRAP the resumed clients can decode from
+    for (guint i = 0; i < resync_pads->len; i++) {
+        gst_pad_send_event(g_ptr_array_index(resync_pads, i),
+                           gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE,
+                                                                       0));
+    }
+    g_ptr_array_unref(resync_pads);
+
+    return G_SOURCE_CONTINUE;
+}
@@ -0,0 +1,77 @@
+#ifndef SKYWAY_CLIENT_MONITOR_H
+#define SKYWAY_CLIENT_MONITOR_H
+
+#include <gst/gst.h>
+#include <gst/rtsp-server/rtsp-server.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+    SKYWAY_THIN_NONE,
+    SKYWAY_THIN_NON_REFERENCE,
+    SKYWAY_THIN_IDR_ONLY
+} SkywayThinLevel;
+
+typedef struct _SkywayBacklogStats {
+    // Times a TCP-interleaved client fell behind by more than the backlog limit
+    guint64 overflows;
+    // Times a transport of such a client was resumed at an IRAP once its backlog drained
+    guint64 resyncs;
+    // Frames not sent to such clients in the meantime
+    guint64 skipped_frames;
+} SkywayBacklogStats;
+
+typedef struct _SkywayClientMonitor SkywayClientMonitor;
+
+typedef struct _SkywayMediaProbe SkywayMediaProbe;
+
+/*
+ * Watches the RTCP receiver reports of every client playing over unicast UDP. When a client
+ * reports congestion, the frames sent to that client only are thinned, whole frames being held
+ * back where the stream's multiudpsink sends them.
+ */
+SkywayClientMonitor *skyway_client_monitor_new();
+
+/*
+ * Thinning is disabled until enabled here.
+ */
+void skyway_client_monitor_set_thinning(SkywayClientMonitor *self, gboolean enabled,
+                                        gboolean allow_idr_only);
+
+/*
+ * A TCP-interleaved client that has more than max_bytes handed to it but not acknowledged yet,
+ * or data handed more than max_delay_ms ago (0 for no limit), has that backlog flushed: its
+ * transports are deactivated, which drops what the server queued for them, until its socket
+ * drained. They then resume where the stream is, and an IRAP is requested upstream for them.
+ * Other clients of the media are not held back meanwhile. Both limits are off by default.
+ */
+void skyway_client_monitor_set_tcp_backlog_limit(SkywayClientMonitor *self, guint max_bytes,
+                                                 guint max_delay_ms);
+
+void skyway_client_monitor_get_backlog_stats(SkywayClientMonitor *self,
+                                             SkywayBacklogStats *stats);
+
+void skyway_client_monitor_watch_client(SkywayClientMonitor *self, GstRTSPClient *client);
+
+SkywayMediaProbe *
+skyway_client_monitor_attach_media(SkywayClientMonitor *self, GstRTSPMedia *media,
+                                   GstElement *payloader);
+
+/*
+ * How many client transports are thinned for congestion right now, and how many frames were
+ * held back from clients so far, over all media.
+ */
+void skyway_client_monitor_get_congestion(SkywayClientMonitor *self, guint *congested_clients,
+                                          guint64 *dropped_frames);
+
+void skyway_client_monitor_detach_media(SkywayClientMonitor *self, SkywayMediaProbe *probe);
+
+/*
+ * Stops polling the clients, for the server to shut down. Media still attached keep their
+ * probes until detached.
+ */
+void skyway_client_monitor_stop(SkywayClientMonitor *self);
+
+G_END_DECLS
+
+#endif // SKYWAY_CLIENT_MONITOR_H
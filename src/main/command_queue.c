@@ -0,0 +1,186 @@
+#include "command_queue.h"
+
+struct _SkywayFuture {
+    gint ref_count;
+    GMutex lock;
+    GCond cond;
+    gboolean done;
+    gpointer result;
+};
+
+typedef struct _Command {
+    struct _Command *next;
+    SkywayCommandFunc func;
+    gpointer data;
+    SkywayFuture *future;
+} Command;
+
+struct _SkywayCommandQueue {
+    // Pending commands, most recent first. Producers only ever push, the consumer takes all.
+    Command *head;
+    gint closed;
+    GMainContext *context;
+    GSource *source;
+};
+
+typedef struct _QueueSource {
+    GSource parent;
+    SkywayCommandQueue *queue;
+} QueueSource;
+
+static SkywayFuture *future_new();
+
+static void future_resolve(SkywayFuture *future, gpointer result);
+
+static void drain(SkywayCommandQueue *self, gboolean run);
+
+static gboolean
+queue_source_dispatch(GSource *source, __attribute__ ((unused)) GSourceFunc callback,
+                      __attribute__ ((unused)) gpointer user_data);
+
+static GSourceFuncs queue_source_funcs = {
+        .dispatch = queue_source_dispatch,
+};
+
+static SkywayFuture *future_new() {
+    SkywayFuture *future = g_new0(SkywayFuture, 1);
+    future->ref_count = 1;
+    g_mutex_init(&future->lock);
+    g_cond_init(&future->cond);
+    future->done = FALSE;
+    future->result = NULL;
+    return future;
+}
+
+static void future_resolve(SkywayFuture *future, gpointer result) {
+    g_mutex_lock(&future->lock);
+    future->result = result;
+    future->done = TRUE;
+    g_cond_broadcast(&future->cond);
+    g_mutex_unlock(&future->lock);
+}
+
+gpointer skyway_future_wait(SkywayFuture *future) {
+    g_mutex_lock(&future->lock);
+    while (!future->done) {
+        g_cond_wait(&future->cond, &future->lock);
+    }
+    gpointer result = future->result;
+    g_mutex_unlock(&future->lock);
+
+    return result;
+}
+
+gboolean skyway_future_is_done(SkywayFuture *future) {
+    g_mutex_lock(&future->lock);
+    gboolean done = future->done;
+    g_mutex_unlock(&future->lock);
+
+    return done;
+}
+
+SkywayFuture *skyway_future_ref(SkywayFuture *future) {
+    g_atomic_int_inc(&future->ref_count);
+    return future;
+}
+
+void skyway_future_unref(SkywayFuture *future) {
+    if (g_atomic_int_dec_and_test(&future->ref_count)) {
+        g_mutex_clear(&future->lock);
+        g_cond_clear(&future->cond);
+        g_free(future);
+    }
+}
+
+SkywayCommandQueue *skyway_command_queue_new(GMainContext *context) {
+    SkywayCommandQueue *self = g_new0(SkywayCommandQueue, 1);
+    self->head = NULL;
+    self->closed = FALSE;
+    self->context = g_main_context_ref(context);
+
+    self->source = g_source_new(&queue_source_funcs, sizeof(QueueSource));
+    ((QueueSource *) self->source)->queue = self;
+    g_source_set_priority(self->source, G_PRIORITY_HIGH);
+    g_source_set_ready_time(self->source, -1);
+    g_source_attach(self->source, context);
+
+    return self;
+}
+
+SkywayFuture *
+skyway_command_queue_push(SkywayCommandQueue *self, SkywayCommandFunc func, gpointer data) {
+    SkywayFuture *future = future_new();
+    if (g_atomic_int_get(&self->closed)) {
+        future_resolve(future, NULL);
+        return future;
+    }
+
+    Command *command = g_new0(Command, 1);
+    command->func = func;
+    command->data = data;
+    command->future = skyway_future_ref(future);
+
+    Command *head;
+    do {
+        head = g_atomic_pointer_get(&self->head);
+        command->next = head;
+    } while (!g_atomic_pointer_compare_and_exchange(&self->head, head, command));
+
+    if (g_atomic_int_get(&self->closed)) {
+        // Closed while we were pushing: nobody will drain the queue anymore
+        drain(self, FALSE);
+    } else {
+        g_source_set_ready_time(self->source, 0);
+    }
+
+    return future;
+}
+
+gpointer skyway_command_queue_call(SkywayCommandQueue *self, SkywayCommandFunc func, gpointer data) {
+    if (g_main_context_is_owner(self->context)) {
+        return func(data);
+    }
+
+    SkywayFuture *future = skyway_command_queue_push(self, func, data);
+    gpointer result = skyway_future_wait(future);
+    skyway_future_unref(future);
+
+    return result;
+}
+
+void skyway_command_queue_close(SkywayCommandQueue *self) {
+    g_atomic_int_set(&self->closed, TRUE);
+    drain(self, g_main_context_is_owner(self->context));
+    g_source_destroy(self->source);
+}
+
+static void drain(SkywayCommandQueue *self, gboolean run) {
+    Command *pending = g_atomic_pointer_exchange(&self->head, NULL);
+
+    // Reverse the stack so that commands run in the order they were pushed
+    Command *ordered = NULL;
+    while (pending) {
+        Command *next = pending->next;
+        pending->next = ordered;
+        ordered = pending;
+        pending = next;
+    }
+
+    while (ordered) {
+        Command *next = ordered->next;
+        future_resolve(ordered->future, run ? ordered->func(ordered->data) : NULL);
+        skyway_future_unref(ordered->future);
+        g_free(ordered);
+        ordered = next;
+    }
+}
+
+static gboolean
+queue_source_dispatch(GSource *source, __attribute__ ((unused)) GSourceFunc callback,
+                      __attribute__ ((unused)) gpointer user_data) {
+    // Re-arm before draining so that commands pushed meanwhile wake us up again
+    g_source_set_ready_time(source, -1);
+    drain(((QueueSource *) source)->queue, TRUE);
+
+    return G_SOURCE_CONTINUE;
+}
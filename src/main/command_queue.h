@@ -0,0 +1,48 @@
+#ifndef SKYWAY_COMMAND_QUEUE_H
+#define SKYWAY_COMMAND_QUEUE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef gpointer (*SkywayCommandFunc)(gpointer data);
+
+typedef struct _SkywayCommandQueue SkywayCommandQueue;
+
+typedef struct _SkywayFuture SkywayFuture;
+
+/*
+ * Multi-producer, single-consumer queue of control commands. Any thread can push without taking
+ * a lock, the commands are run in order on the thread iterating the given main context.
+ */
+SkywayCommandQueue *skyway_command_queue_new(GMainContext *context);
+
+/*
+ * Returns a future resolved with the command's result once it ran. Once the queue is closed,
+ * commands are not run anymore and their future resolves to NULL.
+ */
+SkywayFuture *
+skyway_command_queue_push(SkywayCommandQueue *self, SkywayCommandFunc func, gpointer data);
+
+/*
+ * Pushes the command and waits for its result. Runs it directly when called from the main
+ * context's own thread, which would otherwise deadlock.
+ */
+gpointer skyway_command_queue_call(SkywayCommandQueue *self, SkywayCommandFunc func, gpointer data);
+
+/*
+ * Runs the commands still queued, then refuses new ones.
+ */
+void skyway_command_queue_close(SkywayCommandQueue *self);
+
+gpointer skyway_future_wait(SkywayFuture *future);
+
+gboolean skyway_future_is_done(SkywayFuture *future);
+
+SkywayFuture *skyway_future_ref(SkywayFuture *future);
+
+void skyway_future_unref(SkywayFuture *future);
+
+G_END_DECLS
+
+#endif // SKYWAY_COMMAND_QUEUE_H
@@ -0,0 +1,93 @@
+#include "congestion.h"
+
+#define POLL_INTERVAL_MS 250
+
+#define REPEAT_INTERVAL_US G_USEC_PER_SEC
+
+// Out of the 5 samples a media queues, see custom_media_prepare
+#define RISING_QUEUE_DEPTH 2
+
+struct _SkywayCongestionWatch {
+    GWeakRef *proxy;
+    SkywayClientMonitor *monitor;
+    SkywayCongestionFunc func;
+    gpointer user_data;
+    GDestroyNotify notify;
+    guint poll_source;
+    SkywayCongestion last;
+    gint64 last_report_time;
+};
+
+static gboolean poll_congestion(SkywayCongestionWatch *self);
+
+SkywayCongestionWatch *
+skyway_congestion_watch_new(GWeakRef *proxy, SkywayClientMonitor *monitor,
+                            SkywayCongestionFunc func, gpointer user_data, GDestroyNotify notify) {
+    SkywayCongestionWatch *self = g_new0(SkywayCongestionWatch, 1);
+    self->proxy = proxy;
+    self->monitor = monitor;
+    self->func = func;
+    self->user_data = user_data;
+    self->notify = notify;
+    self->last.level = SKYWAY_CONGESTION_NONE;
+
+    SkywayAppSinkProxy *current = g_weak_ref_get(proxy);
+    if (current) {
+        SkywayBackpressure backpressure;
+        skyway_app_sink_proxy_get_backpressure(current, &backpressure);
+        self->last.dropped_samples = backpressure.dropped_samples;
+        g_object_unref(current);
+    }
+    skyway_client_monitor_get_congestion(monitor, &self->last.congested_clients,
+                                         &self->last.client_dropped_frames);
+
+    self->poll_source = g_timeout_add(POLL_INTERVAL_MS, (GSourceFunc) poll_congestion, self);
+    return self;
+}
+
+void skyway_congestion_watch_free(SkywayCongestionWatch *self) {
+    g_source_remove(self->poll_source);
+    if (self->notify) {
+        self->notify(self->user_data);
+    }
+    g_free(self);
+}
+
+static gboolean poll_congestion(SkywayCongestionWatch *self) {
+    SkywayCongestion congestion = {0};
+
+    SkywayAppSinkProxy *proxy = g_weak_ref_get(self->proxy);
+    if (proxy) {
+        SkywayBackpressure backpressure;
+        skyway_app_sink_proxy_get_backpressure(proxy, &backpressure);
+        congestion.queue_depth = backpressure.queue_depth;
+        congestion.dropped_samples = backpressure.dropped_samples;
+        g_object_unref(proxy);
+    }
+    skyway_client_monitor_get_congestion(self->monitor, &congestion.congested_clients,
+                                         &congestion.client_dropped_frames);
+
+    // A different proxy counts from 0 again, any change is new drops
+    if (congestion.dropped_samples != self->last.dropped_samples ||
+        congestion.client_dropped_frames > self->last.client_dropped_frames) {
+        congestion.level = SKYWAY_CONGESTION_DROPPING;
+    } else if (congestion.queue_depth >= RISING_QUEUE_DEPTH || congestion.congested_clients > 0) {
+        congestion.level = SKYWAY_CONGESTION_RISING;
+    } else {
+        congestion.level = SKYWAY_CONGESTION_NONE;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    gboolean report = congestion.level != self->last.level ||
+                      (congestion.level != SKYWAY_CONGESTION_NONE &&
+                       now - self->last_report_time >= REPEAT_INTERVAL_US);
+
+    // Drops are counted from one poll to the next, whether reported or not
+    self->last = congestion;
+    if (report) {
+        self->last_report_time = now;
+        self->func(&congestion, self->user_data);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
@@ -0,0 +1,46 @@
+#ifndef SKYWAY_CONGESTION_H
+#define SKYWAY_CONGESTION_H
+
+#include <glib.h>
+
+#include "appsink_proxy.h"
+#include "client_monitor.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+    SKYWAY_CONGESTION_NONE,
+    // Queues are filling up or clients report loss, nothing is dropped yet
+    SKYWAY_CONGESTION_RISING,
+    // Frames were dropped since the last report
+    SKYWAY_CONGESTION_DROPPING,
+} SkywayCongestionLevel;
+
+typedef struct _SkywayCongestion {
+    SkywayCongestionLevel level;
+    guint queue_depth;
+    guint dropped_samples;
+    guint congested_clients;
+    guint64 client_dropped_frames;
+} SkywayCongestion;
+
+typedef void (*SkywayCongestionFunc)(const SkywayCongestion *congestion, gpointer user_data);
+
+typedef struct _SkywayCongestionWatch SkywayCongestionWatch;
+
+/*
+ * Samples, from the default main context, the backpressure of whichever proxy the weak reference
+ * points to at the time and the congestion of the clients. Calls func there when the level
+ * changes, and at most once per second while it stays above SKYWAY_CONGESTION_NONE, so that a
+ * producer can lower its bitrate or frame rate before frames have to be dropped. The weak
+ * reference must outlive the watch.
+ */
+SkywayCongestionWatch *
+skyway_congestion_watch_new(GWeakRef *proxy, SkywayClientMonitor *monitor,
+                            SkywayCongestionFunc func, gpointer user_data, GDestroyNotify notify);
+
+void skyway_congestion_watch_free(SkywayCongestionWatch *self);
+
+G_END_DECLS
+
+#endif // SKYWAY_CONGESTION_H
@@ -0,0 +1,146 @@
+#include "derived_sink.h"
+
+#include <gst/gst.h>
+
+#include "h265_nal.h"
+
+typedef struct _SkywayDerivedSinkPrivate {
+    SkywayAppSinkProxy *source;
+    SkywayDerivedMode mode;
+    gint max_temporal_id;
+    gint64 min_interval_us;
+    gint64 last_forward_us;
+    gulong new_sample_handle;
+} SkywayDerivedSinkPrivate;
+
+G_DEFINE_TYPE_WITH_PRIVATE(SkywayDerivedSink, skyway_derived_sink, SKYWAY_TYPE_APP_SINK_PROXY)
+
+static void skyway_derived_sink_class_init(SkywayDerivedSinkClass *klass);
+
+static void skyway_derived_sink_init(SkywayDerivedSink *self);
+
+static gboolean skyway_derived_sink_play(SkywayDerivedSink *self);
+
+static void skyway_derived_sink_stop(SkywayDerivedSink *self);
+
+static gboolean should_forward(SkywayDerivedSinkPrivate *priv, GstSample *sample);
+
+static GstFlowReturn
+source_sample_handler(__attribute__ ((unused)) SkywayAppSinkProxy *source, GstSample *sample,
+                      SkywayDerivedSink *self);
+
+static void skyway_derived_sink_dispose(GObject *object);
+
+static void skyway_derived_sink_class_init(SkywayDerivedSinkClass *klass) {
+    g_print("skyway_derived_sink_class_init()\n");
+
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    object_class->dispose = skyway_derived_sink_dispose;
+
+    klass->parent_class.play = skyway_derived_sink_play;
+    klass->parent_class.stop = skyway_derived_sink_stop;
+}
+
+static void skyway_derived_sink_init(__attribute__ ((unused)) SkywayDerivedSink *self) {
+    g_print("skyway_derived_sink_init()\n");
+}
+
+SkywayDerivedSink *skyway_derived_sink_new(SkywayAppSinkProxy *source, SkywayDerivedMode mode,
+                                           gint max_temporal_id, guint max_fps) {
+    SkywayDerivedSink *self = g_object_new(SKYWAY_TYPE_DERIVED_SINK, NULL);
+    SkywayDerivedSinkPrivate *priv = skyway_derived_sink_get_instance_private(self);
+
+    priv->source = g_object_ref(source);
+    priv->mode = mode;
+    priv->max_temporal_id = max_temporal_id;
+    priv->min_interval_us = max_fps > 0 ? G_USEC_PER_SEC / max_fps : 0;
+    priv->last_forward_us = 0;
+
+    return self;
+}
+
+static gboolean skyway_derived_sink_play(SkywayDerivedSink *self) {
+    SkywayDerivedSinkPrivate *priv = skyway_derived_sink_get_instance_private(self);
+
+    if (!skyway_app_sink_proxy_play(priv->source)) {
+        g_printerr("Failed to play the source of a derived stream\n");
+        return FALSE;
+    }
+
+    priv->last_forward_us = 0;
+    priv->new_sample_handle = g_signal_connect(priv->source, "new-sample",
+                                               G_CALLBACK(source_sample_handler), self);
+    return TRUE;
+}
+
+static void skyway_derived_sink_stop(SkywayDerivedSink *self) {
+    SkywayDerivedSinkPrivate *priv = skyway_derived_sink_get_instance_private(self);
+
+    g_signal_handler_disconnect(priv->source, priv->new_sample_handle);
+    priv->new_sample_handle = 0;
+    skyway_app_sink_proxy_stop(priv->source);
+
+    skyway_app_sink_proxy_emit_eos(SKYWAY_APP_SINK_PROXY(self));
+}
+
+static gboolean should_forward(SkywayDerivedSinkPrivate *priv, GstSample *sample) {
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    GstMapInfo map;
+    if (!buffer || !gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        return FALSE;
+    }
+
+    SkywayH265AccessUnitInfo info;
+    gboolean parsed = skyway_h265_parse_access_unit(map.data, map.size, &info);
+    gst_buffer_unmap(buffer, &map);
+
+    // Without Annex-B we cannot tell frames apart, and parameter sets are always needed
+    if (!parsed || !info.has_vcl) {
+        return TRUE;
+    }
+
+    if (priv->mode == SKYWAY_DERIVED_TEMPORAL_LAYERS) {
+        return info.max_temporal_id <= priv->max_temporal_id;
+    }
+
+    if (!info.has_irap) {
+        return FALSE;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    if (priv->last_forward_us != 0 && now - priv->last_forward_us < priv->min_interval_us) {
+        return FALSE;
+    }
+
+    priv->last_forward_us = now;
+    return TRUE;
+}
+
+static GstFlowReturn
+source_sample_handler(__attribute__ ((unused)) SkywayAppSinkProxy *source, GstSample *sample,
+                      SkywayDerivedSink *self) {
+    SkywayDerivedSinkPrivate *priv = skyway_derived_sink_get_instance_private(self);
+
+    if (should_forward(priv, sample)) {
+        skyway_app_sink_proxy_emit_sample(SKYWAY_APP_SINK_PROXY(self), sample);
+    }
+
+    // Never let a derived consumer stop the source
+    return GST_FLOW_OK;
+}
+
+static void skyway_derived_sink_dispose(GObject *object) {
+    g_print("skyway_derived_sink_dispose()\n");
+    SkywayDerivedSinkPrivate *priv = skyway_derived_sink_get_instance_private(
+            SKYWAY_DERIVED_SINK(object));
+
+    // Still playing: give back the play taken on the source, for it to linger or stop
+    if (priv->new_sample_handle) {
+        g_signal_handler_disconnect(priv->source, priv->new_sample_handle);
+        priv->new_sample_handle = 0;
+        skyway_app_sink_proxy_stop(priv->source);
+    }
+    g_clear_object(&priv->source);
+
+    G_OBJECT_CLASS (skyway_derived_sink_parent_class)->dispose(object);
+}
@@ -0,0 +1,34 @@
+#ifndef SKYWAY_DERIVED_SINK_H
+#define SKYWAY_DERIVED_SINK_H
+
+#include "appsink_proxy.h"
+
+G_BEGIN_DECLS
+
+#define SKYWAY_TYPE_DERIVED_SINK (skyway_derived_sink_get_type())
+
+typedef enum {
+    SKYWAY_DERIVED_IDR_ONLY,
+    SKYWAY_DERIVED_TEMPORAL_LAYERS
+} SkywayDerivedMode;
+
+typedef struct _SkywayDerivedSink {
+    SkywayAppSinkProxy parent;
+} SkywayDerivedSink;
+
+G_DECLARE_FINAL_TYPE(SkywayDerivedSink, skyway_derived_sink, SKYWAY, DERIVED_SINK,
+                     SkywayAppSinkProxy)
+
+GType skyway_derived_sink_get_type(void);
+
+/*
+ * Forwards a subset of the access units of another proxy, without decoding: either only the
+ * IRAP frames (at most max_fps of them per second, 0 for no limit), or only the frames whose
+ * TemporalId is at most max_temporal_id.
+ */
+SkywayDerivedSink *skyway_derived_sink_new(SkywayAppSinkProxy *source, SkywayDerivedMode mode,
+                                           gint max_temporal_id, guint max_fps);
+
+G_END_DECLS
+
+#endif // SKYWAY_DERIVED_SINK_H
@@ -3,16 +3,25 @@
 #include <gst/gst.h>
 #include <gst/base/base.h>
 
+#include "h265_nal.h"
+#include "push_record.h"
+
 enum playing_state {
     STOPPED,
     PLAYING
 };
 
 typedef struct _SkywayGstBufferToSinkPrivate {
-    enum playing_state playing_state;
+    gint playing_state; // enum playing_state, the control and pushing threads both access it
     guint num_buffers;
     guint max_buffers;
     GstQueueArray *queue;
+    // Of the last access unit that carried parameter sets, only touched by the pushing thread
+    gboolean has_parameter_sets;
+    guint32 parameter_set_hash;
+    // Started and stopped from the control thread, written to by the pushing thread
+    GMutex recorder_lock;
+    SkywayPushRecorder *recorder;
 } SkywayGstBufferToSinkPrivate;
 
 #define DEFAULT_PROP_MAX_BUFFERS 1
@@ -30,13 +39,18 @@ static void skyway_gstbuffer_to_sink_stop(SkywayGstBufferToSink *self);
 
 static GstSample *skyway_gstbuffer_to_sink_pull_sample(SkywayGstBufferToSink *self);
 
+static void drain_queue(SkywayGstBufferToSinkPrivate *priv);
+
 static void skyway_gstbuffer_to_sink_dispose(GObject *object);
 
+static void skyway_gstbuffer_to_sink_finalize(GObject *object);
+
 static void skyway_gstbuffer_to_sink_class_init(SkywayGstBufferToSinkClass *klass) {
     g_print("skyway_gstbuffer_to_sink_class_init()\n");
 
     GObjectClass *object_class = G_OBJECT_CLASS(klass);
     object_class->dispose = skyway_gstbuffer_to_sink_dispose;
+    object_class->finalize = skyway_gstbuffer_to_sink_finalize;
 
     klass->parent_class.play = skyway_gstbuffer_to_sink_play;
     klass->parent_class.stop = skyway_gstbuffer_to_sink_stop;
@@ -51,6 +65,10 @@ static void skyway_gstbuffer_to_sink_init(SkywayGstBufferToSink *self) {
     priv->max_buffers = DEFAULT_PROP_MAX_BUFFERS;
     priv->num_buffers = 0;
     priv->queue = gst_queue_array_new(16);
+    priv->has_parameter_sets = FALSE;
+    priv->parameter_set_hash = 0;
+    g_mutex_init(&priv->recorder_lock);
+    priv->recorder = NULL;
 }
 
 SkywayGstBufferToSink *skyway_gstbuffer_to_sink_new() {
@@ -59,37 +77,106 @@ SkywayGstBufferToSink *skyway_gstbuffer_to_sink_new() {
 
 static gboolean skyway_gstbuffer_to_sink_play(SkywayGstBufferToSink *self) {
     SkywayGstBufferToSinkPrivate *priv = skyway_gstbuffer_to_sink_get_instance_private(self);
-    priv->playing_state = PLAYING;
+    g_atomic_int_set(&priv->playing_state, PLAYING);
     return TRUE;
 }
 
 static void skyway_gstbuffer_to_sink_stop(SkywayGstBufferToSink *self) {
     SkywayGstBufferToSinkPrivate *priv = skyway_gstbuffer_to_sink_get_instance_private(self);
-    priv->playing_state = STOPPED;
-    gst_queue_array_clear(priv->queue);
+    // The queue belongs to the pushing thread, which drains it on its first push after the stop
+    g_atomic_int_set(&priv->playing_state, STOPPED);
 
     skyway_app_sink_proxy_emit_eos(SKYWAY_APP_SINK_PROXY(self));
 }
 
+void skyway_gstbuffer_to_sink_classify_buffer(SkywayGstBufferToSink *self, GstBuffer *buffer) {
+    SkywayGstBufferToSinkPrivate *priv = skyway_gstbuffer_to_sink_get_instance_private(self);
+
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        return;
+    }
+
+    SkywayH265AccessUnitInfo info;
+    gboolean parsed = skyway_h265_parse_access_unit(map.data, map.size, &info);
+    gst_buffer_unmap(buffer, &map);
+    if (!parsed) {
+        return;
+    }
+
+    if (info.has_vcl && !info.has_irap) {
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    } else {
+        GST_BUFFER_FLAG_UNSET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    }
+
+    if (info.has_parameter_sets) {
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_HEADER);
+        if (priv->has_parameter_sets && priv->parameter_set_hash != info.parameter_set_hash) {
+            GST_BUFFER_FLAG_SET(buffer, SKYWAY_BUFFER_FLAG_PARAMETER_SETS_CHANGED);
+        }
+        priv->has_parameter_sets = TRUE;
+        priv->parameter_set_hash = info.parameter_set_hash;
+    }
+}
+
 GstFlowReturn skyway_gstbuffer_to_sink_push_sample(SkywayGstBufferToSink *self, GstSample *sample) {
     SkywayGstBufferToSinkPrivate *priv = skyway_gstbuffer_to_sink_get_instance_private(self);
 
-    if (priv->playing_state == STOPPED) {
+    // Before anything may drop it, a replay goes through the same drops. Only queued for the
+    // recorder's thread, the lock is never held across a write
+    g_mutex_lock(&priv->recorder_lock);
+    if (priv->recorder) {
+        skyway_push_recorder_write(priv->recorder, sample);
+    }
+    g_mutex_unlock(&priv->recorder_lock);
+
+    if (g_atomic_int_get(&priv->playing_state) == STOPPED) {
+        drain_queue(priv);
         return GST_FLOW_OK;
     }
 
     while (priv->max_buffers > 0 && priv->num_buffers >= priv->max_buffers) {
         g_print("Dropping oldest sample\n");
-        gst_queue_array_pop_head(priv->queue);
+        gst_sample_unref(gst_queue_array_pop_head(priv->queue));
         priv->num_buffers--;
     }
 
-    gst_queue_array_push_tail(priv->queue, sample);
+    // The caller keeps its reference, the queue holds its own until the sample is pulled
+    gst_queue_array_push_tail(priv->queue, gst_sample_ref(sample));
     priv->num_buffers++;
 
     return skyway_app_sink_proxy_emit_new_sample(SKYWAY_APP_SINK_PROXY(self));
 }
 
+gboolean skyway_gstbuffer_to_sink_start_recording(SkywayGstBufferToSink *self, const gchar *path) {
+    SkywayGstBufferToSinkPrivate *priv = skyway_gstbuffer_to_sink_get_instance_private(self);
+    SkywayPushRecorder *recorder = skyway_push_recorder_new(path);
+    if (!recorder) {
+        return FALSE;
+    }
+
+    g_mutex_lock(&priv->recorder_lock);
+    SkywayPushRecorder *previous = priv->recorder;
+    priv->recorder = recorder;
+    g_mutex_unlock(&priv->recorder_lock);
+
+    // Waits for its pending samples, which pushes need not
+    g_clear_pointer(&previous, skyway_push_recorder_free);
+
+    g_print("Recording pushed frames to %s\n", path);
+    return TRUE;
+}
+
+void skyway_gstbuffer_to_sink_stop_recording(SkywayGstBufferToSink *self) {
+    SkywayGstBufferToSinkPrivate *priv = skyway_gstbuffer_to_sink_get_instance_private(self);
+    g_mutex_lock(&priv->recorder_lock);
+    SkywayPushRecorder *recorder = g_steal_pointer(&priv->recorder);
+    g_mutex_unlock(&priv->recorder_lock);
+
+    g_clear_pointer(&recorder, skyway_push_recorder_free);
+}
+
 static GstSample *skyway_gstbuffer_to_sink_pull_sample(SkywayGstBufferToSink *self) {
     SkywayGstBufferToSinkPrivate *priv = skyway_gstbuffer_to_sink_get_instance_private(self);
 
@@ -103,11 +190,31 @@ static GstSample *skyway_gstbuffer_to_sink_pull_sample(SkywayGstBufferToSink *se
     return sample;
 }
 
+static void drain_queue(SkywayGstBufferToSinkPrivate *priv) {
+    while (priv->num_buffers > 0) {
+        gst_sample_unref(gst_queue_array_pop_head(priv->queue));
+        priv->num_buffers--;
+    }
+}
+
 static void skyway_gstbuffer_to_sink_dispose(GObject *object) {
     g_print("skyway_gstbuffer_to_sink_dispose()\n");
     SkywayGstBufferToSinkPrivate *priv = skyway_gstbuffer_to_sink_get_instance_private(
             SKYWAY_GSTBUFFER_TO_SINK(object));
-    gst_queue_array_free(priv->queue);
+    if (priv->queue) {
+        drain_queue(priv);
+        gst_queue_array_free(priv->queue);
+        priv->queue = NULL;
+    }
+    skyway_gstbuffer_to_sink_stop_recording(SKYWAY_GSTBUFFER_TO_SINK(object));
 
     G_OBJECT_CLASS (skyway_gstbuffer_to_sink_parent_class)->dispose(object);
 }
+
+static void skyway_gstbuffer_to_sink_finalize(GObject *object) {
+    SkywayGstBufferToSinkPrivate *priv = skyway_gstbuffer_to_sink_get_instance_private(
+            SKYWAY_GSTBUFFER_TO_SINK(object));
+    g_mutex_clear(&priv->recorder_lock);
+
+    G_OBJECT_CLASS (skyway_gstbuffer_to_sink_parent_class)->finalize(object);
+}
@@ -14,9 +14,30 @@ typedef struct _SkywayGstBufferToSink {
 G_DECLARE_FINAL_TYPE(SkywayGstBufferToSink, skyway_gstbuffer_to_sink, SKYWAY, GSTBUFFER_TO_SINK, SkywayAppSinkProxy)
 GType skyway_gstbuffer_to_sink_get_type(void);
 
+/*
+ * On an access unit whose parameter sets differ from the ones seen before (e.g. the encoder
+ * changed resolution). The stream goes on without a gap, which DISCONT would claim.
+ */
+#define SKYWAY_BUFFER_FLAG_PARAMETER_SETS_CHANGED GST_BUFFER_FLAG_LAST
+
 SkywayGstBufferToSink* skyway_gstbuffer_to_sink_new();
+/*
+ * Flags a pushed Annex-B access unit from its NAL units: DELTA_UNIT unless it is an IRAP, HEADER
+ * if it carries parameter sets, and SKYWAY_BUFFER_FLAG_PARAMETER_SETS_CHANGED if those changed.
+ * Other data is left alone. The buffer must be writable.
+ */
+void skyway_gstbuffer_to_sink_classify_buffer(SkywayGstBufferToSink *self, GstBuffer *buffer);
+
 GstFlowReturn skyway_gstbuffer_to_sink_push_sample(SkywayGstBufferToSink* self, GstSample* sample);
 
+/*
+ * Records every sample pushed from now on, also while no client plays, into path (see
+ * push_record.h), replacing any recording in progress. Returns FALSE if path cannot be created.
+ */
+gboolean skyway_gstbuffer_to_sink_start_recording(SkywayGstBufferToSink *self, const gchar *path);
+
+void skyway_gstbuffer_to_sink_stop_recording(SkywayGstBufferToSink *self);
+
 G_END_DECLS
 
 #endif // SKYWAY_GSTBUFFER_TO_SINK_H
@@ -0,0 +1,180 @@
+#include "h265_nal.h"
+
+#include <string.h>
+
+#if !defined(SKYWAY_H265_SCALAR) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SKYWAY_H265_SSE2
+#elif !defined(SKYWAY_H265_SCALAR) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SKYWAY_H265_NEON
+#endif
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+static const guint8 *find_start_code_scalar(const guint8 *data, const guint8 *end);
+
+static guint32 hash_bytes(guint32 hash, const guint8 *data, const guint8 *end);
+
+static gboolean nal_is_random_access_point(guint8 nal_type);
+
+static const guint8 *find_start_code_scalar(const guint8 *data, const guint8 *end) {
+    while (end - data >= 3) {
+        if (data[2] > 1) {
+            data += 3;
+        } else if (data[2] == 0) {
+            data++;
+        } else if (data[0] == 0 && data[1] == 0) {
+            return data + 3;
+        } else {
+            data += 3;
+        }
+    }
+
+    return end;
+}
+
+/*
+ * 16 candidate positions at a time: a start code begins at i if bytes i, i + 1 and i + 2 are
+ * 00 00 01, which three overlapping loads compare at once. Slice data rarely contains zeros, so
+ * almost every block is rejected with a single branch.
+ */
+const guint8 *skyway_h265_find_start_code(const guint8 *data, const guint8 *end) {
+#if defined(SKYWAY_H265_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    while (end - data >= 16 + 2) {
+        __m128i first = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) data), zero);
+        __m128i second = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (data + 1)), zero);
+        __m128i third = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (data + 2)), one);
+        guint mask = (guint) _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(first, second), third));
+        if (mask) {
+            return data + g_bit_nth_lsf(mask, -1) + 3;
+        }
+        data += 16;
+    }
+#elif defined(SKYWAY_H265_NEON)
+    while (end - data >= 16 + 2) {
+        uint8x16_t first = vceqq_u8(vld1q_u8(data), vdupq_n_u8(0));
+        uint8x16_t second = vceqq_u8(vld1q_u8(data + 1), vdupq_n_u8(0));
+        uint8x16_t third = vceqq_u8(vld1q_u8(data + 2), vdupq_n_u8(1));
+        uint8x16_t matches = vandq_u8(vandq_u8(first, second), third);
+        // Narrow to 4 bits per byte, NEON has no movemask
+        uint64_t mask = vget_lane_u64(
+                vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+        if (mask) {
+            return data + __builtin_ctzll(mask) / 4 + 3;
+        }
+        data += 16;
+    }
+#endif
+
+    return find_start_code_scalar(data, end);
+}
+
+static guint32 hash_bytes(guint32 hash, const guint8 *data, const guint8 *end) {
+    for (; data < end; data++) {
+        hash = (hash ^ *data) * FNV_PRIME;
+    }
+    return hash;
+}
+
+gboolean skyway_h265_nal_is_vcl(guint8 nal_type) {
+    return nal_type < 32;
+}
+
+gboolean skyway_h265_nal_is_irap(guint8 nal_type) {
+    return nal_type >= SKYWAY_H265_NAL_BLA_W_LP && nal_type <= SKYWAY_H265_NAL_RSV_IRAP_23;
+}
+
+gboolean skyway_h265_nal_is_sub_layer_reference(guint8 nal_type) {
+    // TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N and RSV_VCL_N10/12/14 are the even types up to 14
+    return !(nal_type <= 14 && nal_type % 2 == 0);
+}
+
+gboolean
+skyway_h265_parse_access_unit(const guint8 *data, gsize size, SkywayH265AccessUnitInfo *info) {
+    memset(info, 0, sizeof(*info));
+    info->max_temporal_id = -1;
+    info->parameter_set_hash = FNV_OFFSET_BASIS;
+
+    const guint8 *end = data + size;
+    if (size < 3 || data[0] != 0 || data[1] != 0) {
+        return FALSE;
+    }
+
+    const guint8 *nal = skyway_h265_find_start_code(data, end);
+    if (nal != data + 3 && nal != data + 4) {
+        return FALSE;
+    }
+
+    while (nal < end) {
+        const guint8 *next = skyway_h265_find_start_code(nal, end);
+
+        if (end - nal >= 2) {
+            guint8 nal_type = SKYWAY_H265_NAL_TYPE(nal);
+            info->nal_count++;
+
+            if (skyway_h265_nal_is_vcl(nal_type)) {
+                info->has_vcl = TRUE;
+                info->has_irap |= skyway_h265_nal_is_irap(nal_type);
+                info->has_reference |= skyway_h265_nal_is_sub_layer_reference(nal_type);
+
+                gint temporal_id = SKYWAY_H265_NAL_TEMPORAL_ID(nal);
+                if (temporal_id > info->max_temporal_id) {
+                    info->max_temporal_id = temporal_id;
+                }
+            } else if (nal_type >= SKYWAY_H265_NAL_VPS && nal_type <= SKYWAY_H265_NAL_PPS) {
+                // The next start code (and the zero byte of a 4-byte one) is not part of the NAL
+                const guint8 *nal_end = next < end ? next - 3 : end;
+                while (nal_end > nal && nal_end[-1] == 0) {
+                    nal_end--;
+                }
+                info->has_parameter_sets = TRUE;
+                info->parameter_set_hash = hash_bytes(info->parameter_set_hash, nal, nal_end);
+            }
+        }
+
+        nal = next;
+    }
+
+    return TRUE;
+}
+
+static gboolean nal_is_random_access_point(guint8 nal_type) {
+    return skyway_h265_nal_is_irap(nal_type) || nal_type == SKYWAY_H265_NAL_VPS;
+}
+
+gboolean skyway_h265_rtp_payload_is_random_access_point(const guint8 *payload, gsize size) {
+    if (size < 3) {
+        return FALSE;
+    }
+
+    switch (SKYWAY_H265_NAL_TYPE(payload)) {
+        case SKYWAY_H265_RTP_AGGREGATION_PACKET: {
+            // Up to the first picture, past e.g. an access unit delimiter
+            gsize offset = 2;
+            while (offset + 2 + 2 <= size) {
+                gsize nal_size = (payload[offset] << 8) | payload[offset + 1];
+                const guint8 *nal = payload + offset + 2;
+                if (nal_size < 2 || offset + 2 + nal_size > size) {
+                    return FALSE;
+                }
+                if (nal_is_random_access_point(SKYWAY_H265_NAL_TYPE(nal))) {
+                    return TRUE;
+                }
+                if (skyway_h265_nal_is_vcl(SKYWAY_H265_NAL_TYPE(nal))) {
+                    return FALSE;
+                }
+                offset += 2 + nal_size;
+            }
+            return FALSE;
+        }
+        case SKYWAY_H265_RTP_FRAGMENTATION_UNIT:
+            // Only the first fragment (S bit) starts the picture
+            return (payload[2] & 0x80) && skyway_h265_nal_is_irap(payload[2] & 0x3f);
+        default:
+            return nal_is_random_access_point(SKYWAY_H265_NAL_TYPE(payload));
+    }
+}
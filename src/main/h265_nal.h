@@ -0,0 +1,60 @@
+#ifndef SKYWAY_H265_NAL_H
+#define SKYWAY_H265_NAL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define SKYWAY_H265_NAL_BLA_W_LP 16
+#define SKYWAY_H265_NAL_RSV_IRAP_23 23
+#define SKYWAY_H265_NAL_VPS 32
+#define SKYWAY_H265_NAL_SPS 33
+#define SKYWAY_H265_NAL_PPS 34
+
+// RFC 7798 payload structures beside single NAL units
+#define SKYWAY_H265_RTP_AGGREGATION_PACKET 48
+#define SKYWAY_H265_RTP_FRAGMENTATION_UNIT 49
+
+#define SKYWAY_H265_NAL_TYPE(header) (((header)[0] >> 1) & 0x3f)
+#define SKYWAY_H265_NAL_TEMPORAL_ID(header) (((header)[1] & 0x07) - 1)
+
+typedef struct _SkywayH265AccessUnitInfo {
+    guint nal_count;
+    gboolean has_vcl;
+    gboolean has_irap;
+    gboolean has_reference;
+    gboolean has_parameter_sets;
+    gint max_temporal_id;
+    // Changes whenever the VPS, SPS or PPS content does, only meaningful if has_parameter_sets
+    guint32 parameter_set_hash;
+} SkywayH265AccessUnitInfo;
+
+/*
+ * Returns a pointer to the first byte following the next 00 00 01 start code in [data, end),
+ * or end if there is none. Uses SSE2 or NEON where available, unless built with
+ * SKYWAY_H265_SCALAR.
+ */
+const guint8 *skyway_h265_find_start_code(const guint8 *data, const guint8 *end);
+
+gboolean skyway_h265_nal_is_vcl(guint8 nal_type);
+
+gboolean skyway_h265_nal_is_irap(guint8 nal_type);
+
+gboolean skyway_h265_nal_is_sub_layer_reference(guint8 nal_type);
+
+/*
+ * Walks an Annex-B access unit and summarizes its NAL units. Returns FALSE if the data is not
+ * Annex-B (e.g. hvc1 length-prefixed), in which case info must not be trusted.
+ */
+gboolean
+skyway_h265_parse_access_unit(const guint8 *data, gsize size, SkywayH265AccessUnitInfo *info);
+
+/*
+ * Whether decoding can start at an RTP payload (RFC 7798, without DONL fields): the first
+ * fragment or NAL unit of an IRAP picture, or the VPS encoders send right ahead of one.
+ */
+gboolean skyway_h265_rtp_payload_is_random_access_point(const guint8 *payload, gsize size);
+
+G_END_DECLS
+
+#endif // SKYWAY_H265_NAL_H
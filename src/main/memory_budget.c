@@ -0,0 +1,124 @@
+#include "memory_budget.h"
+
+struct _SkywayMemoryBudget {
+    gsize limit;
+    // Pointer-sized so that the data plane can update them with plain atomics
+    gssize used;
+    gssize peak;
+    gint shed_samples;
+};
+
+typedef struct _Charge {
+    SkywayMemoryBudget *budget;
+    gssize bytes;
+} Charge;
+
+// Share of the budget (in percent) that streams of each priority may fill
+static const gssize priority_share[] = {
+        [SKYWAY_PRIORITY_LOW] = 60,
+        [SKYWAY_PRIORITY_NORMAL] = 85,
+        [SKYWAY_PRIORITY_HIGH] = 100,
+};
+
+static GQuark charge_quark(void);
+
+static void charge_buffer(SkywayMemoryBudget *self, GstBuffer *buffer);
+
+static void release_charge(Charge *charge);
+
+static void update_peak(SkywayMemoryBudget *self, gssize used);
+
+SkywayMemoryBudget *skyway_memory_budget_new(gsize limit) {
+    SkywayMemoryBudget *self = g_atomic_rc_box_new0(SkywayMemoryBudget);
+    self->limit = limit;
+    self->used = 0;
+    self->peak = 0;
+    self->shed_samples = 0;
+
+    return self;
+}
+
+SkywayMemoryBudget *skyway_memory_budget_ref(SkywayMemoryBudget *self) {
+    return g_atomic_rc_box_acquire(self);
+}
+
+void skyway_memory_budget_unref(SkywayMemoryBudget *self) {
+    g_atomic_rc_box_release(self);
+}
+
+static GQuark charge_quark(void) {
+    static GQuark quark = 0;
+    if (!quark) {
+        quark = g_quark_from_static_string("skyway-memory-charge");
+    }
+    return quark;
+}
+
+gboolean
+skyway_memory_budget_admit(SkywayMemoryBudget *self, GstBuffer *buffer,
+                           SkywayStreamPriority priority) {
+    if (self->limit > 0) {
+        gssize used = g_atomic_pointer_get(&self->used);
+        gssize share = (gssize) self->limit / 100 * priority_share[priority];
+        // A buffer charged on its way here, e.g. in a queue, is part of used already
+        if (!gst_mini_object_get_qdata(GST_MINI_OBJECT(buffer), charge_quark())) {
+            used += (gssize) gst_buffer_get_size(buffer);
+        }
+        if (used > share) {
+            return FALSE;
+        }
+    }
+
+    charge_buffer(self, buffer);
+    return TRUE;
+}
+
+void skyway_memory_budget_charge(SkywayMemoryBudget *self, GstBuffer *buffer) {
+    charge_buffer(self, buffer);
+}
+
+void skyway_memory_budget_count_shed(SkywayMemoryBudget *self) {
+    g_atomic_int_inc(&self->shed_samples);
+}
+
+void skyway_memory_budget_get_usage(SkywayMemoryBudget *self, SkywayMemoryUsage *usage) {
+    usage->limit = self->limit;
+    usage->used = (gsize) MAX(g_atomic_pointer_get(&self->used), 0);
+    usage->peak = (gsize) g_atomic_pointer_get(&self->peak);
+    usage->shed_samples = (guint) g_atomic_int_get(&self->shed_samples);
+}
+
+/*
+ * The charge rides along with the buffer as qdata, so it is released wherever the buffer dies
+ * and shared buffers (e.g. one frame fed to several mounts) are only counted once.
+ */
+static void charge_buffer(SkywayMemoryBudget *self, GstBuffer *buffer) {
+    if (gst_mini_object_get_qdata(GST_MINI_OBJECT(buffer), charge_quark())) {
+        return;
+    }
+
+    Charge *charge = g_new(Charge, 1);
+    charge->budget = skyway_memory_budget_ref(self);
+    charge->bytes = (gssize) gst_buffer_get_size(buffer);
+    gst_mini_object_set_qdata(GST_MINI_OBJECT(buffer), charge_quark(), charge,
+                              (GDestroyNotify) release_charge);
+
+    gssize used = g_atomic_pointer_add(&self->used, charge->bytes) + charge->bytes;
+    update_peak(self, used);
+}
+
+static void release_charge(Charge *charge) {
+    g_atomic_pointer_add(&charge->budget->used, -charge->bytes);
+    skyway_memory_budget_unref(charge->budget);
+    g_free(charge);
+}
+
+static void update_peak(SkywayMemoryBudget *self, gssize used) {
+    gssize peak = g_atomic_pointer_get(&self->peak);
+    while (used > peak) {
+        if (g_atomic_pointer_compare_and_exchange(&self->peak, peak, used)) {
+            return;
+        }
+        peak = g_atomic_pointer_get(&self->peak);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef SKYWAY_MEMORY_BUDGET_H
+#define SKYWAY_MEMORY_BUDGET_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * When the budget runs low, lower priority streams stop admitting frames first.
+ */
+typedef enum {
+    SKYWAY_PRIORITY_LOW,
+    SKYWAY_PRIORITY_NORMAL,
+    SKYWAY_PRIORITY_HIGH,
+} SkywayStreamPriority;
+
+typedef struct _SkywayMemoryBudget SkywayMemoryBudget;
+
+typedef struct _SkywayMemoryUsage {
+    gsize limit;
+    gsize used;
+    gsize peak;
+    guint shed_samples;
+} SkywayMemoryUsage;
+
+/*
+ * Bytes held by buffers anywhere in the server: a buffer is charged once, when it is admitted
+ * or leaves an element of a served media, and released when its last reference goes away. A
+ * limit of 0 is unlimited.
+ *
+ * What elements hold apart from the buffers they pass on is not covered: the bytes h265parse
+ * and the depayloaders gather into frames, or the packets in rtspsrc's jitterbuffer. Proxies
+ * hand samples on from the thread that produced them, so their appsinks hold one at a time.
+ */
+SkywayMemoryBudget *skyway_memory_budget_new(gsize limit);
+
+SkywayMemoryBudget *skyway_memory_budget_ref(SkywayMemoryBudget *self);
+
+void skyway_memory_budget_unref(SkywayMemoryBudget *self);
+
+/*
+ * Charges the buffer unless the budget is already used beyond the share of the given priority.
+ * Returns FALSE if the buffer should be shed. A buffer charged before is not charged again.
+ */
+gboolean
+skyway_memory_budget_admit(SkywayMemoryBudget *self, GstBuffer *buffer,
+                           SkywayStreamPriority priority);
+
+/*
+ * Charges the buffer regardless of the remaining budget, for memory we cannot refuse (e.g. the
+ * packets of frames already admitted).
+ */
+void skyway_memory_budget_charge(SkywayMemoryBudget *self, GstBuffer *buffer);
+
+void skyway_memory_budget_count_shed(SkywayMemoryBudget *self);
+
+void skyway_memory_budget_get_usage(SkywayMemoryBudget *self, SkywayMemoryUsage *usage);
+
+G_END_DECLS
+
+#endif // SKYWAY_MEMORY_BUDGET_H
@@ -0,0 +1,301 @@
+#include "pipeline_tracer.h"
+
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Threads named per recording, the others show up by their id only
+#define MAX_THREAD_NAMES 256
+
+typedef struct _TraceEvent {
+    // Number of the write that filled the slot, 0 while it is being written
+    gint seq;
+    gchar phase;
+    guint tid;
+    GQuark name;
+    GstClockTime ts;
+} TraceEvent;
+
+typedef struct _TraceRing {
+    TraceEvent *events;
+    guint mask;
+    gint head;
+    gint recording;
+    // Of the recording, for threads to name themselves again in each
+    gint generation;
+    GMutex lock;
+    // Names of the threads that recorded events since the recording started, by thread id
+    GHashTable *thread_names;
+    SkywayPipelineTracer *tracer;
+    // Whether ours is the only tracer, whose hooks may then be switched off between recordings
+    gboolean exclusive;
+} TraceRing;
+
+G_DEFINE_TYPE(SkywayPipelineTracer, skyway_pipeline_tracer, GST_TYPE_TRACER)
+
+static TraceRing ring;
+
+static GPrivate thread_id;
+
+static GPrivate thread_generation;
+
+static GQuark name_quark(void);
+
+static GQuark pad_name(GstPad *pad);
+
+static guint current_thread_id(void);
+
+static void record(gchar phase, GstClockTime ts, GstPad *pad);
+
+static void push_pre(GObject *self, GstClockTime ts, GstPad *pad, GstBuffer *buffer);
+
+static void push_post(GObject *self, GstClockTime ts, GstPad *pad, GstFlowReturn res);
+
+static void push_list_pre(GObject *self, GstClockTime ts, GstPad *pad, GstBufferList *list);
+
+static void pull_range_pre(GObject *self, GstClockTime ts, GstPad *pad, guint64 offset, guint size);
+
+static void
+pull_range_post(GObject *self, GstClockTime ts, GstPad *pad, GstBuffer *buffer, GstFlowReturn res);
+
+static void append_json_string(GString *json, const gchar *value);
+
+static void set_hooks_attached(gboolean attached);
+
+static void skyway_pipeline_tracer_class_init(__attribute__ ((unused)) SkywayPipelineTracerClass *klass) {}
+
+static void skyway_pipeline_tracer_init(SkywayPipelineTracer *self) {
+    GstTracer *tracer = GST_TRACER(self);
+    gst_tracing_register_hook(tracer, "pad-push-pre", G_CALLBACK(push_pre));
+    gst_tracing_register_hook(tracer, "pad-push-post", G_CALLBACK(push_post));
+    gst_tracing_register_hook(tracer, "pad-push-list-pre", G_CALLBACK(push_list_pre));
+    gst_tracing_register_hook(tracer, "pad-push-list-post", G_CALLBACK(push_post));
+    gst_tracing_register_hook(tracer, "pad-pull-range-pre", G_CALLBACK(pull_range_pre));
+    gst_tracing_register_hook(tracer, "pad-pull-range-post", G_CALLBACK(pull_range_post));
+}
+
+void skyway_tracing_register(void) {
+    g_mutex_lock(&ring.lock);
+    if (!ring.tracer) {
+        // GST_TRACERS are set up by gst_init(), before us
+        GList *tracers = gst_tracing_get_active_tracers();
+        ring.exclusive = tracers == NULL;
+        g_list_free_full(tracers, gst_object_unref);
+
+        ring.tracer = g_object_new(SKYWAY_TYPE_PIPELINE_TRACER, NULL);
+        set_hooks_attached(FALSE);
+    }
+    g_mutex_unlock(&ring.lock);
+}
+
+void skyway_tracing_start(guint capacity) {
+    g_mutex_lock(&ring.lock);
+    g_atomic_int_set(&ring.recording, FALSE);
+    if (!ring.events) {
+        guint size = 1;
+        while (size < MAX(capacity, 1024u) && size < (1u << 24)) {
+            size <<= 1;
+        }
+
+        // Never freed: a hook may still be writing to it when tracing stops
+        ring.events = g_new0(TraceEvent, size);
+        ring.mask = size - 1;
+        ring.thread_names = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    }
+
+    for (guint i = 0; i <= ring.mask; i++) {
+        g_atomic_int_set(&ring.events[i].seq, 0);
+    }
+    g_atomic_int_set(&ring.head, 0);
+    g_hash_table_remove_all(ring.thread_names);
+    g_atomic_int_inc(&ring.generation);
+    g_atomic_int_set(&ring.recording, TRUE);
+    set_hooks_attached(TRUE);
+    g_mutex_unlock(&ring.lock);
+}
+
+void skyway_tracing_stop(void) {
+    g_mutex_lock(&ring.lock);
+    g_atomic_int_set(&ring.recording, FALSE);
+    set_hooks_attached(FALSE);
+    g_mutex_unlock(&ring.lock);
+}
+
+/*
+ * Every pad push checks this one flag before dispatching hooks, exactly as it does without any
+ * tracer. A push racing with the switch may still run a hook, which the recording flag stops.
+ */
+static void set_hooks_attached(gboolean attached) {
+    if (ring.tracer && ring.exclusive) {
+        g_atomic_int_set(&_priv_tracer_enabled, attached);
+    }
+}
+
+static GQuark name_quark(void) {
+    static GQuark quark = 0;
+    if (!quark) {
+        quark = g_quark_from_static_string("skyway-trace-name");
+    }
+    return quark;
+}
+
+/*
+ * "element:pad", interned once per pad so that recording an event never allocates.
+ */
+static GQuark pad_name(GstPad *pad) {
+    GQuark name = GPOINTER_TO_UINT(g_object_get_qdata(G_OBJECT(pad), name_quark()));
+    if (name) {
+        return name;
+    }
+
+    GstObject *parent = gst_object_get_parent(GST_OBJECT(pad));
+    gchar *full_name = g_strdup_printf("%s:%s", parent ? GST_OBJECT_NAME(parent) : "",
+                                       GST_OBJECT_NAME(pad));
+    name = g_quark_from_string(full_name);
+    g_free(full_name);
+    if (parent) {
+        gst_object_unref(parent);
+    }
+
+    g_object_set_qdata(G_OBJECT(pad), name_quark(), GUINT_TO_POINTER(name));
+    return name;
+}
+
+/*
+ * The kernel's id of the thread, as systrace and Perfetto show it.
+ */
+static guint current_thread_id(void) {
+    guint id = GPOINTER_TO_UINT(g_private_get(&thread_id));
+    if (!id) {
+        id = (guint) syscall(SYS_gettid);
+        g_private_set(&thread_id, GUINT_TO_POINTER(id));
+    }
+
+    gint generation = g_atomic_int_get(&ring.generation);
+    if (GPOINTER_TO_INT(g_private_get(&thread_generation)) == generation) {
+        return id;
+    }
+
+    // GStreamer names its streaming threads after the pad they run
+    gchar thread_name[17] = {0};
+    prctl(PR_GET_NAME, thread_name, 0, 0, 0);
+
+    // A thread reusing the id of one gone takes over its name
+    g_mutex_lock(&ring.lock);
+    if (g_hash_table_contains(ring.thread_names, GUINT_TO_POINTER(id)) ||
+        g_hash_table_size(ring.thread_names) < MAX_THREAD_NAMES) {
+        g_hash_table_insert(ring.thread_names, GUINT_TO_POINTER(id), g_strdup(thread_name));
+    }
+    g_mutex_unlock(&ring.lock);
+
+    g_private_set(&thread_generation, GINT_TO_POINTER(generation));
+    return id;
+}
+
+static void record(gchar phase, GstClockTime ts, GstPad *pad) {
+    if (!g_atomic_int_get(&ring.recording)) {
+        return;
+    }
+
+    gint seq = g_atomic_int_add(&ring.head, 1) + 1;
+    TraceEvent *event = &ring.events[(guint) seq & ring.mask];
+
+    g_atomic_int_set(&event->seq, 0);
+    event->phase = phase;
+    event->tid = current_thread_id();
+    event->name = pad_name(pad);
+    event->ts = ts;
+    g_atomic_int_set(&event->seq, seq);
+}
+
+static void push_pre(__attribute__ ((unused)) GObject *self, GstClockTime ts, GstPad *pad,
+                     __attribute__ ((unused)) GstBuffer *buffer) {
+    record('B', ts, pad);
+}
+
+static void push_post(__attribute__ ((unused)) GObject *self, GstClockTime ts, GstPad *pad,
+                      __attribute__ ((unused)) GstFlowReturn res) {
+    record('E', ts, pad);
+}
+
+static void push_list_pre(__attribute__ ((unused)) GObject *self, GstClockTime ts, GstPad *pad,
+                          __attribute__ ((unused)) GstBufferList *list) {
+    record('B', ts, pad);
+}
+
+static void pull_range_pre(__attribute__ ((unused)) GObject *self, GstClockTime ts, GstPad *pad,
+                           __attribute__ ((unused)) guint64 offset,
+                           __attribute__ ((unused)) guint size) {
+    record('B', ts, pad);
+}
+
+static void
+pull_range_post(__attribute__ ((unused)) GObject *self, GstClockTime ts, GstPad *pad,
+                __attribute__ ((unused)) GstBuffer *buffer,
+                __attribute__ ((unused)) GstFlowReturn res) {
+    record('E', ts, pad);
+}
+
+static void append_json_string(GString *json, const gchar *value) {
+    g_string_append_c(json, '"');
+    for (const gchar *c = value; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            g_string_append_c(json, '\\');
+            g_string_append_c(json, *c);
+        } else if ((guchar) *c < 0x20) {
+            g_string_append_printf(json, "\\u%04x", (guchar) *c);
+        } else {
+            g_string_append_c(json, *c);
+        }
+    }
+    g_string_append_c(json, '"');
+}
+
+gchar *skyway_tracing_dump_json(void) {
+    GString *json = g_string_new("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    gboolean first = TRUE;
+
+    g_mutex_lock(&ring.lock);
+    if (!ring.events) {
+        g_mutex_unlock(&ring.lock);
+        g_string_append(json, "]}");
+        return g_string_free(json, FALSE);
+    }
+
+    GHashTableIter iter;
+    gpointer id;
+    gpointer name;
+    g_hash_table_iter_init(&iter, ring.thread_names);
+    while (g_hash_table_iter_next(&iter, &id, &name)) {
+        g_string_append_printf(json, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+                                     "\"tid\":%u,\"args\":{\"name\":", first ? "" : ",",
+                               GPOINTER_TO_UINT(id));
+        append_json_string(json, name);
+        g_string_append(json, "}}");
+        first = FALSE;
+    }
+    g_mutex_unlock(&ring.lock);
+
+    // Oldest first: the slots written by the last (capacity) writes
+    guint head = (guint) g_atomic_int_get(&ring.head);
+    guint count = MIN(head, ring.mask + 1);
+    for (guint seq = head - count + 1; seq != head + 1; seq++) {
+        TraceEvent *slot = &ring.events[seq & ring.mask];
+        gint before = g_atomic_int_get(&slot->seq);
+        TraceEvent event = *slot;
+        // Skip slots rewritten while we were reading them
+        if (before != (gint) seq || g_atomic_int_get(&slot->seq) != before) {
+            continue;
+        }
+
+        g_string_append_printf(json, "%s{\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"name\":",
+                               first ? "" : ",", event.phase, event.tid,
+                               (gdouble) event.ts / 1000.0);
+        append_json_string(json, g_quark_to_string(event.name));
+        g_string_append_c(json, '}');
+        first = FALSE;
+    }
+
+    g_string_append(json, "]}");
+    return g_string_free(json, FALSE);
+}
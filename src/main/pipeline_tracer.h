@@ -0,0 +1,45 @@
+#ifndef SKYWAY_PIPELINE_TRACER_H
+#define SKYWAY_PIPELINE_TRACER_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define SKYWAY_TYPE_PIPELINE_TRACER (skyway_pipeline_tracer_get_type())
+
+typedef struct _SkywayPipelineTracer {
+    GstTracer parent;
+} SkywayPipelineTracer;
+
+G_DECLARE_FINAL_TYPE(SkywayPipelineTracer, skyway_pipeline_tracer, SKYWAY, PIPELINE_TRACER,
+                     GstTracer)
+
+GType skyway_pipeline_tracer_get_type(void);
+
+/*
+ * Installs the tracer hooks, detached until tracing starts. GStreamer offers no way to remove
+ * them, nor to add them safely while pipelines stream: call once at startup.
+ */
+void skyway_tracing_register(void);
+
+/*
+ * Records how long every pad push (i.e. the downstream elements it runs) takes, per streaming
+ * thread, into an in-memory ring of the given number of events (fixed by the first call). Each
+ * start drops what was recorded before, names of threads included. Unless other tracers are
+ * active (GST_TRACERS), stopping switches GStreamer's hook dispatch off again, so that pads
+ * push without calling into the tracer at all.
+ */
+void skyway_tracing_start(guint capacity);
+
+void skyway_tracing_stop(void);
+
+/*
+ * The recorded events as a Chrome trace (JSON Trace Event Format), which Perfetto and
+ * chrome://tracing open. Free with g_free().
+ */
+gchar *skyway_tracing_dump_json(void);
+
+G_END_DECLS
+
+#endif // SKYWAY_PIPELINE_TRACER_H
@@ -0,0 +1,391 @@
+#include "push_record.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "capture_time.h"
+
+#define MAGIC_SIZE 8
+#define CAPS_RECORD 'C'
+#define FRAME_RECORD 'F'
+
+// Far beyond any caps string or access unit, so that a corrupt length fails the replay
+#define MAX_CAPS_LENGTH (64 * 1024)
+#define MAX_FRAME_SIZE (64 * 1024 * 1024)
+
+// About two seconds of frames, beyond which the storage is not keeping up
+#define MAX_PENDING_SAMPLES 64
+
+typedef struct _PendingSample {
+    GstSample *sample;
+    gint64 arrival;
+} PendingSample;
+
+struct _SkywayPushRecorder {
+    FILE *file;
+    gchar *path;
+    GThread *writer;
+    GMutex lock;
+    GCond cond;
+    // Guarded by the lock
+    GQueue pending;
+    gboolean closing;
+    gboolean failed;
+    // Only touched by the pushing thread
+    gboolean started;
+    gint64 start_time;
+    gint64 start_real_time;
+    gboolean resyncing;
+    guint dropped;
+    // Only touched by the writer thread
+    gboolean header_written;
+    GstCaps *caps;
+};
+
+struct _SkywayPushReplay {
+    FILE *file;
+    gint64 file_size;
+    gint64 start_time;
+    GstCaps *caps;
+};
+
+static gpointer write_pending(SkywayPushRecorder *self);
+
+static void pending_sample_free(PendingSample *pending);
+
+static gboolean write_sample(SkywayPushRecorder *self, GstSample *sample, gint64 arrival);
+
+static gboolean write_header(SkywayPushRecorder *self);
+
+static gboolean write_caps(SkywayPushRecorder *self, GstCaps *caps);
+
+static gboolean write_frame(SkywayPushRecorder *self, GstBuffer *buffer, gint64 arrival);
+
+static gboolean write_bytes(SkywayPushRecorder *self, const void *data, gsize size);
+
+static gboolean read_bytes(SkywayPushReplay *self, void *data, gsize size);
+
+static gboolean check_length(SkywayPushReplay *self, guint32 length, guint32 max);
+
+SkywayPushRecorder *skyway_push_recorder_new(const gchar *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        g_printerr("Cannot record to %s: %s\n", path, g_strerror(errno));
+        return NULL;
+    }
+
+    SkywayPushRecorder *self = g_new0(SkywayPushRecorder, 1);
+    self->file = file;
+    self->path = g_strdup(path);
+    g_mutex_init(&self->lock);
+    g_cond_init(&self->cond);
+    g_queue_init(&self->pending);
+    self->writer = g_thread_new("skyway-recorder", (GThreadFunc) write_pending, self);
+    return self;
+}
+
+void skyway_push_recorder_write(SkywayPushRecorder *self, GstSample *sample) {
+    gint64 now = g_get_monotonic_time();
+    if (!self->started) {
+        self->started = TRUE;
+        self->start_time = now;
+        self->start_real_time = g_get_real_time();
+    }
+
+    // Frames after a dropped one would not decode in the replay
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    gboolean delta = buffer && GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+    g_mutex_lock(&self->lock);
+    if (self->failed) {
+        g_mutex_unlock(&self->lock);
+        return;
+    }
+
+    if (g_queue_get_length(&self->pending) >= MAX_PENDING_SAMPLES ||
+        (self->resyncing && delta)) {
+        self->resyncing = TRUE;
+        self->dropped++;
+        g_mutex_unlock(&self->lock);
+        return;
+    }
+
+    PendingSample *pending = g_new(PendingSample, 1);
+    pending->sample = gst_sample_ref(sample);
+    pending->arrival = now - self->start_time;
+    g_queue_push_tail(&self->pending, pending);
+    self->resyncing = FALSE;
+    g_cond_signal(&self->cond);
+    g_mutex_unlock(&self->lock);
+}
+
+void skyway_push_recorder_free(SkywayPushRecorder *self) {
+    g_mutex_lock(&self->lock);
+    self->closing = TRUE;
+    g_cond_signal(&self->cond);
+    g_mutex_unlock(&self->lock);
+    g_thread_join(self->writer);
+
+    if (self->dropped > 0) {
+        g_printerr("Recording to %s misses %u frames, the storage did not keep up\n", self->path,
+                   self->dropped);
+    }
+    if (fclose(self->file) != 0 && !self->failed) {
+        g_printerr("Recording to %s may be truncated: %s\n", self->path, g_strerror(errno));
+    }
+    gst_caps_replace(&self->caps, NULL);
+    g_mutex_clear(&self->lock);
+    g_cond_clear(&self->cond);
+    g_free(self->path);
+    g_free(self);
+}
+
+/*
+ * The writer thread, until the recorder is freed and nothing is pending.
+ */
+static gpointer write_pending(SkywayPushRecorder *self) {
+    g_mutex_lock(&self->lock);
+    while (TRUE) {
+        PendingSample *pending = g_queue_pop_head(&self->pending);
+        if (!pending) {
+            if (self->closing) {
+                break;
+            }
+            g_cond_wait(&self->cond, &self->lock);
+            continue;
+        }
+
+        gboolean failed = self->failed;
+        g_mutex_unlock(&self->lock);
+
+        if (!failed && !write_sample(self, pending->sample, pending->arrival)) {
+            g_printerr("Recording to %s failed, stopped it\n", self->path);
+            failed = TRUE;
+        }
+        pending_sample_free(pending);
+
+        g_mutex_lock(&self->lock);
+        self->failed = failed;
+    }
+    g_mutex_unlock(&self->lock);
+
+    return NULL;
+}
+
+static void pending_sample_free(PendingSample *pending) {
+    gst_sample_unref(pending->sample);
+    g_free(pending);
+}
+
+static gboolean write_sample(SkywayPushRecorder *self, GstSample *sample, gint64 arrival) {
+    if (!self->header_written) {
+        self->header_written = TRUE;
+        if (!write_header(self)) {
+            return FALSE;
+        }
+    }
+
+    GstCaps *caps = gst_sample_get_caps(sample);
+    if (!(caps == self->caps || (caps && self->caps && gst_caps_is_equal(caps, self->caps)))) {
+        if (!write_caps(self, caps)) {
+            return FALSE;
+        }
+        gst_caps_replace(&self->caps, caps);
+    }
+
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    return !buffer || write_frame(self, buffer, arrival);
+}
+
+SkywayPushReplay *skyway_push_replay_open(const gchar *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        g_printerr("Cannot open %s: %s\n", path, g_strerror(errno));
+        return NULL;
+    }
+
+    SkywayPushReplay *self = g_new0(SkywayPushReplay, 1);
+    self->file = file;
+    self->file_size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        self->file_size = ftell(file);
+    }
+
+    gchar magic[MAGIC_SIZE];
+    gint64 start_time;
+    if (self->file_size < 0 || fseek(file, 0, SEEK_SET) != 0 ||
+        !read_bytes(self, magic, MAGIC_SIZE) ||
+        memcmp(magic, SKYWAY_PUSH_RECORD_MAGIC, MAGIC_SIZE) != 0 ||
+        !read_bytes(self, &start_time, sizeof(start_time))) {
+        g_printerr("%s is not a recording\n", path);
+        skyway_push_replay_free(self);
+        return NULL;
+    }
+
+    self->start_time = GINT64_FROM_LE(start_time);
+    return self;
+}
+
+gint64 skyway_push_replay_get_start_time(SkywayPushReplay *self) {
+    return self->start_time;
+}
+
+GstSample *skyway_push_replay_next(SkywayPushReplay *self, gint64 *arrival) {
+    guint8 type;
+    while (read_bytes(self, &type, 1)) {
+        if (type == CAPS_RECORD) {
+            guint32 length;
+            if (!read_bytes(self, &length, sizeof(length)) ||
+                !check_length(self, GUINT32_FROM_LE(length), MAX_CAPS_LENGTH)) {
+                return NULL;
+            }
+
+            gchar *string = g_try_malloc(GUINT32_FROM_LE(length) + 1);
+            if (!string) {
+                g_printerr("Cannot allocate the caps of a recorded frame\n");
+                return NULL;
+            }
+            gboolean complete = read_bytes(self, string, GUINT32_FROM_LE(length));
+            string[complete ? GUINT32_FROM_LE(length) : 0] = '\0';
+            gst_caps_replace(&self->caps, NULL);
+            if (complete && string[0] != '\0') {
+                self->caps = gst_caps_from_string(string);
+            }
+            g_free(string);
+
+            if (!complete) {
+                return NULL;
+            }
+            continue;
+        }
+
+        if (type != FRAME_RECORD) {
+            g_printerr("Unknown record type 0x%02x, stopping the replay\n", type);
+            return NULL;
+        }
+
+        gint64 frame_arrival;
+        guint64 pts;
+        gint64 capture_time;
+        guint32 flags;
+        guint32 size;
+        if (!read_bytes(self, &frame_arrival, sizeof(frame_arrival)) ||
+            !read_bytes(self, &pts, sizeof(pts)) ||
+            !read_bytes(self, &capture_time, sizeof(capture_time)) ||
+            !read_bytes(self, &flags, sizeof(flags)) ||
+            !read_bytes(self, &size, sizeof(size)) ||
+            !check_length(self, GUINT32_FROM_LE(size), MAX_FRAME_SIZE)) {
+            return NULL;
+        }
+
+        GstBuffer *buffer = gst_buffer_new_allocate(NULL, GUINT32_FROM_LE(size), NULL);
+        GstMapInfo map;
+        if (!buffer || !gst_buffer_map(buffer, &map, GST_MAP_WRITE)) {
+            g_printerr("Cannot allocate a recorded frame of %u bytes, stopping the replay\n",
+                       GUINT32_FROM_LE(size));
+            if (buffer) {
+                gst_buffer_unref(buffer);
+            }
+            return NULL;
+        }
+        gboolean complete = read_bytes(self, map.data, map.size);
+        gst_buffer_unmap(buffer, &map);
+        if (!complete) {
+            gst_buffer_unref(buffer);
+            return NULL;
+        }
+
+        GST_BUFFER_PTS(buffer) = GUINT64_FROM_LE(pts);
+        if (GINT64_FROM_LE(capture_time) != -1) {
+            skyway_capture_time_set(buffer, GINT64_FROM_LE(capture_time));
+        }
+        GST_BUFFER_FLAG_SET(buffer, GUINT32_FROM_LE(flags));
+        *arrival = GINT64_FROM_LE(frame_arrival);
+
+        GstSample *sample = gst_sample_new(buffer, self->caps, NULL, NULL);
+        gst_buffer_unref(buffer);
+        return sample;
+    }
+
+    return NULL;
+}
+
+void skyway_push_replay_free(SkywayPushReplay *self) {
+    fclose(self->file);
+    gst_caps_replace(&self->caps, NULL);
+    g_free(self);
+}
+
+static gboolean write_header(SkywayPushRecorder *self) {
+    gint64 start_time = GINT64_TO_LE(self->start_real_time);
+    return write_bytes(self, SKYWAY_PUSH_RECORD_MAGIC, MAGIC_SIZE) &&
+           write_bytes(self, &start_time, sizeof(start_time));
+}
+
+static gboolean write_caps(SkywayPushRecorder *self, GstCaps *caps) {
+    gchar *string = caps ? gst_caps_to_string(caps) : g_strdup("");
+    guint8 type = CAPS_RECORD;
+    guint32 length = GUINT32_TO_LE((guint32) strlen(string));
+    gboolean written = write_bytes(self, &type, 1) &&
+                       write_bytes(self, &length, sizeof(length)) &&
+                       write_bytes(self, string, strlen(string));
+    g_free(string);
+    return written;
+}
+
+static gboolean write_frame(SkywayPushRecorder *self, GstBuffer *buffer, gint64 arrival) {
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        // Keep the recording going, the replay just misses this frame
+        g_printerr("Cannot map a pushed buffer, not recording it\n");
+        return TRUE;
+    }
+    if (map.size > MAX_FRAME_SIZE) {
+        g_printerr("Pushed buffer of %" G_GSIZE_FORMAT " bytes is too large, not recording it\n",
+                   map.size);
+        gst_buffer_unmap(buffer, &map);
+        return TRUE;
+    }
+
+    guint8 type = FRAME_RECORD;
+    gint64 le_arrival = GINT64_TO_LE(arrival);
+    guint64 pts = GUINT64_TO_LE(GST_BUFFER_PTS(buffer));
+    gint64 capture_time = -1;
+    skyway_capture_time_get(buffer, &capture_time);
+    capture_time = GINT64_TO_LE(capture_time);
+    // Only the buffer flags, the miniobject ones below them are of no meaning to a replay
+    guint32 flags = GUINT32_TO_LE(GST_BUFFER_FLAGS(buffer) & ~(GST_MINI_OBJECT_FLAG_LAST - 1));
+    guint32 size = GUINT32_TO_LE((guint32) map.size);
+    gboolean written = write_bytes(self, &type, 1) &&
+                       write_bytes(self, &le_arrival, sizeof(le_arrival)) &&
+                       write_bytes(self, &pts, sizeof(pts)) &&
+                       write_bytes(self, &capture_time, sizeof(capture_time)) &&
+                       write_bytes(self, &flags, sizeof(flags)) &&
+                       write_bytes(self, &size, sizeof(size)) &&
+                       write_bytes(self, map.data, map.size);
+    gst_buffer_unmap(buffer, &map);
+    return written;
+}
+
+static gboolean write_bytes(SkywayPushRecorder *self, const void *data, gsize size) {
+    return size == 0 || fwrite(data, 1, size, self->file) == size;
+}
+
+static gboolean read_bytes(SkywayPushReplay *self, void *data, gsize size) {
+    return size == 0 || fread(data, 1, size, self->file) == size;
+}
+
+/*
+ * Whether a record of length bytes may follow, i.e. it is sane and not cut short by the end of
+ * the file. A truncated last record is the normal end of a recording that was not stopped.
+ */
+static gboolean check_length(SkywayPushReplay *self, guint32 length, guint32 max) {
+    if (length > max) {
+        g_printerr("Corrupt record of %u bytes, stopping the replay\n", length);
+        return FALSE;
+    }
+
+    long position = ftell(self->file);
+    return position >= 0 && (gint64) length <= self->file_size - position;
+}
@@ -0,0 +1,59 @@
+#ifndef SKYWAY_PUSH_RECORD_H
+#define SKYWAY_PUSH_RECORD_H
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Captures of the samples pushed into a pushable stream, to replay field recordings on a desktop
+ * (see test/push_replay.c). All integers are little-endian:
+ *
+ *   header:       "SKYWREC" 0x01, wall-clock time of the first sample (gint64, us since epoch)
+ *   caps record:  'C', length (guint32), caps string without terminator, empty for no caps.
+ *                 Only written when the caps differ from the previous sample's.
+ *   frame record: 'F', arrival (gint64, us since the first sample, monotonic), pts (guint64,
+ *                 G_MAXUINT64 for none), capture time (gint64, see capture_time.h, -1 for none),
+ *                 buffer flags (guint32), size (guint32), payload
+ */
+#define SKYWAY_PUSH_RECORD_MAGIC "SKYWREC\001"
+
+typedef struct _SkywayPushRecorder SkywayPushRecorder;
+
+typedef struct _SkywayPushReplay SkywayPushReplay;
+
+/*
+ * Returns NULL if path cannot be created.
+ */
+SkywayPushRecorder *skyway_push_recorder_new(const gchar *path);
+
+/*
+ * Queues the sample, arrived now, for the recorder's thread to append, so that the pusher never
+ * waits for the storage. Samples are dropped while too many are pending, then up to the next
+ * IRAP for the replay to decode. Not thread-safe, stops recording after a write error.
+ */
+void skyway_push_recorder_write(SkywayPushRecorder *self, GstSample *sample);
+
+/*
+ * Waits for the pending samples to be written.
+ */
+void skyway_push_recorder_free(SkywayPushRecorder *self);
+
+/*
+ * Returns NULL if path cannot be read or is not a recording.
+ */
+SkywayPushReplay *skyway_push_replay_open(const gchar *path);
+
+gint64 skyway_push_replay_get_start_time(SkywayPushReplay *self);
+
+/*
+ * The next recorded sample, with its arrival in microseconds after the first one. NULL at the end
+ * of the recording, or at a truncated record (e.g. the recording process was killed).
+ */
+GstSample *skyway_push_replay_next(SkywayPushReplay *self, gint64 *arrival);
+
+void skyway_push_replay_free(SkywayPushReplay *self);
+
+G_END_DECLS
+
+#endif // SKYWAY_PUSH_RECORD_H
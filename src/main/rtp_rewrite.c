@@ -0,0 +1,513 @@
+#include "rtp_rewrite.h"
+
+#include <string.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#include "h265_nal.h"
+
+#define DEFAULT_CLOCK_RATE 90000
+// A larger jump in upstream sequence numbers is a restart, not loss or reordering
+#define MAX_SEQ_JUMP 3000
+#define PARAMETER_SET_COUNT (SKYWAY_H265_NAL_PPS - SKYWAY_H265_NAL_VPS + 1)
+
+typedef struct _SkywayRtpRewritePrivate {
+    // Guards everything below, the streaming thread writes what the RTSP server reads
+    GMutex lock;
+    guint32 ssrc;
+    gint seqnum_offset;
+    guint timestamp_offset;
+    guint mtu;
+    gint clock_rate;
+    gboolean started;
+    guint32 input_ssrc;
+    guint16 last_input_seq;
+    guint16 seq_delta;
+    guint32 timestamp_delta;
+    guint16 last_seq;
+    guint32 last_timestamp;
+    GstClockTime last_running_time;
+    // Latest VPS, SPS and PPS, and the input timestamp of the last packet carrying one
+    GBytes *parameter_sets[PARAMETER_SET_COUNT];
+    gboolean have_parameter_set_timestamp;
+    guint32 parameter_set_timestamp;
+    gint need_parameter_sets;
+} SkywayRtpRewritePrivate;
+
+enum {
+    PROP_0,
+    PROP_SSRC,
+    PROP_SEQNUM_OFFSET,
+    PROP_TIMESTAMP_OFFSET,
+    PROP_MTU,
+    PROP_SEQNUM,
+    PROP_TIMESTAMP,
+    PROP_STATS,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK,
+                                                                    GST_PAD_ALWAYS,
+                                                                    GST_STATIC_CAPS(
+                                                                            "application/x-rtp"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC,
+                                                                   GST_PAD_ALWAYS,
+                                                                   GST_STATIC_CAPS(
+                                                                           "application/x-rtp"));
+
+G_DEFINE_TYPE_WITH_PRIVATE(SkywayRtpRewrite, skyway_rtp_rewrite, GST_TYPE_BASE_TRANSFORM)
+
+static void skyway_rtp_rewrite_class_init(SkywayRtpRewriteClass *klass);
+
+static void skyway_rtp_rewrite_init(SkywayRtpRewrite *self);
+
+static void skyway_rtp_rewrite_finalize(GObject *object);
+
+static void
+skyway_rtp_rewrite_set_property(GObject *object, guint prop_id, const GValue *value,
+                                GParamSpec *pspec);
+
+static void
+skyway_rtp_rewrite_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+
+static GstCaps *
+skyway_rtp_rewrite_transform_caps(GstBaseTransform *trans, GstPadDirection direction,
+                                  GstCaps *caps, GstCaps *filter);
+
+static gboolean skyway_rtp_rewrite_set_caps(GstBaseTransform *trans, GstCaps *incaps,
+                                            GstCaps *outcaps);
+
+static gboolean skyway_rtp_rewrite_start(GstBaseTransform *trans);
+
+static GstFlowReturn skyway_rtp_rewrite_transform_ip(GstBaseTransform *trans, GstBuffer *buffer);
+
+static void rebase(SkywayRtpRewritePrivate *priv, guint16 seq, guint32 timestamp,
+                   GstClockTime running_time);
+
+static void inspect_nal(SkywayRtpRewritePrivate *priv, const guint8 *nal, guint size,
+                        guint32 timestamp, gboolean *irap);
+
+static gboolean inspect_payload(SkywayRtpRewritePrivate *priv, const guint8 *payload, guint size,
+                                guint32 timestamp);
+
+static GstBufferList *
+parameter_set_packets(SkywayRtpRewritePrivate *priv, GstRTPBuffer *rtp, guint32 timestamp);
+
+static void skyway_rtp_rewrite_class_init(SkywayRtpRewriteClass *klass) {
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    object_class->finalize = skyway_rtp_rewrite_finalize;
+    object_class->set_property = skyway_rtp_rewrite_set_property;
+    object_class->get_property = skyway_rtp_rewrite_get_property;
+
+    g_object_class_install_property(
+            object_class, PROP_SSRC,
+            g_param_spec_uint("ssrc", "SSRC", "SSRC of the packets sent (G_MAXUINT = random)",
+                              0, G_MAXUINT, G_MAXUINT,
+                              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(
+            object_class, PROP_SEQNUM_OFFSET,
+            g_param_spec_int("seqnum-offset", "Sequence number offset",
+                             "First sequence number sent (-1 = random)", -1, G_MAXUINT16, -1,
+                             G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(
+            object_class, PROP_TIMESTAMP_OFFSET,
+            g_param_spec_uint("timestamp-offset", "Timestamp offset",
+                              "First RTP timestamp sent (G_MAXUINT = random)", 0, G_MAXUINT,
+                              G_MAXUINT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    // Set by the RTSP server on payloaders, packets are forwarded at their upstream size
+    g_object_class_install_property(
+            object_class, PROP_MTU,
+            g_param_spec_uint("mtu", "MTU", "Ignored, packets are not re-fragmented", 28,
+                              G_MAXUINT, 1400, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(
+            object_class, PROP_SEQNUM,
+            g_param_spec_uint("seqnum", "Sequence number", "Last sequence number sent", 0,
+                              G_MAXUINT16, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(
+            object_class, PROP_TIMESTAMP,
+            g_param_spec_uint("timestamp", "Timestamp", "Last RTP timestamp sent", 0, G_MAXUINT,
+                              0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(
+            object_class, PROP_STATS,
+            g_param_spec_boxed("stats", "Statistics", "Like the stats of a payloader",
+                               GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+    gst_element_class_set_static_metadata(element_class, "RTP relay rewriter",
+                                          "Codec/Payloader/Network/RTP",
+                                          "Rewrites the SSRC, sequence numbers and timestamps "
+                                          "of relayed H.265 RTP packets",
+                                          "Sambaza");
+
+    GstBaseTransformClass *transform_class = GST_BASE_TRANSFORM_CLASS(klass);
+    transform_class->transform_caps = skyway_rtp_rewrite_transform_caps;
+    transform_class->set_caps = skyway_rtp_rewrite_set_caps;
+    transform_class->start = skyway_rtp_rewrite_start;
+    transform_class->transform_ip = skyway_rtp_rewrite_transform_ip;
+}
+
+static void skyway_rtp_rewrite_init(SkywayRtpRewrite *self) {
+    SkywayRtpRewritePrivate *priv = skyway_rtp_rewrite_get_instance_private(self);
+    g_mutex_init(&priv->lock);
+    priv->ssrc = g_random_int();
+    priv->seqnum_offset = -1;
+    priv->timestamp_offset = G_MAXUINT;
+    priv->mtu = 1400;
+    priv->clock_rate = DEFAULT_CLOCK_RATE;
+    priv->started = FALSE;
+    priv->last_running_time = GST_CLOCK_TIME_NONE;
+    priv->have_parameter_set_timestamp = FALSE;
+    priv->need_parameter_sets = FALSE;
+}
+
+static void skyway_rtp_rewrite_finalize(GObject *object) {
+    SkywayRtpRewritePrivate *priv = skyway_rtp_rewrite_get_instance_private(
+            SKYWAY_RTP_REWRITE(object));
+    for (guint i = 0; i < PARAMETER_SET_COUNT; i++) {
+        g_clear_pointer(&priv->parameter_sets[i], g_bytes_unref);
+    }
+    g_mutex_clear(&priv->lock);
+
+    G_OBJECT_CLASS (skyway_rtp_rewrite_parent_class)->finalize(object);
+}
+
+gboolean skyway_rtp_rewrite_register(void) {
+    return gst_element_register(NULL, "skywayrtprewrite", GST_RANK_NONE, SKYWAY_TYPE_RTP_REWRITE);
+}
+
+void skyway_rtp_rewrite_request_parameter_sets(SkywayRtpRewrite *self) {
+    SkywayRtpRewritePrivate *priv = skyway_rtp_rewrite_get_instance_private(self);
+    g_atomic_int_set(&priv->need_parameter_sets, TRUE);
+}
+
+static void
+skyway_rtp_rewrite_set_property(GObject *object, guint prop_id, const GValue *value,
+                                GParamSpec *pspec) {
+    SkywayRtpRewritePrivate *priv = skyway_rtp_rewrite_get_instance_private(
+            SKYWAY_RTP_REWRITE(object));
+
+    g_mutex_lock(&priv->lock);
+    switch (prop_id) {
+        case PROP_SSRC:
+            priv->ssrc = g_value_get_uint(value) == G_MAXUINT ? g_random_int()
+                                                              : g_value_get_uint(value);
+            break;
+        case PROP_SEQNUM_OFFSET:
+            priv->seqnum_offset = g_value_get_int(value);
+            break;
+        case PROP_TIMESTAMP_OFFSET:
+            priv->timestamp_offset = g_value_get_uint(value);
+            break;
+        case PROP_MTU:
+            priv->mtu = g_value_get_uint(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    g_mutex_unlock(&priv->lock);
+}
+
+static void
+skyway_rtp_rewrite_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+    SkywayRtpRewritePrivate *priv = skyway_rtp_rewrite_get_instance_private(
+            SKYWAY_RTP_REWRITE(object));
+
+    g_mutex_lock(&priv->lock);
+    switch (prop_id) {
+        case PROP_SSRC:
+            g_value_set_uint(value, priv->ssrc);
+            break;
+        case PROP_SEQNUM_OFFSET:
+            g_value_set_int(value, priv->seqnum_offset);
+            break;
+        case PROP_TIMESTAMP_OFFSET:
+            g_value_set_uint(value, priv->timestamp_offset);
+            break;
+        case PROP_MTU:
+            g_value_set_uint(value, priv->mtu);
+            break;
+        case PROP_SEQNUM:
+            g_value_set_uint(value, priv->last_seq);
+            break;
+        case PROP_TIMESTAMP:
+            g_value_set_uint(value, priv->last_timestamp);
+            break;
+        case PROP_STATS:
+            // What a client joining now sees first: the packet after the last one sent
+            g_value_take_boxed(value, gst_structure_new(
+                    "application/x-rtp-payload-stats",
+                    "clock-rate", G_TYPE_UINT, (guint) priv->clock_rate,
+                    "running-time", G_TYPE_UINT64, priv->last_running_time,
+                    "seqnum", G_TYPE_UINT, (guint) priv->last_seq,
+                    "timestamp", G_TYPE_UINT, priv->last_timestamp,
+                    "ssrc", G_TYPE_UINT, priv->ssrc,
+                    "seqnum-offset", G_TYPE_UINT, (guint) (guint16) (priv->last_seq + 1),
+                    "timestamp-offset", G_TYPE_UINT, priv->last_timestamp,
+                    NULL));
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    g_mutex_unlock(&priv->lock);
+}
+
+/*
+ * The upstream SSRC and offsets are ours to replace. Downstream, the SSRC tells the RTP session
+ * which source it sends as.
+ */
+static GstCaps *
+skyway_rtp_rewrite_transform_caps(GstBaseTransform *trans, GstPadDirection direction,
+                                  GstCaps *caps, GstCaps *filter) {
+    SkywayRtpRewritePrivate *priv = skyway_rtp_rewrite_get_instance_private(
+            SKYWAY_RTP_REWRITE(trans));
+
+    g_mutex_lock(&priv->lock);
+    guint32 ssrc = priv->ssrc;
+    g_mutex_unlock(&priv->lock);
+
+    GstCaps *result = gst_caps_copy(caps);
+    for (guint i = 0; i < gst_caps_get_size(result); i++) {
+        GstStructure *structure = gst_caps_get_structure(result, i);
+        gst_structure_remove_fields(structure, "ssrc", "clock-base", "seqnum-base",
+                                    "timestamp-offset", "seqnum-offset", NULL);
+        if (direction == GST_PAD_SINK) {
+            gst_structure_set(structure, "ssrc", G_TYPE_UINT, ssrc, NULL);
+        }
+    }
+
+    if (filter) {
+        GstCaps *filtered = gst_caps_intersect_full(filter, result, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(result);
+        result = filtered;
+    }
+
+    return result;
+}
+
+static gboolean skyway_rtp_rewrite_set_caps(GstBaseTransform *trans, GstCaps *incaps,
+                                            __attribute__ ((unused)) GstCaps *outcaps) {
+    SkywayRtpRewritePrivate *priv = skyway_rtp_rewrite_get_instance_private(
+            SKYWAY_RTP_REWRITE(trans));
+    GstStructure *structure = gst_caps_get_structure(incaps, 0);
+
+    gint clock_rate = DEFAULT_CLOCK_RATE;
+    gst_structure_get_int(structure, "clock-rate", &clock_rate);
+
+    g_mutex_lock(&priv->lock);
+    priv->clock_rate = clock_rate > 0 ? clock_rate : DEFAULT_CLOCK_RATE;
+
+    // Parameter sets announced out of band, in case the camera never repeats them in-band
+    const gchar *fields[PARAMETER_SET_COUNT] = {"sprop-vps", "sprop-sps", "sprop-pps"};
+    for (guint i = 0; i < PARAMETER_SET_COUNT; i++) {
+        const gchar *value = gst_structure_get_string(structure, fields[i]);
+        if (!value || priv->parameter_sets[i]) {
+            continue;
+        }
+
+        // Only the first one of a comma-separated list, we serve a single layer
+        gchar *first = g_strndup(value, strcspn(value, ","));
+        gsize size = 0;
+        guchar *nal = g_base64_decode(first, &size);
+        g_free(first);
+        if (size >= 2) {
+            priv->parameter_sets[i] = g_bytes_new_take(nal, size);
+        } else {
+            g_free(nal);
+        }
+    }
+    g_mutex_unlock(&priv->lock);
+
+    return TRUE;
+}
+
+static gboolean skyway_rtp_rewrite_start(GstBaseTransform *trans) {
+    SkywayRtpRewritePrivate *priv = skyway_rtp_rewrite_get_instance_private(
+            SKYWAY_RTP_REWRITE(trans));
+
+    g_mutex_lock(&priv->lock);
+    priv->started = FALSE;
+    g_mutex_unlock(&priv->lock);
+
+    return TRUE;
+}
+
+/*
+ * Maps the upstream numbering onto ours: at random offsets at first, then right after the last
+ * packet sent, so that clients see one continuous stream across upstream restarts.
+ */
+static void rebase(SkywayRtpRewritePrivate *priv, guint16 seq, guint32 timestamp,
+                   GstClockTime running_time) {
+    guint16 next_seq;
+    guint32 next_timestamp;
+
+    if (!priv->started) {
+        next_seq = priv->seqnum_offset >= 0 ? (guint16) priv->seqnum_offset
+                                            : (guint16) g_random_int_range(0, G_MAXUINT16 + 1);
+        next_timestamp = priv->timestamp_offset != G_MAXUINT ? priv->timestamp_offset
+                                                             : g_random_int();
+    } else {
+        next_seq = priv->last_seq + 1;
+        next_timestamp = priv->last_timestamp;
+        if (GST_CLOCK_TIME_IS_VALID(running_time) &&
+            GST_CLOCK_TIME_IS_VALID(priv->last_running_time) &&
+            running_time > priv->last_running_time) {
+            next_timestamp += (guint32) gst_util_uint64_scale_int(
+                    running_time - priv->last_running_time, priv->clock_rate, GST_SECOND);
+        }
+        g_print("Upstream RTP restarted, continuing from sequence number %u\n", next_seq);
+    }
+
+    priv->seq_delta = next_seq - seq;
+    priv->timestamp_delta = next_timestamp - timestamp;
+    priv->have_parameter_set_timestamp = FALSE;
+    priv->started = TRUE;
+}
+
+static void inspect_nal(SkywayRtpRewritePrivate *priv, const guint8 *nal, guint size,
+                        guint32 timestamp, gboolean *irap) {
+    guint8 nal_type = SKYWAY_H265_NAL_TYPE(nal);
+    if (skyway_h265_nal_is_irap(nal_type)) {
+        *irap = TRUE;
+        return;
+    }
+
+    if (nal_type < SKYWAY_H265_NAL_VPS || nal_type > SKYWAY_H265_NAL_PPS) {
+        return;
+    }
+
+    priv->have_parameter_set_timestamp = TRUE;
+    priv->parameter_set_timestamp = timestamp;
+
+    GBytes **cached = &priv->parameter_sets[nal_type - SKYWAY_H265_NAL_VPS];
+    gsize cached_size = 0;
+    const guint8 *cached_data = *cached ? g_bytes_get_data(*cached, &cached_size) : NULL;
+    if (!cached_data || cached_size != size || memcmp(cached_data, nal, size) != 0) {
+        g_clear_pointer(cached, g_bytes_unref);
+        *cached = g_bytes_new(nal, size);
+    }
+}
+
+/*
+ * Caches the parameter sets the packet carries, and returns whether it starts an IRAP frame.
+ */
+static gboolean inspect_payload(SkywayRtpRewritePrivate *priv, const guint8 *payload, guint size,
+                                guint32 timestamp) {
+    gboolean irap = FALSE;
+    if (size < 3) {
+        return FALSE;
+    }
+
+    switch (SKYWAY_H265_NAL_TYPE(payload)) {
+        case SKYWAY_H265_RTP_AGGREGATION_PACKET: {
+            guint offset = 2;
+            while (offset + 2 <= size) {
+                guint nal_size = GST_READ_UINT16_BE(payload + offset);
+                offset += 2;
+                if (nal_size < 2 || offset + nal_size > size) {
+                    break;
+                }
+                inspect_nal(priv, payload + offset, nal_size, timestamp, &irap);
+                offset += nal_size;
+            }
+            break;
+        }
+        case SKYWAY_H265_RTP_FRAGMENTATION_UNIT:
+            // Only the first fragment (S bit) starts the frame
+            irap = (payload[2] & 0x80) && skyway_h265_nal_is_irap(payload[2] & 0x3f);
+            break;
+        default:
+            inspect_nal(priv, payload, size, timestamp, &irap);
+            break;
+    }
+
+    return irap;
+}
+
+static GstBufferList *
+parameter_set_packets(SkywayRtpRewritePrivate *priv, GstRTPBuffer *rtp, guint32 timestamp) {
+    GstBufferList *packets = gst_buffer_list_new();
+
+    for (guint i = 0; i < PARAMETER_SET_COUNT; i++) {
+        if (!priv->parameter_sets[i]) {
+            continue;
+        }
+
+        gsize size = 0;
+        const guint8 *nal = g_bytes_get_data(priv->parameter_sets[i], &size);
+        GstBuffer *packet = gst_rtp_buffer_new_allocate((guint) size, 0, 0);
+        GstRTPBuffer packet_rtp = GST_RTP_BUFFER_INIT;
+        gst_rtp_buffer_map(packet, GST_MAP_WRITE, &packet_rtp);
+        gst_rtp_buffer_set_payload_type(&packet_rtp, gst_rtp_buffer_get_payload_type(rtp));
+        gst_rtp_buffer_set_ssrc(&packet_rtp, priv->ssrc);
+        gst_rtp_buffer_set_seq(&packet_rtp, gst_rtp_buffer_get_seq(rtp) + priv->seq_delta);
+        gst_rtp_buffer_set_timestamp(&packet_rtp, timestamp + priv->timestamp_delta);
+        memcpy(gst_rtp_buffer_get_payload(&packet_rtp), nal, size);
+        gst_rtp_buffer_unmap(&packet_rtp);
+
+        GST_BUFFER_PTS(packet) = GST_BUFFER_PTS(rtp->buffer);
+        gst_buffer_list_add(packets, packet);
+        // The packet that triggered us comes after the inserted ones
+        priv->seq_delta++;
+    }
+
+    if (gst_buffer_list_length(packets) == 0) {
+        gst_buffer_list_unref(packets);
+        return NULL;
+    }
+    return packets;
+}
+
+static GstFlowReturn skyway_rtp_rewrite_transform_ip(GstBaseTransform *trans, GstBuffer *buffer) {
+    SkywayRtpRewritePrivate *priv = skyway_rtp_rewrite_get_instance_private(
+            SKYWAY_RTP_REWRITE(trans));
+
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+    if (!gst_rtp_buffer_map(buffer, GST_MAP_READWRITE, &rtp)) {
+        g_printerr("Dropping invalid RTP packet\n");
+        return GST_BASE_TRANSFORM_FLOW_DROPPED;
+    }
+
+    guint32 ssrc = gst_rtp_buffer_get_ssrc(&rtp);
+    guint16 seq = gst_rtp_buffer_get_seq(&rtp);
+    guint32 timestamp = gst_rtp_buffer_get_timestamp(&rtp);
+    GstClockTime running_time = gst_segment_to_running_time(&trans->segment, GST_FORMAT_TIME,
+                                                            GST_BUFFER_PTS(buffer));
+
+    g_mutex_lock(&priv->lock);
+    gint16 seq_jump = (gint16) (seq - priv->last_input_seq);
+    if (!priv->started || ssrc != priv->input_ssrc || ABS(seq_jump) > MAX_SEQ_JUMP) {
+        rebase(priv, seq, timestamp, running_time);
+    }
+    priv->input_ssrc = ssrc;
+    priv->last_input_seq = seq;
+
+    gboolean irap = inspect_payload(priv, gst_rtp_buffer_get_payload(&rtp),
+                                    gst_rtp_buffer_get_payload_len(&rtp), timestamp);
+
+    GstBufferList *inserted = NULL;
+    if (irap && g_atomic_int_get(&priv->need_parameter_sets)) {
+        g_atomic_int_set(&priv->need_parameter_sets, FALSE);
+        // Parameter sets are sent before the slices of their access unit, i.e. with its timestamp
+        if (!priv->have_parameter_set_timestamp || priv->parameter_set_timestamp != timestamp) {
+            inserted = parameter_set_packets(priv, &rtp, timestamp);
+        }
+    }
+
+    priv->last_seq = seq + priv->seq_delta;
+    priv->last_timestamp = timestamp + priv->timestamp_delta;
+    priv->last_running_time = running_time;
+    gst_rtp_buffer_set_ssrc(&rtp, priv->ssrc);
+    gst_rtp_buffer_set_seq(&rtp, priv->last_seq);
+    gst_rtp_buffer_set_timestamp(&rtp, priv->last_timestamp);
+    g_mutex_unlock(&priv->lock);
+
+    gst_rtp_buffer_unmap(&rtp);
+
+    if (inserted) {
+        return gst_pad_push_list(GST_BASE_TRANSFORM_SRC_PAD(trans), inserted);
+    }
+    return GST_FLOW_OK;
+}
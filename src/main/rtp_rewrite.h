@@ -0,0 +1,35 @@
+#ifndef SKYWAY_RTP_REWRITE_H
+#define SKYWAY_RTP_REWRITE_H
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+G_BEGIN_DECLS
+
+#define SKYWAY_TYPE_RTP_REWRITE (skyway_rtp_rewrite_get_type())
+
+typedef struct _SkywayRtpRewrite {
+    GstBaseTransform parent;
+} SkywayRtpRewrite;
+
+G_DECLARE_FINAL_TYPE(SkywayRtpRewrite, skyway_rtp_rewrite, SKYWAY, RTP_REWRITE, GstBaseTransform)
+
+GType skyway_rtp_rewrite_get_type(void);
+
+/*
+ * Stands in for the payloader of a media relaying H.265 RTP packets as they were received: it
+ * gives them our own SSRC and sequence and timestamp offsets, continuous across upstream
+ * restarts. It exposes the payloader properties the RTSP server reads (ssrc, seqnum, timestamp,
+ * stats), so it must be named pay0 like one.
+ */
+gboolean skyway_rtp_rewrite_register(void);
+
+/*
+ * Sends the last VPS, SPS and PPS seen before the next IRAP frame, unless that frame carries
+ * them already. For clients joining a stream whose parameter sets are not repeated in-band.
+ */
+void skyway_rtp_rewrite_request_parameter_sets(SkywayRtpRewrite *self);
+
+G_END_DECLS
+
+#endif // SKYWAY_RTP_REWRITE_H
@@ -30,36 +30,29 @@
  * - Original License URL: https://git.sr.ht/~jonasvautherin/sambaza/tree/main/item/LICENSE
  */
 #include <jni.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <gst/gst.h>
 #include <gst/rtsp-server/rtsp-server.h>
+#ifdef __ANDROID__
 #include <android/log.h>
+#endif
 
 #include "appsink_proxy.h"
+#include "capture_time.h"
+#include "command_queue.h"
 #include "gstbuffer_to_sink.h"
+#include "pipeline_tracer.h"
 #include "rtsp_server.h"
-
-GST_PLUGIN_STATIC_DECLARE(app);
-
-GST_PLUGIN_STATIC_DECLARE(coreelements);
-
-GST_PLUGIN_STATIC_DECLARE(rtp);
-
-GST_PLUGIN_STATIC_DECLARE(rtpmanager);
-
-GST_PLUGIN_STATIC_DECLARE(rtsp);
-
-GST_PLUGIN_STATIC_DECLARE(tcp);
-
-GST_PLUGIN_STATIC_DECLARE(udp);
-
-GST_PLUGIN_STATIC_DECLARE(videoparsersbad);
-
+#include "startup.h"
 
 typedef struct _SkywayHandles {
     GMainLoop *main_loop;
     guint server_handle; // TODO have a collection of handles for each server -> actually we want one server but multiple streams
 } SkywayHandles;
 
+#ifdef __ANDROID__
 static void gstAndroidLog(GstDebugCategory * category,
                           GstDebugLevel      level,
                           const gchar      * file,
@@ -79,17 +72,21 @@ static void gstAndroidLog(GstDebugCategory * category,
                             file, function, gst_debug_message_get(message));
     }
 }
+#endif
 
 JNIEXPORT jlong JNICALL
 Java_com_auterion_sambaza_JniApi_00024Companion_initNative(__attribute__ ((unused)) JNIEnv *env,
                                                                __attribute__ ((unused)) jobject thiz) {
+    skyway_startup_mark(SKYWAY_STARTUP_INIT);
     gst_debug_set_default_threshold(GST_LEVEL_INFO);
+#ifdef __ANDROID__
     #pragma GCC diagnostic push
     #pragma GCC diagnostic ignored "-Wpedantic"
 
     gst_debug_add_log_function(gstAndroidLog, NULL, NULL);
 
     #pragma GCC diagnostic pop
+#endif
 
     GError *err;
     gboolean init_succeeded = gst_init_check(NULL, NULL, &err);
@@ -98,14 +95,9 @@ Java_com_auterion_sambaza_JniApi_00024Companion_initNative(__attribute__ ((unuse
         return 0;
     }
 
-    GST_PLUGIN_STATIC_REGISTER(app);
-    GST_PLUGIN_STATIC_REGISTER(coreelements);
-    GST_PLUGIN_STATIC_REGISTER(rtp);
-    GST_PLUGIN_STATIC_REGISTER(rtpmanager);
-    GST_PLUGIN_STATIC_REGISTER(rtsp);
-    GST_PLUGIN_STATIC_REGISTER(tcp);
-    GST_PLUGIN_STATIC_REGISTER(udp);
-    GST_PLUGIN_STATIC_REGISTER(videoparsersbad);
+    skyway_startup_mark(SKYWAY_STARTUP_GST_READY);
+    // Nothing creates elements before the first stream is added, which waits for them
+    skyway_startup_register_plugins();
 
     SkywayHandles *handles = malloc(sizeof(SkywayHandles));
     handles->main_loop = g_main_loop_new(NULL, FALSE);
@@ -129,8 +121,9 @@ JNIEXPORT jlong JNICALL
 Java_com_auterion_sambaza_JniApi_00024Companion_createRtspServerNative(
         __attribute__ ((unused)) JNIEnv *env,
         __attribute__ ((unused)) jobject thiz,
-        jint port) {
-    jlong server = (jlong) skyway_rtsp_server_new(port);
+        jint port,
+        jlong memory_budget) {
+    jlong server = (jlong) skyway_rtsp_server_new(port, memory_budget > 0 ? memory_budget : 0);
     return server;
 }
 
@@ -143,17 +136,231 @@ Java_com_auterion_sambaza_JniApi_00024Companion_getPortNative(
     return server->port;
 }
 
+/*
+ * Control operations arrive from arbitrary Kotlin threads. Those on a server are all marshalled
+ * onto the main context through the server's command queue, so that mount points and the server
+ * are only ever touched from the thread serving the clients. Tracing and the startup timings
+ * belong to the process rather than a server and are called directly. The fields used depend on
+ * the command, getters fill in out.
+ */
+typedef struct _ControlCommand {
+    SkywayHandles *handles;
+    SkywayRtspServer *server;
+    const char *location;
+    const char *path;
+    const char *source_path;
+    SkywayDerivedMode derived_mode;
+    gint value;
+    gint second_value;
+    guint64 mask;
+    gboolean flag;
+    gboolean second_flag;
+    gpointer listener;
+    gpointer out;
+} ControlCommand;
+
+typedef struct _CongestionListener {
+    JavaVM *vm;
+    jobject listener;
+    jmethodID on_congestion;
+} CongestionListener;
+
+static gpointer run_start(ControlCommand *command) {
+    SkywayRtspServer *server = command->server;
+    command->handles->server_handle = gst_rtsp_server_attach(server->server, NULL);
+    server->port = gst_rtsp_server_get_bound_port(server->server);
+    skyway_startup_mark(SKYWAY_STARTUP_SERVER_STARTED);
+    return NULL;
+}
+
+static gpointer run_stop(ControlCommand *command) {
+    SkywayRtspServer *server = command->server;
+    SkywayAppSinkProxy *src = g_weak_ref_get(&server->src);
+
+    // TODO server->src is set only for pushable proxy
+    if (src) {
+        skyway_app_sink_proxy_stop(src);
+        g_object_unref(src);
+    }
+    skyway_rtsp_server_stop(server);
+    g_source_remove(command->handles->server_handle);
+    g_object_unref(server->server);
+
+    skyway_command_queue_close(server->commands);
+    g_main_loop_quit(command->handles->main_loop);
+    return NULL;
+}
+
+static gpointer run_add_rtspsrc_stream(ControlCommand *command) {
+    if (command->second_flag) {
+        return GINT_TO_POINTER(skyway_add_direct_rtspsrc_stream(command->server,
+                                                                command->location, command->path,
+                                                                command->flag));
+    }
+    return GINT_TO_POINTER(skyway_add_rtspsrc_stream(command->server, command->location,
+                                                     command->path, command->flag));
+}
+
+static gpointer run_add_pushable_stream(ControlCommand *command) {
+    skyway_add_pushable_stream(command->server, command->path);
+    return NULL;
+}
+
+static gpointer run_add_shm_stream(ControlCommand *command) {
+    return GINT_TO_POINTER(skyway_add_shm_stream(command->server, command->path, command->value,
+                                                 command->second_value));
+}
+
+static gpointer run_add_derived_stream(ControlCommand *command) {
+    return GINT_TO_POINTER(skyway_add_derived_stream(command->server, command->source_path,
+                                                     command->path, command->derived_mode,
+                                                     command->value,
+                                                     (unsigned int) command->second_value));
+}
+
+static gpointer run_add_switchable_stream(ControlCommand *command) {
+    return GINT_TO_POINTER(skyway_add_switchable_stream(command->server, command->path,
+                                                        command->source_path));
+}
+
+static gpointer run_switch_stream_source(ControlCommand *command) {
+    return GINT_TO_POINTER(skyway_switch_stream_source(command->server, command->path,
+                                                       command->source_path));
+}
+
+static gpointer run_remove_stream(ControlCommand *command) {
+    skyway_remove_stream(command->server, command->path);
+    return NULL;
+}
+
+static gpointer run_set_default_linger(ControlCommand *command) {
+    skyway_set_default_linger(command->server, command->value);
+    return NULL;
+}
+
+static gpointer run_set_stream_linger(ControlCommand *command) {
+    return GINT_TO_POINTER(skyway_set_stream_linger(command->server, command->path,
+                                                    command->value));
+}
+
+static gpointer run_set_stream_priority(ControlCommand *command) {
+    return GINT_TO_POINTER(skyway_set_stream_priority(command->server, command->path,
+                                                      (SkywayStreamPriority) command->value));
+}
+
+static gpointer run_set_frame_thinning(ControlCommand *command) {
+    skyway_set_frame_thinning(command->server, command->flag, command->second_flag);
+    return NULL;
+}
+
+static gpointer run_set_thread_policy(ControlCommand *command) {
+    // Running on the main context, this also applies the policy to the main loop thread
+    skyway_set_thread_policy(command->server, command->mask, command->value,
+                             command->second_value, command->path);
+    return NULL;
+}
+
+static gpointer run_set_capture_time_extension(ControlCommand *command) {
+    skyway_set_capture_time_extension(command->server, command->flag);
+    return NULL;
+}
+
+static gpointer run_set_tcp_backlog_limit(ControlCommand *command) {
+    skyway_set_tcp_backlog_limit(command->server, command->value, command->second_value);
+    return NULL;
+}
+
+static gpointer run_get_backlog_stats(ControlCommand *command) {
+    skyway_get_backlog_stats(command->server, command->out);
+    return NULL;
+}
+
+static gpointer run_set_client_limits(ControlCommand *command) {
+    if (command->path) {
+        return GINT_TO_POINTER(skyway_set_stream_client_limits(command->server, command->path,
+                                                               (unsigned int) command->value,
+                                                               command->mask));
+    }
+    skyway_set_client_limits(command->server, (unsigned int) command->value, command->mask);
+    return NULL;
+}
+
+static gpointer run_set_bitrate_estimate(ControlCommand *command) {
+    skyway_set_bitrate_estimate(command->server, command->mask);
+    return NULL;
+}
+
+static gpointer run_add_priority_address(ControlCommand *command) {
+    return GINT_TO_POINTER(skyway_add_priority_address(command->server, command->location));
+}
+
+static gpointer run_get_memory_usage(ControlCommand *command) {
+    skyway_get_memory_usage(command->server, command->out);
+    return NULL;
+}
+
+static gpointer run_start_recording(ControlCommand *command) {
+    return GINT_TO_POINTER(skyway_start_recording(command->server, command->path));
+}
+
+static gpointer run_stop_recording(ControlCommand *command) {
+    skyway_stop_recording(command->server);
+    return NULL;
+}
+
+static void notify_congestion(const SkywayCongestion *congestion, CongestionListener *listener) {
+    JNIEnv *env = NULL;
+    // The main context is run by runMainLoopNative, i.e. on a thread the JVM knows
+    if ((*listener->vm)->GetEnv(listener->vm, (void **) &env, JNI_VERSION_1_6) != JNI_OK) {
+        g_printerr("No JNI environment to report congestion from\n");
+        return;
+    }
+
+    (*env)->CallVoidMethod(env, listener->listener, listener->on_congestion,
+                           (jint) congestion->level, (jint) congestion->queue_depth,
+                           (jint) congestion->dropped_samples,
+                           (jint) congestion->congested_clients,
+                           (jlong) congestion->client_dropped_frames);
+    if ((*env)->ExceptionCheck(env)) {
+        (*env)->ExceptionDescribe(env);
+        (*env)->ExceptionClear(env);
+    }
+}
+
+static void congestion_listener_free(CongestionListener *listener) {
+    JNIEnv *env = NULL;
+    if ((*listener->vm)->GetEnv(listener->vm, (void **) &env, JNI_VERSION_1_6) == JNI_OK) {
+        (*env)->DeleteGlobalRef(env, listener->listener);
+    }
+    g_free(listener);
+}
+
+static gpointer run_set_congestion_listener(ControlCommand *command) {
+    if (command->listener) {
+        skyway_set_congestion_callback(command->server, (SkywayCongestionFunc) notify_congestion,
+                                       command->listener,
+                                       (GDestroyNotify) congestion_listener_free);
+    } else {
+        skyway_set_congestion_callback(command->server, NULL, NULL, NULL);
+    }
+    return NULL;
+}
+
+static gpointer call_on_main_context(SkywayCommandFunc func, ControlCommand *command) {
+    return skyway_command_queue_call(command->server->commands, func, command);
+}
+
 JNIEXPORT void JNICALL
 Java_com_auterion_sambaza_JniApi_00024Companion_startNative(
         __attribute__ ((unused)) JNIEnv *env,
         __attribute__ ((unused)) jobject thiz,
         jlong skyway_server_handle,
         jlong main_loop_handle) {
-    SkywayHandles *handles = (SkywayHandles *) main_loop_handle;
-
-    SkywayRtspServer *server = (SkywayRtspServer *) skyway_server_handle;
-    handles->server_handle = (jlong) gst_rtsp_server_attach(server->server, NULL);
-    server->port = gst_rtsp_server_get_bound_port(server->server);
+    ControlCommand command = {
+            .handles = (SkywayHandles *) main_loop_handle,
+            .server = (SkywayRtspServer *) skyway_server_handle,
+    };
+    call_on_main_context((SkywayCommandFunc) run_start, &command);
 }
 
 JNIEXPORT void JNICALL
@@ -161,17 +368,11 @@ Java_com_auterion_sambaza_JniApi_00024Companion_stopNative(__attribute__ ((unuse
                                                                __attribute__ ((unused)) jobject thiz,
                                                                jlong skyway_server_handle,
                                                                jlong main_loop_handle) {
-    SkywayHandles *handles = (SkywayHandles *) main_loop_handle;
-
-    SkywayRtspServer *server = (SkywayRtspServer *) skyway_server_handle;
-    // TODO server->src is set only for pushable proxy
-    if (server->src) {
-        skyway_app_sink_proxy_stop(server->src);
-    }
-    g_source_remove(handles->server_handle);
-    g_object_unref(server->server);
-
-    g_main_loop_quit(handles->main_loop);
+    ControlCommand command = {
+            .handles = (SkywayHandles *) main_loop_handle,
+            .server = (SkywayRtspServer *) skyway_server_handle,
+    };
+    call_on_main_context((SkywayCommandFunc) run_stop, &command);
 }
 
 JNIEXPORT void JNICALL
@@ -180,13 +381,21 @@ Java_com_auterion_sambaza_JniApi_00024Companion_addRtspSrcStreamNative(
         __attribute__ ((unused)) jobject thiz,
         jlong skyway_server_handle,
         jstring location,
-        jstring path) {
+        jstring path,
+        jboolean passthrough,
+        jboolean direct) {
 
     const char *native_location = (*env)->GetStringUTFChars(env, location, 0);
     const char *native_path = (*env)->GetStringUTFChars(env, path, 0);
 
-    SkywayRtspServer *server = (SkywayRtspServer *) skyway_server_handle;
-    skyway_add_rtspsrc_stream(server, native_location, native_path);
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .location = native_location,
+            .path = native_path,
+            .flag = passthrough,
+            .second_flag = direct,
+    };
+    call_on_main_context((SkywayCommandFunc) run_add_rtspsrc_stream, &command);
 
     (*env)->ReleaseStringUTFChars(env, location, native_location);
     (*env)->ReleaseStringUTFChars(env, path, native_path);
@@ -201,12 +410,119 @@ Java_com_auterion_sambaza_JniApi_00024Companion_addPushableStreamNative(
 
     const char *native_path = (*env)->GetStringUTFChars(env, path, 0);
 
-    SkywayRtspServer *server = (SkywayRtspServer *) skyway_server_handle;
-    skyway_add_pushable_stream(server, native_path);
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .path = native_path,
+    };
+    call_on_main_context((SkywayCommandFunc) run_add_pushable_stream, &command);
 
     (*env)->ReleaseStringUTFChars(env, path, native_path);
 }
 
+/*
+ * The descriptors stay owned by the caller, the stream gets its own duplicates.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_addShmStreamNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jstring path,
+        jint memory_fd,
+        jint doorbell_fd) {
+    int own_memory_fd = dup(memory_fd);
+    int own_doorbell_fd = dup(doorbell_fd);
+    if (own_memory_fd < 0 || own_doorbell_fd < 0) {
+        g_printerr("Invalid shared memory ring descriptors\n");
+        if (own_memory_fd >= 0) {
+            close(own_memory_fd);
+        }
+        if (own_doorbell_fd >= 0) {
+            close(own_doorbell_fd);
+        }
+        return JNI_FALSE;
+    }
+
+    const char *native_path = (*env)->GetStringUTFChars(env, path, 0);
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .path = native_path,
+            .value = own_memory_fd,
+            .second_value = own_doorbell_fd,
+    };
+    gpointer added = call_on_main_context((SkywayCommandFunc) run_add_shm_stream, &command);
+
+    (*env)->ReleaseStringUTFChars(env, path, native_path);
+    return GPOINTER_TO_INT(added) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_addDerivedStreamNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jstring parent_path,
+        jstring path,
+        jboolean idr_only,
+        jint max_temporal_id,
+        jint max_fps) {
+    const char *native_parent_path = (*env)->GetStringUTFChars(env, parent_path, 0);
+    const char *native_path = (*env)->GetStringUTFChars(env, path, 0);
+
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .source_path = native_parent_path,
+            .path = native_path,
+            .derived_mode = idr_only ? SKYWAY_DERIVED_IDR_ONLY : SKYWAY_DERIVED_TEMPORAL_LAYERS,
+            .value = max_temporal_id,
+            .second_value = max_fps > 0 ? max_fps : 0,
+    };
+    gpointer added = call_on_main_context((SkywayCommandFunc) run_add_derived_stream, &command);
+
+    (*env)->ReleaseStringUTFChars(env, parent_path, native_parent_path);
+    (*env)->ReleaseStringUTFChars(env, path, native_path);
+    return GPOINTER_TO_INT(added) ? JNI_TRUE : JNI_FALSE;
+}
+
+static jboolean call_with_paths(JNIEnv *env, jlong skyway_server_handle, SkywayCommandFunc func,
+                                jstring path, jstring source_path) {
+    const char *native_path = (*env)->GetStringUTFChars(env, path, 0);
+    const char *native_source_path = (*env)->GetStringUTFChars(env, source_path, 0);
+
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .path = native_path,
+            .source_path = native_source_path,
+    };
+    gpointer done = call_on_main_context(func, &command);
+
+    (*env)->ReleaseStringUTFChars(env, path, native_path);
+    (*env)->ReleaseStringUTFChars(env, source_path, native_source_path);
+    return GPOINTER_TO_INT(done) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_addSwitchableStreamNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jstring path,
+        jstring source_path) {
+    return call_with_paths(env, skyway_server_handle,
+                           (SkywayCommandFunc) run_add_switchable_stream, path, source_path);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_switchSourceNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jstring path,
+        jstring source_path) {
+    return call_with_paths(env, skyway_server_handle,
+                           (SkywayCommandFunc) run_switch_stream_source, path, source_path);
+}
+
 JNIEXPORT void JNICALL
 Java_com_auterion_sambaza_JniApi_00024Companion_removeStreamNative(
         JNIEnv *env,
@@ -214,33 +530,388 @@ Java_com_auterion_sambaza_JniApi_00024Companion_removeStreamNative(
         jlong skyway_server_handle,
         jstring path) {
     const char *native_path = (*env)->GetStringUTFChars(env, path, 0);
-    SkywayRtspServer *server = (SkywayRtspServer *) skyway_server_handle;
-    skyway_remove_stream(server, native_path);
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .path = native_path,
+    };
+    call_on_main_context((SkywayCommandFunc) run_remove_stream, &command);
+    (*env)->ReleaseStringUTFChars(env, path, native_path);
+}
+
+JNIEXPORT void JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_setDefaultLingerNative(
+        __attribute__ ((unused)) JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jint seconds) {
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .value = seconds,
+    };
+    call_on_main_context((SkywayCommandFunc) run_set_default_linger, &command);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_setStreamLingerNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jstring path,
+        jint seconds) {
+    const char *native_path = (*env)->GetStringUTFChars(env, path, 0);
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .path = native_path,
+            .value = seconds,
+    };
+    gpointer found = call_on_main_context((SkywayCommandFunc) run_set_stream_linger, &command);
+    (*env)->ReleaseStringUTFChars(env, path, native_path);
+    return GPOINTER_TO_INT(found) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_setFrameThinningNative(
+        __attribute__ ((unused)) JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jboolean enabled,
+        jboolean allow_idr_only) {
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .flag = enabled,
+            .second_flag = allow_idr_only,
+    };
+    call_on_main_context((SkywayCommandFunc) run_set_frame_thinning, &command);
+}
+
+JNIEXPORT void JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_setCaptureTimeExtensionNative(
+        __attribute__ ((unused)) JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jboolean enabled) {
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .flag = enabled,
+    };
+    call_on_main_context((SkywayCommandFunc) run_set_capture_time_extension, &command);
+}
+
+JNIEXPORT void JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_setThreadPolicyNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jlong cpu_mask,
+        jint nice,
+        jint rt_priority,
+        jstring name_prefix) {
+    const char *native_name_prefix = name_prefix
+                                     ? (*env)->GetStringUTFChars(env, name_prefix, 0) : NULL;
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .mask = (guint64) cpu_mask,
+            .value = nice,
+            .second_value = rt_priority,
+            .path = native_name_prefix,
+    };
+    call_on_main_context((SkywayCommandFunc) run_set_thread_policy, &command);
+
+    if (native_name_prefix) {
+        (*env)->ReleaseStringUTFChars(env, name_prefix, native_name_prefix);
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_setTcpBacklogLimitNative(
+        __attribute__ ((unused)) JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jint max_bytes,
+        jint max_delay_ms) {
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .value = MAX(max_bytes, 0),
+            .second_value = MAX(max_delay_ms, 0),
+    };
+    call_on_main_context((SkywayCommandFunc) run_set_tcp_backlog_limit, &command);
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_getBacklogStatsNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle) {
+    // Left at zero once the server is stopped
+    SkywayBacklogStats stats = {0};
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .out = &stats,
+    };
+    call_on_main_context((SkywayCommandFunc) run_get_backlog_stats, &command);
+
+    jlong values[] = {(jlong) stats.overflows, (jlong) stats.resyncs,
+                      (jlong) stats.skipped_frames};
+    jlongArray result = (*env)->NewLongArray(env, 3);
+    if (result) {
+        (*env)->SetLongArrayRegion(env, result, 0, 3, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_setStreamPriorityNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jstring path,
+        jint priority) {
+    if (priority < SKYWAY_PRIORITY_LOW || priority > SKYWAY_PRIORITY_HIGH) {
+        g_printerr("Invalid stream priority: %d\n", priority);
+        return JNI_FALSE;
+    }
+
+    const char *native_path = (*env)->GetStringUTFChars(env, path, 0);
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .path = native_path,
+            .value = priority,
+    };
+    gpointer found = call_on_main_context((SkywayCommandFunc) run_set_stream_priority, &command);
+    (*env)->ReleaseStringUTFChars(env, path, native_path);
+    return GPOINTER_TO_INT(found) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_setCongestionListenerNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jobject listener) {
+    CongestionListener *native_listener = NULL;
+    if (listener) {
+        jclass listener_class = (*env)->GetObjectClass(env, listener);
+        jmethodID on_congestion = (*env)->GetMethodID(env, listener_class, "onCongestion",
+                                                      "(IIIIJ)V");
+        (*env)->DeleteLocalRef(env, listener_class);
+        if (!on_congestion) {
+            // NoSuchMethodError is pending
+            return;
+        }
+
+        native_listener = g_new0(CongestionListener, 1);
+        (*env)->GetJavaVM(env, &native_listener->vm);
+        native_listener->listener = (*env)->NewGlobalRef(env, listener);
+        native_listener->on_congestion = on_congestion;
+    }
+
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .listener = native_listener,
+    };
+    call_on_main_context((SkywayCommandFunc) run_set_congestion_listener, &command);
+}
+
+JNIEXPORT void JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_setClientLimitsNative(
+        __attribute__ ((unused)) JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jint max_clients,
+        jlong max_bitrate) {
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .value = MAX(max_clients, 0),
+            .mask = max_bitrate > 0 ? (guint64) max_bitrate : 0,
+    };
+    call_on_main_context((SkywayCommandFunc) run_set_client_limits, &command);
+}
+
+JNIEXPORT void JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_setBitrateEstimateNative(
+        __attribute__ ((unused)) JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jlong bitrate) {
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .mask = bitrate > 0 ? (guint64) bitrate : 0,
+    };
+    call_on_main_context((SkywayCommandFunc) run_set_bitrate_estimate, &command);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_setStreamClientLimitsNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jstring path,
+        jint max_clients,
+        jlong max_bitrate) {
+    const char *native_path = (*env)->GetStringUTFChars(env, path, 0);
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .path = native_path,
+            .value = MAX(max_clients, 0),
+            .mask = max_bitrate > 0 ? (guint64) max_bitrate : 0,
+    };
+    gpointer found = call_on_main_context((SkywayCommandFunc) run_set_client_limits, &command);
     (*env)->ReleaseStringUTFChars(env, path, native_path);
+    return GPOINTER_TO_INT(found) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_addPriorityAddressNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jstring address) {
+    const char *native_address = (*env)->GetStringUTFChars(env, address, 0);
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .location = native_address,
+    };
+    gpointer valid = call_on_main_context((SkywayCommandFunc) run_add_priority_address,
+                                          &command);
+    (*env)->ReleaseStringUTFChars(env, address, native_address);
+    return GPOINTER_TO_INT(valid) ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * Returns [limit, used, peak, shed samples], all zero once the server is stopped.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_getMemoryUsageNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle) {
+    SkywayMemoryUsage usage = {0};
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .out = &usage,
+    };
+    call_on_main_context((SkywayCommandFunc) run_get_memory_usage, &command);
+
+    jlong values[] = {(jlong) usage.limit, (jlong) usage.used, (jlong) usage.peak,
+                      (jlong) usage.shed_samples};
+    jlongArray result = (*env)->NewLongArray(env, 4);
+    if (result) {
+        (*env)->SetLongArrayRegion(env, result, 0, 4, values);
+    }
+    return result;
 }
 
+/*
+ * Tracing covers every pipeline in the process, so it is not tied to a server handle.
+ */
 JNIEXPORT void JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_startTracingNative(
+        __attribute__ ((unused)) JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jint capacity) {
+    skyway_tracing_start(capacity > 0 ? (guint) capacity : 0);
+}
+
+JNIEXPORT void JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_stopTracingNative(
+        __attribute__ ((unused)) JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz) {
+    skyway_tracing_stop();
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_dumpTraceNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz) {
+    gchar *json = skyway_tracing_dump_json();
+    jstring result = (*env)->NewStringUTF(env, json);
+    g_free(json);
+    return result;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_getStartupTimingsNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz) {
+    gint64 timings[SKYWAY_STARTUP_PHASE_COUNT];
+    skyway_startup_get_timings(timings);
+
+    jlong values[SKYWAY_STARTUP_PHASE_COUNT];
+    for (guint i = 0; i < SKYWAY_STARTUP_PHASE_COUNT; i++) {
+        values[i] = (jlong) timings[i];
+    }
+    jlongArray result = (*env)->NewLongArray(env, SKYWAY_STARTUP_PHASE_COUNT);
+    if (result) {
+        (*env)->SetLongArrayRegion(env, result, 0, SKYWAY_STARTUP_PHASE_COUNT, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_startRecordingNative(
+        JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle,
+        jstring path) {
+    const char *native_path = (*env)->GetStringUTFChars(env, path, 0);
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+            .path = native_path,
+    };
+    gpointer started = call_on_main_context((SkywayCommandFunc) run_start_recording, &command);
+    (*env)->ReleaseStringUTFChars(env, path, native_path);
+
+    return GPOINTER_TO_INT(started) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_auterion_sambaza_JniApi_00024Companion_stopRecordingNative(
+        __attribute__ ((unused)) JNIEnv *env,
+        __attribute__ ((unused)) jobject thiz,
+        jlong skyway_server_handle) {
+    ControlCommand command = {
+            .server = (SkywayRtspServer *) skyway_server_handle,
+    };
+    call_on_main_context((SkywayCommandFunc) run_stop_recording, &command);
+}
+
+/*
+ * Returns the flow return of the push in the low 32 bits, the queue depth after it in the next
+ * 16 and whether a frame was dropped for it in bit 48, so that pushing does not allocate.
+ */
+JNIEXPORT jlong JNICALL
 Java_com_auterion_sambaza_JniApi_00024Companion_pushFrameNative(
         JNIEnv *env,
         __attribute__ ((unused)) jobject thiz,
         jlong skyway_server_handle,
         jlong pts,
+        jlong capture_time,
         jbyteArray buffer,
         jstring caps) {
+    SkywayRtspServer *server = (SkywayRtspServer *) skyway_server_handle;
+    // The stream may be removed concurrently, hold it for the duration of the push
+    SkywayGstBufferToSink *gst_buffer_to_sink = g_weak_ref_get(&server->src);
+    if (!gst_buffer_to_sink) {
+        return (guint32) GST_FLOW_FLUSHING;
+    }
+
     jbyte *buffer_ptr = (*env)->GetByteArrayElements(env, buffer, NULL);
     jsize buffer_size = (*env)->GetArrayLength(env, buffer);
     const char *native_caps = (*env)->GetStringUTFChars(env, caps, 0);
 
-    SkywayRtspServer *server = (SkywayRtspServer *) skyway_server_handle;
-    SkywayGstBufferToSink *gst_buffer_to_sink = (SkywayGstBufferToSink *) server->src;
-
-    GstBuffer *gst_buffer = gst_buffer_new_wrapped(buffer_ptr, buffer_size);
+    // The array elements are released below, the buffer must own a copy to be queued (and
+    // charged against the memory budget) beyond this call
+    GstBuffer *gst_buffer = gst_buffer_new_memdup(buffer_ptr, buffer_size);
 
     if (pts == -1) {
         GST_BUFFER_PTS(gst_buffer) = GST_CLOCK_TIME_NONE;
     } else {
         GST_BUFFER_PTS(gst_buffer) = pts;
     }
+    if (capture_time != -1) {
+        skyway_capture_time_set(gst_buffer, capture_time);
+    }
+    skyway_gstbuffer_to_sink_classify_buffer(gst_buffer_to_sink, gst_buffer);
 
     GstCaps *gst_caps = NULL;
     if (strlen(native_caps) > 0) {
@@ -248,9 +919,22 @@ Java_com_auterion_sambaza_JniApi_00024Companion_pushFrameNative(
     }
 
     GstSample *sample = gst_sample_new(gst_buffer, gst_caps, NULL, NULL);
-    skyway_gstbuffer_to_sink_push_sample(gst_buffer_to_sink, sample);
+    gst_buffer_unref(gst_buffer);
+    if (gst_caps) {
+        gst_caps_unref(gst_caps);
+    }
+    SkywayBackpressure before;
+    SkywayBackpressure after;
+    skyway_app_sink_proxy_get_backpressure(SKYWAY_APP_SINK_PROXY(gst_buffer_to_sink), &before);
+    GstFlowReturn flow = skyway_gstbuffer_to_sink_push_sample(gst_buffer_to_sink, sample);
+    skyway_app_sink_proxy_get_backpressure(SKYWAY_APP_SINK_PROXY(gst_buffer_to_sink), &after);
     gst_sample_unref(sample);
+    g_object_unref(gst_buffer_to_sink);
 
     (*env)->ReleaseByteArrayElements(env, buffer, buffer_ptr, JNI_ABORT);
     (*env)->ReleaseStringUTFChars(env, caps, native_caps);
+
+    jlong dropped = after.dropped_samples != before.dropped_samples;
+    return (dropped << 48) | ((jlong) MIN(after.queue_depth, G_MAXUINT16) << 32) |
+           (guint32) flow;
 }
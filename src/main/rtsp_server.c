@@ -36,17 +36,33 @@
 #include "rtsp_server.h"
 
 #include "appsrc_factory.h"
+#include "derived_sink.h"
 #include "gstbuffer_to_sink.h"
+#include "rtp_rewrite.h"
 #include "rtspsrc_to_sink.h"
+#include "shm_to_sink.h"
+#include "startup.h"
+
+typedef struct _GraceWindow {
+    SkywayRtspServer *server;
+    SkywayStream *stream;
+} GraceWindow;
 
 static void closed_handler(GstRTSPClient *client, gpointer user_data);
 
 static void
 teardown_request_handler(GstRTSPClient *client, GstRTSPContext *ctx, gpointer user_data);
 
+static void
+play_request_handler(GstRTSPClient *client, GstRTSPContext *ctx, gpointer user_data);
+
 static void
 client_connected_handler(GstRTSPServer *server, GstRTSPClient *client, gpointer user_data);
 
+static gboolean grace_timeout(GraceWindow *window);
+
+static void grace_window_free(GraceWindow *window);
+
 static void closed_handler(GstRTSPClient *client, __attribute__ ((unused)) gpointer user_data) {
     GstRTSPConnection *connection = gst_rtsp_client_get_connection(client);
     GstRTSPUrl *client_url = gst_rtsp_connection_get_url(connection);
@@ -61,12 +77,41 @@ static void teardown_request_handler(__attribute__ ((unused)) GstRTSPClient *cli
     g_print("Teardown client\n");
 }
 
+/*
+ * Relayed packets carry parameter sets only as often as the camera repeats them, so a joining
+ * client gets them inserted before the next IRAP frame.
+ */
+static void play_request_handler(__attribute__ ((unused)) GstRTSPClient *client,
+                                 GstRTSPContext *ctx,
+                                 __attribute__ ((unused)) gpointer user_data) {
+    if (!ctx->sessmedia) {
+        return;
+    }
+
+    GstRTSPMedia *media = gst_rtsp_session_media_get_media(ctx->sessmedia);
+    GstElement *element = gst_rtsp_media_get_element(media);
+    GstElement *pay = gst_bin_get_by_name(GST_BIN(element), "pay0");
+    if (pay && SKYWAY_IS_RTP_REWRITE(pay)) {
+        skyway_rtp_rewrite_request_parameter_sets(SKYWAY_RTP_REWRITE(pay));
+    }
+
+    if (pay) {
+        gst_object_unref(pay);
+    }
+    gst_object_unref(element);
+}
+
 static void
 client_connected_handler(__attribute__ ((unused)) GstRTSPServer *server,
                          GstRTSPClient *client,
-                         __attribute__ ((unused)) gpointer user_data) {
+                         gpointer user_data) {
+    SkywayRtspServer *skyway_rtsp_server = user_data;
+
     g_signal_connect(client, "teardown-request", G_CALLBACK(teardown_request_handler), NULL);
     g_signal_connect(client, "closed", G_CALLBACK(closed_handler), NULL);
+    g_signal_connect(client, "play-request", G_CALLBACK(play_request_handler), NULL);
+    skyway_client_monitor_watch_client(skyway_rtsp_server->monitor, client);
+    skyway_admission_watch_client(skyway_rtsp_server->admission, client);
 
     GstRTSPConnection *connection = gst_rtsp_client_get_connection(client);
     GstRTSPUrl *client_url = gst_rtsp_connection_get_url(connection);
@@ -87,60 +132,456 @@ static void remove_mount_point(GstRTSPServer *server, const char *path) {
     g_object_unref(mount_points);
 }
 
-static GstRTSPServer *create_rtsp_server(int port) {
+static GstRTSPServer *create_rtsp_server(SkywayRtspServer *skyway_rtsp_server, int port) {
     GstRTSPServer *server = gst_rtsp_server_new();
     gchar port_str[50];
     sprintf(port_str, "%d", port);
     gst_rtsp_server_set_service(server, port_str);
-    g_signal_connect(server, "client-connected", G_CALLBACK(client_connected_handler), NULL);
+    g_signal_connect(server, "client-connected", G_CALLBACK(client_connected_handler),
+                     skyway_rtsp_server);
+
+    GstRTSPThreadPool *thread_pool = skyway_thread_policy_create_thread_pool(
+            skyway_rtsp_server->thread_policy);
+    gst_rtsp_server_set_thread_pool(server, thread_pool);
+    g_object_unref(thread_pool);
 
     return server;
 }
 
+static void register_stream(SkywayRtspServer *server, const char *path, SkywayStream *stream) {
+    g_hash_table_replace(server->streams, g_strdup(path), stream);
+    if (stream->proxy) {
+        // A revived stream gets back the linger it had before its grace window
+        if (stream->linger < 0) {
+            stream->linger = server->default_linger;
+        }
+        skyway_app_sink_proxy_set_memory_budget(stream->proxy, server->budget);
+        skyway_app_sink_proxy_set_linger(stream->proxy, stream->linger);
+    }
+    skyway_admission_add_mount(server->admission, path, APP_SRC_FACTORY(stream->factory)->load);
+    add_mount_point(server->server, stream->factory, path);
+}
+
+// NULL for direct relays as well, there is no ingest apart from their media to act on
+static SkywayAppSinkProxy *lookup_proxy(SkywayRtspServer *server, const char *path) {
+    SkywayStream *stream = g_hash_table_lookup(server->streams, path);
+    return stream ? stream->proxy : NULL;
+}
+
+/*
+ * Whether the proxy emits the RTP packets of a passthrough relay instead of access units, which
+ * only a passthrough mount can stream.
+ */
+static gboolean relays_packets(SkywayAppSinkProxy *proxy) {
+    return SKYWAY_IS_RTSP_SRC_TO_SINK(proxy) &&
+           skyway_rtsp_src_to_sink_is_passthrough(SKYWAY_RTSP_SRC_TO_SINK(proxy));
+}
+
 static GstRTSPMediaFactory *
-create_factory(SkywayAppSinkProxy *skyway_app_sink_proxy, const char *launch_str) {
+create_factory(SkywayRtspServer *server, SkywayAppSinkProxy *skyway_app_sink_proxy,
+               const char *launch_str, gboolean passthrough) {
     g_print("Creating appsrc factory\n");
     AppSrcFactory *app_src_factory = app_src_factory_new();
     gst_rtsp_media_factory_set_shared(GST_RTSP_MEDIA_FACTORY(app_src_factory), TRUE);
     gst_rtsp_media_factory_set_launch(GST_RTSP_MEDIA_FACTORY(app_src_factory), launch_str);
-    app_src_factory->appsink = skyway_app_sink_proxy;
+    app_src_factory->appsink = skyway_app_sink_proxy ? g_object_ref(skyway_app_sink_proxy) : NULL;
+    app_src_factory->monitor = server->monitor;
+    app_src_factory->budget = server->budget;
+    app_src_factory->thread_policy = server->thread_policy;
+    app_src_factory->capture_time = server->capture_time;
+    app_src_factory->passthrough = passthrough;
+    app_src_factory_prebuild(app_src_factory);
 
     return GST_RTSP_MEDIA_FACTORY(app_src_factory);
 }
 
-SkywayRtspServer *skyway_rtsp_server_new(int port) {
+static SkywayStream *
+create_stream(SkywayRtspServer *server, SkywayAppSinkProxy *proxy, const char *launch_str,
+              const char *location) {
+    GstRTSPMediaFactory *factory = create_factory(server, proxy, launch_str,
+                                                  relays_packets(proxy));
+    SkywayStream *stream = skyway_stream_new(proxy, factory, location);
+    g_object_unref(factory);
+
+    return stream;
+}
+
+static gboolean grace_timeout(GraceWindow *window) {
+    SkywayStream *stream = window->stream;
+    stream->grace_source = 0;
+
+    if (g_hash_table_lookup(window->server->retired, stream->location) == stream) {
+        g_print("Releasing unused stream from %s\n", stream->location);
+        g_hash_table_remove(window->server->retired, stream->location);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static void grace_window_free(GraceWindow *window) {
+    g_object_unref(window->stream);
+    g_free(window);
+}
+
+static void retire_stream(SkywayRtspServer *server, SkywayStream *stream) {
+    GraceWindow *window = g_new(GraceWindow, 1);
+    window->server = server;
+    window->stream = g_object_ref(stream);
+
+    // Keep the upstream running through the window so that a re-add is instant
+    skyway_app_sink_proxy_set_linger(stream->proxy, SKYWAY_REUSE_GRACE_SECONDS);
+    stream->grace_source = g_timeout_add_seconds_full(G_PRIORITY_DEFAULT,
+                                                      SKYWAY_REUSE_GRACE_SECONDS,
+                                                      (GSourceFunc) grace_timeout, window,
+                                                      (GDestroyNotify) grace_window_free);
+    g_hash_table_replace(server->retired, g_strdup(stream->location), stream);
+}
+
+static SkywayStream *
+revive_stream(SkywayRtspServer *server, const char *location, gboolean passthrough) {
+    // A pipeline in the other mode is of no use, let its window run out
+    SkywayStream *retired = g_hash_table_lookup(server->retired, location);
+    if (!retired || !SKYWAY_IS_RTSP_SRC_TO_SINK(retired->proxy) ||
+        skyway_rtsp_src_to_sink_is_passthrough(SKYWAY_RTSP_SRC_TO_SINK(retired->proxy)) !=
+        passthrough) {
+        return NULL;
+    }
+
+    gpointer key = NULL;
+    gpointer stream = NULL;
+    g_hash_table_steal_extended(server->retired, location, &key, &stream);
+
+    g_free(key);
+    if (SKYWAY_STREAM(stream)->grace_source) {
+        g_source_remove(SKYWAY_STREAM(stream)->grace_source);
+        SKYWAY_STREAM(stream)->grace_source = 0;
+    }
+
+    return stream;
+}
+
+SkywayRtspServer *skyway_rtsp_server_new(int port, gsize memory_budget) {
     SkywayRtspServer *skyway_rtsp_server = malloc(sizeof(SkywayRtspServer));
-    skyway_rtsp_server->server = create_rtsp_server(port);
-    skyway_rtsp_server->src = NULL;
+    skyway_rtsp_server->monitor = skyway_client_monitor_new();
+    skyway_rtsp_server->thread_policy = skyway_thread_policy_new();
+    skyway_rtsp_server->server = create_rtsp_server(skyway_rtsp_server, port);
+    g_weak_ref_init(&skyway_rtsp_server->src, NULL);
+    skyway_rtsp_server->streams = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                        g_object_unref);
+    skyway_rtsp_server->retired = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                        g_object_unref);
+    skyway_rtsp_server->default_linger = 0;
+    skyway_rtsp_server->commands = skyway_command_queue_new(g_main_context_default());
+    skyway_rtsp_server->budget = skyway_memory_budget_new(memory_budget);
+    skyway_rtsp_server->admission = skyway_admission_new();
+    skyway_rtsp_server->congestion = NULL;
+    skyway_rtsp_server->capture_time = FALSE;
 
     return skyway_rtsp_server;
 }
 
-int skyway_add_rtspsrc_stream(SkywayRtspServer *server, const char *location, const char *path) {
+int skyway_add_rtspsrc_stream(SkywayRtspServer *server, const char *location, const char *path,
+                              gboolean passthrough) {
+    SkywayStream *stream = revive_stream(server, location, passthrough);
+    if (stream) {
+        g_print("Reusing the pipeline from %s for %s\n", location, path);
+        register_stream(server, path, stream);
+        return TRUE;
+    }
+
+    skyway_startup_wait_for_plugins();
     SkywayRtspSrcToSink *skyway_rtsp_src_to_sink = skyway_rtsp_src_to_sink_new();
-    if (!skyway_rtsp_src_to_sink_prepare(skyway_rtsp_src_to_sink, location)) {
+    if (!skyway_rtsp_src_to_sink_prepare(skyway_rtsp_src_to_sink, location, passthrough,
+                                         server->thread_policy)) {
         g_printerr("Failed to prepare SkywayRtspSrcToSink\n");
+        g_object_unref(skyway_rtsp_src_to_sink);
         return FALSE;
     }
 
-    const char *launch_str = "appsrc do-timestamp=true format=time is-live=true ! queue ! rtph265pay config-interval=-1 name=pay0";
-    GstRTSPMediaFactory *factory = create_factory(SKYWAY_APP_SINK_PROXY(skyway_rtsp_src_to_sink),
-                                                  launch_str);
-    add_mount_point(server->server, factory, path);
+    const char *launch_str = passthrough
+                             ? "appsrc do-timestamp=true format=time is-live=true ! queue ! skywayrtprewrite name=pay0"
+                             : "appsrc do-timestamp=true format=time is-live=true ! queue ! rtph265pay config-interval=-1 name=pay0";
+    stream = create_stream(server, SKYWAY_APP_SINK_PROXY(skyway_rtsp_src_to_sink), launch_str,
+                           location);
+    g_object_unref(skyway_rtsp_src_to_sink);
+    register_stream(server, path, stream);
+
+    return TRUE;
+}
+
+int skyway_add_direct_rtspsrc_stream(SkywayRtspServer *server, const char *location,
+                                     const char *path, gboolean passthrough) {
+    // Frames as the depayloader emits them are what the client monitor classifies
+    const char *launch_str = passthrough
+                             ? "rtspsrc name=relaysrc ! application/x-rtp,media=video,encoding-name=H265 ! skywayrtprewrite name=pay0"
+                             : "rtspsrc name=relaysrc ! application/x-rtp,media=video,encoding-name=H265 ! rtph265depay ! video/x-h265,stream-format=byte-stream,alignment=au ! rtph265pay config-interval=-1 name=pay0";
+    GstRTSPMediaFactory *factory = create_factory(server, NULL, launch_str, passthrough);
+    APP_SRC_FACTORY(factory)->relay_location = g_strdup(location);
+
+    // Not reusable after removal either, the pipeline goes with the media
+    SkywayStream *stream = skyway_stream_new(NULL, factory, NULL);
+    g_object_unref(factory);
+    register_stream(server, path, stream);
 
     return TRUE;
 }
 
 void skyway_add_pushable_stream(SkywayRtspServer *server, const char *path) {
     SkywayGstBufferToSink *skyway_gst_buffer_to_sink = skyway_gstbuffer_to_sink_new();
-    server->src = skyway_gst_buffer_to_sink; // TODO remove later, now support only one pushable stream per server
+    // TODO remove later, now support only one pushable stream per server
+    g_weak_ref_set(&server->src, skyway_gst_buffer_to_sink);
+
+    const char *launch_str = "appsrc do-timestamp=true format=time is-live=true ! h265parse config-interval=-1 ! queue ! rtph265pay name=pay0";
+    SkywayStream *stream = create_stream(server, SKYWAY_APP_SINK_PROXY(skyway_gst_buffer_to_sink),
+                                         launch_str, NULL);
+    g_object_unref(skyway_gst_buffer_to_sink);
+    register_stream(server, path, stream);
+}
+
+int skyway_add_shm_stream(SkywayRtspServer *server, const char *path, int memory_fd,
+                          int doorbell_fd) {
+    SkywayShmToSink *skyway_shm_to_sink = skyway_shm_to_sink_new(memory_fd, doorbell_fd);
+    if (!skyway_shm_to_sink) {
+        g_printerr("Cannot add %s, no valid shared memory ring\n", path);
+        return FALSE;
+    }
 
     const char *launch_str = "appsrc do-timestamp=true format=time is-live=true ! h265parse config-interval=-1 ! queue ! rtph265pay name=pay0";
-    GstRTSPMediaFactory *factory = create_factory(SKYWAY_APP_SINK_PROXY(skyway_gst_buffer_to_sink),
-                                                  launch_str);
-    add_mount_point(server->server, factory, path);
+    SkywayStream *stream = create_stream(server, SKYWAY_APP_SINK_PROXY(skyway_shm_to_sink),
+                                         launch_str, NULL);
+    g_object_unref(skyway_shm_to_sink);
+    register_stream(server, path, stream);
+    return TRUE;
+}
+
+int skyway_add_derived_stream(SkywayRtspServer *server, const char *parent_path, const char *path,
+                              SkywayDerivedMode mode, int max_temporal_id, unsigned int max_fps) {
+    SkywayAppSinkProxy *parent = lookup_proxy(server, parent_path);
+    if (!parent) {
+        g_printerr("Cannot derive %s, no stream is mounted at %s\n", path, parent_path);
+        return FALSE;
+    }
+    if (relays_packets(parent)) {
+        g_printerr("Cannot derive %s, %s relays RTP packets instead of frames\n", path,
+                   parent_path);
+        return FALSE;
+    }
+
+    SkywayDerivedSink *skyway_derived_sink = skyway_derived_sink_new(parent, mode, max_temporal_id,
+                                                                     max_fps);
+    // A derived view is the first thing to give up when memory runs short
+    skyway_app_sink_proxy_set_priority(SKYWAY_APP_SINK_PROXY(skyway_derived_sink),
+                                       SKYWAY_PRIORITY_LOW);
+
+    // The derived frames are not guaranteed to carry parameter sets, so always parse here
+    const char *launch_str = "appsrc do-timestamp=true format=time is-live=true ! h265parse config-interval=-1 ! queue ! rtph265pay name=pay0";
+    SkywayStream *stream = create_stream(server, SKYWAY_APP_SINK_PROXY(skyway_derived_sink),
+                                         launch_str, NULL);
+    g_object_unref(skyway_derived_sink);
+    register_stream(server, path, stream);
+
+    return TRUE;
+}
+
+int skyway_add_switchable_stream(SkywayRtspServer *server, const char *path,
+                                 const char *source_path) {
+    SkywayAppSinkProxy *source = lookup_proxy(server, source_path);
+    if (!source) {
+        g_printerr("Cannot mount %s, no stream is mounted at %s\n", path, source_path);
+        return FALSE;
+    }
+    if (relays_packets(source)) {
+        g_printerr("Cannot mount %s, %s relays RTP packets instead of frames\n", path,
+                   source_path);
+        return FALSE;
+    }
+
+    SkywaySwitchSink *skyway_switch_sink = skyway_switch_sink_new(source);
+
+    // The sources may differ in resolution, so their parameter sets are sent in-band
+    const char *launch_str = "appsrc do-timestamp=true format=time is-live=true ! h265parse config-interval=-1 ! queue ! rtph265pay name=pay0";
+    SkywayStream *stream = create_stream(server, SKYWAY_APP_SINK_PROXY(skyway_switch_sink),
+                                         launch_str, NULL);
+    g_object_unref(skyway_switch_sink);
+    register_stream(server, path, stream);
+
+    return TRUE;
+}
+
+int skyway_switch_stream_source(SkywayRtspServer *server, const char *path,
+                                const char *source_path) {
+    SkywayAppSinkProxy *proxy = lookup_proxy(server, path);
+    if (!proxy || !SKYWAY_IS_SWITCH_SINK(proxy)) {
+        g_printerr("Cannot switch, no switchable stream is mounted at %s\n", path);
+        return FALSE;
+    }
+
+    SkywayAppSinkProxy *source = lookup_proxy(server, source_path);
+    if (!source) {
+        g_printerr("Cannot switch %s, no stream is mounted at %s\n", path, source_path);
+        return FALSE;
+    }
+    if (relays_packets(source)) {
+        g_printerr("Cannot switch %s, %s relays RTP packets instead of frames\n", path,
+                   source_path);
+        return FALSE;
+    }
+
+    skyway_switch_sink_switch_to(SKYWAY_SWITCH_SINK(proxy), source);
+    return TRUE;
 }
 
 void skyway_remove_stream(SkywayRtspServer *server, const char *path) {
     remove_mount_point(server->server, path);
+    skyway_admission_remove_mount(server->admission, path);
+
+    gpointer key = NULL;
+    gpointer stream = NULL;
+    if (!g_hash_table_steal_extended(server->streams, path, &key, &stream)) {
+        return;
+    }
+    g_free(key);
+
+    if (SKYWAY_STREAM(stream)->location) {
+        retire_stream(server, stream);
+    } else {
+        g_object_unref(stream);
+    }
+}
+
+void skyway_rtsp_server_stop(SkywayRtspServer *server) {
+    GHashTableIter iter;
+    SkywayStream *stream;
+    g_hash_table_iter_init(&iter, server->streams);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &stream)) {
+        if (stream->proxy) {
+            // Stops the pipeline at once unless clients still play it
+            skyway_app_sink_proxy_set_linger(stream->proxy, 0);
+        }
+    }
+
+    g_hash_table_iter_init(&iter, server->retired);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &stream)) {
+        skyway_app_sink_proxy_set_linger(stream->proxy, 0);
+        if (stream->grace_source) {
+            g_source_remove(stream->grace_source);
+            stream->grace_source = 0;
+        }
+    }
+    g_hash_table_remove_all(server->retired);
+
+    // Releases the listener, e.g. its JNI global reference
+    skyway_set_congestion_callback(server, NULL, NULL, NULL);
+    skyway_admission_stop(server->admission);
+    skyway_client_monitor_stop(server->monitor);
+}
+
+void skyway_set_default_linger(SkywayRtspServer *server, int seconds) {
+    server->default_linger = seconds;
+}
+
+int skyway_set_stream_linger(SkywayRtspServer *server, const char *path, int seconds) {
+    SkywayStream *stream = g_hash_table_lookup(server->streams, path);
+    if (!stream || !stream->proxy) {
+        g_printerr("Cannot set linger time, no stream is mounted at %s\n", path);
+        return FALSE;
+    }
+
+    stream->linger = seconds;
+    skyway_app_sink_proxy_set_linger(stream->proxy, seconds);
+    return TRUE;
+}
+
+int skyway_set_stream_priority(SkywayRtspServer *server, const char *path,
+                               SkywayStreamPriority priority) {
+    SkywayAppSinkProxy *proxy = lookup_proxy(server, path);
+    if (!proxy) {
+        g_printerr("Cannot set priority, no stream is mounted at %s\n", path);
+        return FALSE;
+    }
+
+    skyway_app_sink_proxy_set_priority(proxy, priority);
+    return TRUE;
+}
+
+void skyway_get_memory_usage(SkywayRtspServer *server, SkywayMemoryUsage *usage) {
+    skyway_memory_budget_get_usage(server->budget, usage);
+}
+
+void skyway_set_client_limits(SkywayRtspServer *server, unsigned int max_clients,
+                              guint64 max_bitrate) {
+    skyway_admission_set_limits(server->admission, max_clients, max_bitrate);
+}
+
+void skyway_set_bitrate_estimate(SkywayRtspServer *server, guint64 bitrate) {
+    skyway_admission_set_bitrate_estimate(server->admission, bitrate);
+}
+
+int skyway_set_stream_client_limits(SkywayRtspServer *server, const char *path,
+                                    unsigned int max_clients, guint64 max_bitrate) {
+    if (!skyway_admission_set_mount_limits(server->admission, path, max_clients, max_bitrate)) {
+        g_printerr("Cannot set client limits, no stream is mounted at %s\n", path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int skyway_add_priority_address(SkywayRtspServer *server, const char *address) {
+    if (!skyway_admission_add_priority_address(server->admission, address)) {
+        g_printerr("Invalid priority address %s\n", address);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void skyway_set_congestion_callback(SkywayRtspServer *server, SkywayCongestionFunc func,
+                                    gpointer user_data, GDestroyNotify notify) {
+    g_clear_pointer(&server->congestion, skyway_congestion_watch_free);
+    if (func) {
+        server->congestion = skyway_congestion_watch_new(&server->src, server->monitor, func,
+                                                         user_data, notify);
+    }
+}
+
+void skyway_set_frame_thinning(SkywayRtspServer *server, gboolean enabled, gboolean allow_idr_only) {
+    skyway_client_monitor_set_thinning(server->monitor, enabled, allow_idr_only);
+}
+
+void skyway_set_tcp_backlog_limit(SkywayRtspServer *server, unsigned int max_bytes,
+                                  unsigned int max_delay_ms) {
+    skyway_client_monitor_set_tcp_backlog_limit(server->monitor, max_bytes, max_delay_ms);
+}
+
+void skyway_get_backlog_stats(SkywayRtspServer *server, SkywayBacklogStats *stats) {
+    skyway_client_monitor_get_backlog_stats(server->monitor, stats);
+}
+
+void skyway_set_thread_policy(SkywayRtspServer *server, guint64 cpu_mask, int nice,
+                              int rt_priority, const char *name_prefix) {
+    skyway_thread_policy_set(server->thread_policy, cpu_mask, nice, rt_priority, name_prefix);
+    skyway_thread_policy_apply(server->thread_policy, "main");
+}
+
+int skyway_start_recording(SkywayRtspServer *server, const char *path) {
+    SkywayGstBufferToSink *src = g_weak_ref_get(&server->src);
+    if (!src) {
+        g_printerr("Cannot record, no pushable stream was added\n");
+        return FALSE;
+    }
+
+    gboolean started = skyway_gstbuffer_to_sink_start_recording(src, path);
+    g_object_unref(src);
+    return started;
+}
+
+void skyway_stop_recording(SkywayRtspServer *server) {
+    SkywayGstBufferToSink *src = g_weak_ref_get(&server->src);
+    if (src) {
+        skyway_gstbuffer_to_sink_stop_recording(src);
+        g_object_unref(src);
+    }
+}
+
+void skyway_set_capture_time_extension(SkywayRtspServer *server, gboolean enabled) {
+    server->capture_time = enabled;
 }
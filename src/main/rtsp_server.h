@@ -1,18 +1,171 @@
 #ifndef SKYWAY_RTSP_SERVER_H
 #define SKYWAY_RTSP_SERVER_H
 
+#include "admission.h"
+#include "client_monitor.h"
+#include "command_queue.h"
+#include "congestion.h"
+#include "derived_sink.h"
+#include "memory_budget.h"
+#include "stream.h"
+#include "switch_sink.h"
+#include "thread_policy.h"
+
+#define SKYWAY_REUSE_GRACE_SECONDS 10
+
 typedef struct _SkywayRtspServer {
     GstRTSPServer *server;
-    void *src;
+    GWeakRef src;
     int port;
+    SkywayClientMonitor *monitor;
+    GHashTable *streams;
+    // Removed relayed streams by location, kept for a grace window to be mounted again
+    GHashTable *retired;
+    int default_linger;
+    SkywayCommandQueue *commands;
+    SkywayMemoryBudget *budget;
+    SkywayAdmission *admission;
+    SkywayCongestionWatch *congestion;
+    SkywayThreadPolicy *thread_policy;
+    // Whether streams added from now on send their capture time to clients
+    gboolean capture_time;
 } SkywayRtspServer;
 
-SkywayRtspServer *skyway_rtsp_server_new();
+/*
+ * Every queue of the server charges its buffers against memory_budget bytes (0 for no limit).
+ */
+SkywayRtspServer *skyway_rtsp_server_new(int port, gsize memory_budget);
+
+/*
+ * In passthrough mode, the RTP packets from location are relayed as they are, with only their
+ * SSRC, sequence numbers and timestamps rewritten, instead of being depayloaded and payloaded
+ * again. Such a stream is not thinned per client, and cannot be derived from or switched to.
+ */
+int skyway_add_rtspsrc_stream(SkywayRtspServer *server, const char *location, const char *path,
+                              gboolean passthrough);
 
-int skyway_add_rtspsrc_stream(SkywayRtspServer *server, const char *location, const char *path);
+/*
+ * Relays location from within the media pipeline: rtspsrc, the depayloader and the payloader
+ * share the media's clock and streaming thread, with no appsink, appsrc and queue in between.
+ * The upstream is only connected to while clients play, and the mount cannot be derived from,
+ * switched to, lingered or reused after removal.
+ */
+int skyway_add_direct_rtspsrc_stream(SkywayRtspServer *server, const char *location,
+                                     const char *path, gboolean passthrough);
 
 void skyway_add_pushable_stream(SkywayRtspServer *server, const char *path);
 
+/*
+ * Mounts at path the frames an external process writes into a shared memory ring (see
+ * shm_ring.h). Takes ownership of both descriptors.
+ */
+int skyway_add_shm_stream(SkywayRtspServer *server, const char *path, int memory_fd,
+                          int doorbell_fd);
+
+int skyway_add_derived_stream(SkywayRtspServer *server, const char *parent_path, const char *path,
+                              SkywayDerivedMode mode, int max_temporal_id, unsigned int max_fps);
+
+/*
+ * Mounts at path whatever the stream mounted at source_path serves, until switched to another
+ * source: connected clients keep their session, the picture changes on the next IRAP frame.
+ */
+int skyway_add_switchable_stream(SkywayRtspServer *server, const char *path,
+                                 const char *source_path);
+
+int skyway_switch_stream_source(SkywayRtspServer *server, const char *path,
+                                const char *source_path);
+
+/*
+ * Releases the stream mounted at path. A relayed stream is kept for SKYWAY_REUSE_GRACE_SECONDS
+ * (running, if it was), and adding its location again meanwhile reuses its pipeline.
+ */
 void skyway_remove_stream(SkywayRtspServer *server, const char *path);
 
+/*
+ * Stops what the server keeps running on its own: always-on and lingering ingest pipelines,
+ * relays kept for reuse, and the polls of the congestion watch, admission and client monitor.
+ * Media still playing stop with their clients. To be called on the main context, before the
+ * server is released.
+ */
+void skyway_rtsp_server_stop(SkywayRtspServer *server);
+
+/*
+ * Linger times (in seconds, SKYWAY_LINGER_ALWAYS_ON to never stop) keep the ingest of a stream
+ * running after its last client left. The default applies to streams added afterwards, a relay
+ * reused within its grace window keeps the linger it was mounted with.
+ */
+void skyway_set_default_linger(SkywayRtspServer *server, int seconds);
+
+int skyway_set_stream_linger(SkywayRtspServer *server, const char *path, int seconds);
+
+/*
+ * Streams are NORMAL by default, derived ones LOW. When memory runs short, LOW streams shed
+ * frames first and HIGH ones last.
+ */
+int skyway_set_stream_priority(SkywayRtspServer *server, const char *path,
+                               SkywayStreamPriority priority);
+
+void skyway_get_memory_usage(SkywayRtspServer *server, SkywayMemoryUsage *usage);
+
+/*
+ * Over these limits (0 for none), SETUPs are refused with 453 Not Enough Bandwidth. Bitrates
+ * are in bits per second, measured on what the mounts send.
+ */
+void skyway_set_client_limits(SkywayRtspServer *server, unsigned int max_clients,
+                              guint64 max_bitrate);
+
+int skyway_set_stream_client_limits(SkywayRtspServer *server, const char *path,
+                                    unsigned int max_clients, guint64 max_bitrate);
+
+/*
+ * Per client, for the streams not measured yet, see skyway_admission_set_bitrate_estimate().
+ */
+void skyway_set_bitrate_estimate(SkywayRtspServer *server, guint64 bitrate);
+
+/*
+ * Clients from address (or subnet, e.g. "192.168.42.0/24") are admitted regardless of limits.
+ */
+int skyway_add_priority_address(SkywayRtspServer *server, const char *address);
+
+/*
+ * Reports the congestion of the pushable stream to func (see congestion.h), NULL to stop.
+ */
+void skyway_set_congestion_callback(SkywayRtspServer *server, SkywayCongestionFunc func,
+                                    gpointer user_data, GDestroyNotify notify);
+
+void skyway_set_frame_thinning(SkywayRtspServer *server, gboolean enabled, gboolean allow_idr_only);
+
+/*
+ * RTSP-over-TCP clients falling behind by more than max_bytes or max_delay_ms (0 for no limit,
+ * the default) have the frames queued for them flushed, and resume once caught up.
+ */
+void skyway_set_tcp_backlog_limit(SkywayRtspServer *server, unsigned int max_bytes,
+                                  unsigned int max_delay_ms);
+
+void skyway_get_backlog_stats(SkywayRtspServer *server, SkywayBacklogStats *stats);
+
+/*
+ * Pins the streaming threads of streams added from now on, the RTSP client and media threads
+ * and the calling thread (the main loop's) to the CPUs of cpu_mask, at nice or at a real-time
+ * priority (see thread_policy.h).
+ */
+void skyway_set_thread_policy(SkywayRtspServer *server, guint64 cpu_mask, int nice,
+                              int rt_priority, const char *name_prefix);
+
+/*
+ * Records what is pushed into the pushable stream to path (see push_record.h), until stopped or
+ * the stream is removed.
+ */
+int skyway_start_recording(SkywayRtspServer *server, const char *path);
+
+void skyway_stop_recording(SkywayRtspServer *server);
+
+/*
+ * Streams added from now on send the capture time of their frames in the abs-capture-time RTP
+ * header extension (see capture_time.h): pushed frames the one they are pushed with, relayed
+ * ones the one upstream sent, or the NTP time of its sender reports. Passthrough relays forward
+ * the extensions of upstream anyway.
+ */
+void skyway_set_capture_time_extension(SkywayRtspServer *server, gboolean enabled);
+
 #endif //SKYWAY_RTSP_SERVER_H
@@ -32,11 +32,16 @@
 
 #include <gst/gst.h>
 
+// How long play waits for the upstream under the proxy's lock, connecting goes on past it
+#define PLAY_TIMEOUT (2 * GST_SECOND)
+
 typedef struct _SkywayRtspSrcToSinkPrivate {
     GstElement *rtsp_source;
     GstElement *rtph265depay;
     GstElement *appsink;
     GstElement *pipeline;
+    // No depayloader: the appsink gets the RTP packets
+    gboolean passthrough;
     gulong pad_added_handle;
     gulong pad_removed_handle;
     gulong eos_handle;
@@ -89,25 +94,49 @@ SkywayRtspSrcToSink *skyway_rtsp_src_to_sink_new() {
     return g_object_new(SKYWAY_TYPE_RTSP_SRC_TO_SINK, NULL);
 }
 
-gboolean skyway_rtsp_src_to_sink_prepare(SkywayRtspSrcToSink *self, const char *location) {
+gboolean skyway_rtsp_src_to_sink_prepare(SkywayRtspSrcToSink *self, const char *location,
+                                         gboolean passthrough, SkywayThreadPolicy *thread_policy) {
     g_print("skyway_rtsp_src_to_sink_prepare()\n");
     SkywayRtspSrcToSinkPrivate *priv = skyway_rtsp_src_to_sink_get_instance_private(self);
+    priv->passthrough = passthrough;
 
     priv->rtsp_source = gst_element_factory_make("rtspsrc", NULL);
-    priv->rtph265depay = gst_element_factory_make("rtph265depay", NULL);
+    if (!passthrough) {
+        priv->rtph265depay = gst_element_factory_make("rtph265depay", NULL);
+    }
     priv->appsink = gst_element_factory_make("appsink", NULL);
     priv->pipeline = gst_pipeline_new(NULL);
 
-    if (!priv->rtsp_source || !priv->rtph265depay || !priv->appsink || !priv->pipeline) {
+    if (!priv->rtsp_source || (!passthrough && !priv->rtph265depay) || !priv->appsink ||
+        !priv->pipeline) {
         g_printerr("skyway_rtsp_src_to_sink_init: not all elements could be created\n");
+        gst_clear_object(&priv->rtsp_source);
+        gst_clear_object(&priv->rtph265depay);
+        gst_clear_object(&priv->appsink);
+        gst_clear_object(&priv->pipeline);
         return FALSE;
     }
 
-    g_object_set(priv->rtsp_source, "location", location, NULL);
-    g_object_set(priv->rtsp_source, "latency", 40, NULL);
+    if (thread_policy) {
+        skyway_thread_policy_watch_pipeline(thread_policy, priv->pipeline);
+    }
+
+    skyway_rtsp_src_configure(priv->rtsp_source, location);
     g_object_set(priv->appsink, "emit-signals", TRUE, NULL);
     g_object_set(priv->appsink, "drop", TRUE, NULL);
-    g_object_set(priv->appsink, "max-buffers", 60, NULL);
+
+    GstCaps *caps;
+    if (passthrough) {
+        // Packets, not frames: an IRAP frame alone can take a few hundred
+        g_object_set(priv->appsink, "max-buffers", 600, NULL);
+        caps = gst_caps_from_string("application/x-rtp,media=video,encoding-name=H265");
+    } else {
+        g_object_set(priv->appsink, "max-buffers", 60, NULL);
+        // Whole access units let the served media classify and thin frames per client
+        caps = gst_caps_from_string("video/x-h265,stream-format=byte-stream,alignment=au");
+    }
+    g_object_set(priv->appsink, "caps", caps, NULL);
+    gst_caps_unref(caps);
 
     priv->pad_added_handle = g_signal_connect(priv->rtsp_source, "pad-added",
                                               G_CALLBACK(pad_added_handler), priv);
@@ -117,18 +146,43 @@ gboolean skyway_rtsp_src_to_sink_prepare(SkywayRtspSrcToSink *self, const char *
     priv->new_sample_handle = g_signal_connect(priv->appsink, "new-sample",
                                                G_CALLBACK(new_sample_handler), self);
 
-    gst_bin_add_many(GST_BIN(priv->pipeline), priv->rtsp_source, priv->rtph265depay,
-                     priv->appsink, NULL);
+    gst_bin_add_many(GST_BIN(priv->pipeline), priv->rtsp_source, priv->appsink, NULL);
+    if (priv->rtph265depay) {
+        gst_bin_add(GST_BIN(priv->pipeline), priv->rtph265depay);
+    }
 
     return TRUE;
 }
 
+gboolean skyway_rtsp_src_to_sink_is_passthrough(SkywayRtspSrcToSink *self) {
+    SkywayRtspSrcToSinkPrivate *priv = skyway_rtsp_src_to_sink_get_instance_private(self);
+    return priv->passthrough;
+}
+
+void skyway_rtsp_src_configure(GstElement *rtsp_source, const char *location) {
+    g_object_set(rtsp_source, "location", location, NULL);
+    g_object_set(rtsp_source, "latency", 40, NULL);
+    // The NTP time of the sender reports, for depayloaded frames to carry their capture time on
+    // (see capture_time.h). Unused in passthrough, which forwards the header extensions as sent.
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(rtsp_source),
+                                     "add-reference-timestamp-meta")) {
+        g_object_set(rtsp_source, "add-reference-timestamp-meta", TRUE, NULL);
+    }
+}
+
 static void pad_added_handler(__attribute__ ((unused)) GstElement *src, GstPad *new_pad,
                               SkywayRtspSrcToSinkPrivate *data) {
     gchar *name = gst_pad_get_name(new_pad);
     g_print("A new pad %s is created\n", name);
     g_free(name);
 
+    if (data->passthrough) {
+        if (gst_element_link(data->rtsp_source, data->appsink) != TRUE) {
+            g_printerr("Elements (rtsp_source->appsink) could not be linked!\n");
+        }
+        return;
+    }
+
     if (gst_element_link(data->rtsp_source, data->rtph265depay) != TRUE) {
         g_printerr("Elements (rtsp_source->rtph265depay) could not be linked!\n");
         return;
@@ -146,7 +200,11 @@ static void pad_removed_handler(__attribute__ ((unused)) GstElement *src, GstPad
     g_print("pad removed: %s\n", name);
     g_free(name);
 
-    gst_element_unlink_many(data->rtsp_source, data->rtph265depay, data->appsink, NULL);
+    if (data->passthrough) {
+        gst_element_unlink(data->rtsp_source, data->appsink);
+    } else {
+        gst_element_unlink_many(data->rtsp_source, data->rtph265depay, data->appsink, NULL);
+    }
 }
 
 static void
@@ -162,16 +220,22 @@ static GstFlowReturn new_sample_handler(__attribute__ ((unused)) GstElement *sin
 static gboolean skyway_rtsp_src_to_sink_play(SkywayRtspSrcToSink *self) {
     SkywayRtspSrcToSinkPrivate *priv = skyway_rtsp_src_to_sink_get_instance_private(self);
 
-    gst_element_set_state(priv->pipeline, GST_STATE_PLAYING);
-    GstStateChangeReturn ret = gst_element_get_state(priv->pipeline, NULL, NULL,
-                                                     GST_CLOCK_TIME_NONE);
+    GstStateChangeReturn ret = gst_element_set_state(priv->pipeline, GST_STATE_PLAYING);
+    if (ret == GST_STATE_CHANGE_ASYNC) {
+        ret = gst_element_get_state(priv->pipeline, NULL, NULL, PLAY_TIMEOUT);
+    }
 
-    if (ret != GST_STATE_CHANGE_SUCCESS) {
+    if (ret == GST_STATE_CHANGE_FAILURE) {
         g_printerr("Failed to set appsink pipeline to PLAYING\n");
         gst_element_set_state(priv->pipeline, GST_STATE_NULL);
         return FALSE;
     }
 
+    // A slow upstream only delays the first samples
+    if (ret == GST_STATE_CHANGE_ASYNC) {
+        g_print("Upstream still connecting, appsink pipeline goes to PLAYING asynchronously\n");
+    }
+
     return TRUE;
 }
 
@@ -192,12 +256,16 @@ static void skyway_rtsp_src_to_sink_dispose(GObject *object) {
     SkywayRtspSrcToSinkPrivate *priv = skyway_rtsp_src_to_sink_get_instance_private(
             SKYWAY_RTSP_SRC_TO_SINK(object));
 
-    g_signal_handler_disconnect(priv->appsink, priv->new_sample_handle);
-    g_signal_handler_disconnect(priv->appsink, priv->eos_handle);
-    g_signal_handler_disconnect(priv->rtsp_source, priv->pad_removed_handle);
-    g_signal_handler_disconnect(priv->rtsp_source, priv->pad_added_handle);
+    // Dispose may run more than once, and prepare may have failed before building the pipeline
+    if (priv->pipeline) {
+        g_signal_handler_disconnect(priv->appsink, priv->new_sample_handle);
+        g_signal_handler_disconnect(priv->appsink, priv->eos_handle);
+        g_signal_handler_disconnect(priv->rtsp_source, priv->pad_removed_handle);
+        g_signal_handler_disconnect(priv->rtsp_source, priv->pad_added_handle);
 
-    gst_object_unref(priv->pipeline);
+        gst_element_set_state(priv->pipeline, GST_STATE_NULL);
+        gst_clear_object(&priv->pipeline);
+    }
 
     G_OBJECT_CLASS (skyway_rtsp_src_to_sink_parent_class)->dispose(object);
 }
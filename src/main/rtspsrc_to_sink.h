@@ -2,6 +2,7 @@
 #define SKYWAY_RTSPSRC_TO_SINK_H
 
 #include "appsink_proxy.h"
+#include "thread_policy.h"
 
 G_BEGIN_DECLS
 
@@ -18,7 +19,20 @@ GType skyway_rtsp_src_to_sink_get_type(void);
 
 SkywayRtspSrcToSink *skyway_rtsp_src_to_sink_new();
 
-gboolean skyway_rtsp_src_to_sink_prepare(SkywayRtspSrcToSink *self, const char *location);
+/*
+ * Emits H.265 access units or, in passthrough mode, the RTP packets as received, to be forwarded
+ * without depayloading (see rtp_rewrite.h). The streaming threads follow thread_policy, if any.
+ */
+gboolean skyway_rtsp_src_to_sink_prepare(SkywayRtspSrcToSink *self, const char *location,
+                                         gboolean passthrough, SkywayThreadPolicy *thread_policy);
+
+gboolean skyway_rtsp_src_to_sink_is_passthrough(SkywayRtspSrcToSink *self);
+
+/*
+ * Points an rtspsrc at location with the settings of our relays, whether it feeds a proxy or is
+ * part of a media pipeline itself.
+ */
+void skyway_rtsp_src_configure(GstElement *rtsp_source, const char *location);
 
 G_END_DECLS
 
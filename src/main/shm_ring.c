@@ -0,0 +1,153 @@
+#include "shm_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Older C libraries (e.g. Android before API 30) have the syscall but not the wrappers
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001u
+#define MFD_ALLOW_SEALING 0x0002u
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+struct _SkywayShmProducer {
+    int memory_fd;
+    int doorbell_fd;
+    uint8_t *map;
+    size_t map_size;
+    SkywayShmRingHeader *header;
+    SkywayShmSlot *slots;
+    uint8_t *data;
+    uint32_t write_index;
+    // Whether begin_frame handed out the slot at write_index
+    int writing;
+};
+
+static int create_memory(size_t size);
+
+static int create_memory(size_t size) {
+    int fd = (int) syscall(SYS_memfd_create, "sambaza-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // Sealed so that the reader can map it without fearing SIGBUS from a truncation
+    if (ftruncate(fd, (off_t) size) < 0 ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    return fd;
+}
+
+SkywayShmProducer *
+skyway_shm_producer_new(uint32_t slot_count, uint32_t slot_size, const char *caps) {
+    if (slot_count == 0 || slot_count > SKYWAY_SHM_RING_MAX_SLOTS || slot_size == 0 ||
+        (uint64_t) slot_count * slot_size > SIZE_MAX / 2 ||
+        strlen(caps) >= SKYWAY_SHM_RING_CAPS_SIZE) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    SkywayShmProducer *self = calloc(1, sizeof(SkywayShmProducer));
+    if (!self) {
+        return NULL;
+    }
+    self->memory_fd = -1;
+    self->doorbell_fd = -1;
+    self->map = MAP_FAILED;
+    self->map_size = skyway_shm_ring_size(slot_count, slot_size);
+
+    self->memory_fd = create_memory(self->map_size);
+    self->doorbell_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (self->memory_fd >= 0 && self->doorbell_fd >= 0) {
+        self->map = mmap(NULL, self->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, self->memory_fd,
+                         0);
+    }
+    if (self->map == MAP_FAILED) {
+        int error = errno;
+        skyway_shm_producer_free(self);
+        errno = error;
+        return NULL;
+    }
+
+    // A new memfd is zeroed, i.e. every slot is FREE
+    self->header = (SkywayShmRingHeader *) self->map;
+    self->slots = (SkywayShmSlot *) (self->map + sizeof(SkywayShmRingHeader));
+    self->data = self->map + skyway_shm_ring_data_offset(slot_count);
+    self->header->slot_count = slot_count;
+    self->header->slot_size = slot_size;
+    strcpy(self->header->caps, caps);
+    self->header->version = SKYWAY_SHM_RING_VERSION;
+    __atomic_store_n(&self->header->magic, SKYWAY_SHM_RING_MAGIC, __ATOMIC_RELEASE);
+
+    return self;
+}
+
+void skyway_shm_producer_free(SkywayShmProducer *self) {
+    if (self->map != MAP_FAILED) {
+        munmap(self->map, self->map_size);
+    }
+    if (self->memory_fd >= 0) {
+        close(self->memory_fd);
+    }
+    if (self->doorbell_fd >= 0) {
+        close(self->doorbell_fd);
+    }
+    free(self);
+}
+
+int skyway_shm_producer_get_memory_fd(const SkywayShmProducer *self) {
+    return self->memory_fd;
+}
+
+int skyway_shm_producer_get_doorbell_fd(const SkywayShmProducer *self) {
+    return self->doorbell_fd;
+}
+
+uint8_t *skyway_shm_producer_begin_frame(SkywayShmProducer *self) {
+    uint32_t index = self->write_index % self->header->slot_count;
+    if (__atomic_load_n(&self->slots[index].state, __ATOMIC_ACQUIRE) != SKYWAY_SHM_SLOT_FREE) {
+        self->writing = 0;
+        return NULL;
+    }
+
+    self->writing = 1;
+    return self->data + (size_t) index * self->header->slot_size;
+}
+
+int skyway_shm_producer_end_frame(SkywayShmProducer *self, uint32_t size, int64_t pts) {
+    if (!self->writing || size > self->header->slot_size) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    SkywayShmSlot *slot = &self->slots[self->write_index % self->header->slot_count];
+    slot->size = size;
+    slot->pts = pts;
+    __atomic_store_n(&slot->state, SKYWAY_SHM_SLOT_WRITTEN, __ATOMIC_RELEASE);
+    self->write_index++;
+    self->writing = 0;
+
+    // Fails only if the counter would overflow, in which case the reader is woken up anyway
+    uint64_t one = 1;
+    if (write(self->doorbell_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+#ifndef SKYWAY_SHM_RING_H
+#define SKYWAY_SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A ring of frame slots in shared memory, written by an encoder in another process and read by
+ * Sambaza without copying. Plain C without GLib, so that producers only need this header and
+ * shm_ring.c.
+ *
+ * The memory (a sealed memfd) starts with a SkywayShmRingHeader, followed by slot_count
+ * SkywayShmSlot and then slot_count blocks of slot_size bytes of frame data. Both sides walk the
+ * slots in order: the producer fills a FREE slot and marks it WRITTEN, then rings the doorbell
+ * (an eventfd). Sambaza marks it READING while frames reference the data, and FREE again once
+ * the last reference is gone, so a slow consumer makes the producer drop frames rather than
+ * overwrite data in use.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SKYWAY_SHM_RING_MAGIC 0x534b5952u // "SKYR"
+#define SKYWAY_SHM_RING_VERSION 1
+#define SKYWAY_SHM_RING_MAX_SLOTS 1024
+#define SKYWAY_SHM_RING_CAPS_SIZE 256
+#define SKYWAY_SHM_RING_ALIGNMENT 64
+#define SKYWAY_SHM_PTS_NONE (-1)
+
+enum {
+    SKYWAY_SHM_SLOT_FREE,
+    SKYWAY_SHM_SLOT_WRITTEN,
+    SKYWAY_SHM_SLOT_READING,
+};
+
+typedef struct _SkywayShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    // GStreamer caps of the frames, e.g. video/x-h265,stream-format=byte-stream,alignment=au
+    char caps[SKYWAY_SHM_RING_CAPS_SIZE];
+} SkywayShmRingHeader;
+
+typedef struct _SkywayShmSlot {
+    // SKYWAY_SHM_SLOT_*, only accessed atomically
+    int32_t state;
+    uint32_t size;
+    // Nanoseconds, or SKYWAY_SHM_PTS_NONE to timestamp on arrival
+    int64_t pts;
+} SkywayShmSlot;
+
+static inline size_t skyway_shm_ring_data_offset(uint32_t slot_count) {
+    size_t offset = sizeof(SkywayShmRingHeader) + slot_count * sizeof(SkywayShmSlot);
+    return (offset + SKYWAY_SHM_RING_ALIGNMENT - 1) & ~((size_t) SKYWAY_SHM_RING_ALIGNMENT - 1);
+}
+
+static inline size_t skyway_shm_ring_size(uint32_t slot_count, uint32_t slot_size) {
+    return skyway_shm_ring_data_offset(slot_count) + (size_t) slot_count * slot_size;
+}
+
+typedef struct _SkywayShmProducer SkywayShmProducer;
+
+/*
+ * Creates the ring and its doorbell. Returns NULL (with errno set) on failure.
+ */
+SkywayShmProducer *
+skyway_shm_producer_new(uint32_t slot_count, uint32_t slot_size, const char *caps);
+
+void skyway_shm_producer_free(SkywayShmProducer *self);
+
+/*
+ * The descriptors to hand to Sambaza (e.g. over a Unix socket or as ParcelFileDescriptors),
+ * which duplicates them. They stay owned by the producer.
+ */
+int skyway_shm_producer_get_memory_fd(const SkywayShmProducer *self);
+
+int skyway_shm_producer_get_doorbell_fd(const SkywayShmProducer *self);
+
+/*
+ * Returns where to write the next frame (at most slot_size bytes), or NULL if Sambaza still
+ * holds that slot, in which case the frame should be dropped.
+ */
+uint8_t *skyway_shm_producer_begin_frame(SkywayShmProducer *self);
+
+/*
+ * Publishes the frame written since the last begin_frame. Returns 0, or -1 if no frame was
+ * begun or it does not fit.
+ */
+int skyway_shm_producer_end_frame(SkywayShmProducer *self, uint32_t size, int64_t pts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SKYWAY_SHM_RING_H
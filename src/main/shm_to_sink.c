@@ -0,0 +1,306 @@
+#include "shm_to_sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm_ring.h"
+
+#ifndef F_GET_SEALS
+#define F_GET_SEALS 1034
+#define F_SEAL_SHRINK 0x0002
+#endif
+
+/*
+ * The mapped ring, shared by the proxy and every buffer wrapping one of its slots, since those
+ * can outlive the proxy. The geometry is copied from the header once it is validated: the
+ * producer can write to the header at any time.
+ */
+typedef struct _ShmMapping {
+    guint8 *map;
+    gsize map_size;
+    guint32 slot_count;
+    guint32 slot_size;
+    SkywayShmSlot *slots;
+    guint8 *data;
+} ShmMapping;
+
+typedef struct _SlotRelease {
+    ShmMapping *mapping;
+    guint32 index;
+} SlotRelease;
+
+typedef struct _SkywayShmToSinkPrivate {
+    gint playing; // the control and reading threads both access it
+    int memory_fd;
+    int doorbell_fd;
+    // Wakes the reading thread up to exit
+    int wakeup_fd;
+    ShmMapping *mapping;
+    GstCaps *caps;
+    guint32 read_index;
+    GThread *thread;
+} SkywayShmToSinkPrivate;
+
+G_DEFINE_TYPE_WITH_PRIVATE(SkywayShmToSink, skyway_shm_to_sink, SKYWAY_TYPE_APP_SINK_PROXY)
+
+static void skyway_shm_to_sink_class_init(SkywayShmToSinkClass *klass);
+
+static void skyway_shm_to_sink_init(SkywayShmToSink *self);
+
+static gboolean skyway_shm_to_sink_play(SkywayShmToSink *self);
+
+static void skyway_shm_to_sink_stop(SkywayShmToSink *self);
+
+static void skyway_shm_to_sink_dispose(GObject *object);
+
+static ShmMapping *mapping_new(int memory_fd, gchar **caps);
+
+static void mapping_free(ShmMapping *mapping);
+
+static void release_slot(SlotRelease *release);
+
+static void drain_ring(SkywayShmToSink *self, SkywayShmToSinkPrivate *priv);
+
+static gpointer read_ring(SkywayShmToSink *self);
+
+static void close_fd(int *fd);
+
+static void skyway_shm_to_sink_class_init(SkywayShmToSinkClass *klass) {
+    g_print("skyway_shm_to_sink_class_init()\n");
+
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    object_class->dispose = skyway_shm_to_sink_dispose;
+
+    klass->parent_class.play = skyway_shm_to_sink_play;
+    klass->parent_class.stop = skyway_shm_to_sink_stop;
+}
+
+static void skyway_shm_to_sink_init(SkywayShmToSink *self) {
+    g_print("skyway_shm_to_sink_init()\n");
+    SkywayShmToSinkPrivate *priv = skyway_shm_to_sink_get_instance_private(self);
+    priv->playing = FALSE;
+    priv->memory_fd = -1;
+    priv->doorbell_fd = -1;
+    priv->wakeup_fd = -1;
+    priv->mapping = NULL;
+    priv->caps = NULL;
+    priv->read_index = 0;
+    priv->thread = NULL;
+}
+
+SkywayShmToSink *skyway_shm_to_sink_new(int memory_fd, int doorbell_fd) {
+    SkywayShmToSink *self = g_object_new(SKYWAY_TYPE_SHM_TO_SINK, NULL);
+    SkywayShmToSinkPrivate *priv = skyway_shm_to_sink_get_instance_private(self);
+    priv->memory_fd = memory_fd;
+    priv->doorbell_fd = doorbell_fd;
+
+    gchar *caps = NULL;
+    priv->mapping = mapping_new(memory_fd, &caps);
+    if (!priv->mapping) {
+        g_object_unref(self);
+        return NULL;
+    }
+
+    priv->caps = gst_caps_from_string(caps);
+    g_free(caps);
+    if (!priv->caps) {
+        g_printerr("Invalid caps in the shared memory ring\n");
+        g_object_unref(self);
+        return NULL;
+    }
+
+    priv->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (priv->wakeup_fd < 0) {
+        g_printerr("Failed to create an eventfd: %s\n", g_strerror(errno));
+        g_object_unref(self);
+        return NULL;
+    }
+
+    priv->thread = g_thread_new("shm-ring", (GThreadFunc) read_ring, self);
+    return self;
+}
+
+static ShmMapping *mapping_new(int memory_fd, gchar **caps) {
+    struct stat info;
+    if (fstat(memory_fd, &info) < 0 || (gsize) info.st_size < sizeof(SkywayShmRingHeader)) {
+        g_printerr("Shared memory ring too small\n");
+        return NULL;
+    }
+
+    // Without this seal the producer could truncate the memory under our feet
+    int seals = fcntl(memory_fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        g_printerr("Shared memory ring is not sealed against shrinking\n");
+        return NULL;
+    }
+
+    gsize map_size = info.st_size;
+    guint8 *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+    if (map == MAP_FAILED) {
+        g_printerr("Failed to map the shared memory ring: %s\n", g_strerror(errno));
+        return NULL;
+    }
+
+    SkywayShmRingHeader *header = (SkywayShmRingHeader *) map;
+    guint32 slot_count = header->slot_count;
+    guint32 slot_size = header->slot_size;
+    if (g_atomic_int_get((gint *) &header->magic) != (gint) SKYWAY_SHM_RING_MAGIC ||
+        header->version != SKYWAY_SHM_RING_VERSION || slot_count == 0 ||
+        slot_count > SKYWAY_SHM_RING_MAX_SLOTS || slot_size == 0 ||
+        skyway_shm_ring_data_offset(slot_count) + (guint64) slot_count * slot_size > map_size) {
+        g_printerr("Invalid shared memory ring\n");
+        munmap(map, map_size);
+        return NULL;
+    }
+
+    ShmMapping *mapping = g_atomic_rc_box_new0(ShmMapping);
+    mapping->map = map;
+    mapping->map_size = map_size;
+    mapping->slot_count = slot_count;
+    mapping->slot_size = slot_size;
+    mapping->slots = (SkywayShmSlot *) (map + sizeof(SkywayShmRingHeader));
+    mapping->data = map + skyway_shm_ring_data_offset(slot_count);
+    *caps = g_strndup(header->caps, SKYWAY_SHM_RING_CAPS_SIZE);
+
+    return mapping;
+}
+
+static void mapping_free(ShmMapping *mapping) {
+    munmap(mapping->map, mapping->map_size);
+}
+
+static void release_slot(SlotRelease *release) {
+    g_atomic_int_set(&release->mapping->slots[release->index].state, SKYWAY_SHM_SLOT_FREE);
+    g_atomic_rc_box_release_full(release->mapping, (GDestroyNotify) mapping_free);
+    g_free(release);
+}
+
+static gboolean skyway_shm_to_sink_play(SkywayShmToSink *self) {
+    SkywayShmToSinkPrivate *priv = skyway_shm_to_sink_get_instance_private(self);
+    g_atomic_int_set(&priv->playing, TRUE);
+    return TRUE;
+}
+
+static void skyway_shm_to_sink_stop(SkywayShmToSink *self) {
+    SkywayShmToSinkPrivate *priv = skyway_shm_to_sink_get_instance_private(self);
+    g_atomic_int_set(&priv->playing, FALSE);
+
+    skyway_app_sink_proxy_emit_eos(SKYWAY_APP_SINK_PROXY(self));
+}
+
+/*
+ * Emits every frame written since the last doorbell, in ring order.
+ */
+static void drain_ring(SkywayShmToSink *self, SkywayShmToSinkPrivate *priv) {
+    ShmMapping *mapping = priv->mapping;
+
+    while (TRUE) {
+        guint32 index = priv->read_index % mapping->slot_count;
+        SkywayShmSlot *slot = &mapping->slots[index];
+        if (g_atomic_int_get(&slot->state) != SKYWAY_SHM_SLOT_WRITTEN) {
+            return;
+        }
+        g_atomic_int_set(&slot->state, SKYWAY_SHM_SLOT_READING);
+        priv->read_index++;
+
+        guint32 size = slot->size;
+        gint64 pts = slot->pts;
+        if (size > mapping->slot_size || !g_atomic_int_get(&priv->playing)) {
+            if (size > mapping->slot_size) {
+                g_printerr("Frame larger than its slot in the shared memory ring\n");
+            }
+            g_atomic_int_set(&slot->state, SKYWAY_SHM_SLOT_FREE);
+            continue;
+        }
+
+        SlotRelease *release = g_new0(SlotRelease, 1);
+        release->mapping = g_atomic_rc_box_acquire(mapping);
+        release->index = index;
+
+        // The producer leaves the slot alone until the last buffer referencing it is gone
+        guint8 *data = mapping->data + (gsize) index * mapping->slot_size;
+        GstBuffer *buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, data,
+                                                        mapping->slot_size, 0, size, release,
+                                                        (GDestroyNotify) release_slot);
+        GST_BUFFER_PTS(buffer) = pts == SKYWAY_SHM_PTS_NONE ? GST_CLOCK_TIME_NONE
+                                                            : (GstClockTime) pts;
+
+        GstSample *sample = gst_sample_new(buffer, priv->caps, NULL, NULL);
+        gst_buffer_unref(buffer);
+        skyway_app_sink_proxy_emit_sample(SKYWAY_APP_SINK_PROXY(self), sample);
+        gst_sample_unref(sample);
+    }
+}
+
+static gpointer read_ring(SkywayShmToSink *self) {
+    SkywayShmToSinkPrivate *priv = skyway_shm_to_sink_get_instance_private(self);
+    struct pollfd fds[] = {
+            {.fd = priv->doorbell_fd, .events = POLLIN},
+            {.fd = priv->wakeup_fd, .events = POLLIN},
+    };
+
+    while (TRUE) {
+        if (poll(fds, G_N_ELEMENTS(fds), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            g_printerr("Failed to wait for the shared memory ring: %s\n", g_strerror(errno));
+            return NULL;
+        }
+
+        if (fds[1].revents) {
+            return NULL;
+        }
+
+        if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            g_printerr("Shared memory ring doorbell closed\n");
+            return NULL;
+        }
+
+        guint64 count;
+        if (read(priv->doorbell_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+            g_printerr("Failed to read the shared memory ring doorbell: %s\n", g_strerror(errno));
+            return NULL;
+        }
+        drain_ring(self, priv);
+    }
+}
+
+static void close_fd(int *fd) {
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+static void skyway_shm_to_sink_dispose(GObject *object) {
+    g_print("skyway_shm_to_sink_dispose()\n");
+    SkywayShmToSinkPrivate *priv = skyway_shm_to_sink_get_instance_private(
+            SKYWAY_SHM_TO_SINK(object));
+
+    if (priv->thread) {
+        guint64 one = 1;
+        if (write(priv->wakeup_fd, &one, sizeof(one)) < 0) {
+            g_printerr("Failed to wake the shared memory ring reader: %s\n", g_strerror(errno));
+        }
+        g_thread_join(priv->thread);
+        priv->thread = NULL;
+    }
+
+    if (priv->mapping) {
+        g_atomic_rc_box_release_full(priv->mapping, (GDestroyNotify) mapping_free);
+        priv->mapping = NULL;
+    }
+    gst_clear_caps(&priv->caps);
+
+    close_fd(&priv->memory_fd);
+    close_fd(&priv->doorbell_fd);
+    close_fd(&priv->wakeup_fd);
+
+    G_OBJECT_CLASS (skyway_shm_to_sink_parent_class)->dispose(object);
+}
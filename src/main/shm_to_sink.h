@@ -0,0 +1,28 @@
+#ifndef SKYWAY_SHM_TO_SINK_H
+#define SKYWAY_SHM_TO_SINK_H
+
+#include "appsink_proxy.h"
+
+G_BEGIN_DECLS
+
+#define SKYWAY_TYPE_SHM_TO_SINK (skyway_shm_to_sink_get_type())
+
+typedef struct _SkywayShmToSink {
+    SkywayAppSinkProxy parent;
+} SkywayShmToSink;
+
+G_DECLARE_FINAL_TYPE(SkywayShmToSink, skyway_shm_to_sink, SKYWAY, SHM_TO_SINK, SkywayAppSinkProxy)
+
+GType skyway_shm_to_sink_get_type(void);
+
+/*
+ * Emits the frames an external producer writes into a shared memory ring (see shm_ring.h),
+ * wrapping the ring memory instead of copying it. The ring is drained from its own thread for as
+ * long as the proxy exists, frames arriving while it is not playing are released right away.
+ * Takes ownership of both descriptors, and returns NULL if they do not hold a valid ring.
+ */
+SkywayShmToSink *skyway_shm_to_sink_new(int memory_fd, int doorbell_fd);
+
+G_END_DECLS
+
+#endif // SKYWAY_SHM_TO_SINK_H
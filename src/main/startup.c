@@ -0,0 +1,99 @@
+#include "startup.h"
+
+#include <gst/gst.h>
+
+#include "capture_time.h"
+#include "pipeline_tracer.h"
+#include "rtp_rewrite.h"
+
+GST_PLUGIN_STATIC_DECLARE(app);
+
+GST_PLUGIN_STATIC_DECLARE(coreelements);
+
+GST_PLUGIN_STATIC_DECLARE(rtp);
+
+GST_PLUGIN_STATIC_DECLARE(rtpmanager);
+
+GST_PLUGIN_STATIC_DECLARE(rtsp);
+
+GST_PLUGIN_STATIC_DECLARE(tcp);
+
+GST_PLUGIN_STATIC_DECLARE(udp);
+
+GST_PLUGIN_STATIC_DECLARE(videoparsersbad);
+
+// Monotonic times in microseconds, 0 until reached
+static gint64 marks[SKYWAY_STARTUP_PHASE_COUNT];
+
+static GMutex marks_lock;
+
+static GMutex plugins_lock;
+
+static GCond plugins_cond;
+
+static gboolean plugins_ready = FALSE;
+
+static gpointer register_plugins(gpointer data);
+
+void skyway_startup_mark(SkywayStartupPhase phase) {
+    g_mutex_lock(&marks_lock);
+    gboolean first = marks[phase] == 0;
+    if (first) {
+        marks[phase] = g_get_monotonic_time();
+    }
+    g_mutex_unlock(&marks_lock);
+
+    if (first && phase == SKYWAY_STARTUP_FIRST_MEDIA_PREPARED) {
+        gint64 timings[SKYWAY_STARTUP_PHASE_COUNT];
+        skyway_startup_get_timings(timings);
+        g_print("Startup: gst ready at %.1f ms, plugins at %.1f ms, server at %.1f ms, "
+                "first media prepared at %.1f ms\n",
+                timings[SKYWAY_STARTUP_GST_READY] / 1000.0,
+                timings[SKYWAY_STARTUP_PLUGINS_READY] / 1000.0,
+                timings[SKYWAY_STARTUP_SERVER_STARTED] / 1000.0,
+                timings[SKYWAY_STARTUP_FIRST_MEDIA_PREPARED] / 1000.0);
+    }
+}
+
+void skyway_startup_get_timings(gint64 timings[SKYWAY_STARTUP_PHASE_COUNT]) {
+    g_mutex_lock(&marks_lock);
+    gint64 origin = marks[SKYWAY_STARTUP_INIT];
+    for (guint i = 0; i < SKYWAY_STARTUP_PHASE_COUNT; i++) {
+        timings[i] = origin && marks[i] ? marks[i] - origin : -1;
+    }
+    g_mutex_unlock(&marks_lock);
+}
+
+void skyway_startup_register_plugins(void) {
+    g_thread_unref(g_thread_new("skyway-plugins", register_plugins, NULL));
+}
+
+void skyway_startup_wait_for_plugins(void) {
+    g_mutex_lock(&plugins_lock);
+    while (!plugins_ready) {
+        g_cond_wait(&plugins_cond, &plugins_lock);
+    }
+    g_mutex_unlock(&plugins_lock);
+}
+
+static gpointer register_plugins(__attribute__ ((unused)) gpointer data) {
+    GST_PLUGIN_STATIC_REGISTER(app);
+    GST_PLUGIN_STATIC_REGISTER(coreelements);
+    GST_PLUGIN_STATIC_REGISTER(rtp);
+    GST_PLUGIN_STATIC_REGISTER(rtpmanager);
+    GST_PLUGIN_STATIC_REGISTER(rtsp);
+    GST_PLUGIN_STATIC_REGISTER(tcp);
+    GST_PLUGIN_STATIC_REGISTER(udp);
+    GST_PLUGIN_STATIC_REGISTER(videoparsersbad);
+    skyway_rtp_rewrite_register();
+    skyway_abs_capture_time_register();
+    skyway_tracing_register();
+    skyway_startup_mark(SKYWAY_STARTUP_PLUGINS_READY);
+
+    g_mutex_lock(&plugins_lock);
+    plugins_ready = TRUE;
+    g_cond_broadcast(&plugins_cond);
+    g_mutex_unlock(&plugins_lock);
+
+    return NULL;
+}
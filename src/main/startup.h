@@ -0,0 +1,44 @@
+#ifndef SKYWAY_STARTUP_H
+#define SKYWAY_STARTUP_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Milestones of a cold start, in the order they are normally reached.
+ */
+typedef enum {
+    SKYWAY_STARTUP_INIT,
+    SKYWAY_STARTUP_GST_READY,
+    SKYWAY_STARTUP_PLUGINS_READY,
+    SKYWAY_STARTUP_SERVER_STARTED,
+    SKYWAY_STARTUP_FIRST_MEDIA_PREPARED,
+    SKYWAY_STARTUP_PHASE_COUNT,
+} SkywayStartupPhase;
+
+/*
+ * Records that the phase was reached, the first time only. SKYWAY_STARTUP_INIT is the origin of
+ * the others.
+ */
+void skyway_startup_mark(SkywayStartupPhase phase);
+
+/*
+ * Microseconds from SKYWAY_STARTUP_INIT to each phase, -1 for phases not reached yet.
+ */
+void skyway_startup_get_timings(gint64 timings[SKYWAY_STARTUP_PHASE_COUNT]);
+
+/*
+ * Registers the static plugins (and our own elements and tracer) on a thread of its own, so
+ * that the library finishes loading while they register. Call once, after gst_init().
+ */
+void skyway_startup_register_plugins(void);
+
+/*
+ * Blocks until the plugins are registered, i.e. until elements can be created.
+ */
+void skyway_startup_wait_for_plugins(void);
+
+G_END_DECLS
+
+#endif // SKYWAY_STARTUP_H
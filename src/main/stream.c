@@ -0,0 +1,55 @@
+#include "stream.h"
+
+G_DEFINE_TYPE(SkywayStream, skyway_stream, G_TYPE_OBJECT)
+
+static void skyway_stream_class_init(SkywayStreamClass *klass);
+
+static void skyway_stream_init(SkywayStream *self);
+
+static void skyway_stream_dispose(GObject *object);
+
+static void skyway_stream_finalize(GObject *object);
+
+static void skyway_stream_class_init(SkywayStreamClass *klass) {
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    object_class->dispose = skyway_stream_dispose;
+    object_class->finalize = skyway_stream_finalize;
+}
+
+static void skyway_stream_init(SkywayStream *self) {
+    self->proxy = NULL;
+    self->factory = NULL;
+    self->location = NULL;
+    self->linger = -1;
+    self->grace_source = 0;
+}
+
+SkywayStream *
+skyway_stream_new(SkywayAppSinkProxy *proxy, GstRTSPMediaFactory *factory, const gchar *location) {
+    SkywayStream *self = g_object_new(SKYWAY_TYPE_STREAM, NULL);
+    self->proxy = proxy ? g_object_ref(proxy) : NULL;
+    self->factory = g_object_ref(factory);
+    self->location = g_strdup(location);
+
+    return self;
+}
+
+static void skyway_stream_dispose(GObject *object) {
+    SkywayStream *self = SKYWAY_STREAM(object);
+
+    if (self->proxy) {
+        // Nothing will mount it again, so an idle pipeline can go right away
+        skyway_app_sink_proxy_set_linger(self->proxy, 0);
+        g_clear_object(&self->proxy);
+    }
+    g_clear_object(&self->factory);
+
+    G_OBJECT_CLASS (skyway_stream_parent_class)->dispose(object);
+}
+
+static void skyway_stream_finalize(GObject *object) {
+    SkywayStream *self = SKYWAY_STREAM(object);
+    g_free(self->location);
+
+    G_OBJECT_CLASS (skyway_stream_parent_class)->finalize(object);
+}
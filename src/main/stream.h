@@ -0,0 +1,39 @@
+#ifndef SKYWAY_STREAM_H
+#define SKYWAY_STREAM_H
+
+#include <glib-object.h>
+#include <gst/rtsp-server/rtsp-server.h>
+
+#include "appsink_proxy.h"
+
+G_BEGIN_DECLS
+
+#define SKYWAY_TYPE_STREAM (skyway_stream_get_type())
+
+/*
+ * What the server keeps per mount: the proxy feeding it and the factory serving it. Media still
+ * playing hold their own reference on the proxy, so releasing the stream never pulls the
+ * pipeline away from connected clients. Direct relays have no proxy, their media pipelines
+ * ingest the stream themselves.
+ */
+struct _SkywayStream {
+    GObject parent;
+    SkywayAppSinkProxy *proxy;
+    GstRTSPMediaFactory *factory;
+    // Upstream location the stream can be reused for, NULL if it is not relayed
+    gchar *location;
+    // Seconds the proxy lingers while mounted, -1 until the stream is first registered
+    int linger;
+    guint grace_source;
+};
+
+G_DECLARE_FINAL_TYPE(SkywayStream, skyway_stream, SKYWAY, STREAM, GObject)
+
+GType skyway_stream_get_type(void);
+
+SkywayStream *
+skyway_stream_new(SkywayAppSinkProxy *proxy, GstRTSPMediaFactory *factory, const gchar *location);
+
+G_END_DECLS
+
+#endif // SKYWAY_STREAM_H
@@ -0,0 +1,303 @@
+#include "switch_sink.h"
+
+#include <gst/gst.h>
+
+typedef struct _SkywaySwitchSinkPrivate {
+    // Protects the fields below against the streaming threads of the sources
+    GMutex lock;
+    gboolean playing;
+    SkywayAppSinkProxy *active;
+    gulong active_handle;
+    SkywayAppSinkProxy *pending;
+    gulong pending_handle;
+} SkywaySwitchSinkPrivate;
+
+// A source that was switched away from, released on the main context
+typedef struct _RetiredSource {
+    SkywaySwitchSink *self;
+    SkywayAppSinkProxy *source;
+    gulong handle;
+} RetiredSource;
+
+G_DEFINE_TYPE_WITH_PRIVATE(SkywaySwitchSink, skyway_switch_sink, SKYWAY_TYPE_APP_SINK_PROXY)
+
+static void skyway_switch_sink_class_init(SkywaySwitchSinkClass *klass);
+
+static void skyway_switch_sink_init(SkywaySwitchSink *self);
+
+static gboolean skyway_switch_sink_play(SkywaySwitchSink *self);
+
+static void skyway_switch_sink_stop(SkywaySwitchSink *self);
+
+static gulong start_source(SkywaySwitchSink *self, SkywayAppSinkProxy *source);
+
+static void halt_source(SkywayAppSinkProxy *source, gulong handle);
+
+static void release_source(SkywayAppSinkProxy *source, gulong handle);
+
+static gboolean release_retired(RetiredSource *retired);
+
+static void retire_source(SkywaySwitchSink *self, SkywayAppSinkProxy *source, gulong handle);
+
+static GstSample *restamp_sample(GstSample *sample);
+
+static GstFlowReturn
+source_sample_handler(SkywayAppSinkProxy *source, GstSample *sample, SkywaySwitchSink *self);
+
+static void skyway_switch_sink_dispose(GObject *object);
+
+static void skyway_switch_sink_finalize(GObject *object);
+
+static void skyway_switch_sink_class_init(SkywaySwitchSinkClass *klass) {
+    g_print("skyway_switch_sink_class_init()\n");
+
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    object_class->dispose = skyway_switch_sink_dispose;
+    object_class->finalize = skyway_switch_sink_finalize;
+
+    klass->parent_class.play = skyway_switch_sink_play;
+    klass->parent_class.stop = skyway_switch_sink_stop;
+}
+
+static void skyway_switch_sink_init(SkywaySwitchSink *self) {
+    g_print("skyway_switch_sink_init()\n");
+    SkywaySwitchSinkPrivate *priv = skyway_switch_sink_get_instance_private(self);
+    g_mutex_init(&priv->lock);
+    priv->playing = FALSE;
+    priv->active = NULL;
+    priv->active_handle = 0;
+    priv->pending = NULL;
+    priv->pending_handle = 0;
+}
+
+SkywaySwitchSink *skyway_switch_sink_new(SkywayAppSinkProxy *source) {
+    SkywaySwitchSink *self = g_object_new(SKYWAY_TYPE_SWITCH_SINK, NULL);
+    SkywaySwitchSinkPrivate *priv = skyway_switch_sink_get_instance_private(self);
+    priv->active = g_object_ref(source);
+
+    return self;
+}
+
+static gulong start_source(SkywaySwitchSink *self, SkywayAppSinkProxy *source) {
+    if (!skyway_app_sink_proxy_play(source)) {
+        g_printerr("Failed to play the source of a switchable stream\n");
+        return 0;
+    }
+
+    return g_signal_connect(source, "new-sample", G_CALLBACK(source_sample_handler), self);
+}
+
+// A source is connected (and played) exactly while we hold a handler on it
+static void halt_source(SkywayAppSinkProxy *source, gulong handle) {
+    if (handle) {
+        g_signal_handler_disconnect(source, handle);
+        skyway_app_sink_proxy_stop(source);
+    }
+}
+
+static void release_source(SkywayAppSinkProxy *source, gulong handle) {
+    halt_source(source, handle);
+    g_object_unref(source);
+}
+
+static gboolean release_retired(RetiredSource *retired) {
+    release_source(retired->source, retired->handle);
+    g_object_unref(retired->self);
+    g_free(retired);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Stopping a source waits for its streaming thread, which may be blocked on our lock or be the
+ * thread of the new source: leave it to the main context.
+ */
+static void retire_source(SkywaySwitchSink *self, SkywayAppSinkProxy *source, gulong handle) {
+    RetiredSource *retired = g_new(RetiredSource, 1);
+    retired->self = g_object_ref(self);
+    retired->source = source;
+    retired->handle = handle;
+    g_idle_add((GSourceFunc) release_retired, retired);
+}
+
+static gboolean skyway_switch_sink_play(SkywaySwitchSink *self) {
+    SkywaySwitchSinkPrivate *priv = skyway_switch_sink_get_instance_private(self);
+
+    g_mutex_lock(&priv->lock);
+    SkywayAppSinkProxy *active = g_object_ref(priv->active);
+    SkywayAppSinkProxy *pending = priv->pending ? g_object_ref(priv->pending) : NULL;
+    g_mutex_unlock(&priv->lock);
+
+    gulong active_handle = start_source(self, active);
+    gulong pending_handle = pending ? start_source(self, pending) : 0;
+
+    g_mutex_lock(&priv->lock);
+    priv->active_handle = active_handle;
+    priv->pending_handle = pending_handle;
+    priv->playing = TRUE;
+    g_mutex_unlock(&priv->lock);
+
+    g_object_unref(active);
+    g_clear_object(&pending);
+
+    return active_handle != 0;
+}
+
+static void skyway_switch_sink_stop(SkywaySwitchSink *self) {
+    SkywaySwitchSinkPrivate *priv = skyway_switch_sink_get_instance_private(self);
+
+    g_mutex_lock(&priv->lock);
+    SkywayAppSinkProxy *active = g_object_ref(priv->active);
+    gulong active_handle = priv->active_handle;
+    SkywayAppSinkProxy *pending = priv->pending;
+    gulong pending_handle = priv->pending_handle;
+    if (pending) {
+        // Nobody watches anymore, so the switch can complete right away
+        g_object_unref(priv->active);
+        priv->active = pending;
+        priv->pending = NULL;
+        g_object_ref(pending);
+    }
+    priv->active_handle = 0;
+    priv->pending_handle = 0;
+    priv->playing = FALSE;
+    g_mutex_unlock(&priv->lock);
+
+    halt_source(active, active_handle);
+    g_object_unref(active);
+    if (pending) {
+        halt_source(pending, pending_handle);
+        g_object_unref(pending);
+    }
+
+    skyway_app_sink_proxy_emit_eos(SKYWAY_APP_SINK_PROXY(self));
+}
+
+void skyway_switch_sink_switch_to(SkywaySwitchSink *self, SkywayAppSinkProxy *source) {
+    SkywaySwitchSinkPrivate *priv = skyway_switch_sink_get_instance_private(self);
+
+    g_mutex_lock(&priv->lock);
+    SkywayAppSinkProxy *dropped = priv->pending;
+    gulong dropped_handle = priv->pending_handle;
+    priv->pending = NULL;
+    priv->pending_handle = 0;
+
+    gboolean playing = priv->playing;
+    if (source == priv->active) {
+        // Switching back before the switch happened, keep the current source
+        source = NULL;
+    } else if (!playing) {
+        // Nobody watches, switch right away
+        g_object_unref(priv->active);
+        priv->active = g_object_ref(source);
+        source = NULL;
+    } else {
+        priv->pending = g_object_ref(source);
+    }
+    g_mutex_unlock(&priv->lock);
+
+    if (dropped) {
+        release_source(dropped, dropped_handle);
+    }
+
+    if (source) {
+        g_print("Switching source on the next IRAP frame\n");
+        gulong handle = start_source(self, source);
+
+        g_mutex_lock(&priv->lock);
+        if (priv->playing && priv->pending == source) {
+            priv->pending_handle = handle;
+            handle = 0;
+        } else if (priv->playing && priv->active == source && !priv->active_handle) {
+            // Its first IRAP frame arrived before we got here
+            priv->active_handle = handle;
+            handle = 0;
+        }
+        g_mutex_unlock(&priv->lock);
+
+        // Stopped or switched again meanwhile
+        halt_source(source, handle);
+    }
+}
+
+/*
+ * The sources are timed by unrelated pipelines. Without timestamps, the appsrc of the media
+ * stamps the frames on arrival, which keeps the served timeline continuous across switches.
+ */
+static GstSample *restamp_sample(GstSample *sample) {
+    GstBuffer *buffer = gst_buffer_copy(gst_sample_get_buffer(sample));
+    GST_BUFFER_PTS(buffer) = GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DTS(buffer) = GST_CLOCK_TIME_NONE;
+
+    GstSample *restamped = gst_sample_new(buffer, gst_sample_get_caps(sample), NULL, NULL);
+    gst_buffer_unref(buffer);
+    return restamped;
+}
+
+static GstFlowReturn
+source_sample_handler(SkywayAppSinkProxy *source, GstSample *sample, SkywaySwitchSink *self) {
+    SkywaySwitchSinkPrivate *priv = skyway_switch_sink_get_instance_private(self);
+    SkywayAppSinkProxy *retired = NULL;
+    gulong retired_handle = 0;
+    gboolean forward = FALSE;
+
+    if (!gst_sample_get_buffer(sample)) {
+        return GST_FLOW_OK;
+    }
+
+    g_mutex_lock(&priv->lock);
+    if (source == priv->pending &&
+        skyway_buffer_is_random_access_point(gst_sample_get_buffer(sample))) {
+        retired = priv->active;
+        retired_handle = priv->active_handle;
+        priv->active = priv->pending;
+        priv->active_handle = priv->pending_handle;
+        priv->pending = NULL;
+        priv->pending_handle = 0;
+        forward = TRUE;
+    } else {
+        forward = source == priv->active;
+    }
+    g_mutex_unlock(&priv->lock);
+
+    if (retired) {
+        g_print("Switched source\n");
+        retire_source(self, retired, retired_handle);
+    }
+
+    if (forward) {
+        GstSample *restamped = restamp_sample(sample);
+        skyway_app_sink_proxy_emit_sample(SKYWAY_APP_SINK_PROXY(self), restamped);
+        gst_sample_unref(restamped);
+    }
+
+    // Never let a switchable consumer stop a source
+    return GST_FLOW_OK;
+}
+
+static void skyway_switch_sink_dispose(GObject *object) {
+    g_print("skyway_switch_sink_dispose()\n");
+    SkywaySwitchSinkPrivate *priv = skyway_switch_sink_get_instance_private(
+            SKYWAY_SWITCH_SINK(object));
+
+    if (priv->active) {
+        release_source(priv->active, priv->active_handle);
+        priv->active = NULL;
+        priv->active_handle = 0;
+    }
+    if (priv->pending) {
+        release_source(priv->pending, priv->pending_handle);
+        priv->pending = NULL;
+        priv->pending_handle = 0;
+    }
+
+    G_OBJECT_CLASS (skyway_switch_sink_parent_class)->dispose(object);
+}
+
+static void skyway_switch_sink_finalize(GObject *object) {
+    SkywaySwitchSinkPrivate *priv = skyway_switch_sink_get_instance_private(
+            SKYWAY_SWITCH_SINK(object));
+    g_mutex_clear(&priv->lock);
+
+    G_OBJECT_CLASS (skyway_switch_sink_parent_class)->finalize(object);
+}
@@ -0,0 +1,32 @@
+#ifndef SKYWAY_SWITCH_SINK_H
+#define SKYWAY_SWITCH_SINK_H
+
+#include "appsink_proxy.h"
+
+G_BEGIN_DECLS
+
+#define SKYWAY_TYPE_SWITCH_SINK (skyway_switch_sink_get_type())
+
+typedef struct _SkywaySwitchSink {
+    SkywayAppSinkProxy parent;
+} SkywaySwitchSink;
+
+G_DECLARE_FINAL_TYPE(SkywaySwitchSink, skyway_switch_sink, SKYWAY, SWITCH_SINK, SkywayAppSinkProxy)
+
+GType skyway_switch_sink_get_type(void);
+
+/*
+ * Forwards the access units of one of several proxies, and can switch between them without its
+ * consumers noticing beyond a change of picture.
+ */
+SkywaySwitchSink *skyway_switch_sink_new(SkywayAppSinkProxy *source);
+
+/*
+ * Starts the new source right away but keeps forwarding the current one until the new one
+ * delivers an IRAP frame, so that the switch never shows a broken picture.
+ */
+void skyway_switch_sink_switch_to(SkywaySwitchSink *self, SkywayAppSinkProxy *source);
+
+G_END_DECLS
+
+#endif // SKYWAY_SWITCH_SINK_H
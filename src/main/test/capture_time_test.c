@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "capture_time.h"
+
+// 2208988800 seconds from 1900 to 1970, in 32.32 fixed point
+#define NTP_UNIX_EPOCH G_GUINT64_CONSTANT(0x83aa7e8000000000)
+
+typedef struct _Fixture {
+    GstRTPHeaderExtension *extension;
+    GstBuffer *buffer;
+    guint8 data[16];
+} Fixture;
+
+static gssize write_extension(Fixture *fixture) {
+    return gst_rtp_header_extension_write(fixture->extension, fixture->buffer,
+                                          GST_RTP_HEADER_EXTENSION_ONE_BYTE, fixture->buffer,
+                                          fixture->data, sizeof(fixture->data));
+}
+
+static void fixture_set_up(Fixture *fixture, __attribute__ ((unused)) gconstpointer data) {
+    fixture->extension = g_object_new(SKYWAY_TYPE_ABS_CAPTURE_TIME, NULL);
+    gst_object_ref_sink(fixture->extension);
+    gst_rtp_header_extension_set_id(fixture->extension, SKYWAY_ABS_CAPTURE_TIME_ID);
+    fixture->buffer = gst_buffer_new();
+    memset(fixture->data, 0, sizeof(fixture->data));
+}
+
+static void fixture_tear_down(Fixture *fixture, __attribute__ ((unused)) gconstpointer data) {
+    gst_object_unref(fixture->extension);
+    gst_buffer_unref(fixture->buffer);
+}
+
+static void test_unix_time_is_written_as_ntp(Fixture *fixture,
+                                             __attribute__ ((unused)) gconstpointer data) {
+    g_assert_cmpstr(gst_rtp_header_extension_get_uri(fixture->extension), ==,
+                    SKYWAY_ABS_CAPTURE_TIME_URI);
+
+    // Half a second after the Unix epoch
+    skyway_capture_time_set(fixture->buffer, G_USEC_PER_SEC / 2);
+    g_assert_cmpint(write_extension(fixture), ==, 8);
+    g_assert_cmpuint(GST_READ_UINT64_BE(fixture->data), ==,
+                     NTP_UNIX_EPOCH | G_GUINT64_CONSTANT(0x80000000));
+}
+
+/*
+ * A relayed stream knows its capture times from the NTP clock of upstream, which wins.
+ */
+static void test_ntp_time_is_preferred(Fixture *fixture,
+                                       __attribute__ ((unused)) gconstpointer data) {
+    skyway_capture_time_set(fixture->buffer, 0);
+    GstCaps *reference = gst_caps_from_string("timestamp/x-ntp,host=127.0.0.1,port=123");
+    gst_buffer_add_reference_timestamp_meta(fixture->buffer, reference, 3 * GST_SECOND,
+                                            GST_CLOCK_TIME_NONE);
+    gst_caps_unref(reference);
+
+    g_assert_cmpint(write_extension(fixture), ==, 8);
+    g_assert_cmpuint(GST_READ_UINT64_BE(fixture->data), ==, G_GUINT64_CONSTANT(3) << 32);
+}
+
+static void test_unknown_capture_time_is_not_written(Fixture *fixture,
+                                                     __attribute__ ((unused)) gconstpointer data) {
+    g_assert_cmpint(write_extension(fixture), ==, 0);
+}
+
+static void test_read_back_capture_time(Fixture *fixture,
+                                        __attribute__ ((unused)) gconstpointer data) {
+    gint64 captured = g_get_real_time();
+    skyway_capture_time_set(fixture->buffer, captured);
+    g_assert_cmpint(write_extension(fixture), ==, 8);
+
+    GstBuffer *depayloaded = gst_buffer_new();
+    g_assert_true(gst_rtp_header_extension_read(fixture->extension,
+                                                GST_RTP_HEADER_EXTENSION_ONE_BYTE, fixture->data,
+                                                8, depayloaded));
+    // Read once per packet, kept once per frame
+    g_assert_true(gst_rtp_header_extension_read(fixture->extension,
+                                                GST_RTP_HEADER_EXTENSION_ONE_BYTE, fixture->data,
+                                                8, depayloaded));
+    g_assert_cmpuint(gst_buffer_get_n_meta(depayloaded, GST_REFERENCE_TIMESTAMP_META_API_TYPE),
+                     ==, 1);
+
+    guint64 expected;
+    guint64 ntp_time;
+    g_assert_true(skyway_capture_time_get_ntp(fixture->buffer, &expected));
+    g_assert_true(skyway_capture_time_get_ntp(depayloaded, &ntp_time));
+    // 32.32 fixed point resolves a quarter of a nanosecond, each conversion rounds down
+    g_assert_cmpuint(expected - ntp_time, <=, 1);
+    gst_buffer_unref(depayloaded);
+}
+
+int main(int argc, char *argv[]) {
+    gst_init(&argc, &argv);
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add("/capture-time/unix-time-is-written-as-ntp", Fixture, NULL, fixture_set_up,
+               test_unix_time_is_written_as_ntp, fixture_tear_down);
+    g_test_add("/capture-time/ntp-time-is-preferred", Fixture, NULL, fixture_set_up,
+               test_ntp_time_is_preferred, fixture_tear_down);
+    g_test_add("/capture-time/unknown-capture-time-is-not-written", Fixture, NULL,
+               fixture_set_up, test_unknown_capture_time_is_not_written, fixture_tear_down);
+    g_test_add("/capture-time/read-back-capture-time", Fixture, NULL, fixture_set_up,
+               test_read_back_capture_time, fixture_tear_down);
+
+    return g_test_run();
+}
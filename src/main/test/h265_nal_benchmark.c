@@ -0,0 +1,70 @@
+#include <stdlib.h>
+
+#include "h265_nal.h"
+
+/*
+ * Throughput of the access unit parser (i.e. of the start code scanner, which dominates it) on
+ * slice-like data. Pass the number of MiB to scan, 4096 by default.
+ */
+
+#define BUFFER_SIZE (16 * 1024 * 1024)
+#define ACCESS_UNIT_SIZE (64 * 1024)
+#define NALS_PER_ACCESS_UNIT 4
+
+static void fill_access_units(guint8 *data, GRand *rand);
+
+/*
+ * Random bytes with emulation prevention applied (no 00 00 0x with x <= 3), as in a real slice,
+ * and a few NAL units per access unit.
+ */
+static void fill_access_units(guint8 *data, GRand *rand) {
+    for (gsize i = 0; i < BUFFER_SIZE; i++) {
+        data[i] = (guint8) g_rand_int(rand);
+        if (i >= 2 && data[i - 2] == 0 && data[i - 1] == 0 && data[i] <= 3) {
+            data[i] = 3;
+        }
+    }
+
+    for (gsize unit = 0; unit < BUFFER_SIZE; unit += ACCESS_UNIT_SIZE) {
+        for (gsize nal = 0; nal < NALS_PER_ACCESS_UNIT; nal++) {
+            guint8 *start = data + unit + nal * (ACCESS_UNIT_SIZE / NALS_PER_ACCESS_UNIT);
+            start[0] = 0;
+            start[1] = 0;
+            start[2] = 0;
+            start[3] = 1;
+            start[4] = 0x02; // TRAIL_R
+            start[5] = 0x01;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    guint64 megabytes = argc > 1 ? g_ascii_strtoull(argv[1], NULL, 10) : 4096;
+
+    GRand *rand = g_rand_new_with_seed(42);
+    guint8 *data = g_malloc(BUFFER_SIZE);
+    fill_access_units(data, rand);
+
+    guint64 total = 0;
+    guint nal_count = 0;
+    gint64 start = g_get_monotonic_time();
+    while (total < megabytes * 1024 * 1024) {
+        for (gsize unit = 0; unit < BUFFER_SIZE; unit += ACCESS_UNIT_SIZE) {
+            SkywayH265AccessUnitInfo info;
+            if (!skyway_h265_parse_access_unit(data + unit, ACCESS_UNIT_SIZE, &info)) {
+                g_printerr("Access unit not recognized\n");
+                return EXIT_FAILURE;
+            }
+            nal_count += info.nal_count;
+        }
+        total += BUFFER_SIZE;
+    }
+    gint64 elapsed = g_get_monotonic_time() - start;
+
+    g_print("Parsed %" G_GUINT64_FORMAT " MiB (%u NAL units) in %.3f s: %.2f GB/s\n",
+            total / (1024 * 1024), nal_count, elapsed / 1e6, (gdouble) total / (elapsed * 1e3));
+
+    g_free(data);
+    g_rand_free(rand);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+#include <string.h>
+
+#include "h265_nal.h"
+
+/*
+ * Differential fuzzing of the start code scanner against a naive one, and of the access unit
+ * parser for robustness. Runs on random inputs by default, or as a libFuzzer target when built
+ * with -DSKYWAY_LIBFUZZER -fsanitize=fuzzer.
+ */
+
+#define MAX_INPUT_SIZE 4096
+#define ITERATIONS 20000
+
+static const guint8 *reference_find_start_code(const guint8 *data, const guint8 *end);
+
+static guint reference_nal_count(const guint8 *data, gsize size);
+
+static void check_input(const guint8 *data, gsize size);
+
+static const guint8 *reference_find_start_code(const guint8 *data, const guint8 *end) {
+    for (; end - data >= 3; data++) {
+        if (data[0] == 0 && data[1] == 0 && data[2] == 1) {
+            return data + 3;
+        }
+    }
+    return end;
+}
+
+static guint reference_nal_count(const guint8 *data, gsize size) {
+    const guint8 *end = data + size;
+    guint count = 0;
+    const guint8 *nal = reference_find_start_code(data, end);
+    while (nal < end) {
+        const guint8 *next = reference_find_start_code(nal, end);
+        if (end - nal >= 2) {
+            count++;
+        }
+        nal = next;
+    }
+    return count;
+}
+
+static void check_input(const guint8 *data, gsize size) {
+    // Copy so that reads past the end are caught by the sanitizers
+    guint8 *copy = g_memdup2(data, size);
+    const guint8 *end = copy + size;
+
+    for (gsize offset = 0; offset <= size; offset += 1 + offset / 16) {
+        const guint8 *position = copy + offset;
+        while (TRUE) {
+            const guint8 *found = skyway_h265_find_start_code(position, end);
+            g_assert_true(found == reference_find_start_code(position, end));
+            if (found == end) {
+                break;
+            }
+            position = found;
+        }
+    }
+
+    SkywayH265AccessUnitInfo info;
+    if (skyway_h265_parse_access_unit(copy, size, &info)) {
+        g_assert_cmpuint(info.nal_count, ==, reference_nal_count(copy, size));
+        g_assert_cmpint(info.max_temporal_id, >=, -1);
+        g_assert_cmpint(info.max_temporal_id, <=, 6);
+    }
+
+    // As an RTP payload, for aggregation packets with bogus sizes
+    skyway_h265_rtp_payload_is_random_access_point(copy, size);
+
+    g_free(copy);
+}
+
+#ifdef SKYWAY_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const guint8 *data, gsize size) {
+    check_input(data, size);
+    return 0;
+}
+
+#else
+
+/*
+ * Mostly 0s and 1s so that start codes, near misses and runs of zeros are frequent, with some
+ * well-formed NAL headers so that the parser gets past the first start code.
+ */
+static gsize random_input(guint8 *data) {
+    gsize size = g_test_rand_int_range(0, MAX_INPUT_SIZE + 1);
+    for (gsize i = 0; i < size; i++) {
+        gint kind = g_test_rand_int_range(0, 8);
+        data[i] = kind < 3 ? 0 : kind < 5 ? 1 : (guint8) g_test_rand_int_range(0, 256);
+    }
+
+    for (gsize i = 0; i + 5 < size; i += g_test_rand_int_range(5, 256)) {
+        data[i] = 0;
+        data[i + 1] = 0;
+        data[i + 2] = 1;
+        data[i + 3] = (guint8) (g_test_rand_int_range(0, 41) << 1);
+        data[i + 4] = (guint8) g_test_rand_int_range(1, 8);
+    }
+
+    return size;
+}
+
+static void test_random_inputs(void) {
+    guint8 *data = g_malloc(MAX_INPUT_SIZE);
+    for (guint i = 0; i < ITERATIONS; i++) {
+        check_input(data, random_input(data));
+    }
+    g_free(data);
+}
+
+static void test_start_code_at_every_alignment(void) {
+    guint8 data[64];
+    for (gsize position = 0; position + 3 <= sizeof(data); position++) {
+        memset(data, 0xff, sizeof(data));
+        memcpy(data + position, "\x00\x00\x01", 3);
+        for (gsize offset = 0; offset <= position; offset++) {
+            g_assert_true(skyway_h265_find_start_code(data + offset, data + sizeof(data)) ==
+                          data + position + 3);
+        }
+        g_assert_true(skyway_h265_find_start_code(data + position + 1, data + sizeof(data)) ==
+                      data + sizeof(data));
+    }
+}
+
+static void test_parameter_set_hash(void) {
+    static const guint8 first[] = {0, 0, 0, 1, 0x42, 0x01, 0xaa, 0, 0, 1, 0x26, 0x01, 0xbb};
+    static const guint8 same[] = {0, 0, 1, 0x42, 0x01, 0xaa, 0, 0, 0, 1, 0x26, 0x01, 0xcc};
+    static const guint8 changed[] = {0, 0, 0, 1, 0x42, 0x01, 0xab, 0, 0, 1, 0x26, 0x01, 0xbb};
+
+    SkywayH265AccessUnitInfo info;
+    g_assert_true(skyway_h265_parse_access_unit(first, sizeof(first), &info));
+    g_assert_true(info.has_parameter_sets);
+    g_assert_true(info.has_irap);
+    guint32 hash = info.parameter_set_hash;
+
+    g_assert_true(skyway_h265_parse_access_unit(same, sizeof(same), &info));
+    g_assert_cmpuint(info.parameter_set_hash, ==, hash);
+
+    g_assert_true(skyway_h265_parse_access_unit(changed, sizeof(changed), &info));
+    g_assert_cmpuint(info.parameter_set_hash, !=, hash);
+}
+
+static void test_rtp_payload_random_access(void) {
+    // IDR_W_RADL, a TRAIL_R, the VPS ahead of an IRAP
+    static const guint8 idr[] = {0x26, 0x01, 0xaf};
+    static const guint8 trail[] = {0x02, 0x01, 0xd0};
+    static const guint8 vps[] = {0x40, 0x01, 0x0c};
+    // First and later fragments of an IDR_W_RADL, first fragment of a TRAIL_R
+    static const guint8 idr_start[] = {0x62, 0x01, 0x93, 0xaf};
+    static const guint8 idr_middle[] = {0x62, 0x01, 0x13, 0xaf};
+    static const guint8 trail_start[] = {0x62, 0x01, 0x81, 0xd0};
+    // An AUD followed by a VPS, by a TRAIL_R, and a truncated one
+    static const guint8 aud_vps[] = {0x60, 0x01, 0x00, 0x03, 0x46, 0x01, 0x50,
+                                     0x00, 0x03, 0x40, 0x01, 0x0c};
+    static const guint8 aud_trail[] = {0x60, 0x01, 0x00, 0x03, 0x46, 0x01, 0x50,
+                                       0x00, 0x03, 0x02, 0x01, 0xd0};
+    static const guint8 truncated[] = {0x60, 0x01, 0x00, 0x09, 0x40, 0x01, 0x0c};
+
+    g_assert_true(skyway_h265_rtp_payload_is_random_access_point(idr, sizeof(idr)));
+    g_assert_false(skyway_h265_rtp_payload_is_random_access_point(trail, sizeof(trail)));
+    g_assert_true(skyway_h265_rtp_payload_is_random_access_point(vps, sizeof(vps)));
+    g_assert_true(skyway_h265_rtp_payload_is_random_access_point(idr_start, sizeof(idr_start)));
+    g_assert_false(skyway_h265_rtp_payload_is_random_access_point(idr_middle, sizeof(idr_middle)));
+    g_assert_false(skyway_h265_rtp_payload_is_random_access_point(trail_start,
+                                                                  sizeof(trail_start)));
+    g_assert_true(skyway_h265_rtp_payload_is_random_access_point(aud_vps, sizeof(aud_vps)));
+    g_assert_false(skyway_h265_rtp_payload_is_random_access_point(aud_trail, sizeof(aud_trail)));
+    g_assert_false(skyway_h265_rtp_payload_is_random_access_point(truncated, sizeof(truncated)));
+}
+
+int main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/h265-nal/random-inputs", test_random_inputs);
+    g_test_add_func("/h265-nal/start-code-at-every-alignment", test_start_code_at_every_alignment);
+    g_test_add_func("/h265-nal/parameter-set-hash", test_parameter_set_hash);
+    g_test_add_func("/h265-nal/rtp-payload-random-access", test_rtp_payload_random_access);
+
+    return g_test_run();
+}
+
+#endif
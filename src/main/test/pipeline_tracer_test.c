@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "pipeline_tracer.h"
+
+// The smallest ring, which every test shares: its size is fixed by the first start
+#define CAPACITY 1024
+
+typedef struct _Fixture {
+    GstElement *upstream;
+    GstPad *src;
+    GstPad *sink;
+} Fixture;
+
+static GstFlowReturn
+chain(__attribute__ ((unused)) GstPad *pad, __attribute__ ((unused)) GstObject *parent,
+      GstBuffer *buffer) {
+    gst_buffer_unref(buffer);
+    return GST_FLOW_OK;
+}
+
+static void fixture_set_up(Fixture *fixture, __attribute__ ((unused)) gconstpointer data) {
+    // Recorded by the name of the element the pushing pad belongs to
+    fixture->upstream = gst_object_ref_sink(gst_bin_new("upstream"));
+    fixture->src = gst_pad_new("src", GST_PAD_SRC);
+    gst_element_add_pad(fixture->upstream, fixture->src);
+    fixture->sink = gst_object_ref_sink(gst_pad_new("sink", GST_PAD_SINK));
+    gst_pad_set_chain_function(fixture->sink, chain);
+
+    g_assert_cmpint(gst_pad_link(fixture->src, fixture->sink), ==, GST_PAD_LINK_OK);
+    g_assert_true(gst_pad_set_active(fixture->sink, TRUE));
+    g_assert_true(gst_pad_set_active(fixture->src, TRUE));
+
+    GstSegment segment;
+    gst_segment_init(&segment, GST_FORMAT_TIME);
+    gst_pad_push_event(fixture->src, gst_event_new_stream_start("pipeline-tracer-test"));
+    gst_pad_push_event(fixture->src, gst_event_new_segment(&segment));
+}
+
+static void fixture_tear_down(Fixture *fixture, __attribute__ ((unused)) gconstpointer data) {
+    skyway_tracing_stop();
+    gst_pad_set_active(fixture->src, FALSE);
+    gst_pad_set_active(fixture->sink, FALSE);
+    gst_object_unref(fixture->sink);
+    gst_object_unref(fixture->upstream);
+}
+
+static void push_buffers(Fixture *fixture, guint count) {
+    for (guint i = 0; i < count; i++) {
+        g_assert_cmpint(gst_pad_push(fixture->src, gst_buffer_new()), ==, GST_FLOW_OK);
+    }
+}
+
+static gpointer push_one_buffer(Fixture *fixture) {
+    push_buffers(fixture, 1);
+    return NULL;
+}
+
+static guint count_occurrences(const gchar *json, const gchar *needle) {
+    guint count = 0;
+    for (const gchar *found = strstr(json, needle); found;
+         found = strstr(found + strlen(needle), needle)) {
+        count++;
+    }
+    return count;
+}
+
+static void test_export_format(Fixture *fixture, __attribute__ ((unused)) gconstpointer data) {
+    skyway_tracing_start(CAPACITY);
+    push_buffers(fixture, 3);
+    skyway_tracing_stop();
+    // Stopped, the hooks record nothing
+    push_buffers(fixture, 2);
+
+    gchar *json = skyway_tracing_dump_json();
+    g_assert_true(g_str_has_prefix(json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[{"));
+    g_assert_true(g_str_has_suffix(json, "}]}"));
+    g_assert_cmpuint(count_occurrences(json, "\"ph\":\"B\""), ==, 3);
+    g_assert_cmpuint(count_occurrences(json, "\"ph\":\"E\""), ==, 3);
+    g_assert_cmpuint(count_occurrences(json, "\"name\":\"upstream:src\""), ==, 6);
+    // The one thread that pushed is named once, before its events
+    g_assert_cmpuint(count_occurrences(json, "\"ph\":\"M\",\"name\":\"thread_name\""), ==, 1);
+    g_assert_true(strstr(json, "\"ph\":\"M\"") < strstr(json, "\"ph\":\"B\""));
+    // Oldest first, each push begins before it ends
+    g_assert_true(strstr(json, "\"ph\":\"B\"") < strstr(json, "\"ph\":\"E\""));
+    g_free(json);
+}
+
+static void test_ring_keeps_latest_events(Fixture *fixture,
+                                          __attribute__ ((unused)) gconstpointer data) {
+    skyway_tracing_start(CAPACITY);
+    push_buffers(fixture, CAPACITY);
+    skyway_tracing_stop();
+
+    gchar *json = skyway_tracing_dump_json();
+    g_assert_cmpuint(count_occurrences(json, "\"ph\":\"B\"") +
+                     count_occurrences(json, "\"ph\":\"E\""), ==, CAPACITY);
+    g_free(json);
+
+    // A new recording drops the events of the last one
+    skyway_tracing_start(CAPACITY);
+    push_buffers(fixture, 1);
+    skyway_tracing_stop();
+
+    json = skyway_tracing_dump_json();
+    g_assert_cmpuint(count_occurrences(json, "\"name\":\"upstream:src\""), ==, 2);
+    g_free(json);
+}
+
+static void test_thread_names_per_recording(Fixture *fixture,
+                                            __attribute__ ((unused)) gconstpointer data) {
+    skyway_tracing_start(CAPACITY);
+    g_thread_join(g_thread_new("pusher", (GThreadFunc) push_one_buffer, fixture));
+    skyway_tracing_stop();
+
+    gchar *json = skyway_tracing_dump_json();
+    g_assert_nonnull(strstr(json, "\"args\":{\"name\":\"pusher\"}"));
+    g_free(json);
+
+    // Threads are named in the recordings they took part in only
+    skyway_tracing_start(CAPACITY);
+    push_buffers(fixture, 1);
+    skyway_tracing_stop();
+
+    json = skyway_tracing_dump_json();
+    g_assert_null(strstr(json, "\"pusher\""));
+    g_assert_cmpuint(count_occurrences(json, "\"ph\":\"M\",\"name\":\"thread_name\""), ==, 1);
+    g_free(json);
+}
+
+int main(int argc, char *argv[]) {
+    gst_init(&argc, &argv);
+    g_test_init(&argc, &argv, NULL);
+    skyway_tracing_register();
+
+    g_test_add("/pipeline-tracer/export-format", Fixture, NULL, fixture_set_up,
+               test_export_format, fixture_tear_down);
+    g_test_add("/pipeline-tracer/ring-keeps-latest-events", Fixture, NULL, fixture_set_up,
+               test_ring_keeps_latest_events, fixture_tear_down);
+    g_test_add("/pipeline-tracer/thread-names-per-recording", Fixture, NULL, fixture_set_up,
+               test_thread_names_per_recording, fixture_tear_down);
+
+    return g_test_run();
+}
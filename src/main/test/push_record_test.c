@@ -0,0 +1,194 @@
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#include "capture_time.h"
+#include "gstbuffer_to_sink.h"
+#include "push_record.h"
+
+#define CAPS "video/x-h265,stream-format=byte-stream,alignment=au"
+#define OTHER_CAPS "video/x-h265,stream-format=byte-stream,alignment=au,width=640"
+
+typedef struct _Fixture {
+    gchar *path;
+    SkywayGstBufferToSink *sink;
+} Fixture;
+
+static void push(Fixture *fixture, guint8 value, gsize size, GstClockTime pts,
+                 const gchar *caps_string, gint64 capture_time) {
+    GstBuffer *buffer = gst_buffer_new_allocate(NULL, size, NULL);
+    gst_buffer_memset(buffer, 0, value, size);
+    GST_BUFFER_PTS(buffer) = pts;
+    if (capture_time != -1) {
+        skyway_capture_time_set(buffer, capture_time);
+    }
+    GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+    GstCaps *caps = caps_string ? gst_caps_from_string(caps_string) : NULL;
+    GstSample *sample = gst_sample_new(buffer, caps, NULL, NULL);
+    skyway_gstbuffer_to_sink_push_sample(fixture->sink, sample);
+
+    gst_sample_unref(sample);
+    gst_buffer_unref(buffer);
+    if (caps) {
+        gst_caps_unref(caps);
+    }
+}
+
+static gchar *create_temporary_file(void) {
+    gchar *path;
+    int fd = g_file_open_tmp("push-record-XXXXXX", &path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+    return path;
+}
+
+static void fixture_set_up(Fixture *fixture, __attribute__ ((unused)) gconstpointer data) {
+    fixture->path = create_temporary_file();
+    fixture->sink = skyway_gstbuffer_to_sink_new();
+    g_assert_true(skyway_gstbuffer_to_sink_start_recording(fixture->sink, fixture->path));
+}
+
+static void fixture_tear_down(Fixture *fixture, __attribute__ ((unused)) gconstpointer data) {
+    g_object_unref(fixture->sink);
+    g_unlink(fixture->path);
+    g_free(fixture->path);
+}
+
+/*
+ * Nobody plays the stream: the frames are recorded nonetheless, exactly as pushed.
+ */
+static void test_replay_matches_pushes(Fixture *fixture,
+                                       __attribute__ ((unused)) gconstpointer data) {
+    gint64 captured = g_get_real_time();
+    push(fixture, 1, 100, 0, CAPS, captured);
+    push(fixture, 2, 200, 40 * GST_MSECOND, CAPS, -1);
+    push(fixture, 3, 0, GST_CLOCK_TIME_NONE, OTHER_CAPS, captured + 40000);
+    push(fixture, 4, 300, 80 * GST_MSECOND, NULL, -1);
+    skyway_gstbuffer_to_sink_stop_recording(fixture->sink);
+
+    const gchar *expected_caps[] = {CAPS, CAPS, OTHER_CAPS, NULL};
+    const gsize expected_sizes[] = {100, 200, 0, 300};
+    const GstClockTime expected_pts[] = {0, 40 * GST_MSECOND, GST_CLOCK_TIME_NONE,
+                                         80 * GST_MSECOND};
+    const gint64 expected_capture_times[] = {captured, -1, captured + 40000, -1};
+
+    SkywayPushReplay *replay = skyway_push_replay_open(fixture->path);
+    g_assert_nonnull(replay);
+    g_assert_cmpint(skyway_push_replay_get_start_time(replay), >, 0);
+
+    gint64 last_arrival = 0;
+    for (guint i = 0; i < G_N_ELEMENTS(expected_sizes); i++) {
+        gint64 arrival = -1;
+        GstSample *sample = skyway_push_replay_next(replay, &arrival);
+        g_assert_nonnull(sample);
+        g_assert_cmpint(arrival, >=, last_arrival);
+        last_arrival = arrival;
+
+        GstBuffer *buffer = gst_sample_get_buffer(sample);
+        g_assert_cmpuint(gst_buffer_get_size(buffer), ==, expected_sizes[i]);
+        g_assert_cmpuint(GST_BUFFER_PTS(buffer), ==, expected_pts[i]);
+        g_assert_true(GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT));
+        gint64 capture_time = -1;
+        skyway_capture_time_get(buffer, &capture_time);
+        g_assert_cmpint(capture_time, ==, expected_capture_times[i]);
+        if (expected_sizes[i] > 0) {
+            GstMapInfo map;
+            g_assert_true(gst_buffer_map(buffer, &map, GST_MAP_READ));
+            g_assert_cmpuint(map.data[0], ==, i + 1);
+            g_assert_cmpuint(map.data[map.size - 1], ==, i + 1);
+            gst_buffer_unmap(buffer, &map);
+        }
+
+        GstCaps *caps = gst_sample_get_caps(sample);
+        if (expected_caps[i]) {
+            GstCaps *expected = gst_caps_from_string(expected_caps[i]);
+            g_assert_true(gst_caps_is_equal(caps, expected));
+            gst_caps_unref(expected);
+        } else {
+            g_assert_null(caps);
+        }
+        gst_sample_unref(sample);
+    }
+
+    gint64 arrival;
+    g_assert_null(skyway_push_replay_next(replay, &arrival));
+    skyway_push_replay_free(replay);
+}
+
+/*
+ * A recording cut short (e.g. the app was killed) replays up to its last complete frame.
+ */
+static void test_truncated_recording_replays_complete_frames(
+        Fixture *fixture, __attribute__ ((unused)) gconstpointer data) {
+    push(fixture, 1, 100, 0, CAPS, -1);
+    push(fixture, 2, 100, GST_MSECOND, CAPS, -1);
+    skyway_gstbuffer_to_sink_stop_recording(fixture->sink);
+
+    gchar *contents;
+    gsize length;
+    g_assert_true(g_file_get_contents(fixture->path, &contents, &length, NULL));
+    g_assert_true(g_file_set_contents(fixture->path, contents, (gssize) length - 10, NULL));
+    g_free(contents);
+
+    SkywayPushReplay *replay = skyway_push_replay_open(fixture->path);
+    g_assert_nonnull(replay);
+
+    gint64 arrival;
+    GstSample *sample = skyway_push_replay_next(replay, &arrival);
+    g_assert_nonnull(sample);
+    g_assert_cmpuint(GST_BUFFER_PTS(gst_sample_get_buffer(sample)), ==, 0);
+    gst_sample_unref(sample);
+
+    g_assert_null(skyway_push_replay_next(replay, &arrival));
+    skyway_push_replay_free(replay);
+}
+
+/*
+ * Lengths read from a corrupt recording are not trusted to allocate.
+ */
+static void test_corrupt_length_stops_replay(void) {
+    // The header, then a frame record claiming 4 GiB
+    guint8 contents[8 + 8 + 1 + 8 + 8 + 8 + 4 + 4] = {0};
+    memcpy(contents, SKYWAY_PUSH_RECORD_MAGIC, 8);
+    contents[16] = 'F';
+    GST_WRITE_UINT32_LE(contents + sizeof(contents) - 4, G_MAXUINT32);
+    gchar *path = create_temporary_file();
+    g_assert_true(g_file_set_contents(path, (const gchar *) contents, sizeof(contents), NULL));
+
+    SkywayPushReplay *replay = skyway_push_replay_open(path);
+    g_assert_nonnull(replay);
+    gint64 arrival;
+    g_assert_null(skyway_push_replay_next(replay, &arrival));
+    skyway_push_replay_free(replay);
+
+    g_unlink(path);
+    g_free(path);
+}
+
+static void test_other_files_are_rejected(void) {
+    gchar *path = create_temporary_file();
+    g_assert_true(g_file_set_contents(path, "not a recording at all", -1, NULL));
+    g_assert_null(skyway_push_replay_open(path));
+
+    g_unlink(path);
+    g_free(path);
+}
+
+int main(int argc, char *argv[]) {
+    gst_init(&argc, &argv);
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add("/push-record/replay-matches-pushes", Fixture, NULL, fixture_set_up,
+               test_replay_matches_pushes, fixture_tear_down);
+    g_test_add("/push-record/truncated-recording-replays-complete-frames", Fixture, NULL,
+               fixture_set_up, test_truncated_recording_replays_complete_frames,
+               fixture_tear_down);
+    g_test_add_func("/push-record/corrupt-length-stops-replay",
+                    test_corrupt_length_stops_replay);
+    g_test_add_func("/push-record/other-files-are-rejected", test_other_files_are_rejected);
+
+    return g_test_run();
+}
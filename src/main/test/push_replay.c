@@ -0,0 +1,148 @@
+/*
+ * Replays a recording of a pushable stream (see push_record.h, PushableProxyImpl.startRecording)
+ * through a local server, with the timing it was pushed with in the field:
+ *
+ *   push_replay --port 8554 --path /stream1 --delay 3 capture.skyrec
+ *
+ * and play rtsp://127.0.0.1:8554/stream1 meanwhile. --speed 2 replays twice as fast, --speed 0
+ * as fast as the stream takes the frames, e.g. as a fixed load for regression benchmarks.
+ */
+#include <stdio.h>
+
+#include <gst/gst.h>
+
+#include "gstbuffer_to_sink.h"
+#include "push_record.h"
+#include "rtsp_server.h"
+#include "startup.h"
+
+typedef struct _Replay {
+    SkywayRtspServer *server;
+    SkywayPushReplay *recording;
+    const gchar *file;
+    GMainLoop *loop;
+} Replay;
+
+static gint port = 8554;
+static gchar *path = NULL;
+static gdouble speed = 1.0;
+static gint delay = 0;
+
+static GOptionEntry entries[] = {
+        {"port",  'p', 0, G_OPTION_ARG_INT,    &port,  "Port to serve on (default 8554)",  "PORT"},
+        {"path",  'm', 0, G_OPTION_ARG_STRING, &path,  "Mount path (default /stream)",     "PATH"},
+        {"speed", 's', 0, G_OPTION_ARG_DOUBLE, &speed,
+                "Replay speed, 0 for as fast as possible (default 1)",                     "FACTOR"},
+        {"delay", 'd', 0, G_OPTION_ARG_INT,    &delay,
+                "Seconds to wait before replaying, e.g. to connect a client",              "SECONDS"},
+        G_OPTION_ENTRY_NULL
+};
+
+static gboolean quit_loop(GMainLoop *loop) {
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer replay_thread(Replay *replay) {
+    SkywayPushReplay *recording = replay->recording;
+    GDateTime *recorded = g_date_time_new_from_unix_local(
+            skyway_push_replay_get_start_time(recording) / G_USEC_PER_SEC);
+    gchar *recorded_at = g_date_time_format(recorded, "%F %T");
+    g_print("Replaying %s, recorded %s, on rtsp://127.0.0.1:%d%s\n", replay->file, recorded_at,
+            replay->server->port, path);
+    g_free(recorded_at);
+    g_date_time_unref(recorded);
+
+    g_usleep((gulong) delay * G_USEC_PER_SEC);
+
+    guint64 frames = 0;
+    guint64 failed = 0;
+    gint64 late = 0;
+    gint64 start = g_get_monotonic_time();
+    gint64 arrival;
+    GstSample *sample;
+    while ((sample = skyway_push_replay_next(recording, &arrival))) {
+        if (speed > 0) {
+            gint64 wait = start + (gint64) ((gdouble) arrival / speed) - g_get_monotonic_time();
+            if (wait > 0) {
+                g_usleep((gulong) wait);
+            } else {
+                late = MAX(late, -wait);
+            }
+        }
+
+        SkywayGstBufferToSink *sink = g_weak_ref_get(&replay->server->src);
+        if (sink) {
+            if (skyway_gstbuffer_to_sink_push_sample(sink, sample) != GST_FLOW_OK) {
+                failed++;
+            }
+            g_object_unref(sink);
+        }
+        gst_sample_unref(sample);
+        frames++;
+    }
+    gint64 elapsed = g_get_monotonic_time() - start;
+
+    SkywayBackpressure backpressure = {0};
+    SkywayAppSinkProxy *sink = g_weak_ref_get(&replay->server->src);
+    if (sink) {
+        skyway_app_sink_proxy_get_backpressure(sink, &backpressure);
+        g_object_unref(sink);
+    }
+
+    g_print("Replayed %" G_GUINT64_FORMAT " frames in %.3f s: %" G_GUINT64_FORMAT
+            " pushes failed, %u frames dropped, up to %.1f ms behind the recorded timing\n",
+            frames, elapsed / 1e6, failed, backpressure.dropped_samples, late / 1000.0);
+
+    // Through the loop itself, it may not be running yet for a short recording
+    g_idle_add((GSourceFunc) quit_loop, replay->loop);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    GError *error = NULL;
+    GOptionContext *context = g_option_context_new("RECORDING - replay a pushed stream");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &error) || argc != 2) {
+        gchar *help = g_option_context_get_help(context, TRUE, NULL);
+        g_printerr("%s\n", error ? error->message : help);
+        g_free(help);
+        g_clear_error(&error);
+        g_option_context_free(context);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    if (!path) {
+        path = g_strdup("/stream");
+    }
+
+    SkywayPushReplay *recording = skyway_push_replay_open(argv[1]);
+    if (!recording) {
+        g_free(path);
+        return 1;
+    }
+
+    skyway_startup_mark(SKYWAY_STARTUP_INIT);
+    skyway_startup_register_plugins();
+
+    Replay replay = {
+            .server = skyway_rtsp_server_new(port, 0),
+            .recording = recording,
+            .file = argv[1],
+            .loop = g_main_loop_new(NULL, FALSE),
+    };
+    skyway_add_pushable_stream(replay.server, path);
+    gst_rtsp_server_attach(replay.server->server, NULL);
+    replay.server->port = gst_rtsp_server_get_bound_port(replay.server->server);
+
+    GThread *thread = g_thread_new("replay", (GThreadFunc) replay_thread, &replay);
+    g_main_loop_run(replay.loop);
+    g_thread_join(thread);
+
+    skyway_push_replay_free(recording);
+    g_main_loop_unref(replay.loop);
+    g_free(path);
+    return 0;
+}
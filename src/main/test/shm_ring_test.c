@@ -0,0 +1,140 @@
+#include <string.h>
+#include <unistd.h>
+
+#include <gst/gst.h>
+
+#include "shm_ring.h"
+#include "shm_to_sink.h"
+
+#define SLOT_COUNT 4
+#define SLOT_SIZE 4096
+#define CAPS "video/x-h265,stream-format=byte-stream,alignment=au"
+#define TIMEOUT_USEC (5 * G_USEC_PER_SEC)
+
+typedef struct _Fixture {
+    SkywayShmProducer *producer;
+    SkywayShmToSink *sink;
+    GAsyncQueue *samples;
+} Fixture;
+
+static GstFlowReturn
+on_new_sample(__attribute__ ((unused)) SkywayAppSinkProxy *proxy, GstSample *sample,
+              GAsyncQueue *samples) {
+    g_async_queue_push(samples, gst_sample_ref(sample));
+    return GST_FLOW_OK;
+}
+
+static void produce(Fixture *fixture, guint8 value, guint32 size, gint64 pts) {
+    guint8 *data = skyway_shm_producer_begin_frame(fixture->producer);
+    g_assert_nonnull(data);
+    memset(data, value, size);
+    g_assert_cmpint(skyway_shm_producer_end_frame(fixture->producer, size, pts), ==, 0);
+}
+
+static void fixture_set_up(Fixture *fixture, __attribute__ ((unused)) gconstpointer data) {
+    fixture->producer = skyway_shm_producer_new(SLOT_COUNT, SLOT_SIZE, CAPS);
+    g_assert_nonnull(fixture->producer);
+
+    fixture->sink = skyway_shm_to_sink_new(
+            dup(skyway_shm_producer_get_memory_fd(fixture->producer)),
+            dup(skyway_shm_producer_get_doorbell_fd(fixture->producer)));
+    g_assert_nonnull(fixture->sink);
+
+    fixture->samples = g_async_queue_new_full((GDestroyNotify) gst_sample_unref);
+    g_signal_connect(fixture->sink, "new-sample", G_CALLBACK(on_new_sample), fixture->samples);
+}
+
+static void fixture_tear_down(Fixture *fixture, __attribute__ ((unused)) gconstpointer data) {
+    g_object_unref(fixture->sink);
+    g_async_queue_unref(fixture->samples);
+    skyway_shm_producer_free(fixture->producer);
+}
+
+static void test_frames_arrive_in_order(Fixture *fixture,
+                                        __attribute__ ((unused)) gconstpointer data) {
+    GstCaps *caps = gst_caps_from_string(CAPS);
+    skyway_app_sink_proxy_play(SKYWAY_APP_SINK_PROXY(fixture->sink));
+
+    for (guint i = 0; i < 10; i++) {
+        produce(fixture, (guint8) i, 100 + i, i * GST_MSECOND);
+
+        GstSample *sample = g_async_queue_timeout_pop(fixture->samples, TIMEOUT_USEC);
+        g_assert_nonnull(sample);
+        GstBuffer *buffer = gst_sample_get_buffer(sample);
+        g_assert_cmpuint(gst_buffer_get_size(buffer), ==, 100 + i);
+        g_assert_cmpuint(GST_BUFFER_PTS(buffer), ==, i * GST_MSECOND);
+
+        GstMapInfo map;
+        g_assert_true(gst_buffer_map(buffer, &map, GST_MAP_READ));
+        g_assert_cmpuint(map.data[0], ==, i);
+        g_assert_cmpuint(map.data[map.size - 1], ==, i);
+        gst_buffer_unmap(buffer, &map);
+
+        g_assert_true(gst_caps_is_equal(gst_sample_get_caps(sample), caps));
+        gst_sample_unref(sample);
+    }
+
+    gst_caps_unref(caps);
+}
+
+/*
+ * The buffers wrap the ring: while they are referenced, the producer cannot reuse their slots.
+ */
+static void test_held_frames_block_their_slots(Fixture *fixture,
+                                               __attribute__ ((unused)) gconstpointer data) {
+    skyway_app_sink_proxy_play(SKYWAY_APP_SINK_PROXY(fixture->sink));
+
+    GstSample *held[SLOT_COUNT];
+    for (guint i = 0; i < SLOT_COUNT; i++) {
+        produce(fixture, (guint8) i, 16, SKYWAY_SHM_PTS_NONE);
+        held[i] = g_async_queue_timeout_pop(fixture->samples, TIMEOUT_USEC);
+        g_assert_nonnull(held[i]);
+        g_assert_false(GST_BUFFER_PTS_IS_VALID(gst_sample_get_buffer(held[i])));
+    }
+
+    g_assert_null(skyway_shm_producer_begin_frame(fixture->producer));
+
+    gst_sample_unref(held[0]);
+    g_assert_nonnull(skyway_shm_producer_begin_frame(fixture->producer));
+
+    for (guint i = 1; i < SLOT_COUNT; i++) {
+        gst_sample_unref(held[i]);
+    }
+}
+
+static void test_frames_are_released_when_stopped(Fixture *fixture,
+                                                  __attribute__ ((unused)) gconstpointer data) {
+    for (guint i = 0; i < SLOT_COUNT * 3; i++) {
+        // Not playing: every frame is released as soon as it is read
+        gint64 deadline = g_get_monotonic_time() + TIMEOUT_USEC;
+        guint8 *frame;
+        while (!(frame = skyway_shm_producer_begin_frame(fixture->producer))) {
+            g_assert_cmpint(g_get_monotonic_time(), <, deadline);
+            g_usleep(1000);
+        }
+        g_assert_cmpint(skyway_shm_producer_end_frame(fixture->producer, 16, 0), ==, 0);
+    }
+
+    g_assert_cmpint(g_async_queue_length(fixture->samples), ==, 0);
+}
+
+static void test_unsealed_memory_is_rejected(void) {
+    int fds[2];
+    g_assert_cmpint(pipe(fds), ==, 0);
+    g_assert_null(skyway_shm_to_sink_new(fds[0], fds[1]));
+}
+
+int main(int argc, char *argv[]) {
+    gst_init(&argc, &argv);
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add("/shm-ring/frames-arrive-in-order", Fixture, NULL, fixture_set_up,
+               test_frames_arrive_in_order, fixture_tear_down);
+    g_test_add("/shm-ring/held-frames-block-their-slots", Fixture, NULL, fixture_set_up,
+               test_held_frames_block_their_slots, fixture_tear_down);
+    g_test_add("/shm-ring/frames-are-released-when-stopped", Fixture, NULL, fixture_set_up,
+               test_frames_are_released_when_stopped, fixture_tear_down);
+    g_test_add_func("/shm-ring/unsealed-memory-is-rejected", test_unsealed_memory_is_rejected);
+
+    return g_test_run();
+}
@@ -0,0 +1,226 @@
+// For sched_getaffinity() and pthread_getname_np()
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+#include <gst/gst.h>
+
+#include "thread_policy.h"
+
+#define NAME_SIZE 16
+#define TIMEOUT (5 * GST_SECOND)
+
+GST_PLUGIN_STATIC_DECLARE(coreelements);
+
+typedef struct _ThreadState {
+    cpu_set_t cpus;
+    gint nice;
+    gchar name[NAME_SIZE];
+} ThreadState;
+
+typedef struct _Fixture {
+    SkywayThreadPolicy *policy;
+    guint64 cpu_mask;
+    gint nice;
+} Fixture;
+
+typedef struct _StreamingThread {
+    GMutex lock;
+    gboolean streamed;
+    ThreadState state;
+} StreamingThread;
+
+static void read_thread_state(ThreadState *state) {
+    CPU_ZERO(&state->cpus);
+    g_assert_cmpint(sched_getaffinity(0, sizeof(state->cpus), &state->cpus), ==, 0);
+    state->nice = getpriority(PRIO_PROCESS, 0);
+    pthread_getname_np(pthread_self(), state->name, sizeof(state->name));
+}
+
+static void assert_cpus(const cpu_set_t *cpus, guint64 cpu_mask) {
+    for (guint cpu = 0; cpu < 64; cpu++) {
+        g_assert_cmpint(CPU_ISSET(cpu, cpus) ? 1 : 0, ==,
+                        cpu_mask & (G_GUINT64_CONSTANT(1) << cpu) ? 1 : 0);
+    }
+}
+
+static gpointer apply_policy(SkywayThreadPolicy *policy) {
+    ThreadState *state = g_new0(ThreadState, 1);
+    g_assert_true(skyway_thread_policy_apply(policy, "worker"));
+    read_thread_state(state);
+    return state;
+}
+
+static void fixture_set_up(Fixture *fixture, __attribute__ ((unused)) gconstpointer data) {
+    // The lowest CPU we may run on, so that the mask differs from the default whenever the
+    // machine has more than one
+    ThreadState state;
+    read_thread_state(&state);
+    fixture->cpu_mask = 0;
+    for (guint cpu = 0; cpu < 64 && !fixture->cpu_mask; cpu++) {
+        if (CPU_ISSET(cpu, &state.cpus)) {
+            fixture->cpu_mask = G_GUINT64_CONSTANT(1) << cpu;
+        }
+    }
+    g_assert_cmpuint(fixture->cpu_mask, !=, 0);
+
+    // Only raising the nice value is allowed without privileges
+    fixture->nice = MIN(state.nice + 1, 19);
+    fixture->policy = skyway_thread_policy_new();
+}
+
+static void fixture_tear_down(Fixture *fixture, __attribute__ ((unused)) gconstpointer data) {
+    skyway_thread_policy_unref(fixture->policy);
+}
+
+static void test_unset_policy_changes_nothing(void) {
+    ThreadState parent;
+    read_thread_state(&parent);
+    SkywayThreadPolicy *policy = skyway_thread_policy_new();
+
+    GThread *thread = g_thread_new("plain", (GThreadFunc) apply_policy, policy);
+    ThreadState *state = g_thread_join(thread);
+
+    g_assert_true(CPU_EQUAL(&state->cpus, &parent.cpus));
+    g_assert_cmpint(state->nice, ==, parent.nice);
+    g_assert_cmpstr(state->name, ==, "plain");
+    g_free(state);
+    skyway_thread_policy_unref(policy);
+}
+
+static void test_policy_applies_to_calling_thread(Fixture *fixture,
+                                                  __attribute__ ((unused)) gconstpointer data) {
+    ThreadState parent;
+    read_thread_state(&parent);
+    skyway_thread_policy_set(fixture->policy, fixture->cpu_mask, fixture->nice, 0, "sky");
+
+    GThread *thread = g_thread_new("plain", (GThreadFunc) apply_policy, fixture->policy);
+    ThreadState *state = g_thread_join(thread);
+
+    assert_cpus(&state->cpus, fixture->cpu_mask);
+    g_assert_cmpint(state->nice, ==, fixture->nice);
+    g_assert_cmpstr(state->name, ==, "sky:worker");
+    g_free(state);
+
+    // Other threads are left alone
+    ThreadState after;
+    read_thread_state(&after);
+    g_assert_true(CPU_EQUAL(&after.cpus, &parent.cpus));
+    g_assert_cmpint(after.nice, ==, parent.nice);
+}
+
+static gpointer apply_and_restore_policy(SkywayThreadPolicy *policy) {
+    ThreadState *state = g_new0(ThreadState, 1);
+    g_assert_true(skyway_thread_policy_apply(policy, "worker"));
+    // Saved once: applying again must not make the policy what is restored
+    g_assert_true(skyway_thread_policy_apply(policy, "worker"));
+    g_assert_true(skyway_thread_policy_restore());
+    read_thread_state(state);
+    return state;
+}
+
+/*
+ * Pooled threads are given back as they were, to run work the policy is not meant for.
+ */
+static void test_restore_gives_back_previous_policy(Fixture *fixture,
+                                                    __attribute__ ((unused)) gconstpointer data) {
+    ThreadState parent;
+    read_thread_state(&parent);
+    // Lowering the nice value back needs privileges, keep it as it is
+    skyway_thread_policy_set(fixture->policy, fixture->cpu_mask, parent.nice, 0, "sky");
+
+    GThread *thread = g_thread_new("plain", (GThreadFunc) apply_and_restore_policy,
+                                   fixture->policy);
+    ThreadState *state = g_thread_join(thread);
+
+    g_assert_true(CPU_EQUAL(&state->cpus, &parent.cpus));
+    g_assert_cmpint(state->nice, ==, parent.nice);
+    g_assert_cmpstr(state->name, ==, "plain");
+    g_free(state);
+}
+
+static void test_long_names_are_truncated(void) {
+    ThreadState parent;
+    read_thread_state(&parent);
+    SkywayThreadPolicy *policy = skyway_thread_policy_new();
+    skyway_thread_policy_set(policy, 0, parent.nice, 0, "sambaza-streaming");
+
+    GThread *thread = g_thread_new("plain", (GThreadFunc) apply_policy, policy);
+    ThreadState *state = g_thread_join(thread);
+
+    g_assert_cmpstr(state->name, ==, "sambaza-streami");
+    g_free(state);
+    skyway_thread_policy_unref(policy);
+}
+
+static GstPadProbeReturn
+record_streaming_thread(__attribute__ ((unused)) GstPad *pad,
+                        __attribute__ ((unused)) GstPadProbeInfo *info,
+                        StreamingThread *streaming) {
+    g_mutex_lock(&streaming->lock);
+    if (!streaming->streamed) {
+        read_thread_state(&streaming->state);
+        streaming->streamed = TRUE;
+    }
+    g_mutex_unlock(&streaming->lock);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void test_streaming_threads_follow_policy(Fixture *fixture,
+                                                 __attribute__ ((unused)) gconstpointer data) {
+    skyway_thread_policy_set(fixture->policy, fixture->cpu_mask, fixture->nice, 0, "sky");
+
+    GstElement *pipeline = gst_parse_launch("fakesrc num-buffers=10 ! queue name=q ! "
+                                            "fakesink name=sink", NULL);
+    g_assert_nonnull(pipeline);
+    skyway_thread_policy_watch_pipeline(fixture->policy, pipeline);
+    StreamingThread streaming = {.streamed = FALSE};
+    g_mutex_init(&streaming.lock);
+
+    // The queue pushes into the sink from a streaming thread of its own
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GstPad *sink_pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER,
+                      (GstPadProbeCallback) record_streaming_thread, &streaming, NULL);
+    gst_object_unref(sink_pad);
+    gst_object_unref(sink);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *message = gst_bus_timed_pop_filtered(bus, TIMEOUT,
+                                                     GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    g_assert_nonnull(message);
+    g_assert_cmpint(GST_MESSAGE_TYPE(message), ==, GST_MESSAGE_EOS);
+    gst_message_unref(message);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    g_mutex_clear(&streaming.lock);
+
+    g_assert_true(streaming.streamed);
+    assert_cpus(&streaming.state.cpus, fixture->cpu_mask);
+    g_assert_cmpint(streaming.state.nice, ==, fixture->nice);
+    g_assert_cmpstr(streaming.state.name, ==, "sky:q");
+}
+
+int main(int argc, char *argv[]) {
+    gst_init(&argc, &argv);
+    g_test_init(&argc, &argv, NULL);
+    GST_PLUGIN_STATIC_REGISTER(coreelements);
+
+    g_test_add_func("/thread-policy/unset-policy-changes-nothing",
+                    test_unset_policy_changes_nothing);
+    g_test_add("/thread-policy/policy-applies-to-calling-thread", Fixture, NULL, fixture_set_up,
+               test_policy_applies_to_calling_thread, fixture_tear_down);
+    g_test_add("/thread-policy/restore-gives-back-previous-policy", Fixture, NULL,
+               fixture_set_up, test_restore_gives_back_previous_policy, fixture_tear_down);
+    g_test_add_func("/thread-policy/long-names-are-truncated", test_long_names_are_truncated);
+    g_test_add("/thread-policy/streaming-threads-follow-policy", Fixture, NULL, fixture_set_up,
+               test_streaming_threads_follow_policy, fixture_tear_down);
+
+    return g_test_run();
+}
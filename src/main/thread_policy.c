@@ -0,0 +1,287 @@
+// For sched_setaffinity() and pthread_setname_np()
+#define _GNU_SOURCE
+
+#include "thread_policy.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+
+// Including the terminator, the kernel truncates longer names
+#define THREAD_NAME_SIZE 16
+
+#define MAX_CPUS 64
+
+struct _SkywayThreadPolicy {
+    GMutex lock;
+    gboolean active;
+    guint64 cpu_mask;
+    gint nice;
+    gint rt_priority;
+    gchar *name_prefix;
+};
+
+/*
+ * How the calling thread ran before the policy was first applied to it.
+ */
+typedef struct _SavedPolicy {
+    gboolean have_cpus;
+    cpu_set_t cpus;
+    int scheduler;
+    struct sched_param param;
+    int nice;
+    gchar name[THREAD_NAME_SIZE];
+} SavedPolicy;
+
+typedef struct _SkywayPolicyThreadPool {
+    GstRTSPThreadPool parent;
+    SkywayThreadPolicy *policy;
+} SkywayPolicyThreadPool;
+
+#define SKYWAY_TYPE_POLICY_THREAD_POOL (skyway_policy_thread_pool_get_type())
+
+G_DECLARE_FINAL_TYPE(SkywayPolicyThreadPool, skyway_policy_thread_pool, SKYWAY,
+                     POLICY_THREAD_POOL, GstRTSPThreadPool)
+
+G_DEFINE_TYPE(SkywayPolicyThreadPool, skyway_policy_thread_pool, GST_TYPE_RTSP_THREAD_POOL)
+
+static GPrivate saved_policy = G_PRIVATE_INIT(g_free);
+
+static void thread_policy_clear(SkywayThreadPolicy *self);
+
+static void save_policy(void);
+
+static void thread_policy_closure_notify(gpointer data, GClosure *closure);
+
+static void
+stream_status_handler(GstBus *bus, GstMessage *message, SkywayThreadPolicy *self);
+
+static void
+policy_thread_pool_thread_enter(GstRTSPThreadPool *pool, GstRTSPThread *thread);
+
+static void
+policy_thread_pool_thread_leave(GstRTSPThreadPool *pool, GstRTSPThread *thread);
+
+static void policy_thread_pool_finalize(GObject *object);
+
+SkywayThreadPolicy *skyway_thread_policy_new(void) {
+    SkywayThreadPolicy *self = g_atomic_rc_box_new0(SkywayThreadPolicy);
+    g_mutex_init(&self->lock);
+    self->active = FALSE;
+    return self;
+}
+
+SkywayThreadPolicy *skyway_thread_policy_ref(SkywayThreadPolicy *self) {
+    return g_atomic_rc_box_acquire(self);
+}
+
+void skyway_thread_policy_unref(SkywayThreadPolicy *self) {
+    g_atomic_rc_box_release_full(self, (GDestroyNotify) thread_policy_clear);
+}
+
+void skyway_thread_policy_set(SkywayThreadPolicy *self, guint64 cpu_mask, gint nice,
+                              gint rt_priority, const gchar *name_prefix) {
+    g_mutex_lock(&self->lock);
+    self->active = TRUE;
+    self->cpu_mask = cpu_mask;
+    self->nice = CLAMP(nice, -20, 19);
+    self->rt_priority = CLAMP(rt_priority, 0, 99);
+    g_free(self->name_prefix);
+    self->name_prefix = name_prefix && name_prefix[0] ? g_strdup(name_prefix) : NULL;
+    g_mutex_unlock(&self->lock);
+}
+
+gboolean skyway_thread_policy_apply(SkywayThreadPolicy *self, const gchar *role) {
+    g_mutex_lock(&self->lock);
+    gboolean active = self->active;
+    guint64 cpu_mask = self->cpu_mask;
+    gint nice = self->nice;
+    gint rt_priority = self->rt_priority;
+    gchar *name = self->name_prefix ? g_strdup_printf("%s:%s", self->name_prefix, role) : NULL;
+    g_mutex_unlock(&self->lock);
+
+    if (!active) {
+        return TRUE;
+    }
+
+    save_policy();
+
+    // On Linux, all of these take 0 for the calling thread rather than the whole process
+    gboolean applied = TRUE;
+    if (cpu_mask) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (guint cpu = 0; cpu < MAX_CPUS; cpu++) {
+            if (cpu_mask & (G_GUINT64_CONSTANT(1) << cpu)) {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+            g_printerr("Cannot set the CPU affinity of %s: %s\n", role, g_strerror(errno));
+            applied = FALSE;
+        }
+    }
+
+    struct sched_param param = {.sched_priority = rt_priority};
+    if (rt_priority > 0) {
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+            g_printerr("Cannot run %s at real-time priority %d: %s\n", role, rt_priority,
+                       g_strerror(errno));
+            applied = FALSE;
+        }
+    } else {
+        if (sched_getscheduler(0) != SCHED_OTHER && sched_setscheduler(0, SCHED_OTHER, &param)) {
+            g_printerr("Cannot run %s at normal priority: %s\n", role, g_strerror(errno));
+            applied = FALSE;
+        }
+
+        if (setpriority(PRIO_PROCESS, 0, nice) != 0) {
+            g_printerr("Cannot run %s at nice %d: %s\n", role, nice, g_strerror(errno));
+            applied = FALSE;
+        }
+    }
+
+    if (name) {
+        gchar truncated[THREAD_NAME_SIZE];
+        g_strlcpy(truncated, name, sizeof(truncated));
+        pthread_setname_np(pthread_self(), truncated);
+        g_free(name);
+    }
+
+    return applied;
+}
+
+gboolean skyway_thread_policy_restore(void) {
+    SavedPolicy *saved = g_private_get(&saved_policy);
+    if (!saved) {
+        return TRUE;
+    }
+
+    int error = 0;
+    if (saved->have_cpus && sched_setaffinity(0, sizeof(saved->cpus), &saved->cpus) != 0) {
+        error = errno;
+    }
+    if (saved->scheduler >= 0 && sched_setscheduler(0, saved->scheduler, &saved->param) != 0) {
+        error = errno;
+    }
+    if (setpriority(PRIO_PROCESS, 0, saved->nice) != 0) {
+        error = errno;
+    }
+    pthread_setname_np(pthread_self(), saved->name);
+
+    if (error) {
+        g_printerr("Cannot restore the policy of thread %s: %s\n", saved->name,
+                   g_strerror(error));
+    }
+    g_private_replace(&saved_policy, NULL);
+    return error == 0;
+}
+
+void skyway_thread_policy_watch_pipeline(SkywayThreadPolicy *self, GstElement *pipeline) {
+    GstBus *bus = gst_element_get_bus(pipeline);
+    if (!bus) {
+        return;
+    }
+
+    gst_bus_enable_sync_message_emission(bus);
+    g_signal_connect_data(bus, "sync-message::stream-status", G_CALLBACK(stream_status_handler),
+                          skyway_thread_policy_ref(self), thread_policy_closure_notify, 0);
+    gst_object_unref(bus);
+}
+
+GstRTSPThreadPool *skyway_thread_policy_create_thread_pool(SkywayThreadPolicy *self) {
+    SkywayPolicyThreadPool *pool = g_object_new(SKYWAY_TYPE_POLICY_THREAD_POOL, NULL);
+    pool->policy = skyway_thread_policy_ref(self);
+    return GST_RTSP_THREAD_POOL(pool);
+}
+
+static void thread_policy_clear(SkywayThreadPolicy *self) {
+    g_mutex_clear(&self->lock);
+    g_free(self->name_prefix);
+}
+
+/*
+ * Only the first time, a thread the policy is applied to again keeps what it ran with before.
+ */
+static void save_policy(void) {
+    if (g_private_get(&saved_policy)) {
+        return;
+    }
+
+    SavedPolicy *saved = g_new0(SavedPolicy, 1);
+    saved->have_cpus = sched_getaffinity(0, sizeof(saved->cpus), &saved->cpus) == 0;
+    saved->scheduler = sched_getscheduler(0);
+    if (saved->scheduler >= 0 && sched_getparam(0, &saved->param) != 0) {
+        saved->scheduler = -1;
+    }
+    saved->nice = getpriority(PRIO_PROCESS, 0);
+    // Unlike pthread_getname_np(), available on every Android version
+    prctl(PR_GET_NAME, saved->name, 0, 0, 0);
+    g_private_set(&saved_policy, saved);
+}
+
+static void thread_policy_closure_notify(gpointer data,
+                                         __attribute__ ((unused)) GClosure *closure) {
+    skyway_thread_policy_unref(data);
+}
+
+static void
+stream_status_handler(__attribute__ ((unused)) GstBus *bus, GstMessage *message,
+                      SkywayThreadPolicy *self) {
+    GstStreamStatusType type;
+    GstElement *owner;
+    gst_message_parse_stream_status(message, &type, &owner);
+
+    // Posted synchronously by the streaming thread, before it runs the task and once it is
+    // done with it: task pool threads are reused, for other pipelines as well
+    if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+        skyway_thread_policy_apply(self, GST_ELEMENT_NAME(owner));
+    } else if (type == GST_STREAM_STATUS_TYPE_LEAVE) {
+        skyway_thread_policy_restore();
+    }
+}
+
+static void skyway_policy_thread_pool_class_init(SkywayPolicyThreadPoolClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = policy_thread_pool_finalize;
+    GST_RTSP_THREAD_POOL_CLASS(klass)->thread_enter = policy_thread_pool_thread_enter;
+    GST_RTSP_THREAD_POOL_CLASS(klass)->thread_leave = policy_thread_pool_thread_leave;
+}
+
+static void skyway_policy_thread_pool_init(SkywayPolicyThreadPool *self) {
+    self->policy = NULL;
+}
+
+static void
+policy_thread_pool_thread_enter(GstRTSPThreadPool *pool, GstRTSPThread *thread) {
+    GstRTSPThreadPoolClass *parent_class = GST_RTSP_THREAD_POOL_CLASS(
+            skyway_policy_thread_pool_parent_class);
+    if (parent_class->thread_enter) {
+        parent_class->thread_enter(pool, thread);
+    }
+
+    skyway_thread_policy_apply(SKYWAY_POLICY_THREAD_POOL(pool)->policy,
+                               thread->type == GST_RTSP_THREAD_TYPE_CLIENT ? "client" : "media");
+}
+
+/*
+ * The server's threads come from GLib's shared thread pool, which hands them out to others next.
+ */
+static void
+policy_thread_pool_thread_leave(GstRTSPThreadPool *pool, GstRTSPThread *thread) {
+    skyway_thread_policy_restore();
+
+    GstRTSPThreadPoolClass *parent_class = GST_RTSP_THREAD_POOL_CLASS(
+            skyway_policy_thread_pool_parent_class);
+    if (parent_class->thread_leave) {
+        parent_class->thread_leave(pool, thread);
+    }
+}
+
+static void policy_thread_pool_finalize(GObject *object) {
+    g_clear_pointer(&SKYWAY_POLICY_THREAD_POOL(object)->policy, skyway_thread_policy_unref);
+
+    G_OBJECT_CLASS(skyway_policy_thread_pool_parent_class)->finalize(object);
+}
@@ -0,0 +1,58 @@
+#ifndef SKYWAY_THREAD_POLICY_H
+#define SKYWAY_THREAD_POLICY_H
+
+#include <gst/gst.h>
+#include <gst/rtsp-server/rtsp-server.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SkywayThreadPolicy SkywayThreadPolicy;
+
+/*
+ * Where and how urgently the threads of a server run, e.g. to keep the streaming threads off the
+ * little cores of a big.LITTLE SoC. Does nothing until set.
+ */
+SkywayThreadPolicy *skyway_thread_policy_new(void);
+
+SkywayThreadPolicy *skyway_thread_policy_ref(SkywayThreadPolicy *self);
+
+void skyway_thread_policy_unref(SkywayThreadPolicy *self);
+
+/*
+ * cpu_mask has bit n set for CPU n, 0 to leave the affinity alone. A positive rt_priority (1-99,
+ * needs CAP_SYS_NICE) runs the threads SCHED_FIFO, otherwise they run SCHED_OTHER at nice.
+ * Threads are named "<name_prefix>:<role>" (truncated to 15 characters), NULL keeps their
+ * names. Applies to threads started from now on.
+ */
+void skyway_thread_policy_set(SkywayThreadPolicy *self, guint64 cpu_mask, gint nice,
+                              gint rt_priority, const gchar *name_prefix);
+
+/*
+ * Applies the policy to the calling thread, saving what it ran with before the first time.
+ * Returns FALSE if some of it was refused.
+ */
+gboolean skyway_thread_policy_apply(SkywayThreadPolicy *self, const gchar *role);
+
+/*
+ * Gives the calling thread back what it ran with before a policy was applied to it, if one was.
+ * Raising its priority again (e.g. back to a lower nice value) needs the privileges setting it
+ * would. Returns FALSE if some of it was refused.
+ */
+gboolean skyway_thread_policy_restore(void);
+
+/*
+ * Applies the policy to every streaming thread of pipeline as it starts a task, and restores the
+ * thread once done with it, through the stream-status messages the thread posts itself. Their
+ * role is the element owning the task.
+ */
+void skyway_thread_policy_watch_pipeline(SkywayThreadPolicy *self, GstElement *pipeline);
+
+/*
+ * A thread pool for the RTSP server whose client and media threads follow the policy while
+ * they run for it.
+ */
+GstRTSPThreadPool *skyway_thread_policy_create_thread_pool(SkywayThreadPolicy *self);
+
+G_END_DECLS
+
+#endif // SKYWAY_THREAD_POLICY_H